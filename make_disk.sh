@@ -61,6 +61,8 @@ mount ${TARGET_PARTITION} ${BUILD_DIR}/tmp
 cp ${BUILD_DIR}/kernel.bin ${BUILD_DIR}/tmp
 cp -r ${BUILD_DIR}/user/* ${BUILD_DIR}/tmp
 mkdir ${BUILD_DIR}/tmp/test
+# swap file, after the other files: nothing was deleted from the fresh file system, so its clusters are contiguous
+dd if=/dev/zero of=${BUILD_DIR}/tmp/swap.sys bs=4096 count=2048 >/dev/null
 umount ${BUILD_DIR}/tmp
 
 # destroy loopback device
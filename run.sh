@@ -1 +1,3 @@
-qemu-system-i386 -debugcon stdio -m 64M -hda build/main.img
\ No newline at end of file
+# the application processors need an invariant time stamp counter, QEMU only reports it with KVM=1
+if [ -n "${KVM}" ]; then ACCEL="-enable-kvm -cpu host,+invtsc"; fi
+qemu-system-i386 ${ACCEL} -smp ${CPUS:-4} -debugcon stdio -m ${MEMORY:-64M} -hda build/main.img
\ No newline at end of file
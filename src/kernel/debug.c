@@ -20,8 +20,10 @@
 #include <debug.h>
 #include <stdio.h>
 
+#include <hal/io.h>
 #include <multitasking/scheduler.h>
 #include <multitasking/lock.h>
+#include <multitasking/smp.h>
 
 //============================================================================
 //    IMPLEMENTATION PRIVATE DATA
@@ -37,7 +39,7 @@ static const char* const g_LogSeverityColors[] =
 };
 
 static const char* const g_ColorReset = "\033[0m";
-mutex_t DEBUG_mutex;
+spinlock_t DEBUG_lock = SPINLOCK_INIT("debug");    // logging never sleeps, it works with a spinlock held and in interrupt handlers
 
 //============================================================================
 //    INTERFACE FUNCTIONS
@@ -51,8 +53,15 @@ void logf(const char* module, DebugLevel level, const char* fmt, ...)
     if (level < MIN_LOG_LEVEL)
         return;
 
-    if(is_schedulerEnabled())
-        acquire_mutex(&DEBUG_mutex);
+    uint32_t eflags = get_eflags();
+    disableInterrupts();
+
+    // this cpu already holds the lock: a message from the spinlock code about it (taking it twice panics)
+    // or a fault while printing. It is written as is, waiting for the lock would never end
+    bool nested = DEBUG_lock.cpu == (int32_t)SMP_getCpu()->id;
+
+    if(!nested)
+        spin_lock(&DEBUG_lock);
 
     fputs(g_LogSeverityColors[level], VFS_FD_DEBUG);    // set color depending on level
     fprintf(VFS_FD_DEBUG, "[%s] ", module);             // write module
@@ -60,8 +69,11 @@ void logf(const char* module, DebugLevel level, const char* fmt, ...)
     fputs(g_ColorReset, VFS_FD_DEBUG);                  // reset format
     fputc('\n', VFS_FD_DEBUG);                          // newline
 
-    if(is_schedulerEnabled())
-        release_mutex(&DEBUG_mutex);
+    if(!nested)
+        spin_unlock(&DEBUG_lock);
+
+    if(eflags & (1 << 9))
+        enableInterrupts();
 
     va_end(args);  
 }
\ No newline at end of file
@@ -24,12 +24,34 @@
 #include <drivers/ata.h>
 #include <drivers/device.h>
 #include <mem_manager/heap.h>
+#include <multitasking/lock.h>
+#include <multitasking/scheduler.h>
 
 #define MAX_ATA_DEVICES 4
 
 static ATAdevice_t ATAdevices[MAX_ATA_DEVICES];
 static int ATAdevice_count = 0;
 
+// one command at a time per channel: the master and the slave share its registers. A mutex,
+// a transfer polls the drive for a long time (the file systems, the page cache and the swap use it)
+static mutex_t ATAchannel_mutex[2];
+
+static mutex_t* ATAchannel_lock(ATAdevice_t *dev)
+{
+    mutex_t* mut = &ATAchannel_mutex[dev->base_port == ATA_PRIMARY_DATA ? 0 : 1];
+
+    if (is_schedulerEnabled())
+        acquire_mutex(mut);
+
+    return mut;
+}
+
+static void ATAchannel_unlock(mutex_t* mut)
+{
+    if (is_schedulerEnabled())
+        release_mutex(mut);
+}
+
 void io_wait()
 {
     outb(0x80, 0);
@@ -306,8 +328,8 @@ int ATAdetect_devices(void)
     return ATAdevice_count;
 }
 
-// LBA28 read sector
-int ATAread_sectors(ATAdevice_t *dev, uint64_t lba, uint8_t sector_count, uint16_t *buffer)
+// LBA28 read sector, the channel is locked
+static int ATApio_read(ATAdevice_t *dev, uint64_t lba, uint8_t sector_count, uint16_t *buffer)
 {
     uint16_t base = dev->base_port;
     uint8_t drive = dev->is_slave ? ATA_DRIVE_SLAVE : ATA_DRIVE_MASTER;
@@ -382,7 +404,8 @@ int ATAread_sectors(ATAdevice_t *dev, uint64_t lba, uint8_t sector_count, uint16
     }
 return 0;
 }
-int ATAwrite_sectors(ATAdevice_t *dev, uint64_t lba, uint8_t sector_count, uint16_t *buffer)
+// the channel is locked
+static int ATApio_write(ATAdevice_t *dev, uint64_t lba, uint8_t sector_count, uint16_t *buffer)
 {
     uint16_t base = dev->base_port;
     uint8_t drive = dev->is_slave ? ATA_DRIVE_SLAVE : ATA_DRIVE_MASTER;
@@ -446,6 +469,32 @@ int ATAwrite_sectors(ATAdevice_t *dev, uint64_t lba, uint8_t sector_count, uint1
     return 0;
 }
 
+int ATAread_sectors(ATAdevice_t *dev, uint64_t lba, uint8_t sector_count, uint16_t *buffer)
+{
+    if (!dev) {
+        return -1;
+    }
+
+    mutex_t* mut = ATAchannel_lock(dev);
+    int result = ATApio_read(dev, lba, sector_count, buffer);
+    ATAchannel_unlock(mut);
+
+    return result;
+}
+
+int ATAwrite_sectors(ATAdevice_t *dev, uint64_t lba, uint8_t sector_count, uint16_t *buffer)
+{
+    if (!dev) {
+        return -1;
+    }
+
+    mutex_t* mut = ATAchannel_lock(dev);
+    int result = ATApio_write(dev, lba, sector_count, buffer);
+    ATAchannel_unlock(mut);
+
+    return result;
+}
+
 // get device by index
 ATAdevice_t* ATAget_device(int index) {
     if (index < 0 || index >= ATAdevice_count) {
@@ -510,6 +559,7 @@ void ata_init(void) {
         disk->read = read;
         disk->write = write;
         disk->ioctl = NULL;
+        disk->blockSize = 512;
 
         add_device(disk);
 
@@ -536,6 +586,7 @@ void ata_init(void) {
             disk->read = read;
             disk->write = write;
             disk->ioctl = NULL;
+            disk->blockSize = 512;
 
             add_device(disk);
         }
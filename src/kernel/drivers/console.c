@@ -35,6 +35,7 @@ void create_console()
     console->read = read;
     console->write = write;
     console->ioctl = NULL;
+    console->blockSize = 0;
 
     add_device(console);
 }
@@ -18,9 +18,17 @@
 */
 
 #include <string.h>
+#include <memory.h>
+#include <mem_manager/heap.h>
 #include <multitasking/lock.h>
 #include <drivers/device.h>
 
+typedef struct record_device
+{
+    device_record_t record;
+    uint32_t recordSize;
+} record_device_t;
+
 list_t* devices;
 mutex_t* dev_lock;
 
@@ -71,4 +79,76 @@ int get_device_list(char* buff, uint32_t count)
     release_mutex(dev_lock);
     
     return i;
+}
+
+static int64_t record_read(uint8_t* buffer, int64_t offset , size_t len, void* priv, uint32_t flags)
+{
+    record_device_t* device = (record_device_t*)priv;
+    size_t done = 0;
+
+    uint8_t* record = kmalloc(device->recordSize);
+    if(record == NULL)
+        return -1;
+
+    while(done < len)
+    {
+        uint32_t index = (offset + done) / device->recordSize;
+        uint32_t start = (offset + done) % device->recordSize;
+
+        if(!device->record(index, record))
+            break;
+
+        size_t count = device->recordSize - start;
+        if(count > len - done)
+            count = len - done;
+
+        // the buffer may be a user page that isn't there yet, no lock is held here
+        memcpy(buffer + done, record + start, count);
+        done += count;
+    }
+
+    kfree(record);
+
+    return done;
+}
+
+static int64_t record_write(const uint8_t *buffer, int64_t offset, size_t len, void* priv, uint32_t flags)
+{
+    return -1;  // read only
+}
+
+static int record_ioctl(int request, void* arg)
+{
+    return -1;
+}
+
+/*
+ * read only device returning the records of a subsystem one after the other,
+ * each read asks for the records it covers so they are always up to date
+*/
+device_t* add_record_device(const char* name, device_record_t record, uint32_t recordSize)
+{
+    device_t* dev = kmalloc(sizeof(device_t));
+    record_device_t* device = kmalloc(sizeof(record_device_t));
+
+    if(dev == NULL || device == NULL)
+    {
+        kfree(dev);
+        kfree(device);
+        return NULL;
+    }
+
+    device->record = record;
+    device->recordSize = recordSize;
+
+    strcpy(dev->name, name);
+    dev->priv = device;
+    dev->read = record_read;
+    dev->write = record_write;
+    dev->ioctl = record_ioctl;
+    dev->blockSize = 0;
+
+    add_device(dev);
+
+    return dev;
 }
\ No newline at end of file
@@ -38,8 +38,16 @@ void FRAMEBUFFER_init(video_info_t* boot_info)
 {
     memcpy(&info, boot_info, sizeof(video_info_t));
 
-    for(int i = 0; i < (info.height * info.pitch * info.bytes_per_pixel) / 0x1000; i++)
-        VIRTMEM_mapPageCustom((void*)info.framebuffer + (i * 0x1000), (void*)0xf0000000 + (i * 0x1000), true);
+    uint32_t size = info.height * info.pitch * info.bytes_per_pixel;
+    uint32_t mapped = 0;
+
+    // 4mb pages as long as the alignment allows it (a full frame touches a handful of tlb entries), 4kb pages for the rest.
+    // write combining: the blits are long runs of stores that nobody reads back
+    while(mapped + LARGE_PAGE_SIZE <= size && VIRTMEM_mapLargePage((void*)info.framebuffer + mapped, (void*)0xf0000000 + mapped, true, PAT_WRITE_COMBINING))
+        mapped += LARGE_PAGE_SIZE;
+
+    for(int i = mapped / 0x1000; i < size / 0x1000; i++)
+        VIRTMEM_mapPageCustom((void*)info.framebuffer + (i * 0x1000), (void*)0xf0000000 + (i * 0x1000), true, PAT_WRITE_COMBINING);
 
     info.framebuffer = 0xf0000000;
 
@@ -50,6 +58,7 @@ void FRAMEBUFFER_init(video_info_t* boot_info)
     fb->read = read;
     fb->write = write;
     fb->ioctl = ioctl;
+    fb->blockSize = 0;
 
     add_device(fb);
 }
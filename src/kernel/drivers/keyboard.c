@@ -22,7 +22,6 @@
 #include <string.h>
 #include <memory.h>
 #include <hal/irq.h>
-#include <hal/pic.h>
 #include <hal/io.h>
 #include <mem_manager/heap.h>
 #include <multitasking/lock.h>
@@ -96,7 +95,7 @@ bool g_extended = false;
 
 key_event_t this_keyboard[MAX_KEYBOARD_BUFFER];
 uint8_t buffer_count;
-mutex_t* keyboard_lock;
+spinlock_t keyboard_lock = SPINLOCK_INIT("keyboard");   // the buffer and the waiting list, taken by the interrupt handler
 
 process_t* first_waiting_kbd;
 process_t* last_waiting_kbd;
@@ -205,7 +204,7 @@ bool KEYBOARD_interfaceTest()
 void KEYBOARD_interruptHandler(Registers* regs)
 {
     // send EOI as soon as possible
-    PIC_sendEndOfInterrupt(1);
+    IRQ_sendEndOfInterrupt(1);
 
     uint8_t scancode = KEYBOARD_readOutputBuffer();
     bool is_pressed;
@@ -279,8 +278,7 @@ void KEYBOARD_interruptHandler(Registers* regs)
         }
     }
 
-    // ?? I'm crazy !! acquiring a mutex inside an interrupt...
-    acquire_mutex(keyboard_lock);
+    spin_lock(&keyboard_lock);     // interrupts are disabled already
 
     uint8_t status = (g_capsLockOn ? 1 : 0) << CAPS_LOCK | (g_numLockOn ? 1 : 0) << NUM_LOCK | (g_shiftPressed ? 1 : 0) << SHIFTED | (is_pressed ? 1 : 0) << PRESSED;
 
@@ -294,7 +292,7 @@ void KEYBOARD_interruptHandler(Registers* regs)
         unblock_task(released, false);
     }
 
-    release_mutex(keyboard_lock);
+    spin_unlock(&keyboard_lock);
 
 End:
     // log_debug("Keyboard handler", "Fired");
@@ -338,7 +336,6 @@ void KEYBOARD_initialize()
 
     buffer_count = 0;
     memset(this_keyboard, 0, MAX_KEYBOARD_BUFFER);
-    keyboard_lock = create_mutex();
 
     device_t* new = kmalloc(sizeof(device_t));
     strcpy(new->name, "keyboard");
@@ -346,6 +343,7 @@ void KEYBOARD_initialize()
     new->read = read;
     new->write = write;
     new->ioctl = NULL;
+    new->blockSize = 0;
 
     add_device(new);
     
@@ -369,58 +367,60 @@ char KEYBOARD_scanToAscii(key_event_t* key)
 
 int64_t read(uint8_t* buffer, int64_t offset , size_t len, void* priv, uint32_t flags)
 {
+    key_event_t keys[MAX_KEYBOARD_BUFFER];
     size_t toread = len;
-    bool isFulfilled = false;
 
-    do
+    for(;;)
     {
-        acquire_mutex(keyboard_lock);
+        uint32_t eflags = spin_lock_irqsave(&keyboard_lock);
 
-        if(buffer_count <= 0)
+        if(buffer_count > 0)
         {
-            release_mutex(keyboard_lock);
+            if(toread > buffer_count)
+                toread = buffer_count;
 
-            if(flags & VFS_O_NONBLOCK)
-                return VFS_EAGAIN;
+            memcpy(keys, this_keyboard, sizeof(key_event_t) * toread);
 
-            lock_scheduler();
-            if(first_waiting_kbd == NULL)
+            if(toread)
             {
-                first_waiting_kbd = PROCESS_getCurrent();
-                last_waiting_kbd = first_waiting_kbd;
-            }
-            else{
-                last_waiting_kbd->next = PROCESS_getCurrent();
-                last_waiting_kbd = last_waiting_kbd->next;
+                for(int i = 0; i < toread && i < MAX_KEYBOARD_BUFFER - 1; i++)
+                    this_keyboard[i] = this_keyboard[i+1];
             }
 
-            last_waiting_kbd->next = NULL;
-            last_waiting_kbd->state = WAITING;
-            unlock_scheduler();
+            buffer_count -= toread;
 
-            block_task();
+            spin_unlock_irqrestore(&keyboard_lock, eflags);
+            break;
+        }
 
-            continue;
+        if(flags & VFS_O_NONBLOCK)
+        {
+            spin_unlock_irqrestore(&keyboard_lock, eflags);
+            return VFS_EAGAIN;
         }
 
-        if(toread > buffer_count)
-            toread = buffer_count;
+        // on the waiting list before the lock is released, a key pressed right after wakes us up
+        process_t* current = PROCESS_getCurrent();
+
+        if(first_waiting_kbd == NULL)
+            first_waiting_kbd = current;
+        else
+            last_waiting_kbd->next = current;
 
-        memcpy(buffer, this_keyboard, sizeof(key_event_t) * toread);
+        last_waiting_kbd = current;
+        last_waiting_kbd->next = NULL;
 
-        if(toread)
-        {
-            for(int i = 0; i < toread && i < MAX_KEYBOARD_BUFFER - 1; i++)
-                this_keyboard[i] = this_keyboard[i+1];
-        }
+        lock_scheduler();
+        current->state = WAITING;
+        unlock_scheduler();
 
-        buffer_count -= toread;
-        isFulfilled = true;
+        spin_unlock_irqrestore(&keyboard_lock, eflags);
 
-        release_mutex(keyboard_lock);
+        block_task();
+    }
 
-    }while (!isFulfilled);
-    
+    // the buffer may be a user page that isn't there yet, the copy can fault (and sleep)
+    memcpy(buffer, keys, sizeof(key_event_t) * toread);
 
     return toread;
 }
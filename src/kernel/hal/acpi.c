@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2025,  Novice
+ *
+ * This file is part of the Novix software.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <debug.h>
+#include <memory.h>
+#include <hal/acpi.h>
+#include <mem_manager/virtmem_manager.h>
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
+//============================================================================
+
+#define EBDA_SEGMENT_PTR    0x40E       // word holding the segment of the extended bios data area
+#define BIOS_AREA_START     0xE0000
+#define BIOS_AREA_END       0x100000
+
+#define RSDT_MAX_ENTRIES    64
+
+// madt entry types
+#define MADT_LOCAL_APIC             0
+#define MADT_IO_APIC                1
+#define MADT_SOURCE_OVERRIDE        2
+
+#define MADT_LOCAL_APIC_ENABLED     0x01
+
+// mps inti flags of an interrupt source override
+#define MPS_POLARITY_MASK           0x03
+#define MPS_POLARITY_ACTIVE_LOW     0x03
+#define MPS_TRIGGER_MASK            0x0C
+#define MPS_TRIGGER_LEVEL           0x0C
+
+typedef struct acpi_rsdp
+{
+    char signature[8];      // "RSD PTR "
+    uint8_t checksum;
+    char oemId[6];
+    uint8_t revision;
+    uint32_t rsdtAddress;
+} __attribute__((packed)) acpi_rsdp_t;
+
+typedef struct acpi_header
+{
+    char signature[4];
+    uint32_t length;        // of the whole table, header included
+    uint8_t revision;
+    uint8_t checksum;
+    char oemId[6];
+    char oemTableId[8];
+    uint32_t oemRevision;
+    uint32_t creatorId;
+    uint32_t creatorRevision;
+} __attribute__((packed)) acpi_header_t;
+
+typedef struct acpi_madt
+{
+    acpi_header_t header;
+    uint32_t lapicAddress;
+    uint32_t flags;
+    uint8_t entries[];
+} __attribute__((packed)) acpi_madt_t;
+
+typedef struct madt_entry
+{
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed)) madt_entry_t;
+
+typedef struct madt_local_apic
+{
+    madt_entry_t entry;
+    uint8_t processorId;
+    uint8_t apicId;
+    uint32_t flags;
+} __attribute__((packed)) madt_local_apic_t;
+
+typedef struct madt_io_apic
+{
+    madt_entry_t entry;
+    uint8_t id;
+    uint8_t reserved;
+    uint32_t address;
+    uint32_t gsiBase;
+} __attribute__((packed)) madt_io_apic_t;
+
+typedef struct madt_source_override
+{
+    madt_entry_t entry;
+    uint8_t bus;
+    uint8_t source;         // isa irq
+    uint32_t gsi;
+    uint16_t flags;
+} __attribute__((packed)) madt_source_override_t;
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE DATA
+//============================================================================
+
+uint32_t ACPI_mappedPages = 0;
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE FUNCTIONS
+//============================================================================
+
+static bool ACPI_checksum(const void* data, uint32_t length)
+{
+    uint8_t sum = 0;
+
+    for(uint32_t i = 0; i < length; i++)
+        sum += ((const uint8_t*)data)[i];
+
+    return sum == 0;
+}
+
+static void ACPI_unmap()
+{
+    for(uint32_t i = 0; i < ACPI_mappedPages; i++)
+        VIRTMEM_unMapPageCustom((void*)(ACPI_WINDOW_ADDR + i * 0x1000));
+
+    ACPI_mappedPages = 0;
+}
+
+/*
+ * the tables usually sit at the end of the ram, far from the identity mapped first 4mb:
+ * map the pages covering [phys, phys + length) in the window. returns NULL if it doesn't fit
+*/
+static void* ACPI_map(uint32_t phys, uint32_t length)
+{
+    uint32_t first = phys & ~0xFFF;
+    uint32_t pages = ((phys + length - 1) >> 12) - (first >> 12) + 1;
+
+    ACPI_unmap();
+
+    if(length == 0 || pages > ACPI_WINDOW_PAGES)
+        return NULL;
+
+    for(uint32_t i = 0; i < pages; i++)
+    {
+        if(!VIRTMEM_mapPageCustom((void*)(first + i * 0x1000), (void*)(ACPI_WINDOW_ADDR + i * 0x1000), true, PAT_WRITE_BACK))
+        {
+            ACPI_unmap();
+            return NULL;
+        }
+
+        ACPI_mappedPages++;
+    }
+
+    return (void*)(ACPI_WINDOW_ADDR + (phys - first));
+}
+
+// map a whole table, after checking its signature and checksum
+static acpi_header_t* ACPI_mapTable(uint32_t phys, const char* signature)
+{
+    acpi_header_t* header = ACPI_map(phys, sizeof(acpi_header_t));
+    if(header == NULL || memcmp(header->signature, signature, 4) != 0)
+        return NULL;
+
+    uint32_t length = header->length;
+    header = ACPI_map(phys, length);
+
+    if(header == NULL || !ACPI_checksum(header, length))
+        return NULL;
+
+    return header;
+}
+
+// the rsdp is on a 16 bytes boundary in the first kb of the ebda or in the bios area (both identity mapped)
+static acpi_rsdp_t* ACPI_findRsdp()
+{
+    uint32_t ebda = (uint32_t)(*(uint16_t*)EBDA_SEGMENT_PTR) << 4;
+    uint32_t ranges[2][2] = { {ebda, ebda + 0x400}, {BIOS_AREA_START, BIOS_AREA_END} };
+
+    for(int r = 0; r < 2; r++)
+    {
+        if(ranges[r][0] == 0)
+            continue;
+
+        for(uint32_t addr = ranges[r][0]; addr < ranges[r][1]; addr += 16)
+        {
+            acpi_rsdp_t* rsdp = (acpi_rsdp_t*)addr;
+
+            if(memcmp(rsdp->signature, "RSD PTR ", 8) == 0 && ACPI_checksum(rsdp, sizeof(acpi_rsdp_t)))
+                return rsdp;
+        }
+    }
+
+    return NULL;
+}
+
+static void ACPI_parseMadt(acpi_madt_t* madt, apic_topology_t* topology)
+{
+    uint8_t* entry = madt->entries;
+    uint8_t* end = (uint8_t*)madt + madt->header.length;
+
+    topology->lapicPhys = madt->lapicAddress;
+
+    while(entry + sizeof(madt_entry_t) <= end && ((madt_entry_t*)entry)->length >= sizeof(madt_entry_t))
+    {
+        switch (((madt_entry_t*)entry)->type)
+        {
+        case MADT_LOCAL_APIC:
+        {
+            madt_local_apic_t* lapic = (madt_local_apic_t*)entry;
+
+            if((lapic->flags & MADT_LOCAL_APIC_ENABLED) && topology->cpuCount < APIC_MAX_CPUS)
+                topology->cpuApicIds[topology->cpuCount++] = lapic->apicId;
+            break;
+        }
+        case MADT_IO_APIC:
+        {
+            madt_io_apic_t* ioapic = (madt_io_apic_t*)entry;
+
+            // the isa irqs are on the one starting at gsi 0
+            if(topology->ioapicPhys == 0 || ioapic->gsiBase == 0)
+            {
+                topology->ioapicPhys = ioapic->address;
+                topology->ioapicId = ioapic->id;
+                topology->ioapicGsiBase = ioapic->gsiBase;
+            }
+            break;
+        }
+        case MADT_SOURCE_OVERRIDE:
+        {
+            madt_source_override_t* override = (madt_source_override_t*)entry;
+
+            if(override->source < APIC_ISA_IRQS)
+            {
+                apic_irq_route_t* route = &topology->isaRoutes[override->source];
+
+                route->gsi = override->gsi;
+                route->activeLow = (override->flags & MPS_POLARITY_MASK) == MPS_POLARITY_ACTIVE_LOW;
+                route->levelTriggered = (override->flags & MPS_TRIGGER_MASK) == MPS_TRIGGER_LEVEL;
+            }
+            break;
+        }
+        }
+
+        entry += ((madt_entry_t*)entry)->length;
+    }
+}
+
+//============================================================================
+//    INTERFACE FUNCTIONS
+//============================================================================
+
+/*
+ * fill the topology from the MADT ("APIC" table) found through the RSDP and the RSDT.
+ * needs the virtual memory manager. returns false if there is no usable MADT
+*/
+bool ACPI_findApics(apic_topology_t* topology)
+{
+    acpi_rsdp_t* rsdp = ACPI_findRsdp();
+    if(rsdp == NULL)
+        return false;
+
+    // the rsdt and the madt can't be mapped at the same time, keep the list of tables
+    uint32_t tables[RSDT_MAX_ENTRIES];
+    uint32_t count = 0;
+
+    acpi_header_t* rsdt = ACPI_mapTable(rsdp->rsdtAddress, "RSDT");
+    if(rsdt != NULL)
+    {
+        count = (rsdt->length - sizeof(acpi_header_t)) / sizeof(uint32_t);
+        if(count > RSDT_MAX_ENTRIES)
+            count = RSDT_MAX_ENTRIES;
+
+        memcpy(tables, (uint8_t*)rsdt + sizeof(acpi_header_t), count * sizeof(uint32_t));
+    }
+
+    bool found = false;
+    for(uint32_t i = 0; i < count && !found; i++)
+    {
+        acpi_madt_t* madt = (acpi_madt_t*)ACPI_mapTable(tables[i], "APIC");
+        if(madt == NULL)
+            continue;
+
+        APIC_defaultTopology(topology);
+        ACPI_parseMadt(madt, topology);
+        topology->source = "acpi";
+
+        found = topology->ioapicPhys != 0 && topology->cpuCount > 0;
+    }
+
+    ACPI_unmap();
+    return found;
+}
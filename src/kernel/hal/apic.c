@@ -0,0 +1,443 @@
+/*
+ * Copyright (C) 2025,  Novice
+ *
+ * This file is part of the Novix software.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <debug.h>
+#include <memory.h>
+#include <hal/apic.h>
+#include <hal/isr.h>
+#include <hal/pit.h>
+#include <hal/io.h>
+#include <mem_manager/virtmem_manager.h>
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
+//============================================================================
+
+#define IA32_APIC_BASE_MSR      0x1B
+#define APIC_BASE_ENABLE        (1 << 11)
+#define APIC_BASE_ADDR_MASK     0xFFFFF000
+#define APIC_DEFAULT_PHYS       0xFEE00000
+#define IOAPIC_DEFAULT_PHYS     0xFEC00000
+
+// local apic registers, offsets from its base
+#define LAPIC_ID                0x020
+#define LAPIC_TPR               0x080   // task priority, 0 accepts every vector
+#define LAPIC_EOI               0x0B0
+#define LAPIC_SVR               0x0F0   // spurious vector, bit 8 software enables the apic
+#define LAPIC_ICR_LOW           0x300   // interrupt command: writing the low half sends the ipi
+#define LAPIC_ICR_HIGH          0x310   // bits 24-31: destination apic id
+#define LAPIC_LVT_TIMER         0x320
+#define LAPIC_LVT_LINT0         0x350
+#define LAPIC_LVT_LINT1         0x360
+#define LAPIC_LVT_ERROR         0x370
+#define LAPIC_TIMER_INITIAL     0x380
+#define LAPIC_TIMER_CURRENT     0x390
+#define LAPIC_TIMER_DIVIDE      0x3E0
+
+#define LAPIC_SVR_ENABLE        0x100
+#define LAPIC_LVT_MASKED        0x10000
+#define LAPIC_LVT_NMI           0x400
+#define LAPIC_TIMER_DIVIDE_16   0x3
+
+#define LAPIC_ICR_FIXED         0x000
+#define LAPIC_ICR_INIT          0x500
+#define LAPIC_ICR_STARTUP       0x600
+#define LAPIC_ICR_PENDING       0x1000  // the previous ipi isn't delivered yet
+#define LAPIC_ICR_ASSERT        0x4000
+
+// the io apic is reached through an index and a data register
+#define IOAPIC_REGSEL           0x00
+#define IOAPIC_WINDOW           0x10
+#define IOAPIC_VERSION          0x01    // bits 16-23: last redirection entry
+#define IOAPIC_REDIRECTION(n)   (0x10 + (n) * 2)
+
+#define IOAPIC_ACTIVE_LOW       0x2000
+#define IOAPIC_LEVEL            0x8000
+#define IOAPIC_MASKED           0x10000
+
+#define APIC_CASCADE_IRQ        2       // the slave PIC input, nothing is behind it anymore
+
+// the timer is counted against 10ms of the PIT
+#define CALIBRATION_MS          10
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE DATA
+//============================================================================
+
+bool APIC_enabled = false;
+apic_topology_t APIC_topology;
+uint32_t APIC_ioapicEntries = 0;
+uint32_t APIC_tscKhz = 0;       // time stamp counter frequency, counted during the timer calibration
+
+static void APIC_timerProgram(uint32_t delta);
+static uint32_t APIC_timerElapsed();
+
+clock_event_t APIC_clockEvent = {
+    .name = "lapic",
+    .frequency = 0,             // calibrated by APIC_initialize()
+    .minDelta = 16,
+    .maxDelta = 0x7FFFFFFF,
+    .program = APIC_timerProgram,
+    .elapsed = APIC_timerElapsed,
+};
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE FUNCTIONS
+//============================================================================
+
+static uint64_t APIC_readMsr(uint32_t msr)
+{
+    uint32_t low, high;
+    __asm__ volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+    return ((uint64_t)high << 32) | low;
+}
+
+static void APIC_writeMsr(uint32_t msr, uint64_t value)
+{
+    __asm__ volatile("wrmsr" :: "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+static inline uint32_t LAPIC_read(uint32_t reg)
+{
+    return *(volatile uint32_t*)(LAPIC_VIRT_ADDR + reg);
+}
+
+static inline void LAPIC_write(uint32_t reg, uint32_t value)
+{
+    *(volatile uint32_t*)(LAPIC_VIRT_ADDR + reg) = value;
+}
+
+static uint32_t IOAPIC_read(uint32_t reg)
+{
+    *(volatile uint32_t*)(IOAPIC_VIRT_ADDR + IOAPIC_REGSEL) = reg;
+    return *(volatile uint32_t*)(IOAPIC_VIRT_ADDR + IOAPIC_WINDOW);
+}
+
+static void IOAPIC_write(uint32_t reg, uint32_t value)
+{
+    *(volatile uint32_t*)(IOAPIC_VIRT_ADDR + IOAPIC_REGSEL) = reg;
+    *(volatile uint32_t*)(IOAPIC_VIRT_ADDR + IOAPIC_WINDOW) = value;
+}
+
+// io apic input of an isa irq, -1 if this io apic doesn't have it
+static int APIC_getPin(int irq)
+{
+    if(irq < 0 || irq >= APIC_ISA_IRQS)
+        return -1;
+
+    uint32_t gsi = APIC_topology.isaRoutes[irq].gsi;
+    if(gsi < APIC_topology.ioapicGsiBase || gsi - APIC_topology.ioapicGsiBase >= APIC_ioapicEntries)
+        return -1;
+
+    return gsi - APIC_topology.ioapicGsiBase;
+}
+
+static void APIC_setMask(int irq, bool masked)
+{
+    int pin = APIC_getPin(irq);
+    if(pin < 0)
+        return;
+
+    uint32_t low = IOAPIC_read(IOAPIC_REDIRECTION(pin));
+    low = masked ? (low | IOAPIC_MASKED) : (low & ~IOAPIC_MASKED);
+    IOAPIC_write(IOAPIC_REDIRECTION(pin), low);
+}
+
+/*
+ * every isa irq keeps the vector it had behind the PIC, delivered to the boot processor.
+ * the other inputs stay masked, and so does the PIT: the local apic timer replaces it
+*/
+static void APIC_setupIoApic()
+{
+    APIC_ioapicEntries = ((IOAPIC_read(IOAPIC_VERSION) >> 16) & 0xFF) + 1;
+
+    for(uint32_t pin = 0; pin < APIC_ioapicEntries; pin++)
+    {
+        IOAPIC_write(IOAPIC_REDIRECTION(pin) + 1, 0);
+        IOAPIC_write(IOAPIC_REDIRECTION(pin), IOAPIC_MASKED);
+    }
+
+    for(int irq = 0; irq < APIC_ISA_IRQS; irq++)
+    {
+        int pin = APIC_getPin(irq);
+        if(pin < 0 || irq == APIC_CASCADE_IRQ)
+            continue;
+
+        apic_irq_route_t* route = &APIC_topology.isaRoutes[irq];
+        uint32_t low = APIC_IRQ_VECTOR_BASE + irq;
+
+        if(route->activeLow)        low |= IOAPIC_ACTIVE_LOW;
+        if(route->levelTriggered)   low |= IOAPIC_LEVEL;
+        if(irq == 0)                low |= IOAPIC_MASKED;
+
+        IOAPIC_write(IOAPIC_REDIRECTION(pin) + 1, (uint32_t)APIC_getId() << 24);
+        IOAPIC_write(IOAPIC_REDIRECTION(pin), low);
+    }
+}
+
+static void APIC_timerProgram(uint32_t delta)
+{
+    if(delta > APIC_clockEvent.maxDelta)    delta = APIC_clockEvent.maxDelta;
+    if(delta < APIC_clockEvent.minDelta)    delta = APIC_clockEvent.minDelta;
+
+    LAPIC_write(LAPIC_TIMER_INITIAL, delta);
+}
+
+// in one shot mode the current count stops at 0 once the interrupt fired. the registers are per cpu
+static uint32_t APIC_timerElapsed()
+{
+    return LAPIC_read(LAPIC_TIMER_INITIAL) - LAPIC_read(LAPIC_TIMER_CURRENT);
+}
+
+static inline uint64_t APIC_readTsc()
+{
+    uint32_t low, high;
+    __asm__ volatile("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+// cpuid.1:edx bit 4
+static bool APIC_hasTsc()
+{
+    uint32_t eax = 1, ebx, ecx = 0, edx;
+    __asm__ volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+
+    return edx & (1 << 4);
+}
+
+/*
+ * count how fast the timer goes down while the PIT (polled, its irq is masked) runs
+ * for CALIBRATION_MS. the frequency is the one after the divider. The time stamp counter
+ * is counted over the same window
+*/
+static uint32_t APIC_calibrateTimer()
+{
+    clock_event_t* pit = PIT_getClockEvent();
+    uint32_t pitCount = pit->frequency / 1000 * CALIBRATION_MS;
+
+    LAPIC_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+    LAPIC_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | APIC_IRQ_VECTOR_BASE);
+
+    bool tsc = APIC_hasTsc();
+    uint64_t tscStart = tsc ? APIC_readTsc() : 0;
+
+    pit->program(pitCount);
+    LAPIC_write(LAPIC_TIMER_INITIAL, 0xFFFFFFFF);
+
+    while(pit->elapsed() < pitCount);
+
+    uint32_t counted = 0xFFFFFFFF - LAPIC_read(LAPIC_TIMER_CURRENT);
+    LAPIC_write(LAPIC_TIMER_INITIAL, 0);
+
+    if(tsc)
+        APIC_tscKhz = (uint32_t)((APIC_readTsc() - tscStart) / CALIBRATION_MS);
+
+    return counted * (1000 / CALIBRATION_MS);
+}
+
+// nothing to acknowledge, a spurious interrupt doesn't get an EOI
+static void APIC_spuriousHandler(Registers* regs)
+{
+    (void)regs;
+}
+
+// the registers of the local apic of the calling cpu, same setup on every cpu
+static void APIC_setupLocal(uint32_t lapicPhys)
+{
+    uint64_t base = APIC_readMsr(IA32_APIC_BASE_MSR);
+    APIC_writeMsr(IA32_APIC_BASE_MSR, (base & ~(uint64_t)APIC_BASE_ADDR_MASK) | lapicPhys | APIC_BASE_ENABLE);
+
+    LAPIC_write(LAPIC_TPR, 0);
+    LAPIC_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+    LAPIC_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+    LAPIC_write(LAPIC_LVT_LINT1, LAPIC_LVT_NMI);
+    LAPIC_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+}
+
+static void APIC_sendCommand(uint32_t apicId, uint32_t command)
+{
+    uint32_t eflags = get_eflags();
+    disableInterrupts();    // an ipi sent by an interrupt handler would land between the two writes
+
+    while(LAPIC_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING);
+
+    LAPIC_write(LAPIC_ICR_HIGH, apicId << 24);
+    LAPIC_write(LAPIC_ICR_LOW, command);
+
+    while(LAPIC_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING);
+
+    if(eflags & (1 << 9))
+        enableInterrupts();
+}
+
+//============================================================================
+//    INTERFACE FUNCTIONS
+//============================================================================
+
+// cpuid.1:edx bit 9
+bool APIC_isSupported()
+{
+    uint32_t eax = 1, ebx, ecx = 0, edx;
+    __asm__ volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+
+    return edx & (1 << 9);
+}
+
+// the pc/at wiring: isa irq n on input n, active high and edge triggered
+void APIC_defaultTopology(apic_topology_t* topology)
+{
+    memset(topology, 0, sizeof(apic_topology_t));
+
+    topology->source = "default";
+    topology->lapicPhys = APIC_DEFAULT_PHYS;
+
+    for(int i = 0; i < APIC_ISA_IRQS; i++)
+        topology->isaRoutes[i].gsi = i;
+}
+
+/*
+ * switch the boot processor from the PIC to its local apic and the io apic described by
+ * the topology (see IRQ_enableApic()), and calibrate the local apic timer.
+ * interrupts must be disabled and the PIC masked
+*/
+bool APIC_initialize(const apic_topology_t* topology)
+{
+    if(!APIC_isSupported() || topology->ioapicPhys == 0)
+        return false;
+
+    APIC_topology = *topology;
+
+    uint32_t lapicPhys = APIC_topology.lapicPhys ? APIC_topology.lapicPhys : (uint32_t)(APIC_readMsr(IA32_APIC_BASE_MSR) & APIC_BASE_ADDR_MASK);
+    APIC_topology.lapicPhys = lapicPhys;
+
+    if(!VIRTMEM_mapPageCustom((void*)lapicPhys, (void*)LAPIC_VIRT_ADDR, true, PAT_UNCACHED) ||
+       !VIRTMEM_mapPageCustom((void*)(APIC_topology.ioapicPhys & APIC_BASE_ADDR_MASK), (void*)IOAPIC_VIRT_ADDR, true, PAT_UNCACHED))
+    {
+        log_err("apic", "can't map the apic registers");
+        return false;
+    }
+
+    ISR_registerNewHandler(APIC_SPURIOUS_VECTOR, APIC_spuriousHandler);
+    APIC_setupLocal(lapicPhys);
+
+    APIC_setupIoApic();
+
+    APIC_clockEvent.frequency = APIC_calibrateTimer();
+    if(APIC_clockEvent.frequency < 1000)
+    {
+        log_err("apic", "local apic timer calibration failed");
+        return false;
+    }
+
+    // one shot, on the vector of the PIT: the time keeping code doesn't see the difference
+    LAPIC_write(LAPIC_LVT_TIMER, APIC_IRQ_VECTOR_BASE);
+
+    APIC_enabled = true;
+    return true;
+}
+
+/*
+ * local apic of an application processor: the registers are already mapped (the page table is
+ * shared) and the timer runs at the frequency calibrated on the boot processor
+*/
+void APIC_initializeCpu()
+{
+    APIC_setupLocal(APIC_topology.lapicPhys);
+
+    LAPIC_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+    LAPIC_write(LAPIC_LVT_TIMER, APIC_IRQ_VECTOR_BASE);
+}
+
+bool APIC_isEnabled()
+{
+    return APIC_enabled;
+}
+
+const apic_topology_t* APIC_getTopology()
+{
+    return &APIC_topology;
+}
+
+uint32_t APIC_getId()
+{
+    return LAPIC_read(LAPIC_ID) >> 24;
+}
+
+void APIC_sendEndOfInterrupt()
+{
+    LAPIC_write(LAPIC_EOI, 0);
+}
+
+// fixed interrupt on `vector` for one cpu
+void APIC_sendIpi(uint32_t apicId, uint8_t vector)
+{
+    APIC_sendCommand(apicId, LAPIC_ICR_FIXED | LAPIC_ICR_ASSERT | vector);
+}
+
+// reset an application processor, it then waits for a startup ipi
+void APIC_sendInit(uint32_t apicId)
+{
+    APIC_sendCommand(apicId, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+}
+
+// the application processor starts in real mode at page << 12
+void APIC_sendStartup(uint32_t apicId, uint8_t page)
+{
+    APIC_sendCommand(apicId, LAPIC_ICR_STARTUP | LAPIC_ICR_ASSERT | page);
+}
+
+// 0 without a time stamp counter
+uint32_t APIC_getTscKhz()
+{
+    return APIC_tscKhz;
+}
+
+// cpuid.80000007h:edx bit 8, the counter runs at the same rate in every power state (and is synchronized between cpus)
+bool APIC_hasInvariantTsc()
+{
+    uint32_t eax = 0x80000000, ebx, ecx = 0, edx;
+    __asm__ volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+
+    if(eax < 0x80000007)
+        return false;
+
+    eax = 0x80000007;
+    ecx = 0;
+    __asm__ volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+
+    return edx & (1 << 8);
+}
+
+void APIC_mask(int irq)
+{
+    APIC_setMask(irq, true);
+}
+
+void APIC_unMask(int irq)
+{
+    APIC_setMask(irq, false);
+}
+
+clock_event_t* APIC_getClockEvent()
+{
+    return &APIC_clockEvent;
+}
@@ -18,6 +18,7 @@
 */
 
 #include <hal/gdt.h>
+#include <hal/isr.h>
 #include <debug.h>
 #include <memory.h>
 
@@ -112,21 +113,29 @@ typedef enum{
 
 // helper macro !
 #define GDT_ENTRY(base, limit, access, flags) {             \
-    limit & 0xffff,                                         \
-    base & 0xffff,                                          \
-    ((base >> 16) & 0xff),                                  \
-    access,                                                 \
-    ((limit >> 16) & 0xf) | (flags & 0xf0),                 \
-    (base >> 24) & 0xff                                     \
+    (limit) & 0xffff,                                       \
+    (base) & 0xffff,                                        \
+    (((base) >> 16) & 0xff),                                \
+    (access),                                               \
+    (((limit) >> 16) & 0xf) | ((flags) & 0xf0),             \
+    ((base) >> 24) & 0xff                                   \
 }
 
+// first gdt entry of the double fault tss of the application processors
+#define GDT_AP_DOUBLE_FAULT_INDEX   (GDT_DOUBLE_FAULT_INDEX + GDT_MAX_CPUS - 1)
+
 //============================================================================
 //    IMPLEMENTATION PRIVATE DATA
 //============================================================================
 
 
-// one task state segment
-Tss_entry g_TSS;
+// one task state segment per cpu, for the kernel stack of the task it runs
+Tss_entry g_TSS[GDT_MAX_CPUS];
+
+// the task a cpu switches to on a double fault, it has its own stack
+// so that a kernel stack overflow can still be reported: one per cpu,
+// a busy tss can't be switched to again by another cpu
+Tss_entry g_doubleFaultTSS[GDT_MAX_CPUS];
 
 Gdt_entry g_GDT[] = {
     // Null descriptor
@@ -161,6 +170,24 @@ Gdt_entry g_GDT[] = {
             0,
             1 | GDT_ACCESS_RW_BIT_NOTALLOW | GDT_ACCESS_UP_DIRECTION_BIT | GDT_ACCESS_EXECUTABLE_BIT_CODE | GDT_ACCESS_DESCRIPTOR_BIT_SYSTEM | GDT_ACCESS_DPL_RING0 | GDT_ACCESS_PRESENT_BIT,
             0),
+
+    // Double fault task state segment
+    GDT_ENTRY(0, 
+            0,
+            1 | GDT_ACCESS_RW_BIT_NOTALLOW | GDT_ACCESS_UP_DIRECTION_BIT | GDT_ACCESS_EXECUTABLE_BIT_CODE | GDT_ACCESS_DESCRIPTOR_BIT_SYSTEM | GDT_ACCESS_DPL_RING0 | GDT_ACCESS_PRESENT_BIT,
+            0),
+
+    // Task state segments of the application processors, filled when they start
+    [GDT_DOUBLE_FAULT_INDEX + 1 ... GDT_AP_DOUBLE_FAULT_INDEX] = GDT_ENTRY(0,
+            0,
+            1 | GDT_ACCESS_RW_BIT_NOTALLOW | GDT_ACCESS_UP_DIRECTION_BIT | GDT_ACCESS_EXECUTABLE_BIT_CODE | GDT_ACCESS_DESCRIPTOR_BIT_SYSTEM | GDT_ACCESS_DPL_RING0 | GDT_ACCESS_PRESENT_BIT,
+            0),
+
+    // Double fault task state segments of the application processors
+    [GDT_AP_DOUBLE_FAULT_INDEX + 1 ... GDT_AP_DOUBLE_FAULT_INDEX + GDT_MAX_CPUS - 1] = GDT_ENTRY(0,
+            0,
+            1 | GDT_ACCESS_RW_BIT_NOTALLOW | GDT_ACCESS_UP_DIRECTION_BIT | GDT_ACCESS_EXECUTABLE_BIT_CODE | GDT_ACCESS_DESCRIPTOR_BIT_SYSTEM | GDT_ACCESS_DPL_RING0 | GDT_ACCESS_PRESENT_BIT,
+            0),
 };
 
 Gdt_descriptor g_GDTdescriptor = {sizeof(g_GDT) - 1, g_GDT};
@@ -172,15 +199,27 @@ Gdt_descriptor g_GDTdescriptor = {sizeof(g_GDT) - 1, g_GDT};
 void __attribute__((cdecl)) GDT_flush(Gdt_descriptor* descriptor);
 void __attribute__((cdecl)) TSS_flush(uint8_t gdt_index);
 
+// gdt entry of the tss of a cpu: the boot processor's is entry 5, the others come after the double fault one
+static inline uint32_t GDT_tssIndex(uint32_t cpu)
+{
+    return cpu == 0 ? GDT_TSS_INDEX : GDT_DOUBLE_FAULT_INDEX + cpu;
+}
+
+// gdt entry of the double fault tss of a cpu: entry 6 for the boot processor, the others after the tss of the application processors
+static inline uint32_t GDT_doubleFaultIndex(uint32_t cpu)
+{
+    return cpu == 0 ? GDT_DOUBLE_FAULT_INDEX : GDT_AP_DOUBLE_FAULT_INDEX + cpu;
+}
+
 //============================================================================
 //    INTERFACE FUNCTIONS
 //============================================================================
 
-void write_tss(Gdt_entry *g)
+void write_tss(Gdt_entry *g, Tss_entry* tss)
 {
     // Compute the base and limit of the TSS for use in the GDT entry.
-	uint32_t base = (uint32_t) &g_TSS;
-	uint32_t limit = sizeof(g_TSS) - 1;
+	uint32_t base = (uint32_t) tss;
+	uint32_t limit = sizeof(Tss_entry) - 1;
 
     g->limit_low = limit & 0xffff;
     g->base_low = base & 0xffff;
@@ -188,31 +227,117 @@ void write_tss(Gdt_entry *g)
     g->highLimit_flags = ((limit >> 16) & 0xf) | 0; // no flags needed
     g->base_high = (base >> 24) & 0xff;
 
-    memset(&g_TSS, 0, sizeof(g_TSS));
+    memset(tss, 0, sizeof(Tss_entry));
 
-    g_TSS.ss0 = 2 * 8;
-    g_TSS.esp0 = 0; // this is so invalid ...
+    tss->ss0 = 2 * 8;
+    tss->esp0 = 0; // this is so invalid ...
 }
 
-void TSS_setKernelStack(uint32_t esp0)
+void TSS_setKernelStack(uint32_t cpu, uint32_t esp0)
 {
     // for task switching
-    g_TSS.esp0 = esp0;
+    g_TSS[cpu].esp0 = esp0;
+}
+
+/*
+ * prepare the task run by the double fault task gate: it starts at entry
+ * on its own stack with the page directory given, so it doesn't depend
+ * on the state of the faulting task
+*/
+void TSS_setDoubleFaultTask(uint32_t cpu, void* entry, void* stackTop, uint32_t cr3)
+{
+    Tss_entry* tss = &g_doubleFaultTSS[cpu];
+
+    tss->eip = (uint32_t)entry;
+    tss->esp = (uint32_t)stackTop;
+    tss->ebp = (uint32_t)stackTop;
+    tss->cr3 = cr3;
+    tss->eflags = 0x2;  // interrupts disabled
+
+    tss->cs = 1 * 8;
+    tss->ds = 2 * 8;
+    tss->es = 2 * 8;
+    tss->fs = 2 * 8;
+    tss->gs = 2 * 8;
+    tss->ss = 2 * 8;
+}
+
+// selector of the task gate of the double fault vector of a cpu (see IDT_setTaskGate())
+uint16_t GDT_doubleFaultSelector(uint32_t cpu)
+{
+    return GDT_doubleFaultIndex(cpu) * 8;
+}
+
+/*
+ * when the double fault task runs, the cpu saved the state of the faulting code in the tss
+ * it was running on, the double fault tss links back to it
+*/
+void TSS_getInterruptedState(Registers* regs)
+{
+    // the double fault tss of this cpu is loaded, it links back to the tss of the same cpu
+    uint32_t cpu = GDT_getCpu();
+    Tss_entry* tss = &g_TSS[cpu];
+
+    regs->ds = tss->ds;
+    regs->edi = tss->edi;
+    regs->esi = tss->esi;
+    regs->ebp = tss->ebp;
+    regs->useless = tss->esp;
+    regs->ebx = tss->ebx;
+    regs->edx = tss->edx;
+    regs->ecx = tss->ecx;
+    regs->eax = tss->eax;
+    regs->eip = tss->eip;
+    regs->cs = tss->cs;
+    regs->eflags = tss->eflags;
+    regs->esp = tss->esp;
+    regs->ss = tss->ss;
 }
 
 void GDT_initialize()
 {
     /*
-    * Current GDT setup creates a simple table with 6 entries:
+    * Current GDT setup creates a simple table with 7 entries:
     *  - Null descriptor (mandatory)
     *  - Kernel code segment
     *  - Kernel data segment
     *  - User code segment
     *  - User data segment
     *  - Task State Segment (TSS) descriptor
+    *  - Double fault TSS descriptor
+    * followed by the TSS descriptors of the application processors (see GDT_initializeCpu())
+    * and by their double fault TSS descriptors
     */
 
-    write_tss(&g_GDT[5]);
+    write_tss(&g_GDT[GDT_TSS_INDEX], &g_TSS[0]);
+
+    // all of them now, KSTACK_initialize() prepares the tasks before the application processors start
+    for(uint32_t cpu = 0; cpu < GDT_MAX_CPUS; cpu++)
+        write_tss(&g_GDT[GDT_doubleFaultIndex(cpu)], &g_doubleFaultTSS[cpu]);
+
+    GDT_flush(&g_GDTdescriptor);
+    TSS_flush(GDT_TSS_INDEX);
+}
+
+// run by an application processor: the kernel gdt instead of the one of the trampoline, and its own tss
+void GDT_initializeCpu(uint32_t cpu)
+{
+    write_tss(&g_GDT[GDT_tssIndex(cpu)], &g_TSS[cpu]);
     GDT_flush(&g_GDTdescriptor);
-    TSS_flush(5);
+    TSS_flush(GDT_tssIndex(cpu));
+}
+
+// index of the calling cpu, from the tss it loaded (0 before GDT_initialize())
+// also right in its double fault task, which runs on its double fault tss
+uint32_t GDT_getCpu()
+{
+    uint16_t selector;
+    __asm__ volatile("str %0" : "=r"(selector));
+
+    uint32_t index = selector / 8;
+
+    if(index > GDT_AP_DOUBLE_FAULT_INDEX)
+        return index - GDT_AP_DOUBLE_FAULT_INDEX;
+
+    return index > GDT_DOUBLE_FAULT_INDEX ? index - GDT_DOUBLE_FAULT_INDEX : 0;
 }
\ No newline at end of file
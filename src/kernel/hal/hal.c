@@ -23,6 +23,7 @@
 #include <hal/isr.h>
 #include <hal/irq.h>
 #include <hal/fpu.h>
+#include <hal/pat.h>
 
 //============================================================================
 //    INTERFACE FUNCTIONS
@@ -35,4 +36,5 @@ void HAL_initialize()
     ISR_initialize();
     IRQ_initialize();
     FPU_enable();
+    PAT_initialize();
 }
\ No newline at end of file
@@ -18,6 +18,7 @@
 */
 
 #include <hal/idt.h>
+#include <hal/gdt.h>
 
 //============================================================================
 //    IMPLEMENTATION PRIVATE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
@@ -40,8 +41,8 @@ typedef struct{
 //    IMPLEMENTATION PRIVATE DATA
 //============================================================================
 
-Idt_gate g_IDT[256];
-Idt_descriptor g_IDTdescriptor = {sizeof(g_IDT) - 1, g_IDT};
+// one table per cpu, they only differ by the double fault task gate: each cpu has its own double fault task
+Idt_gate g_IDT[GDT_MAX_CPUS][256];
 
 //============================================================================
 //    IMPLEMENTATION PRIVATE FUNCTION PROTOTYPES
@@ -53,16 +54,34 @@ void __attribute__((cdecl)) IDT_flush(Idt_descriptor* descriptor);
 //    INTERFACE FUNCTIONS
 //============================================================================
 
+// the handler is the same on every cpu
 void IDT_setGate(int interrupt, void* offset, uint8_t attribute)
 {
-    g_IDT[interrupt].offset_low     = (uint32_t)offset & 0XFFFF;
-    g_IDT[interrupt].segment        = 0X08; // code segment
-    g_IDT[interrupt].reserved       = 0;
-    g_IDT[interrupt].attribute      = attribute;
-    g_IDT[interrupt].offset_high    = ((uint32_t)offset >> 16) & 0xFFFF;
+    for(uint32_t cpu = 0; cpu < GDT_MAX_CPUS; cpu++)
+    {
+        g_IDT[cpu][interrupt].offset_low     = (uint32_t)offset & 0XFFFF;
+        g_IDT[cpu][interrupt].segment        = 0X08; // code segment
+        g_IDT[cpu][interrupt].reserved       = 0;
+        g_IDT[cpu][interrupt].attribute      = attribute;
+        g_IDT[cpu][interrupt].offset_high    = ((uint32_t)offset >> 16) & 0xFFFF;
+    }
 }
 
+// the cpu switches to the task whose tss selector is given instead of calling a handler
+void IDT_setTaskGate(uint32_t cpu, int interrupt, uint16_t tss_selector)
+{
+    g_IDT[cpu][interrupt].offset_low     = 0;
+    g_IDT[cpu][interrupt].segment        = tss_selector;
+    g_IDT[cpu][interrupt].reserved       = 0;
+    g_IDT[cpu][interrupt].attribute      = IDT_ATTRIBUTE_TASK_GATE | IDT_ATTRIBUTE_DPL_RING0 | IDT_ATTRIBUTE_PRESENT_BIT;
+    g_IDT[cpu][interrupt].offset_high    = 0;
+}
+
+// load the table of the calling cpu, its tss is already loaded (see GDT_getCpu())
 void IDT_initialize()
 {
-    IDT_flush(&g_IDTdescriptor);
+    uint32_t cpu = GDT_getCpu();
+    Idt_descriptor descriptor = {sizeof(g_IDT[cpu]) - 1, g_IDT[cpu]};   // the cpu keeps its own copy
+
+    IDT_flush(&descriptor);
 }
\ No newline at end of file
@@ -65,6 +65,13 @@ HLT:
     hlt
     ret
 
+; sti only takes effect after the next instruction: no interrupt can come in between
+global enableInterruptsAndHalt
+enableInterruptsAndHalt:
+    sti
+    hlt
+    ret
+
 global get_eflags
 get_eflags:
     pushf
@@ -19,10 +19,14 @@
 
 #include <stdio.h>
 #include <stddef.h>
+#include <debug.h>
 #include <hal/irq.h>
 #include <hal/io.h>
 #include <hal/pic.h>
 #include <hal/pit.h>
+#include <hal/apic.h>
+#include <hal/acpi.h>
+#include <hal/mp.h>
 
 //============================================================================
 //    IMPLEMENTATION PRIVATE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
@@ -36,6 +40,8 @@
 
 IRQHandler g_IRQ_handlers[16];
 
+bool IRQ_apicMode = false;     // the PIC is masked and the io apic delivers the irqs
+
 //============================================================================
 //    IMPLEMENTATION PRIVATE FUNCTIONS
 //============================================================================
@@ -49,6 +55,11 @@ void IRQ_handler(Registers* regs)
         // handle IRQ
         g_IRQ_handlers[irq](regs);
     }
+    else if(IRQ_apicMode)
+    {
+        printf("Unhandled IRQ %d...\n", irq);
+        APIC_sendEndOfInterrupt();
+    }
     else
     {
         uint8_t pic_isr = PIC_readInServiceRegister();
@@ -66,7 +77,7 @@ void IRQ_handler(Registers* regs)
 
 void mask_pitInterupt()
 {
-    PIC_sendEndOfInterrupt(0);
+    IRQ_sendEndOfInterrupt(0);
 }
 
 void IRQ_initialize()
@@ -87,4 +98,66 @@ void IRQ_initialize()
 void IRQ_registerNewHandler(int irq, IRQHandler handler)
 {
     g_IRQ_handlers[irq] = handler;
+}
+
+/*
+ * move the irqs from the PIC to the io apic, with the routing of the ACPI MADT or, without it,
+ * of the MP tables. needs the virtual memory manager. on failure the PIC stays in charge
+*/
+bool IRQ_enableApic()
+{
+    apic_topology_t topology;
+
+    if(!APIC_isSupported())
+    {
+        log_warn("irq", "no local apic, keeping the PIC");
+        return false;
+    }
+
+    if(!ACPI_findApics(&topology) && !MP_findApics(&topology))
+    {
+        log_warn("irq", "no ACPI nor MP tables describe the io apic, keeping the PIC");
+        return false;
+    }
+
+    uint32_t eflags = get_eflags();
+    disableInterrupts();
+
+    PIC_disable();
+    IRQ_apicMode = APIC_initialize(&topology);
+
+    if(!IRQ_apicMode)
+        PIC_configure(PIC_REMAP_OFFSET, PIC_REMAP_OFFSET + 8);     // unmask it again
+
+    if(eflags & (1 << 9))
+        enableInterrupts();
+
+    if(!IRQ_apicMode)
+    {
+        log_warn("irq", "apic initialization failed, keeping the PIC");
+        return false;
+    }
+
+    log_info("irq", "apic mode (%s tables): %d cpu(s), io apic %d at %x, lapic timer at %d hz",
+        topology.source, topology.cpuCount, topology.ioapicId, topology.ioapicPhys, APIC_getClockEvent()->frequency);
+    return true;
+}
+
+bool IRQ_isApicEnabled()
+{
+    return IRQ_apicMode;
+}
+
+void IRQ_sendEndOfInterrupt(int irq)
+{
+    if(IRQ_apicMode)
+        APIC_sendEndOfInterrupt();
+    else
+        PIC_sendEndOfInterrupt(irq);
+}
+
+// the timer driving the scheduler: the local apic one once the apic is enabled, the PIT otherwise
+clock_event_t* IRQ_getClockEvent()
+{
+    return IRQ_apicMode ? APIC_getClockEvent() : PIT_getClockEvent();
 }
\ No newline at end of file
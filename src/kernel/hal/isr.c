@@ -88,21 +88,8 @@ void ISR_handler(Registers* regs)
     else if (regs->interrupt >= 32)
         printf("Unhandled interrupt %d!\n", regs->interrupt);
     
-    else {
-        printf("Unhandled exception %d %s\n", regs->interrupt, g_Exceptions[regs->interrupt]);
-        
-        printf("  eax=%x  ebx=%x  ecx=%x  edx=%x  esi=%x  edi=%x\n",
-               regs->eax, regs->ebx, regs->ecx, regs->edx, regs->esi, regs->edi);
-
-        printf("  esp=%x  ebp=%x  eip=%x  eflags=%x  cs=%x  ds=%x  ss=%x\n",
-               regs->esp, regs->ebp, regs->eip, regs->eflags, regs->cs, regs->ds, regs->ss);
-
-        printf("  interrupt=%x  errorcode=%x\n", regs->interrupt, regs->error);
-        printf("cr2: 0x%x\n", get_cr2());
-
-        puts("KERNEL PANIC!\n");
-        panic();
-    }
+    else
+        ISR_panic(regs);
 }
 
 //============================================================================
@@ -117,4 +104,27 @@ void ISR_initialize()
 void ISR_registerNewHandler(int interrupt, ISRHandler handler)
 {
     g_ISR_handlers[interrupt] = handler;
+}
+
+uint32_t ISR_getFaultAddress()
+{
+    return get_cr2();
+}
+
+// dump the state of the faulting code and stop everything
+void ISR_panic(Registers* regs)
+{
+    printf("Unhandled exception %d %s\n", regs->interrupt, g_Exceptions[regs->interrupt]);
+    
+    printf("  eax=%x  ebx=%x  ecx=%x  edx=%x  esi=%x  edi=%x\n",
+           regs->eax, regs->ebx, regs->ecx, regs->edx, regs->esi, regs->edi);
+
+    printf("  esp=%x  ebp=%x  eip=%x  eflags=%x  cs=%x  ds=%x  ss=%x\n",
+           regs->esp, regs->ebp, regs->eip, regs->eflags, regs->cs, regs->ds, regs->ss);
+
+    printf("  interrupt=%x  errorcode=%x\n", regs->interrupt, regs->error);
+    printf("cr2: 0x%x\n", get_cr2());
+
+    puts("KERNEL PANIC!\n");
+    panic();
 }
\ No newline at end of file
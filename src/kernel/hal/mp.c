@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2025,  Novice
+ *
+ * This file is part of the Novix software.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <memory.h>
+#include <hal/mp.h>
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
+//============================================================================
+
+#define EBDA_SEGMENT_PTR    0x40E
+#define BASE_MEMORY_END     0xA0000
+#define BIOS_ROM_START      0xF0000
+#define BIOS_ROM_END        0x100000
+#define IDENTITY_MAP_END    0x400000    // the tables are read in place, they must be in the identity mapped first 4mb
+
+// configuration table entry types, a processor entry is 20 bytes, the others 8
+#define MP_ENTRY_PROCESSOR      0
+#define MP_ENTRY_BUS            1
+#define MP_ENTRY_IO_APIC        2
+#define MP_ENTRY_IO_INTERRUPT   3
+
+#define MP_PROCESSOR_ENABLED    0x01
+#define MP_IO_APIC_ENABLED      0x01
+#define MP_INTERRUPT_INT        0       // vectored interrupt, the others are nmi, smi and extint
+
+#define MPS_POLARITY_MASK       0x03
+#define MPS_POLARITY_ACTIVE_LOW 0x03
+#define MPS_TRIGGER_MASK        0x0C
+#define MPS_TRIGGER_LEVEL       0x0C
+
+#define MP_MAX_BUSES            32
+
+typedef struct mp_floating
+{
+    char signature[4];      // "_MP_"
+    uint32_t configTable;   // 0 for a default configuration, not supported
+    uint8_t length;         // in 16 bytes units
+    uint8_t revision;
+    uint8_t checksum;
+    uint8_t features[5];
+} __attribute__((packed)) mp_floating_t;
+
+typedef struct mp_config
+{
+    char signature[4];      // "PCMP"
+    uint16_t length;        // base table, header included
+    uint8_t revision;
+    uint8_t checksum;
+    char oemId[8];
+    char productId[12];
+    uint32_t oemTable;
+    uint16_t oemTableSize;
+    uint16_t entryCount;
+    uint32_t lapicAddress;
+    uint16_t extendedLength;
+    uint8_t extendedChecksum;
+    uint8_t reserved;
+} __attribute__((packed)) mp_config_t;
+
+typedef struct mp_processor
+{
+    uint8_t type;
+    uint8_t apicId;
+    uint8_t apicVersion;
+    uint8_t flags;
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+} __attribute__((packed)) mp_processor_t;
+
+typedef struct mp_bus
+{
+    uint8_t type;
+    uint8_t id;
+    char name[6];           // "ISA   ", "PCI   "...
+} __attribute__((packed)) mp_bus_t;
+
+typedef struct mp_io_apic
+{
+    uint8_t type;
+    uint8_t id;
+    uint8_t version;
+    uint8_t flags;
+    uint32_t address;
+} __attribute__((packed)) mp_io_apic_t;
+
+typedef struct mp_interrupt
+{
+    uint8_t type;
+    uint8_t interruptType;
+    uint16_t flags;
+    uint8_t sourceBus;
+    uint8_t sourceIrq;
+    uint8_t ioapicId;
+    uint8_t ioapicInput;
+} __attribute__((packed)) mp_interrupt_t;
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE FUNCTIONS
+//============================================================================
+
+static bool MP_checksum(const void* data, uint32_t length)
+{
+    uint8_t sum = 0;
+
+    for(uint32_t i = 0; i < length; i++)
+        sum += ((const uint8_t*)data)[i];
+
+    return sum == 0;
+}
+
+static mp_floating_t* MP_search(uint32_t start, uint32_t end)
+{
+    for(uint32_t addr = start; addr + sizeof(mp_floating_t) <= end; addr += 16)
+    {
+        mp_floating_t* mp = (mp_floating_t*)addr;
+
+        if(memcmp(mp->signature, "_MP_", 4) == 0 && MP_checksum(mp, mp->length * 16))
+            return mp;
+    }
+
+    return NULL;
+}
+
+// first kb of the ebda, last kb of the base memory, then the bios rom
+static mp_floating_t* MP_findFloating()
+{
+    uint32_t ebda = (uint32_t)(*(uint16_t*)EBDA_SEGMENT_PTR) << 4;
+    mp_floating_t* mp = NULL;
+
+    if(ebda != 0)
+        mp = MP_search(ebda, ebda + 0x400);
+    if(mp == NULL)
+        mp = MP_search(BASE_MEMORY_END - 0x400, BASE_MEMORY_END);
+    if(mp == NULL)
+        mp = MP_search(BIOS_ROM_START, BIOS_ROM_END);
+
+    return mp;
+}
+
+//============================================================================
+//    INTERFACE FUNCTIONS
+//============================================================================
+
+/*
+ * fill the topology from the MP configuration table, for machines without a MADT.
+ * the isa interrupts assigned to the io apic become the routes. returns false without a usable table
+*/
+bool MP_findApics(apic_topology_t* topology)
+{
+    mp_floating_t* mp = MP_findFloating();
+    if(mp == NULL || mp->configTable == 0 || mp->configTable >= IDENTITY_MAP_END)
+        return false;
+
+    mp_config_t* config = (mp_config_t*)mp->configTable;
+    if(memcmp(config->signature, "PCMP", 4) != 0 || !MP_checksum(config, config->length))
+        return false;
+
+    APIC_defaultTopology(topology);
+    topology->source = "mp";
+    topology->lapicPhys = config->lapicAddress;
+
+    bool isaBus[MP_MAX_BUSES] = {false};
+    uint8_t* entry = (uint8_t*)config + sizeof(mp_config_t);
+    uint8_t* end = (uint8_t*)config + config->length;
+
+    for(uint32_t i = 0; i < config->entryCount && entry < end; i++)
+    {
+        switch (*entry)
+        {
+        case MP_ENTRY_PROCESSOR:
+        {
+            mp_processor_t* cpu = (mp_processor_t*)entry;
+
+            if((cpu->flags & MP_PROCESSOR_ENABLED) && topology->cpuCount < APIC_MAX_CPUS)
+                topology->cpuApicIds[topology->cpuCount++] = cpu->apicId;
+
+            entry += sizeof(mp_processor_t);
+            continue;
+        }
+        case MP_ENTRY_BUS:
+        {
+            mp_bus_t* bus = (mp_bus_t*)entry;
+
+            if(bus->id < MP_MAX_BUSES)
+                isaBus[bus->id] = memcmp(bus->name, "ISA", 3) == 0;
+            break;
+        }
+        case MP_ENTRY_IO_APIC:
+        {
+            mp_io_apic_t* ioapic = (mp_io_apic_t*)entry;
+
+            if((ioapic->flags & MP_IO_APIC_ENABLED) && topology->ioapicPhys == 0)
+            {
+                topology->ioapicPhys = ioapic->address;
+                topology->ioapicId = ioapic->id;
+            }
+            break;
+        }
+        case MP_ENTRY_IO_INTERRUPT:
+        {
+            mp_interrupt_t* irq = (mp_interrupt_t*)entry;
+
+            // buses come first in the table, so the bus of the interrupt is known here
+            if(irq->interruptType == MP_INTERRUPT_INT && irq->sourceBus < MP_MAX_BUSES && isaBus[irq->sourceBus] && irq->sourceIrq < APIC_ISA_IRQS)
+            {
+                apic_irq_route_t* route = &topology->isaRoutes[irq->sourceIrq];
+
+                route->gsi = irq->ioapicInput;
+                route->activeLow = (irq->flags & MPS_POLARITY_MASK) == MPS_POLARITY_ACTIVE_LOW;
+                route->levelTriggered = (irq->flags & MPS_TRIGGER_MASK) == MPS_TRIGGER_LEVEL;
+            }
+            break;
+        }
+        }
+
+        entry += 8;
+    }
+
+    return topology->ioapicPhys != 0 && topology->cpuCount > 0;
+}
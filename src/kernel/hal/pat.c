@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2025,  Novice
+ *
+ * This file is part of the Novix software.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <hal/pat.h>
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
+//============================================================================
+
+#define IA32_PAT_MSR    0x277
+
+// memory type encodings used in the PAT msr
+#define PAT_UC      0x00
+#define PAT_WC      0x01
+#define PAT_WT      0x04
+#define PAT_WB      0x06
+#define PAT_UCMINUS 0x07
+
+// a page table entry selects one of the 8 PAT entries with its PWT, PCD and PAT bits
+#define PTE_PWT         0x08
+#define PTE_PCD         0x10
+#define PTE_PAT         0x80
+#define PDE_LARGE_PAT   0x1000  // the PAT bit of a 4mb page is bit 12 (bit 7 is the page size)
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE DATA
+//============================================================================
+
+bool PAT_supported = false;
+
+/*
+ * PA0-PA3 keep their power on value except PA1 (write through -> write combining),
+ * write through moves to PA5. A mapping without PWT/PCD/PAT stays write back
+*/
+static const uint8_t PAT_entries[8] = {PAT_WB, PAT_WC, PAT_UCMINUS, PAT_UC, PAT_WB, PAT_WT, PAT_UCMINUS, PAT_UC};
+
+// page table bits for each type, with our PAT layout and with the power on one
+static const uint32_t PAT_flags[PAT_TYPE_COUNT] =
+{
+    [PAT_WRITE_BACK]        = 0,
+    [PAT_WRITE_COMBINING]   = PTE_PWT,
+    [PAT_WRITE_THROUGH]     = PTE_PAT | PTE_PWT,
+    [PAT_UNCACHED_MINUS]    = PTE_PCD,
+    [PAT_UNCACHED]          = PTE_PCD | PTE_PWT,
+};
+
+// without PAT write combining isn't available, write through is the closest thing
+static const uint32_t PAT_defaultFlags[PAT_TYPE_COUNT] =
+{
+    [PAT_WRITE_BACK]        = 0,
+    [PAT_WRITE_COMBINING]   = PTE_PWT,
+    [PAT_WRITE_THROUGH]     = PTE_PWT,
+    [PAT_UNCACHED_MINUS]    = PTE_PCD,
+    [PAT_UNCACHED]          = PTE_PCD | PTE_PWT,
+};
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE FUNCTIONS
+//============================================================================
+
+static void PAT_writeMsr(uint32_t msr, uint64_t value)
+{
+    __asm__ volatile("wrmsr" :: "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+//============================================================================
+//    INTERFACE FUNCTIONS
+//============================================================================
+
+/*
+ * program the PAT msr, must run before anything is mapped with another type than write back.
+ * returns false if the cpu doesn't have PAT (cpuid.1:edx bit 16)
+*/
+bool PAT_initialize()
+{
+    uint32_t eax = 1, ebx, ecx = 0, edx;
+    __asm__ volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+
+    if(!(edx & (1 << 16)))
+        return false;
+
+    uint64_t value = 0;
+    for(int i = 0; i < 8; i++)
+        value |= (uint64_t)PAT_entries[i] << (i * 8);
+
+    // the caches and the tlb may hold lines of the old types
+    __asm__ volatile("wbinvd" ::: "memory");
+    PAT_writeMsr(IA32_PAT_MSR, value);
+    __asm__ volatile("wbinvd; mov %%cr3, %%eax; mov %%eax, %%cr3" ::: "eax", "memory");
+
+    PAT_supported = true;
+    return true;
+}
+
+bool PAT_isSupported()
+{
+    return PAT_supported;
+}
+
+// PWT/PCD/PAT bits of a 4kb page table entry
+uint32_t PAT_getPteFlags(pat_type_t type)
+{
+    if(type >= PAT_TYPE_COUNT)
+        type = PAT_UNCACHED;
+
+    return PAT_supported ? PAT_flags[type] : PAT_defaultFlags[type];
+}
+
+// same for a 4mb page directory entry
+uint32_t PAT_getLargePageFlags(pat_type_t type)
+{
+    uint32_t flags = PAT_getPteFlags(type);
+
+    if(flags & PTE_PAT)
+        flags = (flags & ~PTE_PAT) | PDE_LARGE_PAT;
+
+    return flags;
+}
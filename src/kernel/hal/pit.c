@@ -29,7 +29,14 @@
 #define COUNTER2_PORT       0X42
 #define CW_PORT             0X43
 
-#define FREQUENCY   1000
+#define FREQUENCY           1000
+#define INPUT_FREQUENCY     1193182     // hz, the counters are decremented at this rate
+
+// read back command: latches the status and the count of the selected counters
+#define PIT_READBACK            0XC0
+#define PIT_READBACK_COUNTER0   0X02
+#define PIT_STATUS_OUTPUT       0X80    // state of the output pin, high once a mode 0 count reached 0
+#define PIT_STATUS_NULL_COUNT   0X40    // the new count isn't loaded in the counter yet
 
 typedef enum{
     PIT_ICW_BINARYCODED_DECIMAL = 0X01,
@@ -51,6 +58,58 @@ typedef enum{
     PIT_ICW_COUNTER2            = 0X80,
 }PIT_ICW_BYTE;
 
+//============================================================================
+//    IMPLEMENTATION PRIVATE DATA
+//============================================================================
+
+uint16_t PIT_oneShotCount;  // count of the running one shot
+
+static void PIT_program(uint32_t delta);
+static uint32_t PIT_elapsed();
+
+clock_event_t PIT_clockEvent = {
+    .name = "pit",
+    .frequency = INPUT_FREQUENCY,
+    .minDelta = 1,
+    .maxDelta = 0xFFFF,
+    .program = PIT_program,
+    .elapsed = PIT_elapsed,
+};
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE FUNCTIONS
+//============================================================================
+
+// mode 0: irq0 fires once, when the count reaches 0, and the output stays high until the next program
+static void PIT_program(uint32_t delta)
+{
+    if(delta > 0xFFFF)  delta = 0xFFFF;
+    if(delta == 0)      delta = 1;
+
+    PIT_oneShotCount = delta;
+
+    outb(CW_PORT, PIT_ICW_MODE0 | PIT_ICW_RL_LSB_MSB | PIT_ICW_COUNTER0);
+    outb(COUNTER0_PORT, (uint8_t)(delta & 0xFF));
+    outb(COUNTER0_PORT, (uint8_t)((delta >> 8) & 0xFF));
+}
+
+static uint32_t PIT_elapsed()
+{
+    outb(CW_PORT, PIT_READBACK | PIT_READBACK_COUNTER0);
+
+    uint8_t status = inb(COUNTER0_PORT);
+    uint16_t count = inb(COUNTER0_PORT);
+    count |= inb(COUNTER0_PORT) << 8;
+
+    if(status & PIT_STATUS_OUTPUT)
+        return PIT_oneShotCount;    // it fired, the counter wrapped around since
+
+    if((status & PIT_STATUS_NULL_COUNT) || count > PIT_oneShotCount)
+        return 0;
+
+    return PIT_oneShotCount - count;
+}
+
 //============================================================================
 //    INTERFACE FUNCTIONS
 //============================================================================
@@ -74,3 +133,8 @@ void PIT_initialize()
     * configuring COUNTER 2 for PC speaker
     */
 }
+
+clock_event_t* PIT_getClockEvent()
+{
+    return &PIT_clockEvent;
+}
@@ -20,6 +20,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <list.h>
 
 #define MAX_NAME_LENGTH 64
@@ -33,10 +34,17 @@ typedef struct device
 	int64_t (*write)(const uint8_t *buffer, int64_t offset, size_t len, void* priv, uint32_t flags);
 	int (*ioctl)(int request, void* arg);
 
+	uint32_t blockSize;	// bytes per block (offsets and lengths are in blocks), 0 for the other devices
+
 	void *priv;	// private data of the device ...
 } device_t;
 
 void init_device_manager();
 void add_device(device_t* dev);
 device_t* lookup_device(const char* name);
-int get_device_list(char* buff, uint32_t count);
\ No newline at end of file
+int get_device_list(char* buff, uint32_t count);
+
+// fills the record at index, false once there are no more records
+typedef bool (*device_record_t)(uint32_t index, void* record);
+
+device_t* add_record_device(const char* name, device_record_t record, uint32_t recordSize);
\ No newline at end of file
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2025,  Novice
+ *
+ * This file is part of the Novix software.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <hal/clock_event.h>
+
+//============================================================================
+//    INTERFACE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
+//============================================================================
+
+#define APIC_MAX_CPUS           16
+#define APIC_ISA_IRQS           16
+
+// in the page table of the temporary mapping, which every address space shares
+#define LAPIC_VIRT_ADDR         0xFFBFD000
+#define IOAPIC_VIRT_ADDR        0xFFBFE000
+
+#define APIC_IRQ_VECTOR_BASE    0x20    // isa irq n keeps the vector it had behind the PIC
+#define APIC_RESCHEDULE_VECTOR  0xFD    // ipi: a task was made ready for this cpu
+#define APIC_SHOOTDOWN_VECTOR   0xFE    // ipi: flush the tlb entries given in SMP_shootdown()
+#define APIC_SPURIOUS_VECTOR    0xFF
+
+// how an isa irq reaches the io apic (identity, unless an interrupt source override says otherwise)
+typedef struct apic_irq_route
+{
+    uint32_t gsi;           // global system interrupt, the io apic input
+    bool activeLow;
+    bool levelTriggered;
+}apic_irq_route_t;
+
+// what the ACPI or MP tables tell about the interrupt controllers
+typedef struct apic_topology
+{
+    const char* source;     // tables it comes from
+    uint32_t lapicPhys;     // local apic registers
+    uint32_t ioapicPhys;    // io apic registers (the one handling gsi 0)
+    uint8_t ioapicId;
+    uint32_t ioapicGsiBase;
+    uint32_t cpuCount;      // enabled processors
+    uint8_t cpuApicIds[APIC_MAX_CPUS];
+    apic_irq_route_t isaRoutes[APIC_ISA_IRQS];
+}apic_topology_t;
+
+//============================================================================
+//    INTERFACE FUNCTION PROTOTYPES
+//============================================================================
+
+bool APIC_isSupported();
+void APIC_defaultTopology(apic_topology_t* topology);
+bool APIC_initialize(const apic_topology_t* topology);
+void APIC_initializeCpu();
+bool APIC_isEnabled();
+const apic_topology_t* APIC_getTopology();
+
+uint32_t APIC_getId();
+void APIC_sendEndOfInterrupt();
+void APIC_sendIpi(uint32_t apicId, uint8_t vector);
+void APIC_sendInit(uint32_t apicId);
+void APIC_sendStartup(uint32_t apicId, uint8_t page);
+uint32_t APIC_getTscKhz();
+bool APIC_hasInvariantTsc();
+void APIC_mask(int irq);
+void APIC_unMask(int irq);
+clock_event_t* APIC_getClockEvent();
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2025,  Novice
+ *
+ * This file is part of the Novix software.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+//============================================================================
+//    INTERFACE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
+//============================================================================
+
+/*
+ * a timer programmed for one interrupt at a time. The kernel keeps time by adding up
+ * what elapsed() returns, so a device only has to count from the last program() call
+*/
+typedef struct clock_event
+{
+    const char* name;
+    uint32_t frequency;                 // input clock, in hz
+    uint32_t minDelta;                  // shortest delay it can be programmed for, in clock ticks
+    uint32_t maxDelta;                  // longest delay, in clock ticks
+
+    void (*program)(uint32_t delta);    // one interrupt in delta clock ticks (the caller disables interrupts)
+    uint32_t (*elapsed)();              // clock ticks since the last program(), delta once the interrupt fired
+}clock_event_t;
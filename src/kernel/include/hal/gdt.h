@@ -19,10 +19,24 @@
 
 #pragma once
 #include <stdint.h>
+#include <hal/isr.h>
+
+//============================================================================
+//    INTERFACE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
+//============================================================================
+
+#define GDT_TSS_INDEX                   5
+#define GDT_DOUBLE_FAULT_INDEX          6
+#define GDT_MAX_CPUS                    16  // two tss each: the kernel stack and the double fault task
 
 //============================================================================
 //    INTERFACE FUNCTION PROTOTYPES
 //============================================================================
 
 void GDT_initialize();
-void TSS_setKernelStack(uint32_t esp0);
\ No newline at end of file
+void GDT_initializeCpu(uint32_t cpu);
+uint32_t GDT_getCpu();
+uint16_t GDT_doubleFaultSelector(uint32_t cpu);
+void TSS_setKernelStack(uint32_t cpu, uint32_t esp0);
+void TSS_setDoubleFaultTask(uint32_t cpu, void* entry, void* stackTop, uint32_t cr3);
+void TSS_getInterruptedState(Registers* regs);
\ No newline at end of file
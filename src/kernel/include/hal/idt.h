@@ -44,4 +44,5 @@ typedef enum{
 //============================================================================
 
 void IDT_initialize();
-void IDT_setGate(int interrupt, void* offset, uint8_t attribute);
\ No newline at end of file
+void IDT_setGate(int interrupt, void* offset, uint8_t attribute);
+void IDT_setTaskGate(uint32_t cpu, int interrupt, uint16_t tss_selector);
\ No newline at end of file
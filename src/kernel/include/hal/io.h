@@ -32,6 +32,7 @@ void __attribute__((cdecl)) outw(uint16_t port, uint16_t value);
 uint16_t __attribute__((cdecl)) inw(uint16_t port);
 void __attribute__((cdecl)) panic();
 void __attribute__((cdecl)) HLT();
+void __attribute__((cdecl)) enableInterruptsAndHalt();
 void __attribute__((cdecl)) enableInterrupts();
 void __attribute__((cdecl)) disableInterrupts();
 uint32_t __attribute__((cdecl)) get_eflags();
\ No newline at end of file
@@ -18,7 +18,9 @@
 */
 
 #pragma once
+#include <stdbool.h>
 #include <hal/isr.h>
+#include <hal/clock_event.h>
 
 //============================================================================
 //    INTERFACE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
@@ -31,4 +33,8 @@ typedef void (*IRQHandler) (Registers* regs);
 //============================================================================
 
 void IRQ_initialize();
-void IRQ_registerNewHandler(int irq, IRQHandler handler);
\ No newline at end of file
+void IRQ_registerNewHandler(int irq, IRQHandler handler);
+bool IRQ_enableApic();
+bool IRQ_isApicEnabled();
+void IRQ_sendEndOfInterrupt(int irq);
+clock_event_t* IRQ_getClockEvent();
\ No newline at end of file
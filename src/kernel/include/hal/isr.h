@@ -40,4 +40,6 @@ typedef void (*ISRHandler) (Registers* regs);
 //============================================================================
 
 void ISR_initialize();
-void ISR_registerNewHandler(int interrupt, ISRHandler handler);
\ No newline at end of file
+void ISR_registerNewHandler(int interrupt, ISRHandler handler);
+uint32_t ISR_getFaultAddress();
+void ISR_panic(Registers* regs);
\ No newline at end of file
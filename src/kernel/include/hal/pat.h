@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2025,  Novice
+ *
+ * This file is part of the Novix software.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+//============================================================================
+//    INTERFACE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
+//============================================================================
+
+// memory types a mapping can ask for, the page table bits come from PAT_getPteFlags()
+typedef enum {
+    PAT_WRITE_BACK,         // normal memory
+    PAT_WRITE_COMBINING,    // stores are buffered and sent in bursts (framebuffers)
+    PAT_WRITE_THROUGH,
+    PAT_UNCACHED_MINUS,     // uncached, but the MTRRs may still ask for write combining
+    PAT_UNCACHED,           // memory mapped registers
+    PAT_TYPE_COUNT,
+}pat_type_t;
+
+//============================================================================
+//    INTERFACE FUNCTION PROTOTYPES
+//============================================================================
+
+bool PAT_initialize();
+bool PAT_isSupported();
+uint32_t PAT_getPteFlags(pat_type_t type);
+uint32_t PAT_getLargePageFlags(pat_type_t type);
@@ -20,9 +20,11 @@
 #pragma once
 #include <stdbool.h>
 #include <stdint.h>
+#include <hal/clock_event.h>
 
 //============================================================================
 //    INTERFACE FUNCTION PROTOTYPES
 //============================================================================
 
-void PIT_initialize();
\ No newline at end of file
+void PIT_initialize();
+clock_event_t* PIT_getClockEvent();
\ No newline at end of file
@@ -19,9 +19,29 @@
 
 #pragma once
 
+#include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
 
+//============================================================================
+//    INTERFACE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
+//============================================================================
+
+#define HEAP_START_ADDR 0xD0000000
+#define HEAP_END_ADDR   0xD7FFFFFF
+
+// uncomment (or build with -DHEAP_DEBUG) to get red zones, poisoning of freed blocks and per call site accounting
+// #define HEAP_DEBUG
+
+#ifdef HEAP_DEBUG
+typedef struct heap_site_stats
+{
+    uint32_t caller;    // return address of the kmalloc call
+    uint32_t blocks;    // live blocks allocated from there
+    uint32_t bytes;     // bytes asked for by those blocks
+}heap_site_stats_t;
+#endif
+
 //============================================================================
 //    INTERFACE FUNCTION PROTOTYPES
 //============================================================================
@@ -30,4 +50,11 @@ bool HEAP_initialize();
 void* kmalloc(size_t size);
 void* krealloc(void* block, size_t size);
 void* kcalloc(size_t num, size_t size);
-void kfree(void* block);
\ No newline at end of file
+void kfree(void* block);
+
+#ifdef HEAP_DEBUG
+uint32_t HEAP_check();
+uint32_t HEAP_getSites(heap_site_stats_t* sites, uint32_t count);
+void HEAP_dumpLeaks();
+void HEAP_createDevice();
+#endif
\ No newline at end of file
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2025,  Novice
+ *
+ * This file is part of the Novix software.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//============================================================================
+//    INTERFACE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
+//============================================================================
+
+#define KSTACK_PAGES        2   // 2 (8kb) or 4 (16kb)
+#define KSTACK_SIZE         (KSTACK_PAGES * 0x1000)
+
+#define KSTACK_PREALLOCATED 8   // stacks mapped at boot
+#define KSTACK_CACHE_MAX    32  // free stacks kept mapped for the next processes
+
+//============================================================================
+//    INTERFACE FUNCTION PROTOTYPES
+//============================================================================
+
+bool KSTACK_initialize();
+void* KSTACK_alloc();
+void KSTACK_free(void* stack);
+bool KSTACK_reportGuardFault(uint32_t address);
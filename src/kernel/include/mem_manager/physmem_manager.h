@@ -21,12 +21,78 @@
 #include <boot_info.h>
 #include <stdbool.h>
 
+//============================================================================
+//    INTERFACE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
+//============================================================================
+
+#define PHYSMEM_MAX_ORDER 15    // biggest buddy block is 2^15 blocks (128mb)
+#define PHYSMEM_ZERO_POOL_SIZE 256  // pre-zeroed blocks kept by the idle task (1mb)
+
+#define PHYSMEM_FRAMES_ADDR     0xCF000000  // the buddy frame array is mapped here, just below the heap
+#define PHYSMEM_FRAMES_MAX_SIZE 0x1000000   // 16mb, enough for the 4gb we can address
+
+// who asked for the memory, only used for statistics
+typedef enum {
+    PHYSMEM_USER_KERNEL,        // anything not listed below
+    PHYSMEM_USER_HEAP,          // kmalloc heap pages
+    PHYSMEM_USER_VMALLOC,       // vmalloc pages (kernel stacks, page directories...)
+    PHYSMEM_USER_PAGE_TABLE,    // page tables and the boot page directory
+    PHYSMEM_USER_SHM,           // shared memory objects
+    PHYSMEM_USER_PROCESS,       // user space pages (code, heap, stack)
+    PHYSMEM_USER_ZERO_POOL,     // pre-zeroed blocks waiting in the pool
+    PHYSMEM_USER_PAGE_CACHE,    // file data kept by the page cache
+    PHYSMEM_USER_COUNT,
+}physmem_user_t;
+
+typedef struct physmem_stats
+{
+    uint32_t totalBlocks;
+    uint32_t freeBlocks;
+    uint32_t usedBlocks;
+
+    uint32_t largestFreeRun;                        // biggest run of contiguous free blocks
+    uint32_t freeBuddyBlocks[PHYSMEM_MAX_ORDER + 1];// free buddy blocks of each order
+    uint32_t freeRuns[PHYSMEM_MAX_ORDER + 1];       // free runs of [2^i, 2^(i+1)) blocks (the last one holds everything bigger)
+
+    uint32_t allocCalls[PHYSMEM_USER_COUNT];
+    uint32_t freeCalls[PHYSMEM_USER_COUNT];
+    uint32_t blocksInUse[PHYSMEM_USER_COUNT];
+    uint32_t failedAllocs;
+
+    uint32_t zeroPoolCount;     // blocks currently waiting in the pool
+    uint32_t zeroPoolHits;      // zeroed allocations served by the pool
+    uint32_t zeroPoolMisses;    // zeroed allocations that had to clear the block
+}physmem_stats_t;
+
+// called when an allocation fails, returns how many blocks it gave back
+typedef uint32_t (*physmem_reclaim_t)(uint32_t blocks);
+
+#define PHYSMEM_MAX_RECLAIM_HANDLERS 4
+
 //============================================================================
 //    INTERFACE FUNCTION PROTOTYPES
 //============================================================================
 
 bool PHYSMEM_initialize(Boot_info* info, uint32_t kernel_size);
+void PHYSMEM_mapFrames(uint32_t* page_directory);
 void PHYSMEM_freeBlock(void* ptr);
 void* PHYSMEM_AllocBlock();
 void* PHYSMEM_AllocBlocks(uint32_t blocks);
-void PHYSMEM_freeBlocks(void* ptr, uint32_t size);
\ No newline at end of file
+void PHYSMEM_freeBlocks(void* ptr, uint32_t size);
+void* PHYSMEM_AllocBlocksFor(uint32_t blocks, physmem_user_t user);
+bool PHYSMEM_AllocBlockList(void** blocks, uint32_t count, physmem_user_t user);
+void PHYSMEM_freeBlocksFor(void* ptr, uint32_t size, physmem_user_t user);
+void PHYSMEM_freeBlockList(void** blocks, uint32_t count, physmem_user_t user);
+void* PHYSMEM_AllocZeroedBlock();
+void* PHYSMEM_AllocZeroedBlockFor(physmem_user_t user);
+bool PHYSMEM_shareBlock(void* ptr);
+uint32_t PHYSMEM_getRefCount(void* ptr);
+bool PHYSMEM_refillZeroPool();
+uint32_t PHYSMEM_getFreeBlocks();
+void PHYSMEM_addReclaimHandler(physmem_reclaim_t handler);
+uint32_t PHYSMEM_shrinkCaches(uint32_t blocks);
+bool PHYSMEM_selfTest();
+
+void PHYSMEM_getStats(physmem_stats_t* stats);
+void PHYSMEM_dumpStats();
+void PHYSMEM_createDevice();
\ No newline at end of file
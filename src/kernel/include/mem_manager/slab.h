@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2025,  Novice
+ *
+ * This file is part of the Novix software.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+//============================================================================
+//    INTERFACE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
+//============================================================================
+
+#define KMEM_CACHE_NAME_LENGTH 32
+
+typedef struct kmem_cache kmem_cache_t;
+
+// called once for every object when a new slab is created,
+// objects must be given back to the cache in their constructed state
+typedef void (*kmem_ctor_t)(void* obj);
+
+typedef struct kmem_cache_stats
+{
+    char name[KMEM_CACHE_NAME_LENGTH];
+    uint32_t objectSize;        // including alignment
+    uint32_t objectsPerSlab;
+    uint32_t slabPages;         // 4kb pages per slab
+
+    uint32_t activeObjects;     // objects currently allocated
+    uint32_t totalObjects;      // objects in all the slabs of the cache
+    uint32_t totalSlabs;
+    uint32_t emptySlabs;        // slabs kept around for the next allocations
+
+    uint32_t allocCalls;
+    uint32_t freeCalls;
+    uint32_t slabsCreated;
+    uint32_t slabsReclaimed;    // empty slabs given back to vmalloc
+}kmem_cache_stats_t;
+
+//============================================================================
+//    INTERFACE FUNCTION PROTOTYPES
+//============================================================================
+
+bool SLAB_initialize();
+
+kmem_cache_t* kmem_cache_create(const char* name, size_t size, kmem_ctor_t ctor);
+void kmem_cache_destroy(kmem_cache_t* cache);
+void* kmem_cache_alloc(kmem_cache_t* cache);
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+uint32_t kmem_cache_shrink(kmem_cache_t* cache);
+
+uint32_t SLAB_reclaim();
+bool SLAB_getCacheStats(uint32_t index, kmem_cache_stats_t* stats);
+void SLAB_createDevice();
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2025,  Novice
+ *
+ * This file is part of the Novix software.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//============================================================================
+//    INTERFACE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
+//============================================================================
+
+#define SWAP_FILE_PATH      "/swap.sys"     // preallocated by make_disk.sh
+#define SWAP_MAX_SLOTS      0x8000          // 128mb of swap at most
+
+#define SWAP_LOW_WATERMARK  256     // free blocks (1mb) below which the reclaim task starts
+#define SWAP_HIGH_WATERMARK 512     // free blocks it tries to get back to
+#define SWAP_PERIOD         100     // ms between two checks of the free memory
+#define SWAP_FAULT_ATTEMPTS 10      // periods a page fault waits for memory before giving up
+
+typedef struct swap_stats
+{
+    uint32_t totalSlots;    // pages the swap file can hold
+    uint32_t usedSlots;
+    uint32_t pagesOut;      // pages written to the swap file
+    uint32_t pagesIn;       // pages read back
+} swap_stats_t;
+
+//============================================================================
+//    INTERFACE FUNCTION PROTOTYPES
+//============================================================================
+
+bool SWAP_initialize(const char* path);
+bool SWAP_canPageOut();
+bool SWAP_pageOut(uint32_t id, uint32_t* hand);
+bool SWAP_pageIn(void* virt, uint32_t slot);
+
+void SWAP_duplicateSlot(uint32_t slot);
+void SWAP_freeSlot(uint32_t slot);
+
+void SWAP_getStats(swap_stats_t* stats);
+void SWAP_createDevice();
@@ -21,6 +21,8 @@
 #pragma once
 #include <stdint.h>
 #include <stdbool.h>
+#include <mem_manager/physmem_manager.h>
+#include <hal/pat.h>
 
 //============================================================================
 //    INTERFACE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
@@ -29,11 +31,23 @@
 typedef uint32_t PDE;
 typedef uint32_t PTE;
 
+#define LARGE_PAGE_SIZE 0x400000    // a 4mb page covers a whole page table
+
+#define VIRTMEM_FLUSH_THRESHOLD 32  // above this many pages, flushing the whole tlb is cheaper than invlpg
+#define VIRTMEM_RANGE_BATCH     64  // frames allocated or freed per call to the physical memory manager
+
+#define PTE_SWAP_SLOT(entry)    ((entry) >> 12)
+
 typedef enum {
     PTE_PAGE_PRESENT        = 0X1,
     PTE_PAGE_WRITE          = 0X2,
     PTE_PAGE_KERNEL_MODE    = 0X0,
     PTE_PAGE_USER_MODE      = 0X4,
+    PTE_PAGE_ACCESSED       = 0X20,     // set by the cpu on every access
+    PTE_PAGE_GLOBAL         = 0X100,    // kept in the tlb across cr3 reloads (needs CR4.PGE)
+    PTE_PAGE_COW            = 0X200,    // available bit: read-only until written, then copied
+    PTE_PAGE_SHARED         = 0X400,    // available bit: the frame isn't owned by this mapping (shm, framebuffer)
+    PTE_PAGE_SWAPPED        = 0X800,    // available bit, page not present: it's in the swap file, the address bits hold the slot
 }PTE_FLAGS;
 
 typedef enum {
@@ -60,16 +74,41 @@ bool VIRTMEM_unMapTable(void* virt);
 bool VIRTMEM_mapPage (void* virt, bool kernel_mode);
 bool VIRTMEM_unMapPage (void* virt);
 
-bool VIRTMEM_mapPageCustom (void* phys, void* virt, bool kernel_mode);
+bool VIRTMEM_mapPageCustom (void* phys, void* virt, bool kernel_mode, pat_type_t cache);
 void* VIRTMEM_unMapPageCustom (void* virt);
 
-void VIRTMEM_freePage(PTE* entry);
-bool VIRTMEM_allocPage(PTE* entry, uint32_t flags);
+bool VIRTMEM_mapLargePage (void* phys, void* virt, bool kernel_mode, pat_type_t cache);
+
+bool VIRTMEM_protectPage (void* virt, bool writable);
+bool VIRTMEM_mapFrame (void* phys, void* virt, bool kernel_mode, bool copy_on_write);
+
+bool VIRTMEM_mapRange (void* virt, uint32_t pages, bool kernel_mode);
+bool VIRTMEM_mapRangeCustom (void* phys, void* virt, uint32_t pages, bool kernel_mode, pat_type_t cache);
+void VIRTMEM_unmapRange (void* virt, uint32_t pages);
+
+void VIRTMEM_freePage(PTE* entry, physmem_user_t user);
+bool VIRTMEM_allocPage(PTE* entry, uint32_t flags, physmem_user_t user);
+void VIRTMEM_clearFrame(void* phys);
+void VIRTMEM_copyToFrame(void* phys, const void* src);
+void VIRTMEM_copyFromFrame(void* dst, void* phys);
+void VIRTMEM_copyFromFramePart(void* dst, void* phys, uint32_t offset, uint32_t size);
 
 uint32_t* VIRTMEM_createAddressSpace();
 void VIRTMEM_destroyAddressSpace(PDE* page_directory);
+uint32_t* VIRTMEM_cloneAddressSpace();
+bool VIRTMEM_handleCowFault(void* virt);
+
+void VIRTMEM_lockAddressSpaces();
+void VIRTMEM_unlockAddressSpaces();
+void* VIRTMEM_pageOut(PDE* page_directory, uint32_t* hand, uint32_t slot);
+bool VIRTMEM_getSwapSlot(void* virt, uint32_t* slot);
+bool VIRTMEM_pageIn(void* virt, void* frame);
 
 void __attribute__((cdecl)) enablePaging();
+bool __attribute__((cdecl)) enableGlobalPages();
+bool __attribute__((cdecl)) enableLargePages();
 void __attribute__((cdecl)) flushTLB(uint32_t* virtual_addr);
+void __attribute__((cdecl)) flushTLBRange(void* virtual_addr, uint32_t pages);
+void __attribute__((cdecl)) flushTLBAll();
 void* __attribute__((cdecl)) getPDBR();
 void __attribute__((cdecl)) switchPDBR(uint32_t* physical_addr);
\ No newline at end of file
@@ -17,12 +17,47 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#pragma once
 #include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+//============================================================================
+//    INTERFACE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
+//============================================================================
+
+#define VMALLOC_START  0xD8000000
+#define VMALLOC_END    0xDFFFFFFF
+
+// unmapped pages reserved around an allocation
+#define VMALLOC_GUARD_LOW   (1 << 0)    // one guard page below the allocation
+#define VMALLOC_GUARD_HIGH  (1 << 1)    // one guard page above the allocation
+
+typedef struct vmalloc_stats
+{
+    uint32_t totalPages;
+    uint32_t usedPages;     // mapped pages
+    uint32_t guardPages;    // reserved but never mapped
+    uint32_t freePages;
+    uint32_t largestFree;   // biggest free range in pages
+
+    uint32_t usedRanges;
+    uint32_t freeRanges;
+
+    uint32_t allocCalls;
+    uint32_t freeCalls;
+    uint32_t failedAllocs;
+}vmalloc_stats_t;
 
 //============================================================================
 //    INTERFACE FUNCTION PROTOTYPES
 //============================================================================
 
 bool VMALLOC_initialize();
+void* VMALLOC_allocate(size_t size, uint32_t flags);
 void* vmalloc(size_t size);
-void vfree(void* ptr);
\ No newline at end of file
+void vfree(void* ptr);
+
+void VMALLOC_getStats(vmalloc_stats_t* stats);
+void VMALLOC_dumpStats();
+void VMALLOC_createDevice();
\ No newline at end of file
@@ -24,6 +24,8 @@
 
 #define MAX_MESSAGE_SIZE 1024
 
+void message_init();
+
 int send_msg(uint32_t receiver_id, void* data, size_t size);
 void receive_msg(void* dataOut, size_t *size);
 bool receive_async_msg(void* dataOut, size_t *size);
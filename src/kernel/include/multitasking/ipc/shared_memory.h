@@ -25,4 +25,5 @@ void shared_memory_init();
 uint64_t shared_memory_create(uint32_t length);
 void* shared_memory_attach(uint64_t id);
 void shared_memory_detach(uint64_t id);
-void shared_memory_detachAll();
\ No newline at end of file
+void shared_memory_detachAll();
+void shared_memory_fork(uint64_t id);
\ No newline at end of file
@@ -21,6 +21,31 @@
 
 #include <multitasking/process.h>
 
+/*
+ * ticket lock: a cpu takes the next ticket and spins until it's served, so the cpus get the
+ * lock in the order they asked for it. Never held across anything that sleeps (a mutex, i/o).
+ * A lock also taken by an interrupt handler is taken with spin_lock_irqsave() everywhere else
+*/
+typedef struct spinlock
+{
+    volatile uint16_t next;     // next ticket handed out
+    volatile uint16_t owner;    // ticket being served
+    volatile int32_t cpu;       // holder, -1 when free (debugging)
+    const char* name;
+}spinlock_t;
+
+#define SPINLOCK_INIT(lockName) { 0, 0, -1, lockName }
+
+void spin_lock(spinlock_t* lock);
+bool spin_trylock(spinlock_t* lock);
+void spin_unlock(spinlock_t* lock);
+uint32_t spin_lock_irqsave(spinlock_t* lock);
+void spin_unlock_irqrestore(spinlock_t* lock, uint32_t eflags);
+bool is_spinlock_held();
+
+uint32_t get_cpu();
+void put_cpu();
+
 bool is_scheduler_locked();
 void lock_scheduler();
 void unlock_scheduler();
@@ -38,4 +63,5 @@ mutex_t* create_mutex();
 void destroy_mutex(mutex_t* mut);
 
 void acquire_mutex(mutex_t* mut);
+bool try_acquire_mutex(mutex_t* mut);
 void release_mutex(mutex_t* mut);
\ No newline at end of file
@@ -22,20 +22,52 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <vfs/vfs.h>
+#include <hal/isr.h>
 
 #define MAX_PROCESS (1024 * 1024)
 
+// page fault error code bits
+#define PAGE_FAULT_PRESENT  (1 << 0)    // the page was present, it's a protection violation
+#define PAGE_FAULT_WRITE    (1 << 1)
+#define PAGE_FAULT_USER     (1 << 2)
+
 typedef enum{DEAD, RUNNING, READY, BLOCKED, WAITING}status_t;
-typedef enum { REGION_CODE, REGION_HEAP, REGION_STACK, REGION_SHM } region_type_t;
+typedef enum { REGION_CODE, REGION_HEAP, REGION_STACK, REGION_SHM, REGION_FILE } region_type_t;
 
 typedef struct vm_region {
     uint32_t start;
     uint32_t length;    // Length in 4KB blocks
     region_type_t type;
     uint64_t shm_id;    // Only if type == REGION_SHM
+    vnode_t* file;      // REGION_FILE, or the REGION_CODE of an executable: pages are read from it when first touched
+    uint32_t file_offset;   // offset in the file of the first page
+    bool file_writable;     // private writes, they never go back to the file
     struct vm_region* next;
 } vm_region_t;
 
+// what a process holds, in 4KB pages
+typedef struct process_memstat
+{
+    uint32_t residentPages;     // private frames mapped in user space (copy on write frames count in every process sharing them)
+    uint32_t sharedPages;       // shared memory and device frames mapped in user space
+    uint32_t pageTablePages;    // page directory and the page tables of the user half
+    uint32_t kstackPages;       // kernel stack
+    uint32_t peakResidentPages; // highest residentPages + sharedPages so far
+    uint32_t swappedPages;      // private pages written to the swap file
+} process_memstat_t;
+
+typedef enum { PROCESS_MEM_RESIDENT, PROCESS_MEM_SHARED, PROCESS_MEM_PAGE_TABLE, PROCESS_MEM_SWAPPED } process_mem_t;
+
+// how a process is scheduled, times are in timer ticks (ms)
+typedef struct process_schedstat
+{
+    uint32_t priority;          // current level of the feedback queue, 0 is the highest
+    uint32_t basePriority;      // highest level it can reach, set by setpriority
+    uint32_t runs;              // times it was picked from a ready queue
+    uint32_t totalWait;         // time spent in the ready queues
+    uint32_t maxWait;           // longest time spent in a ready queue at once
+} process_schedstat_t;
+
 typedef struct process
 {
     void* cr3;      // physical address of the page directory
@@ -46,28 +78,53 @@ typedef struct process
 
     bool usermode;  // usermode or kernel process 
     uint32_t id;
+    uint32_t parent;    // id of the process that forked or started it
     void* entryPoint;
     void* brk;
 
     file_descriptor_t resources[MAX_OPEN_FILES];
     vm_region_t* regions;
 
+    process_memstat_t memory;
+    struct process *account;     // the process the user pages mapped in the loaded address space are counted for (itself, or the new process while execve fills it)
+
+    process_schedstat_t sched;
+    uint32_t sliceLeft;     // ticks before it's preempted and goes down one level
+    uint64_t readySince;    // tick it was put in a ready queue
+
+    uint32_t cpu;           // cpu it last ran on, or whose queue it's in
+    volatile bool onCpu;    // its context is in use, until the next task on that cpu finished switching
+    int lockDepth;          // scheduler lock nesting saved while it's switched out
+
     status_t state;
     struct process *next;
 } __attribute__((packed)) process_t;
 
 void __attribute__((cdecl)) task_switch(process_t *previous, process_t *next);
 void __attribute__((cdecl)) switch_to_usermode(uint32_t stack, uint32_t ip);
+void __attribute__((cdecl)) fork_return();
 
 void PROCESS_initialize(process_t* idle);
+process_t* PROCESS_createIdle(void* stack);
 void PROCESS_createFrom(void* entryPoint);
-void PROCESS_createFromByteArray(void* array, int length, bool is_usermode);
+int PROCESS_createFromByteArray(void* array, int length, bool is_usermode);
 int PROCESS_execve(const char *path, char* argv);
+int PROCESS_fork(Registers* regs);
 void* PROCESS_sbrk(intptr_t size);
+void* PROCESS_mmap(uint32_t length, int fd, uint32_t offset, bool writable);
+int PROCESS_munmap(void* addr, uint32_t length);
 void PROCESS_terminate();
+void PROCESS_startReclaimTask();
 
 void* PROCESS_createNewRegion(region_type_t type, uint32_t length, uint64_t shm_id);
+vm_region_t* PROCESS_findRegion(process_t* proc, uint32_t address);
+void PROCESS_removeRegion(process_t* proc, vm_region_t* region);
+vm_region_t* PROCESS_allocRegion();
+void PROCESS_freeRegion(vm_region_t* region);
 process_t* PROCESS_get(uint32_t id);
 
+void PROCESS_accountMemory(process_mem_t type, int32_t pages);
+bool PROCESS_getMemoryStats(uint32_t id, process_memstat_t* stats);
+
 void block_task();
 void unblock_task(process_t* proc, bool priority);
\ No newline at end of file
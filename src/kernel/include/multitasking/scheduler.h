@@ -21,9 +21,26 @@
 
 #include <multitasking/process.h>
 
+#define SCHED_LEVELS        4       // levels of the feedback queue, 0 is the highest priority
+#define SCHED_BASE_SLICE    10      // ticks (ms) a task of level 0 runs before it's preempted, doubled at each level below
+#define SCHED_BOOST_PERIOD  1000    // ticks between two boosts of every ready task back to its base level
+
 void add_READY_process(process_t* proc, bool high_priority);
 process_t* PROCESS_getCurrent();
 
 void yield();
+void SCHEDULER_idle();
 void SCHEDULER_initialize();
-bool is_schedulerEnabled();
\ No newline at end of file
+bool is_schedulerEnabled();
+
+void SCHEDULER_finishSwitch();
+
+void SCHEDULER_initTask(process_t* proc, uint32_t basePriority);
+void SCHEDULER_wakeUp(process_t* proc);
+bool SCHEDULER_tick();
+uint64_t SCHEDULER_nextEvent();
+bool SCHEDULER_setPriority(uint32_t id, uint32_t priority);
+bool SCHEDULER_getStats(uint32_t id, process_schedstat_t* stats);
+
+struct cpu;
+void SCHEDULER_startCpu(struct cpu* cpu, process_t* idle);
\ No newline at end of file
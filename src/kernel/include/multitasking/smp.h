@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2025,  Novice
+ *
+ * This file is part of the Novix software.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <hal/apic.h>
+#include <multitasking/process.h>
+#include <multitasking/scheduler.h>
+
+#define SMP_MAX_CPUS        APIC_MAX_CPUS
+#define SMP_TRAMPOLINE_ADDR 0x8000      // the application processors start here in real mode, the page is reserved
+#define SMP_START_TIMEOUT   100         // ms an application processor has to come online after its startup ipi
+
+// what /dev/cpus returns for each cpu, user programs see it as struct cpu_stats in <sys/stats.h>
+typedef struct cpu_stats
+{
+    uint32_t apicId;
+    uint32_t online;
+    uint32_t switches;      // task switches
+    uint32_t steals;        // tasks taken from the queue of another cpu
+    uint32_t ipis;          // reschedule interrupts received
+    uint32_t shootdowns;    // tlb flushes asked by another cpu
+    uint64_t idleTime;      // ms spent in the idle task
+}cpu_stats_t;
+
+typedef struct cpu
+{
+    uint32_t id;            // index in SMP_cpus, 0 is the boot processor
+    uint32_t apicId;
+    volatile bool online;
+
+    process_t* current;     // the running task
+    process_t* idle;
+    process_t* previous;    // task switched away from, until SCHEDULER_finishSwitch()
+    int lockDepth;          // scheduler lock nesting on this cpu
+    int spinDepth;          // other spinlocks held, no preemption meanwhile
+
+    // the multilevel feedback queue of the tasks waiting for this cpu
+    process_t* firstReady[SCHED_LEVELS];
+    process_t* lastReady[SCHED_LEVELS];
+    uint32_t readyCount;
+
+    uint64_t lastBoost;
+    uint64_t lastCharge;    // when the running task was last charged for its time
+
+    volatile uint32_t shootdownAck;     // last tlb shootdown done
+
+    cpu_stats_t stats;
+}cpu_t;
+
+void SMP_initialize();
+void SMP_createDevice();
+cpu_t* SMP_getCpu();
+cpu_t* SMP_getCpuById(uint32_t id);
+uint32_t SMP_getCpuCount();
+
+void SMP_sendReschedule(cpu_t* cpu);
+void SMP_shootdown(void* virt, uint32_t pages);
+void SMP_handleShootdown();
@@ -22,6 +22,22 @@
 #include <stdint.h>
 #include <hal/irq.h>
 
+// what /dev/timer returns, user programs see it as struct time_stats in <sys/stats.h>
+typedef struct time_stats
+{
+    uint64_t uptime;        // ms
+    uint32_t interrupts;    // timer interrupts so far
+    uint32_t programs;      // times the clock was programmed for the next event
+}time_stats_t;
+
+void time_init();
 void sleep(uint64_t ms);
 void timer(Registers* reg);
-uint64_t get_tikCount();
\ No newline at end of file
+uint64_t get_tikCount();
+
+void TIME_update();
+void TIME_reprogram();
+void TIME_useTsc(uint32_t khz);
+void TIME_requestEvent();
+void TIME_getStats(time_stats_t* stats);
+void TIME_createDevice();
\ No newline at end of file
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2025,  Novice
+ *
+ * This file is part of the Novix software.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <vfs/vfs.h>
+
+//============================================================================
+//    INTERFACE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
+//============================================================================
+
+#define PCACHE_HASH_SIZE        1024    // buckets of the (vnode, page) hash table
+#define PCACHE_FILL_PAGES       16      // pages read from the file system at once on a miss (64kb)
+#define PCACHE_MIN_FREE_BLOCKS  1024    // below this many free blocks (4mb), cached pages are evicted before new ones are added
+
+// what /dev/pagecache returns, user programs see it as struct pcache_stats in <sys/stats.h>
+typedef struct pcache_stats
+{
+    uint32_t cachedPages;       // pages currently held
+    uint32_t hits;              // pages found in the cache
+    uint32_t misses;            // pages read from the file system
+    uint32_t evictions;         // pages dropped because memory was low
+    uint32_t invalidations;     // pages dropped because the file changed or went away
+    uint32_t mappedPages;       // cached pages mapped in at least one process (executables, mmap)
+    uint32_t mappings;          // mappings of those pages, each one past the first saves a frame
+}pcache_stats_t;
+
+//============================================================================
+//    INTERFACE FUNCTION PROTOTYPES
+//============================================================================
+
+void PCACHE_initialize();
+
+int64_t PCACHE_read(vnode_t* node, void* buffer, size_t size, uint64_t offset);
+void* PCACHE_getPage(vnode_t* node, uint32_t index);
+void PCACHE_invalidate(vnode_t* node, uint64_t offset, uint64_t size);
+void PCACHE_invalidateAll(vnode_t* node);
+uint32_t PCACHE_shrink(uint32_t pages);
+
+void PCACHE_getStats(pcache_stats_t* stats);
+void PCACHE_dumpStats();
+void PCACHE_createDevice();
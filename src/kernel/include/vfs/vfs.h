@@ -121,6 +121,7 @@ typedef struct vnode
     struct vnodeops *vnode_op;      /* Pointer to the vnode operations supported by this file/directory */
     struct vfs *vnode_vfs;          /* The VFS this vnode belongs to */
     void *vnode_data;               /* File-system-specific data (usually an inode or similar) */
+    struct pcache_page *pages;      /* Pages of this file held by the page cache */
 }vnode_t;
 
 typedef struct vfs_stat {
@@ -145,6 +146,8 @@ typedef struct vnodeops
 {
     int64_t (*read)(struct vnode* node, void *buffer, size_t size, int64_t offset, uint32_t flags);
     int64_t (*write)(struct vnode* node, const void *buffer, size_t size, int64_t offset, uint32_t flags);
+    int64_t (*readpages)(struct vnode* node, void *buffer, uint32_t index, uint32_t count); /* Fill the page cache, bypassing it (optional) */
+    int64_t (*bmap)(struct vnode* node, device_t** dev, uint32_t* sectors, uint32_t count); /* Device sector of each page of the file, for swap files (optional) */
     int (*ioctl)(struct vnode* node, const int command, void* arg);
     int (*trunc)(struct vnode* node);
 
@@ -174,6 +177,9 @@ typedef struct file_descriptor
 void VFS_init();
 void VFS_register_new_filesystem(filesystem_t* fs);
 
+vnode_t* VFS_allocVnode();
+void VFS_freeVnode(vnode_t* node);
+
 int VFS_mount(const char *fs_name, device_t* dev, const char *mount_point);
 int VFS_unmount(const char *mount_point);
 
@@ -26,15 +26,19 @@
 #include <memory.h>
 #include <hal/hal.h>
 #include <hal/io.h>
+#include <hal/irq.h>
 #include <mem_manager/physmem_manager.h>
 #include <mem_manager/virtmem_manager.h>
 #include <mem_manager/heap.h>
 #include <mem_manager/vmalloc.h>
+#include <mem_manager/slab.h>
+#include <mem_manager/kstack.h>
 #include <syscall/syscall.h>
 #include <multitasking/scheduler.h>
 #include <multitasking/process.h>
 #include <multitasking/time.h>
 #include <multitasking/lock.h>
+#include <multitasking/smp.h>
 #include <multitasking/ipc/message.h>
 #include <multitasking/ipc/shared_memory.h>
 #include <drivers/vga_text.h>
@@ -43,6 +47,8 @@
 #include <drivers/keyboard.h>
 #include <drivers/framebuffer.h>
 #include <drivers/ata.h>
+#include <vfs/page_cache.h>
+#include <mem_manager/swap.h>
 
 const char logo[] = 
 "\
@@ -65,10 +71,32 @@ extern uint8_t __bss_end;
 
 video_info_t vidInfo;
 
+kmem_cache_t* listNode_cache;
+
+void* listNode_alloc(size_t size)
+{
+    return kmem_cache_alloc(listNode_cache);
+}
+
+void listNode_free(void* node)
+{
+    kmem_cache_free(listNode_cache, node);
+}
+
 void init_process()
 {
     init_device_manager();
     create_console();
+    PHYSMEM_createDevice();
+    VMALLOC_createDevice();
+    SLAB_createDevice();
+    PCACHE_createDevice();
+    SWAP_createDevice();
+    TIME_createDevice();
+    SMP_createDevice();
+#ifdef HEAP_DEBUG
+    HEAP_createDevice();
+#endif
     KEYBOARD_initialize();
     FRAMEBUFFER_init(&vidInfo);
     ata_init();
@@ -81,6 +109,9 @@ void init_process()
     if(VFS_mount("devfs", NULL, "/dev") == VFS_OK)
         log_info("init_process", "devfs mounted successfully at /dev");
 
+    SWAP_initialize(SWAP_FILE_PATH);
+    PROCESS_startReclaimTask();
+
     int new_file = VFS_open("/test/file.txt", VFS_O_RDWR | VFS_O_CREAT | VFS_O_TRUNC);
     if(new_file >= 0)
     {
@@ -129,20 +160,37 @@ void __attribute__((cdecl)) start(Boot_info* boot_info)
 
     HAL_initialize();
     
-    PHYSMEM_initialize(boot_info, kernel_size);
+    // nothing works without it
+    if(!PHYSMEM_initialize(boot_info, kernel_size))
+    {
+        log_crit("kernel", "the physical memory manager failed to initialize");
+        panic();
+    }
+
     VIRTMEM_initialize(kernel_size);
     HEAP_initialize();
     VMALLOC_initialize();
+    SLAB_initialize();
+    KSTACK_initialize();
+
+    // the local apic timer becomes the tick source, so before the scheduler programs it
+    IRQ_enableApic();
 
     List_init(kmalloc, kfree);
 
+    listNode_cache = kmem_cache_create("listNode", sizeof(struct listNode), NULL);
+    List_setNodeAllocator(listNode_alloc, listNode_free);
+
     SCHEDULER_initialize();
+
+    // the other cpus join the scheduler as soon as they're up
+    SMP_initialize();
+
+    if(!PHYSMEM_selfTest())
+        log_crit("kernel", "physical memory manager self-test failed");
+
     PROCESS_createFrom(init_process);
 
 halt:
-    for(;;)
-    {
-        //yield();
-        HLT();
-    }
+    SCHEDULER_idle();   // we are the idle task of the boot processor now
 }
\ No newline at end of file
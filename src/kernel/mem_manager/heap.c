@@ -18,32 +18,74 @@
 */
 
 #include <memory.h>
+#include <debug.h>
+#include <string.h>
 #include <mem_manager/virtmem_manager.h>
 #include <mem_manager/heap.h>
-#include <ordered_array.h>
 #include <multitasking/scheduler.h>
 #include <multitasking/lock.h>
+#include <drivers/device.h>
 
 //============================================================================
 //    IMPLEMENTATION PRIVATE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
 //============================================================================
 
-#define HEAP_START_ADDR 0xD0000000
-#define HEAP_END_ADDR   0xD7FFFFFF
-
 #define PAGE_SIZE 0x1000
 
-#define FREEBLOCK_LIST_SIZE PAGE_SIZE
-#define BREAK_START_ADDR    (HEAP_START_ADDR + FREEBLOCK_LIST_SIZE)
+#define HEAP_ALIGN          8
+#define HEAP_ALIGN_UP(x)    (((x) + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1))
+
+// free blocks smaller than this go to an exact size class bin, the others go to the large block tree
+#define HEAP_SMALL_LIMIT    512
+#define HEAP_BIN_COUNT      (HEAP_SMALL_LIMIT / HEAP_ALIGN)
+#define HEAP_BIN_INDEX(s)   ((s) / HEAP_ALIGN)
+
+#ifdef HEAP_DEBUG
+#define HEAP_MAGIC_USED     0xA110C8ED
+#define HEAP_MAGIC_FREE     0xF8EEB10C
+#define HEAP_GUARD          0x6A8D6A8D
+#define HEAP_REDZONE        8       // at least this many guard bytes after each block
+#define HEAP_REDZONE_BYTE   0xFD
+#define HEAP_POISON_BYTE    0xDD    // content of freed blocks
+#define HEAP_MAX_SITES      128
+#endif
 
 typedef struct header_t header_t;
 struct header_t{
+#ifdef HEAP_DEBUG
+    uint32_t magic;
+    uint32_t guard;     // also keeps the header 8 bytes aligned
+    void* caller;       // return address of the kmalloc call
+    size_t requested;   // size asked by the caller, the rest of the block is red zone
+#endif
     size_t size;
     bool isFree;
     header_t *next;
     header_t *back;
 };
 
+/*
+ * the free list links are stored in the payload of the free blocks themselves,
+ * so there is no limit on the number of free blocks
+*/
+typedef struct bin_node
+{
+    struct bin_node* next;
+    struct bin_node* prev;
+}bin_node_t;
+
+#define HEAP_MIN_SIZE       HEAP_ALIGN_UP(sizeof(bin_node_t))   // a free block must hold its bin links
+
+// large free blocks: binary tree ordered by size, blocks of the same size are chained on the tree node
+typedef struct tree_node
+{
+    struct tree_node* left;
+    struct tree_node* right;
+    struct tree_node* parent;
+    struct tree_node* next_same;
+    struct tree_node* prev_same;    // NULL for the node that is actually in the tree
+}tree_node_t;
+
 //============================================================================
 //    IMPLEMENTATION PRIVATE DATA
 //============================================================================
@@ -52,31 +94,371 @@ void* brk = NULL;
 uint32_t lastHeapAllocatedPage;
 
 header_t *head = NULL, *tail = NULL;
-ordered_array freeBlockArray;
 
-mutex_t HEAP_mutex;
+bin_node_t* HEAP_bins[HEAP_BIN_COUNT];
+uint32_t HEAP_binMap[HEAP_BIN_COUNT / 32];  // bit set when the bin is not empty
+tree_node_t* HEAP_treeRoot = NULL;
+
+spinlock_t HEAP_lock = SPINLOCK_INIT("heap");
 
 //============================================================================
 //    IMPLEMENTATION PRIVATE FUNCTIONS
 //============================================================================
 
-header_t* search_freeBlock(size_t size)
+void* sbrk(intptr_t size);
+
+static inline void* HEAP_payload(header_t* header)
+{
+    return (void*)header + sizeof(header_t);
+}
+
+static inline header_t* HEAP_header(void* payload)
+{
+    return (header_t*)(payload - sizeof(header_t));
+}
+
+// size of the block needed to serve a request of size bytes
+static inline size_t HEAP_blockSize(size_t size)
+{
+#ifdef HEAP_DEBUG
+    size += HEAP_REDZONE;
+#endif
+
+    return size < HEAP_MIN_SIZE ? HEAP_MIN_SIZE : HEAP_ALIGN_UP(size);
+}
+
+#ifdef HEAP_DEBUG
+
+// byte loops: memset and memcmp can't handle more than 64kb
+void HEAP_fill(uint8_t* ptr, uint8_t value, size_t size)
+{
+    for(size_t i = 0; i < size; i++)
+        ptr[i] = value;
+}
+
+bool HEAP_checkFill(uint8_t* ptr, uint8_t value, size_t size)
+{
+    for(size_t i = 0; i < size; i++)
+        if(ptr[i] != value)
+            return false;
+
+    return true;
+}
+
+// mark a block as used, everything after the requested size becomes red zone
+void HEAP_arm(header_t* header, size_t requested, void* caller)
+{
+    header->magic = HEAP_MAGIC_USED;
+    header->guard = HEAP_GUARD;
+    header->caller = caller;
+    header->requested = requested;
+
+    HEAP_fill(HEAP_payload(header) + requested, HEAP_REDZONE_BYTE, header->size - requested);
+}
+
+/*
+ * check a block before giving it back or resizing it
+ * returns false if the header can't be trusted, an overflow is only reported
+*/
+bool HEAP_verify(header_t* header, const char* action)
+{
+    void* block = HEAP_payload(header);
+
+    if(header->magic == HEAP_MAGIC_FREE)
+    {
+        log_err("heap", "%s: 0x%x is already free (allocated by 0x%x)", action, block, header->caller);
+        return false;
+    }
+
+    if(header->magic != HEAP_MAGIC_USED || header->guard != HEAP_GUARD)
+    {
+        log_err("heap", "%s: 0x%x is not a heap block or its header was overwritten", action, block);
+        return false;
+    }
+
+    if(!HEAP_checkFill(block + header->requested, HEAP_REDZONE_BYTE, header->size - header->requested))
+        log_err("heap", "%s: overflow past the end of 0x%x (%d bytes, allocated by 0x%x)", action, block, header->requested, header->caller);
+
+    return true;
+}
+
+#endif
+
+void HEAP_binPush(header_t* header)
+{
+    uint32_t index = HEAP_BIN_INDEX(header->size);
+    bin_node_t* node = HEAP_payload(header);
+
+    node->prev = NULL;
+    node->next = HEAP_bins[index];
+
+    if(HEAP_bins[index] != NULL)
+        HEAP_bins[index]->prev = node;
+
+    HEAP_bins[index] = node;
+    HEAP_binMap[index / 32] |= (1 << (index % 32));
+}
+
+void HEAP_binRemove(header_t* header)
+{
+    uint32_t index = HEAP_BIN_INDEX(header->size);
+    bin_node_t* node = HEAP_payload(header);
+
+    if(node->prev != NULL)
+        node->prev->next = node->next;
+    else
+        HEAP_bins[index] = node->next;
+
+    if(node->next != NULL)
+        node->next->prev = node->prev;
+
+    if(HEAP_bins[index] == NULL)
+        HEAP_binMap[index / 32] &= ~(1 << (index % 32));
+}
+
+// first non empty bin that can hold size bytes, or -1
+int HEAP_binFind(size_t size)
+{
+    uint32_t index = HEAP_BIN_INDEX(size);
+
+    for(uint32_t word = index / 32; word < HEAP_BIN_COUNT / 32; word++)
+    {
+        uint32_t map = HEAP_binMap[word];
+
+        if(word == index / 32)
+            map &= ~((1 << (index % 32)) - 1);  // ignore the bins that are too small
+
+        if(map != 0)
+            return (word * 32) + __builtin_ctz(map);
+    }
+
+    return -1;
+}
+
+static inline size_t HEAP_nodeSize(tree_node_t* node)
+{
+    return HEAP_header(node)->size;
+}
+
+// put v where u was in the tree
+void HEAP_treeReplace(tree_node_t* u, tree_node_t* v)
+{
+    if(u->parent == NULL)
+        HEAP_treeRoot = v;
+    else if(u == u->parent->left)
+        u->parent->left = v;
+    else
+        u->parent->right = v;
+
+    if(v != NULL)
+        v->parent = u->parent;
+}
+
+void HEAP_treeInsert(header_t* header)
 {
-    header_t *header;
+    tree_node_t* node = HEAP_payload(header);
+    tree_node_t* parent = NULL;
+    tree_node_t* current = HEAP_treeRoot;
 
-    for(int i = 0; i < freeBlockArray.size; i++) // search a free block from the free block array
+    node->left = NULL;
+    node->right = NULL;
+    node->next_same = NULL;
+    node->prev_same = NULL;
+
+    while(current != NULL)
+    {
+        if(HEAP_nodeSize(current) == header->size)
+        {
+            // same size: chain it, the tree doesn't change
+            node->parent = NULL;
+            node->prev_same = current;
+            node->next_same = current->next_same;
+
+            if(current->next_same != NULL)
+                current->next_same->prev_same = node;
+
+            current->next_same = node;
+            return;
+        }
+
+        parent = current;
+        current = header->size < HEAP_nodeSize(current) ? current->left : current->right;
+    }
+
+    node->parent = parent;
+
+    if(parent == NULL)
+        HEAP_treeRoot = node;
+    else if(header->size < HEAP_nodeSize(parent))
+        parent->left = node;
+    else
+        parent->right = node;
+}
+
+void HEAP_treeRemove(header_t* header)
+{
+    tree_node_t* node = HEAP_payload(header);
+
+    if(node->prev_same != NULL)    // only in a chain
+    {
+        node->prev_same->next_same = node->next_same;
+        if(node->next_same != NULL)
+            node->next_same->prev_same = node->prev_same;
+
+        return;
+    }
+
+    if(node->next_same != NULL)    // the next block of the same size takes our place
+    {
+        tree_node_t* next = node->next_same;
+
+        next->prev_same = NULL;
+        next->left = node->left;
+        next->right = node->right;
+
+        if(next->left != NULL)
+            next->left->parent = next;
+        if(next->right != NULL)
+            next->right->parent = next;
+
+        HEAP_treeReplace(node, next);
+        return;
+    }
+
+    if(node->left == NULL)
+        HEAP_treeReplace(node, node->right);
+    else if(node->right == NULL)
+        HEAP_treeReplace(node, node->left);
+    else
+    {
+        tree_node_t* successor = node->right;
+        while(successor->left != NULL)
+            successor = successor->left;
+
+        if(successor->parent != node)
+        {
+            HEAP_treeReplace(successor, successor->right);
+            successor->right = node->right;
+            successor->right->parent = successor;
+        }
+
+        HEAP_treeReplace(node, successor);
+        successor->left = node->left;
+        successor->left->parent = successor;
+    }
+}
+
+// smallest large block that can hold size bytes (best fit)
+header_t* HEAP_treeFind(size_t size)
+{
+    tree_node_t* best = NULL;
+    tree_node_t* current = HEAP_treeRoot;
+
+    while(current != NULL)
+    {
+        if(HEAP_nodeSize(current) >= size)
+        {
+            best = current;
+            if(HEAP_nodeSize(current) == size)
+                break;
+
+            current = current->left;
+        }
+        else
+            current = current->right;
+    }
+
+    if(best == NULL)
+        return NULL;
+
+    // prefer a chained block, taking it doesn't touch the tree
+    if(best->next_same != NULL)
+        best = best->next_same;
+
+    return HEAP_header(best);
+}
+
+void HEAP_insertFree(header_t* header)
+{
+    header->isFree = true;
+
+#ifdef HEAP_DEBUG
+    header->magic = HEAP_MAGIC_FREE;
+    HEAP_fill(HEAP_payload(header), HEAP_POISON_BYTE, header->size);
+#endif
+
+    if(header->size < HEAP_SMALL_LIMIT)
+        HEAP_binPush(header);
+    else
+        HEAP_treeInsert(header);
+}
+
+void HEAP_removeFree(header_t* header)
+{
+    if(header->size < HEAP_SMALL_LIMIT)
+        HEAP_binRemove(header);
+    else
+        HEAP_treeRemove(header);
+
+    header->isFree = false;
+}
+
+// take a free block of at least size bytes out of the bins/tree
+header_t* HEAP_takeFree(size_t size)
+{
+    header_t* header = NULL;
+
+    if(size < HEAP_SMALL_LIMIT)
+    {
+        int bin = HEAP_binFind(size);
+        if(bin >= 0)
+            header = HEAP_header(HEAP_bins[bin]);
+    }
+
+    if(header == NULL)
+        header = HEAP_treeFind(size);
+
+    if(header != NULL)
     {
-        header = (header_t*)freeBlockArray.array[i];
-        if(header->size >= size && header->isFree)
-            return header;
+        HEAP_removeFree(header);
+
+#ifdef HEAP_DEBUG
+        // the free list links are allowed to change, the rest must still be poisoned
+        if(header->size > sizeof(tree_node_t) && !HEAP_checkFill(HEAP_payload(header) + sizeof(tree_node_t), HEAP_POISON_BYTE, header->size - sizeof(tree_node_t)))
+            log_err("heap", "0x%x was written after being freed (last allocated by 0x%x)", HEAP_payload(header), header->caller);
+#endif
     }
 
-    return NULL;
+    return header;
 }
 
-bool criteria_function(type_t a, type_t b)
+// cut a used block down to size bytes, the rest becomes a new free block
+void HEAP_split(header_t* header, size_t size)
 {
-    return ((header_t*)a)->size < ((header_t*)b)->size;   // ordered by size in ascending order
+    if((header->size - size) < (sizeof(header_t) + HEAP_MIN_SIZE))
+        return; // not worth it
+
+    if(header == tail)  // just give the end back
+    {
+        sbrk(-1 * (intptr_t)(header->size - size));
+        header->size = size;
+        return;
+    }
+
+    header_t* newHeader = (header_t*)(HEAP_payload(header) + size);
+
+    newHeader->size = header->size - size - sizeof(header_t);
+    newHeader->back = header;
+    newHeader->next = header->next;
+
+    if(header->next != NULL)
+        header->next->back = newHeader;
+
+    header->next = newHeader;
+    header->size = size;
+
+    // the right neighbour of a used block is never free (blocks are always merged)
+    HEAP_insertFree(newHeader);
 }
 
 void* sbrk(intptr_t size)
@@ -94,7 +476,7 @@ void* sbrk(intptr_t size)
             return (void*)-1;   // not enough available memory, heap is full !
         }
 
-        if((uint32_t)(brk+size) > (lastHeapAllocatedPage + PAGE_SIZE)) // if so we will need to increase the heap size
+        while((uint32_t)(brk+size) > (lastHeapAllocatedPage + PAGE_SIZE)) // if so we will need to increase the heap size
         {
             // we need to map this new page first
             if(!VIRTMEM_mapPage((void*)(lastHeapAllocatedPage + PAGE_SIZE), true))
@@ -105,11 +487,11 @@ void* sbrk(intptr_t size)
     }
     else
     {
-        if((uint32_t)(brk+size) < BREAK_START_ADDR)
+        if((uint32_t)(brk+size) < HEAP_START_ADDR)
             return (void*)-1;
 
         // reminder: the size is negative
-        if((uint32_t)(brk+size) < lastHeapAllocatedPage)
+        while((uint32_t)(brk+size) <= lastHeapAllocatedPage && lastHeapAllocatedPage > HEAP_START_ADDR)
         {
             VIRTMEM_unMapPage((void*)lastHeapAllocatedPage);    // releasing memory
             lastHeapAllocatedPage -= PAGE_SIZE;
@@ -120,86 +502,39 @@ void* sbrk(intptr_t size)
     return ptr;
 }
 
-//============================================================================
-//    INTERFACE FUNCTIONS
-//============================================================================
-
-bool HEAP_initialize()
-{
-    // the first 4kb of the heap range is reserved for the free block array
-    // therefore the value of BREAK_START_ADDR
-    brk = (void*)BREAK_START_ADDR;
-    lastHeapAllocatedPage = HEAP_START_ADDR;
-
-    // first we need to allocate all the page table for the heap address range
-    // because we want it to be consistent (to be the same) in all address space
-    for(uint32_t i = HEAP_START_ADDR; i <= HEAP_END_ADDR; i += (400 * 0x1000))
-        VIRTMEM_mapTable((void*)i, true);
-
-    if(!VIRTMEM_mapPage((void*)lastHeapAllocatedPage, true)) // first we map the freeBlockArray address
-        return false;
-
-    lastHeapAllocatedPage += PAGE_SIZE;
-
-    if(!VIRTMEM_mapPage((void*)lastHeapAllocatedPage, true)) // then we map the actual working heap address
-        return false;
-
-    freeBlockArray = create_static_array((void*)HEAP_START_ADDR, FREEBLOCK_LIST_SIZE / sizeof(type_t), criteria_function);
-
-    return true;
-}
-
-void* kmalloc(size_t size)
+void* HEAP_alloc(size_t size, void* caller)
 {
     void *block;
     header_t *header = NULL;
-    size_t totalSize = sizeof(header_t) + size;
+#ifdef HEAP_DEBUG
+    size_t requested = size;
+#endif
 
     if(!size)
         return NULL;
 
-    if(is_schedulerEnabled())
-        acquire_mutex(&HEAP_mutex);
+    size = HEAP_blockSize(size);
+
+    spin_lock(&HEAP_lock);
 
-    header = search_freeBlock(size);
+    header = HEAP_takeFree(size);
     if(header)
     {
-        header->isFree = false;
-        remove_ordered_array(getIndex_ordered_array(header, &freeBlockArray), &freeBlockArray); // remove from free block list
-
-        if((header->size - size) >= (sizeof(header_t) + 16)) // we split the block
-        {
-            header_t* newHeader = (header_t*)((void*)header + size + sizeof(header_t));
-
-            //filling new header information
-            newHeader->size = header->size - size - sizeof(header_t);
-            newHeader->isFree = false;
-            newHeader->back = header;
-            newHeader->next = header->next;
+        HEAP_split(header, size);
 
-            if(header->next != NULL)
-                header->next->back = newHeader;
+#ifdef HEAP_DEBUG
+        HEAP_arm(header, requested, caller);
+#endif
 
-            header->next = newHeader;
-            header->size = size;
+        spin_unlock(&HEAP_lock);
 
-            kfree((void*)newHeader + sizeof(header_t)); // add a new free block !
-
-            if(header == tail)
-                tail = newHeader;
-        }
-
-        if(is_schedulerEnabled())
-            release_mutex(&HEAP_mutex);
-
-        return ((void*)header + sizeof(header_t));
+        return HEAP_payload(header);
     }
 
-    block = sbrk(totalSize);    // requesting memory from the heap
+    block = sbrk(sizeof(header_t) + size);    // requesting memory from the heap
     if(block == (void*) -1)
     {
-        if(is_schedulerEnabled())
-            release_mutex(&HEAP_mutex);
+        spin_unlock(&HEAP_lock);
 
         return NULL;
     }
@@ -223,30 +558,118 @@ void* kmalloc(size_t size)
 
     tail = header;
 
-    block += sizeof(header_t);
+#ifdef HEAP_DEBUG
+    HEAP_arm(header, requested, caller);
+#endif
+
+    spin_unlock(&HEAP_lock);
+
+    return HEAP_payload(header);
+}
+
+//============================================================================
+//    INTERFACE FUNCTIONS
+//============================================================================
+
+bool HEAP_initialize()
+{
+    brk = (void*)HEAP_START_ADDR;
+    lastHeapAllocatedPage = HEAP_START_ADDR;
+
+    // first we need to allocate all the page table for the heap address range
+    // because we want it to be consistent (to be the same) in all address space
+    for(uint32_t i = HEAP_START_ADDR; i <= HEAP_END_ADDR; i += (400 * 0x1000))
+        VIRTMEM_mapTable((void*)i, true);
 
-    if(is_schedulerEnabled())
-        release_mutex(&HEAP_mutex);
+    if(!VIRTMEM_mapPage((void*)lastHeapAllocatedPage, true)) // then we map the actual working heap address
+        return false;
+
+    for(int i = 0; i < HEAP_BIN_COUNT; i++)
+        HEAP_bins[i] = NULL;
+
+    for(int i = 0; i < HEAP_BIN_COUNT / 32; i++)
+        HEAP_binMap[i] = 0;
 
-    return block;
+    HEAP_treeRoot = NULL;
+
+    return true;
+}
+
+void* kmalloc(size_t size)
+{
+    return HEAP_alloc(size, __builtin_return_address(0));
 }
 
 void* krealloc(void* block, size_t size)
 {
+    void* caller = __builtin_return_address(0);
+
     if(block == NULL)
-        return kmalloc(size);
+        return HEAP_alloc(size, caller);
     
-    header_t* header = block - sizeof(header_t);
+    header_t* header = HEAP_header(block);
+    size_t needed = HEAP_blockSize(size);
+    size_t used;
     void* newBlock;
 
-    if(header->size >= size)
+    spin_lock(&HEAP_lock);
+
+#ifdef HEAP_DEBUG
+    if(!HEAP_verify(header, "krealloc"))
+    {
+        spin_unlock(&HEAP_lock);
+
+        return NULL;
+    }
+
+    used = header->requested;
+#else
+    used = header->size;
+#endif
+
+    // try to grow in place first: swallow the free block on the right...
+    header_t* right_block = header->next;
+    if(header->size < needed && right_block != NULL && right_block->isFree && (header->size + sizeof(header_t) + right_block->size) >= needed)
+    {
+        HEAP_removeFree(right_block);
+
+        header->size += sizeof(header_t) + right_block->size;
+        header->next = right_block->next;
+
+        if(right_block->next != NULL)
+            right_block->next->back = header;
+
+        if(right_block == tail)
+            tail = header;
+
+        HEAP_split(header, needed);
+    }
+
+    // ...or move the break if we are the last block
+    if(header->size < needed && header == tail && sbrk(needed - header->size) != (void*)-1)
+        header->size = needed;
+
+    if(header->size >= needed)
+    {
+#ifdef HEAP_DEBUG
+        HEAP_arm(header, size, caller);
+#endif
+
+        spin_unlock(&HEAP_lock);
+
         return block;
+    }
+
+    spin_unlock(&HEAP_lock);
 
-    newBlock = kmalloc(size);
+    newBlock = HEAP_alloc(size, caller);
     if(!newBlock)
         return NULL;
 
-    memcpy(newBlock, block, header->size);
+    // memcpy can't copy more than 64kb at once
+    for(size_t i = 0; i < used; i += 0x8000)
+        memcpy(newBlock + i, block + i, (used - i) > 0x8000 ? 0x8000 : used - i);
+
     kfree(block);
 
     return newBlock;
@@ -262,11 +685,13 @@ void* kcalloc(size_t num, size_t size)
     if(num != totalSize / size) // check mul overflow 
         return NULL;
 
-    void* pointer = kmalloc(totalSize);
+    void* pointer = HEAP_alloc(totalSize, __builtin_return_address(0));
     if(!pointer)
         return NULL;
 
-    memset(pointer, 0, totalSize);
+    // memset can't clear more than 64kb at once
+    for(size_t i = 0; i < totalSize; i += 0x8000)
+        memset(pointer + i, 0, (totalSize - i) > 0x8000 ? 0x8000 : totalSize - i);
     
     return pointer;
 }
@@ -277,20 +702,30 @@ void kfree(void* block)
         return;
     
     header_t *left_block, *right_block;
-    header_t *header = (header_t*)(block - sizeof(header_t));
+    header_t *header = HEAP_header(block);
     size_t totalSize = 0;
 
+#ifndef HEAP_DEBUG
     if(header->isFree)
         return; // nothing to do
+#endif
+
+    spin_lock(&HEAP_lock);
 
-    if(is_schedulerEnabled())
-        acquire_mutex(&HEAP_mutex);
+#ifdef HEAP_DEBUG
+    if(!HEAP_verify(header, "kfree"))
+    {
+        spin_unlock(&HEAP_lock);
+
+        return;
+    }
+#endif
 
     // merging left block if it's free
     left_block = header->back;
     if(left_block != NULL && left_block->isFree)
     {
-        remove_ordered_array(getIndex_ordered_array(left_block, &freeBlockArray), &freeBlockArray);
+        HEAP_removeFree(left_block);
 
         left_block->size += header->size + sizeof(header_t);
         left_block->next = header->next;
@@ -308,7 +743,7 @@ void kfree(void* block)
     right_block = header->next;
     if(right_block != NULL && right_block->isFree)
     {
-        remove_ordered_array(getIndex_ordered_array(right_block, &freeBlockArray), &freeBlockArray);
+        HEAP_removeFree(right_block);
 
         header->size += right_block->size + sizeof(header_t);
         header->next = right_block->next;
@@ -320,9 +755,6 @@ void kfree(void* block)
             tail = header;      // the last block become the left one in this case the header
     }
 
-    header->isFree = true;
-    insert_ordered_array((type_t)header, &freeBlockArray);
-
     totalSize = sizeof(header_t) + header->size;
 
     // if it's the last block we need to release the memory to the OS
@@ -332,19 +764,178 @@ void kfree(void* block)
         {
             tail = NULL;    // erase the actual linked list
             head = NULL;
-            sbrk(-1 * totalSize);
         }
         else
         {
             tail = header->back;
             tail->next = NULL;
+        }
+
+        sbrk(-1 * totalSize);
+    }
+    else
+        HEAP_insertFree(header);
+
+    spin_unlock(&HEAP_lock);
+}
+
+#ifdef HEAP_DEBUG
+
+/*
+ * walk the whole heap and report every damaged block
+ * returns the number of problems found
+*/
+uint32_t HEAP_check()
+{
+    uint32_t errors = 0;
+
+    spin_lock(&HEAP_lock);
+
+    for(header_t* header = head; header != NULL; header = header->next)
+    {
+        if(header->isFree)
+        {
+            if(header->magic != HEAP_MAGIC_FREE)
+            {
+                log_err("heap", "check: free block 0x%x has a damaged header", HEAP_payload(header));
+                errors++;
+            }
+
+            continue;
+        }
+
+        if(header->magic != HEAP_MAGIC_USED || header->guard != HEAP_GUARD)
+        {
+            log_err("heap", "check: block 0x%x has a damaged header, stopping here", HEAP_payload(header));
+            errors++;
+            break;  // the links can't be trusted anymore
+        }
+
+        if(!HEAP_checkFill(HEAP_payload(header) + header->requested, HEAP_REDZONE_BYTE, header->size - header->requested))
+        {
+            log_err("heap", "check: overflow past the end of 0x%x (%d bytes, allocated by 0x%x)", HEAP_payload(header), header->requested, header->caller);
+            errors++;
+        }
+    }
+
+    spin_unlock(&HEAP_lock);
+
+    return errors;
+}
+
+/*
+ * group the live blocks by the address they were allocated from
+ * returns the number of entries filled
+*/
+uint32_t HEAP_getSites(heap_site_stats_t* sites, uint32_t count)
+{
+    uint32_t used = 0;
+
+    spin_lock(&HEAP_lock);
+
+    for(header_t* header = head; header != NULL; header = header->next)
+    {
+        if(header->isFree || HEAP_payload(header) == (void*)sites)   // don't count the caller's buffer
+            continue;
+
+        uint32_t i = 0;
+        while(i < used && sites[i].caller != (uint32_t)header->caller)
+            i++;
 
-            sbrk(-1 * totalSize);
+        if(i == used)
+        {
+            if(used == count)
+                continue;   // no more room
+
+            sites[i].caller = (uint32_t)header->caller;
+            sites[i].blocks = 0;
+            sites[i].bytes = 0;
+            used++;
         }
 
-        remove_ordered_array(getIndex_ordered_array(header, &freeBlockArray), &freeBlockArray); // in all case we need to remove it from the free list array
+        sites[i].blocks++;
+        sites[i].bytes += header->requested;
     }
 
-    if(is_schedulerEnabled())
-        release_mutex(&HEAP_mutex);
-}
\ No newline at end of file
+    spin_unlock(&HEAP_lock);
+
+    return used;
+}
+
+// print the live blocks by call site, biggest first
+void HEAP_dumpLeaks()
+{
+    heap_site_stats_t* sites = kmalloc(sizeof(heap_site_stats_t) * HEAP_MAX_SITES);
+    if(sites == NULL)
+        return;
+
+    uint32_t errors = HEAP_check();
+    uint32_t count = HEAP_getSites(sites, HEAP_MAX_SITES);
+    uint32_t blocks = 0, bytes = 0;
+
+    // insertion sort by size
+    for(uint32_t i = 1; i < count; i++)
+    {
+        heap_site_stats_t site = sites[i];
+        int j = i - 1;
+
+        while(j >= 0 && sites[j].bytes < site.bytes)
+        {
+            sites[j + 1] = sites[j];
+            j--;
+        }
+
+        sites[j + 1] = site;
+    }
+
+    for(uint32_t i = 0; i < count; i++)
+    {
+        blocks += sites[i].blocks;
+        bytes += sites[i].bytes;
+    }
+
+    log_info("heap", "%d live blocks, %d bytes, %d call sites, %d damaged blocks", blocks, bytes, count, errors);
+
+    for(uint32_t i = 0; i < count; i++)
+        log_info("heap", "  0x%x: %d blocks, %d bytes", sites[i].caller, sites[i].blocks, sites[i].bytes);
+
+    kfree(sites);
+}
+
+static bool HEAP_siteRecord(uint32_t index, void* record)
+{
+    if(index >= HEAP_MAX_SITES)
+        return false;
+
+    heap_site_stats_t* sites = kmalloc(sizeof(heap_site_stats_t) * (index + 1));
+    if(sites == NULL)
+        return false;
+
+    bool found = HEAP_getSites(sites, index + 1) > index;
+    if(found)
+        *(heap_site_stats_t*)record = sites[index];
+
+    kfree(sites);
+
+    return found;
+}
+
+static int64_t HEAP_writeDevice(const uint8_t *buffer, int64_t offset, size_t len, void* priv, uint32_t flags)
+{
+    HEAP_dumpLeaks();
+    return len;
+}
+
+/*
+ * /dev/heapdebug: reading returns a heap_site_stats_t per call site,
+ * writing anything prints the leak report to the debug output
+*/
+void HEAP_createDevice()
+{
+    device_t* dev = add_record_device("heapdebug", HEAP_siteRecord, sizeof(heap_site_stats_t));
+
+    if(dev != NULL)
+        dev->write = HEAP_writeDevice;
+}
+
+#endif
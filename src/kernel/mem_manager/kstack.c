@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2025,  Novice
+ *
+ * This file is part of the Novix software.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <debug.h>
+#include <hal/gdt.h>
+#include <hal/idt.h>
+#include <hal/isr.h>
+#include <mem_manager/kstack.h>
+#include <mem_manager/vmalloc.h>
+#include <mem_manager/virtmem_manager.h>
+#include <multitasking/scheduler.h>
+#include <multitasking/process.h>
+#include <multitasking/lock.h>
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
+//============================================================================
+
+#define PAGE_SIZE 0x1000
+
+#define KSTACK_DOUBLE_FAULT_STACK_SIZE 0x1000
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE DATA
+//============================================================================
+
+// free stacks are chained through their first word
+void* KSTACK_freeList = NULL;
+uint32_t KSTACK_freeCount = 0;
+
+mutex_t KSTACK_mutex;
+
+// the double fault task can't use the stack that overflowed, each cpu has its own task and stack
+static uint8_t KSTACK_doubleFaultStack[GDT_MAX_CPUS][KSTACK_DOUBLE_FAULT_STACK_SIZE] __attribute__((aligned(16)));
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE FUNCTIONS
+//============================================================================
+
+// a new stack with an unmapped guard page right below it
+void* KSTACK_create()
+{
+    return VMALLOC_allocate(KSTACK_SIZE, VMALLOC_GUARD_LOW);
+}
+
+/*
+ * entry point of the double fault task. a kernel stack overflow ends here: the page fault
+ * can't push its frame on the guard page so the cpu raises a double fault, which switches
+ * to a task with its own stack. the registers of the faulting code are in the main tss
+*/
+void KSTACK_doubleFault()
+{
+    Registers regs;
+
+    TSS_getInterruptedState(&regs);
+    regs.interrupt = 8;
+    regs.error = 0;
+
+    KSTACK_reportGuardFault(ISR_getFaultAddress());
+    ISR_panic(&regs);
+}
+
+//============================================================================
+//    INTERFACE FUNCTIONS
+//============================================================================
+
+bool KSTACK_initialize()
+{
+    for(int i = 0; i < KSTACK_PREALLOCATED; i++)
+    {
+        void* stack = KSTACK_create();
+        if(stack == NULL)
+            return false;
+
+        *(void**)stack = KSTACK_freeList;
+        KSTACK_freeList = stack;
+        KSTACK_freeCount++;
+    }
+
+    // the task runs with the kernel page directory, the kernel half is the same in every address space anyway
+    // all cpus now, the application processors load their idt when they start
+    for(uint32_t cpu = 0; cpu < GDT_MAX_CPUS; cpu++)
+    {
+        TSS_setDoubleFaultTask(cpu, KSTACK_doubleFault, KSTACK_doubleFaultStack[cpu] + KSTACK_DOUBLE_FAULT_STACK_SIZE, (uint32_t)getPDBR());
+        IDT_setTaskGate(cpu, 8, GDT_doubleFaultSelector(cpu));
+    }
+
+    return true;
+}
+
+// returns the lowest address of a KSTACK_SIZE bytes stack
+void* KSTACK_alloc()
+{
+    void* stack;
+
+    if(is_schedulerEnabled())
+        acquire_mutex(&KSTACK_mutex);
+
+    stack = KSTACK_freeList;
+    if(stack != NULL)
+    {
+        KSTACK_freeList = *(void**)stack;
+        KSTACK_freeCount--;
+    }
+
+    if(is_schedulerEnabled())
+        release_mutex(&KSTACK_mutex);
+
+    if(stack == NULL)
+        stack = KSTACK_create();
+
+    return stack;
+}
+
+void KSTACK_free(void* stack)
+{
+    if(stack == NULL)
+        return;
+
+    if(is_schedulerEnabled())
+        acquire_mutex(&KSTACK_mutex);
+
+    if(KSTACK_freeCount < KSTACK_CACHE_MAX)
+    {
+        *(void**)stack = KSTACK_freeList;
+        KSTACK_freeList = stack;
+        KSTACK_freeCount++;
+        stack = NULL;
+    }
+
+    if(is_schedulerEnabled())
+        release_mutex(&KSTACK_mutex);
+
+    // the cache is full, give the memory back
+    if(stack != NULL)
+        vfree(stack);
+}
+
+/*
+ * if address is in the guard page of a process kernel stack, log which process overflowed it
+ * returns false if the address doesn't belong to any guard page
+*/
+bool KSTACK_reportGuardFault(uint32_t address)
+{
+    if(address < VMALLOC_START || address > VMALLOC_END)
+        return false;
+
+    void* stack = (void*)((address & ~(PAGE_SIZE - 1)) + PAGE_SIZE);
+    process_t* proc = PROCESS_getCurrent();
+
+    // it's almost always the running process, look at the others only if it's not
+    if(proc == NULL || proc->esp0 != stack)
+    {
+        proc = NULL;
+
+        for(uint32_t i = 0; i < MAX_PROCESS && proc == NULL; i++)
+        {
+            process_t* p = PROCESS_get(i);
+            if(p != NULL && p->esp0 == stack)
+                proc = p;
+        }
+    }
+
+    if(proc == NULL)
+        return false;
+
+    log_crit("kstack", "kernel stack overflow: process %d (0x%x) hit the guard page at 0x%x", proc->id, proc, address);
+    return true;
+}
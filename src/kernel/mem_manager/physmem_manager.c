@@ -20,26 +20,55 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <debug.h>
 #include <mem_manager/physmem_manager.h>
+#include <mem_manager/virtmem_manager.h>
 #include <memory.h>
 #include <utility.h>
 #include <multitasking/scheduler.h>
 #include <multitasking/lock.h>
+#include <multitasking/time.h>
+#include <multitasking/smp.h>
+#include <drivers/device.h>
+#include <string.h>
+#include <mem_manager/heap.h>
 
 //============================================================================
 //    IMPLEMENTATION PRIVATE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
 //============================================================================
 
 #define KERNEL_BASE_ADDR 0x100000
+#define IDENTITY_MAP_END 0x400000   // the first 4mb stay identity mapped in every address space
+#define PHYSICAL_END     0x100000000ULL
+#define BLOCK_SIZE       0x1000
 #define MAX_MEMORY_ENTRY 256
 #define BLOCK_SIZEKB 4
 #define BLOCK_PER_BYTE 8
 
+#define PHYSMEM_NO_FRAME 0xFFFFFFFF
+
+#define SELFTEST_BLOCKS     1024    // how many allocations the benchmark keeps alive at once
+#define SELFTEST_ROUNDS     64
+#define SELFTEST_MULTI_SIZE 16      // size (in blocks) of the multi-page benchmark requests
+
 typedef enum{
 	FREE_BLOCK, // 0
     USED_BLOCK, // 1
 }BITMAP_VALUE;
 
+/*
+ * one entry per physical block. Only the first block of a free buddy block
+ * is linked in a free list, the other entries are left untouched
+*/
+typedef struct physmem_frame
+{
+    uint32_t next;      // next free buddy block of the same order
+    uint32_t prev;      // previous free buddy block of the same order
+    uint8_t order;      // order of the buddy block starting here (valid only if isFree)
+    bool isFree;        // true if a free buddy block starts at this frame
+    uint16_t shareCount;// extra owners of a used block (copy on write), it is freed when the last one lets it go
+}physmem_frame_t;
+
 //============================================================================
 //    IMPLEMENTATION PRIVATE DATA
 //============================================================================
@@ -54,57 +83,193 @@ uint32_t PHYSMEM_totalFreeBlock     = 0;
 uint32_t PHYSMEM_totalUsedBlock     = 0;
 uint32_t PHYSMEM_bitmapSize;
 
-mutex_t PHYSMEM_mutex;
+// buddy allocator data
+physmem_frame_t* PHYSMEM_frames;
+PTE* PHYSMEM_frameTables;           // page tables mapping the frame array, next to the bitmap
+uint32_t PHYSMEM_frameTableCount;
+uint32_t PHYSMEM_freeList[PHYSMEM_MAX_ORDER + 1];   // first free block of each order
+uint32_t PHYSMEM_freeCount[PHYSMEM_MAX_ORDER + 1];  // number of free blocks of each order
+
+// statistics per caller subsystem
+uint32_t PHYSMEM_allocCalls[PHYSMEM_USER_COUNT];
+uint32_t PHYSMEM_freeCalls[PHYSMEM_USER_COUNT];
+uint32_t PHYSMEM_blocksInUse[PHYSMEM_USER_COUNT];
+uint32_t PHYSMEM_failedAllocs = 0;
+
+// pre-zeroed blocks, filled by the idle task
+uint32_t PHYSMEM_zeroPool[PHYSMEM_ZERO_POOL_SIZE];
+uint32_t PHYSMEM_zeroPoolCount  = 0;
+uint32_t PHYSMEM_zeroPoolHits   = 0;
+uint32_t PHYSMEM_zeroPoolMisses = 0;
+
+static const char* const g_PhysmemUserNames[] =
+{
+    [PHYSMEM_USER_KERNEL]       = "kernel",
+    [PHYSMEM_USER_HEAP]         = "heap",
+    [PHYSMEM_USER_VMALLOC]      = "vmalloc",
+    [PHYSMEM_USER_PAGE_TABLE]   = "page tables",
+    [PHYSMEM_USER_SHM]          = "shm",
+    [PHYSMEM_USER_PROCESS]      = "process",
+    [PHYSMEM_USER_ZERO_POOL]    = "zero pool",
+    [PHYSMEM_USER_PAGE_CACHE]   = "page cache",
+};
+
+spinlock_t PHYSMEM_lock = SPINLOCK_INIT("physmem");    // short sections, and usable before the scheduler
+
+// caches that can give memory back when we run out (the slabs, the page cache)
+physmem_reclaim_t PHYSMEM_reclaimHandlers[PHYSMEM_MAX_RECLAIM_HANDLERS];
+uint32_t PHYSMEM_reclaimHandlerCount = 0;
+volatile uint32_t PHYSMEM_reclaiming = 0;   // 1 while a task runs the reclaim handler, taken atomically
+
+void* PHYSMEM_selfTestBuffer[SELFTEST_BLOCKS];
 
 //============================================================================
 //    IMPLEMENTATION PRIVATE FUNCTION PROTOTYPES
 //============================================================================
 
+bool PHYSMEM_findRange(Boot_info* info, uint32_t kernel_size, uint64_t size, uint64_t min, uint64_t max, uint32_t* base);
 bool PHYSMEM_initData(Boot_info* info, uint32_t kernel_size);
 void PHYSMEM_memoryMapToBlock(uint32_t memoryBlockCount);
 void PHYSMEM_setBlockToFree(uint32_t block);
-void PHYSMEM_setBlockToUsed(int block);
-bool PHYSMEM_checkIfBlockUsed(int block);
-uint32_t PHYSMEM_firstFreeBlock();
-uint32_t PHYSMEM_firstFreeBlockFrom(uint32_t position);
+void PHYSMEM_setBlockToUsed(uint32_t block);
+bool PHYSMEM_checkIfBlockUsed(uint32_t block);
+
+void PHYSMEM_listPush(uint32_t frame, uint8_t order);
+void PHYSMEM_listRemove(uint32_t frame);
+uint8_t PHYSMEM_sizeToOrder(uint32_t blocks);
+uint32_t PHYSMEM_buddyAlloc(uint8_t order);
+void PHYSMEM_buddyFree(uint32_t frame, uint8_t order);
+void PHYSMEM_freeRange(uint32_t frame, uint32_t count);
+void PHYSMEM_buildFreeLists();
+void PHYSMEM_drainZeroPool();
+bool PHYSMEM_reclaim(uint32_t blocks);
+void* PHYSMEM_tryAllocBlocks(uint32_t block_size, physmem_user_t user);
+bool PHYSMEM_tryAllocBlockList(void** blocks, uint32_t count, physmem_user_t user);
 
 //============================================================================
 //    IMPLEMENTATION PRIVATE FUNCTIONS
 //============================================================================
 
+/*
+ * first available range of size bytes between min and max, 4kb aligned and away from the kernel image
+*/
+bool PHYSMEM_findRange(Boot_info* info, uint32_t kernel_size, uint64_t size, uint64_t min, uint64_t max, uint32_t* base)
+{
+    for(int i = 0; i < info->memoryBlockCount; i++)
+    {
+        if(info->memoryBlockEntries[i].type != AVAILABLE)
+            continue;
+
+        uint64_t start = info->memoryBlockEntries[i].base;
+        uint64_t end = start + info->memoryBlockEntries[i].length;
+
+        if(start < min)
+            start = min;
+
+        if(end > max)
+            end = max;
+
+        // don't step on the kernel image
+        if(start < KERNEL_BASE_ADDR + kernel_size && end > KERNEL_BASE_ADDR)
+            start = KERNEL_BASE_ADDR + kernel_size;
+
+        start = roundUp_div(start, BLOCK_SIZE) * BLOCK_SIZE;
+
+        if(start + size <= end)
+        {
+            *base = (uint32_t)start;
+            return true;
+        }
+    }
+
+    return false;
+}
+
 /*
  * this function initialize some of the useful data of the memory manager
- * sucha as where are we storing the bitmap, it's size ect.
+ * sucha as where are we storing the bitmap and the buddy frame array, their size ect.
+ *
+ * the bitmap (and the page tables of the frame array) must stay below 4mb because that's
+ * the only physical memory we can reach directly. The frame array grows with the memory
+ * (12 bytes per block, 3mb for 1gb) so it goes anywhere and is mapped at PHYSMEM_FRAMES_ADDR
 */ 
 bool PHYSMEM_initData(Boot_info* info, uint32_t kernel_size)
 {
     uint32_t base;
+    uint32_t framesBase;
+    uint32_t lowSize;
+    uint32_t framesSize;
 
     PHYSMEM_totalBlockNumber = roundUp_div(info->memorySize, BLOCK_SIZEKB);
     PHYSMEM_bitmapSize = roundUp_div(PHYSMEM_totalBlockNumber, BLOCK_PER_BYTE);
 
-    // here we are trying to find a free block of memory for the bitmap
-    for(int i = 0; i < info->memoryBlockCount; i++)
+    framesSize = roundUp_div(PHYSMEM_totalBlockNumber * sizeof(physmem_frame_t), BLOCK_SIZE) * BLOCK_SIZE;
+    if(framesSize > PHYSMEM_FRAMES_MAX_SIZE)
     {
-        if(info->memoryBlockEntries[i].type == AVAILABLE && info->memoryBlockEntries[i].length >= PHYSMEM_bitmapSize)
-        {
-            base = info->memoryBlockEntries[i].base;
-            goto Found;
-        }
+        log_crit("physmem", "%d Kb of memory is more than the frame array can describe", info->memorySize);
+        return false;
+    }
+
+    // the bitmap is followed by the page tables of the frame array
+    PHYSMEM_frameTableCount = roundUp_div(framesSize, LARGE_PAGE_SIZE);
+    lowSize = roundUp_div(PHYSMEM_bitmapSize, BLOCK_SIZE) * BLOCK_SIZE + PHYSMEM_frameTableCount * BLOCK_SIZE;
+
+    if(!PHYSMEM_findRange(info, kernel_size, lowSize, 0, IDENTITY_MAP_END, &base))
+    {
+        log_crit("physmem", "no room for the bitmap (%d bytes) below 4mb", lowSize);
+        return false;
+    }
+
+    // leave the low memory alone if we can, only a small machine has to put the frame array there
+    if(!PHYSMEM_findRange(info, kernel_size, framesSize, IDENTITY_MAP_END, PHYSICAL_END, &framesBase) &&
+       !PHYSMEM_findRange(info, kernel_size, framesSize, base + lowSize, IDENTITY_MAP_END, &framesBase))
+    {
+        log_crit("physmem", "no room for the frame array (%d bytes)", framesSize);
+        return false;
     }
 
-    return false;   // we can't find enough space for the bitmap? is this a joke?
+    PHYSMEM_bitmap = (uint8_t*)(uintptr_t)base;
+    PHYSMEM_frameTables = (PTE*)(uintptr_t)(base + roundUp_div(PHYSMEM_bitmapSize, BLOCK_SIZE) * BLOCK_SIZE);
+
+    for(uint32_t i = 0; i < PHYSMEM_frameTableCount * 1024; i++)
+    {
+        uint32_t offset = i * BLOCK_SIZE;
 
-Found:
-    PHYSMEM_bitmap = (uint8_t*)base;
+        PHYSMEM_frameTables[i] = 0;
+        if(offset < framesSize)
+            PHYSMEM_frameTables[i] = (framesBase + offset) | PTE_PAGE_PRESENT | PTE_PAGE_WRITE | PTE_PAGE_KERNEL_MODE | PTE_PAGE_GLOBAL;
+    }
 
-    // initialy we mark the whole memory as used
-    memset(PHYSMEM_bitmap, 0b11111111, PHYSMEM_bitmapSize);
+    // still on the boot page directory, it is identity mapped
+    PHYSMEM_mapFrames(getPDBR());
+    switchPDBR(getPDBR());
+
+    PHYSMEM_frames = (physmem_frame_t*)PHYSMEM_FRAMES_ADDR;
+
+    // initialy we mark the whole memory as used (memset can't handle more than 64kb)
+    for(uint32_t i = 0; i < PHYSMEM_bitmapSize; i++)
+        PHYSMEM_bitmap[i] = 0b11111111;
+
+    for(uint32_t i = 0; i < PHYSMEM_totalBlockNumber; i++)
+    {
+        PHYSMEM_frames[i].next = PHYSMEM_NO_FRAME;
+        PHYSMEM_frames[i].prev = PHYSMEM_NO_FRAME;
+        PHYSMEM_frames[i].order = 0;
+        PHYSMEM_frames[i].isFree = false;
+        PHYSMEM_frames[i].shareCount = 0;
+    }
 
     // to prevent allocating and overwriting this region
     // we need to add a new reserved region to our memory map (because that's where the bitmap will reside)
     info->memoryBlockEntries[info->memoryBlockCount].base = base;
-    info->memoryBlockEntries[info->memoryBlockCount].length = PHYSMEM_bitmapSize;
+    info->memoryBlockEntries[info->memoryBlockCount].length = lowSize;
+    info->memoryBlockEntries[info->memoryBlockCount].type = RESERVED;
+
+    info->memoryBlockCount++;
+
+    // and the frame array
+    info->memoryBlockEntries[info->memoryBlockCount].base = framesBase;
+    info->memoryBlockEntries[info->memoryBlockCount].length = framesSize;
     info->memoryBlockEntries[info->memoryBlockCount].type = RESERVED;
 
     info->memoryBlockCount++;
@@ -116,8 +281,22 @@ Found:
 
     info->memoryBlockCount++;
 
+    // block 0 must never be handed out, its address is NULL
+    info->memoryBlockEntries[info->memoryBlockCount].base = 0;
+    info->memoryBlockEntries[info->memoryBlockCount].length = BLOCK_SIZEKB * 0x400;
+    info->memoryBlockEntries[info->memoryBlockCount].type = RESERVED;
+
+    info->memoryBlockCount++;
+
+    // the application processors start in real mode from this page (see smp.asm)
+    info->memoryBlockEntries[info->memoryBlockCount].base = SMP_TRAMPOLINE_ADDR;
+    info->memoryBlockEntries[info->memoryBlockCount].length = BLOCK_SIZEKB * 0x400;
+    info->memoryBlockEntries[info->memoryBlockCount].type = RESERVED;
+
+    info->memoryBlockCount++;
+
     // the memory map to the 4kb size array
-    memcpy(&g_memory4KbEntries, info->memoryBlockEntries, MAX_MEMORY_ENTRY);
+    memcpy(&g_memory4KbEntries, info->memoryBlockEntries, sizeof(Memory_mapEntry) * info->memoryBlockCount);
 
     return true;
 }
@@ -152,44 +331,228 @@ void PHYSMEM_memoryMapToBlock(uint32_t memoryBlockCount)
 
 void PHYSMEM_setBlockToFree(uint32_t block)
 {
-    if(block > PHYSMEM_totalBlockNumber)
+    if(block >= PHYSMEM_totalBlockNumber)
         return;
     
-    PHYSMEM_bitmap[block / 8] ^= (1 << block % 8);
+    PHYSMEM_bitmap[block / 8] &= ~(1 << block % 8);
 }
 
-void PHYSMEM_setBlockToUsed(int block)
+void PHYSMEM_setBlockToUsed(uint32_t block)
 {
-    if(block > PHYSMEM_totalBlockNumber)
+    if(block >= PHYSMEM_totalBlockNumber)
         return;
     
     PHYSMEM_bitmap[block / 8] |= (1 << block % 8);
 }
 
-bool PHYSMEM_checkIfBlockUsed(int block)
+bool PHYSMEM_checkIfBlockUsed(uint32_t block)
 {
-    if(block > PHYSMEM_totalBlockNumber)
+    if(block >= PHYSMEM_totalBlockNumber)
         return true;
     
     return (PHYSMEM_bitmap[block / 8] & (1 << block % 8)) ? true : false;
 }
 
-uint32_t PHYSMEM_firstFreeBlock()
+// insert a free buddy block at the head of the free list of its order
+void PHYSMEM_listPush(uint32_t frame, uint8_t order)
 {
-    for(int i = 0; i < PHYSMEM_totalBlockNumber; i++)
-        if(!PHYSMEM_checkIfBlockUsed(i))
-            return i;
+    PHYSMEM_frames[frame].order = order;
+    PHYSMEM_frames[frame].isFree = true;
+    PHYSMEM_frames[frame].prev = PHYSMEM_NO_FRAME;
+    PHYSMEM_frames[frame].next = PHYSMEM_freeList[order];
+
+    if(PHYSMEM_freeList[order] != PHYSMEM_NO_FRAME)
+        PHYSMEM_frames[PHYSMEM_freeList[order]].prev = frame;
 
-    return -1;
+    PHYSMEM_freeList[order] = frame;
+    PHYSMEM_freeCount[order]++;
 }
 
-uint32_t PHYSMEM_firstFreeBlockFrom(uint32_t position)
+void PHYSMEM_listRemove(uint32_t frame)
 {
-    for(int i = position; i < PHYSMEM_totalBlockNumber; i++)
-        if(!PHYSMEM_checkIfBlockUsed(i))
-            return i;
+    physmem_frame_t* entry = &PHYSMEM_frames[frame];
+
+    if(entry->prev != PHYSMEM_NO_FRAME)
+        PHYSMEM_frames[entry->prev].next = entry->next;
+    else
+        PHYSMEM_freeList[entry->order] = entry->next;
+
+    if(entry->next != PHYSMEM_NO_FRAME)
+        PHYSMEM_frames[entry->next].prev = entry->prev;
 
-    return -1;
+    PHYSMEM_freeCount[entry->order]--;
+
+    entry->isFree = false;
+    entry->next = PHYSMEM_NO_FRAME;
+    entry->prev = PHYSMEM_NO_FRAME;
+}
+
+// smallest order whose buddy block can hold this many blocks
+uint8_t PHYSMEM_sizeToOrder(uint32_t blocks)
+{
+    uint8_t order = 0;
+
+    while((1u << order) < blocks)
+        order++;
+
+    return order;
+}
+
+/*
+ * take the smallest free buddy block that is big enough and split it
+ * until we reach the requested order, the upper halves go back in the free lists
+*/
+uint32_t PHYSMEM_buddyAlloc(uint8_t order)
+{
+    uint8_t current = order;
+
+    while(current <= PHYSMEM_MAX_ORDER && PHYSMEM_freeList[current] == PHYSMEM_NO_FRAME)
+        current++;
+
+    if(current > PHYSMEM_MAX_ORDER)
+        return PHYSMEM_NO_FRAME;
+
+    uint32_t frame = PHYSMEM_freeList[current];
+    PHYSMEM_listRemove(frame);
+
+    while(current > order)
+    {
+        current--;
+        PHYSMEM_listPush(frame + (1 << current), current);
+    }
+
+    return frame;
+}
+
+/*
+ * give back a buddy block and merge it with its buddy as long as the buddy is free too
+*/
+void PHYSMEM_buddyFree(uint32_t frame, uint8_t order)
+{
+    while(order < PHYSMEM_MAX_ORDER)
+    {
+        uint32_t buddy = frame ^ (1 << order);
+
+        if(buddy >= PHYSMEM_totalBlockNumber)
+            break;
+
+        if(!PHYSMEM_frames[buddy].isFree || PHYSMEM_frames[buddy].order != order)
+            break;
+
+        PHYSMEM_listRemove(buddy);
+
+        if(buddy < frame)
+            frame = buddy;
+
+        order++;
+    }
+
+    PHYSMEM_listPush(frame, order);
+}
+
+/*
+ * free an arbitrary range of blocks, the range is cut into
+ * the biggest naturally aligned buddy blocks it contains
+*/
+void PHYSMEM_freeRange(uint32_t frame, uint32_t count)
+{
+    uint32_t end = frame + count;
+
+    while(frame < end)
+    {
+        uint8_t order = 0;
+
+        while(order < PHYSMEM_MAX_ORDER && (frame & ((2u << order) - 1)) == 0 && frame + (2u << order) <= end)
+            order++;
+
+        PHYSMEM_buddyFree(frame, order);
+        frame += 1 << order;
+    }
+}
+
+/*
+ * build the free lists from the bitmap. We walk the memory from the top so that
+ * after all the insertions each free list is sorted by ascending address, this way
+ * early allocations (page directory, first page tables...) come from low memory
+*/
+void PHYSMEM_buildFreeLists()
+{
+    for(int i = 0; i <= PHYSMEM_MAX_ORDER; i++)
+    {
+        PHYSMEM_freeList[i] = PHYSMEM_NO_FRAME;
+        PHYSMEM_freeCount[i] = 0;
+    }
+
+    uint32_t end = PHYSMEM_totalBlockNumber;
+
+    while(end > 0)
+    {
+        // skip used blocks
+        if(PHYSMEM_checkIfBlockUsed(end - 1))
+        {
+            end--;
+            continue;
+        }
+
+        // find the beginning of this free run
+        uint32_t start = end - 1;
+        while(start > 0 && !PHYSMEM_checkIfBlockUsed(start - 1))
+            start--;
+
+        // and cut it into buddy blocks starting from its end
+        while(end > start)
+        {
+            uint8_t order = 0;
+
+            while(order < PHYSMEM_MAX_ORDER && (end & ((2u << order) - 1)) == 0 && end - (2u << order) >= start)
+                order++;
+
+            end -= 1 << order;
+            PHYSMEM_listPush(end, order);
+        }
+    }
+}
+
+/*
+ * give every pre-zeroed block back to the buddy allocator when memory runs low
+ * the caller must hold PHYSMEM_lock
+*/
+void PHYSMEM_drainZeroPool()
+{
+    while(PHYSMEM_zeroPoolCount > 0)
+    {
+        uint32_t frame = PHYSMEM_zeroPool[--PHYSMEM_zeroPoolCount];
+
+        PHYSMEM_setBlockToFree(frame);
+        PHYSMEM_freeRange(frame, 1);
+
+        PHYSMEM_totalUsedBlock--;
+        PHYSMEM_totalFreeBlock++;
+        PHYSMEM_blocksInUse[PHYSMEM_USER_ZERO_POOL]--;
+    }
+}
+
+/*
+ * an allocation failed: ask the reclaim handlers for memory. They run without PHYSMEM_lock
+ * and free blocks themselves, the flag keeps them from being called again while they run, on
+ * this cpu (an allocation of a handler) or on another one: that caller doesn't wait,
+ * its allocation fails like before. The handlers may sleep, so a caller holding a spinlock
+ * (the heap growing, vmalloc) doesn't get them either: its allocation fails right away and
+ * only the reclaim task or a later allocation gives memory back.
+ * returns true if something was given back
+*/
+bool PHYSMEM_reclaim(uint32_t blocks)
+{
+    if(PHYSMEM_reclaimHandlerCount == 0 || is_spinlock_held())
+        return false;
+
+    if(__sync_lock_test_and_set(&PHYSMEM_reclaiming, 1))
+        return false;
+
+    uint32_t freed = PHYSMEM_shrinkCaches(blocks);
+    __sync_lock_release(&PHYSMEM_reclaiming);
+
+    return freed > 0;
 }
 
 //============================================================================
@@ -201,12 +564,14 @@ bool PHYSMEM_initialize(Boot_info* info, uint32_t kernel_size)
     uint32_t block;
 
     if(info == NULL)
+    {
+        log_crit("physmem", "no boot information");
         return false;
+    }
 
     if(!PHYSMEM_initData(info, kernel_size))
         return false;
 
-
     // transform the actual memory map to a memory map with bases and length align to 4Kb
     PHYSMEM_memoryMapToBlock(info->memoryBlockCount);
 
@@ -246,120 +611,618 @@ bool PHYSMEM_initialize(Boot_info* info, uint32_t kernel_size)
             PHYSMEM_totalUsedBlock++;
     }
 
+    // finally the buddy allocator takes over the free blocks
+    PHYSMEM_buildFreeLists();
+
     return true;
 }
 
+// the frame array window is part of the kernel half, every page directory made at boot needs it
+void PHYSMEM_mapFrames(uint32_t* page_directory)
+{
+    for(uint32_t i = 0; i < PHYSMEM_frameTableCount; i++)
+    {
+        uint32_t table = (uint32_t)PHYSMEM_frameTables + i * BLOCK_SIZE;
+        page_directory[(PHYSMEM_FRAMES_ADDR >> 22) + i] = table | PDE_PRESENT | PDE_WRITE | PDE_KERNEL_MODE;
+    }
+}
+
 void* PHYSMEM_AllocBlock()
 {
-    if(is_schedulerEnabled())
-        acquire_mutex(&PHYSMEM_mutex);
+    return PHYSMEM_AllocBlocksFor(1, PHYSMEM_USER_KERNEL);
+}
 
-    uint32_t block = PHYSMEM_firstFreeBlock();
+void* PHYSMEM_AllocBlocks(uint32_t block_size)
+{
+    return PHYSMEM_AllocBlocksFor(block_size, PHYSMEM_USER_KERNEL);
+}
 
-    if(block == -1)
+void* PHYSMEM_tryAllocBlocks(uint32_t block_size, physmem_user_t user)
+{
+    if(block_size == 0 || block_size > PHYSMEM_totalFreeBlock + PHYSMEM_zeroPoolCount || block_size > (1 << PHYSMEM_MAX_ORDER))
     {
-        if(is_schedulerEnabled())
-            release_mutex(&PHYSMEM_mutex);
+        PHYSMEM_failedAllocs++;
+        return NULL;
+    }
+
+    spin_lock(&PHYSMEM_lock);
+
+    uint8_t order = PHYSMEM_sizeToOrder(block_size);
+    uint32_t frame = PHYSMEM_buddyAlloc(order);
+
+    // the zero pool is just a cache, memory requests come first
+    if(frame == PHYSMEM_NO_FRAME && PHYSMEM_zeroPoolCount > 0)
+    {
+        PHYSMEM_drainZeroPool();
+        frame = PHYSMEM_buddyAlloc(order);
+    }
+
+    if(frame == PHYSMEM_NO_FRAME)
+    {
+        PHYSMEM_failedAllocs++;
+
+        spin_unlock(&PHYSMEM_lock);
 
         return NULL;
     }
-        
-    
-    PHYSMEM_setBlockToUsed(block);
-    PHYSMEM_totalUsedBlock++;
-    PHYSMEM_totalFreeBlock--;
 
-    if(is_schedulerEnabled())
-        release_mutex(&PHYSMEM_mutex);
+    // the buddy block may be bigger than what was asked, give the tail back
+    if(block_size < (1u << order))
+        PHYSMEM_freeRange(frame + block_size, (1 << order) - block_size);
+
+    for(uint32_t i = 0; i < block_size; i++)
+        PHYSMEM_setBlockToUsed(frame + i);
+
+    PHYSMEM_totalUsedBlock += block_size;
+    PHYSMEM_totalFreeBlock -= block_size;
+
+    PHYSMEM_allocCalls[user]++;
+    PHYSMEM_blocksInUse[user] += block_size;
 
-    return (void*)(block * BLOCK_SIZEKB * 0x400);
+    spin_unlock(&PHYSMEM_lock);
+
+    return (void*)(frame * BLOCK_SIZEKB * 0x400);
 }
 
-void* PHYSMEM_AllocBlocks(uint32_t block_size)
+void* PHYSMEM_AllocBlocksFor(uint32_t block_size, physmem_user_t user)
 {
-    uint32_t index;
-    uint32_t block_addr;
-    uint32_t count;
+    void* block = PHYSMEM_tryAllocBlocks(block_size, user);
 
-    if(block_size > PHYSMEM_totalFreeBlock)
-        return NULL;
+    // out of memory, try again once the caches gave something back
+    if(block == NULL && PHYSMEM_reclaim(block_size))
+        block = PHYSMEM_tryAllocBlocks(block_size, user);
 
-    if(is_schedulerEnabled())
-        acquire_mutex(&PHYSMEM_mutex);
-    
-    index = PHYSMEM_firstFreeBlock();
-    block_addr = index;
-    count = 1; // we already have one block
+    return block;
+}
+
+/*
+ * allocate count single blocks (not contiguous) with one lock of the allocator,
+ * used to map big ranges. all or nothing: returns false if they can't all be allocated
+*/
+bool PHYSMEM_tryAllocBlockList(void** blocks, uint32_t count, physmem_user_t user)
+{
+    if(count == 0)
+        return true;
 
-    while (index < PHYSMEM_totalBlockNumber)
+    if(count > PHYSMEM_totalFreeBlock + PHYSMEM_zeroPoolCount)
     {
-        if(count >= block_size)
+        PHYSMEM_failedAllocs++;
+        return false;
+    }
+
+    spin_lock(&PHYSMEM_lock);
+
+    for(uint32_t i = 0; i < count; i++)
+    {
+        uint32_t frame = PHYSMEM_buddyAlloc(0);
+
+        // the zero pool is just a cache, memory requests come first
+        if(frame == PHYSMEM_NO_FRAME && PHYSMEM_zeroPoolCount > 0)
         {
-            for(int i = 0; i < count; i++)
+            PHYSMEM_drainZeroPool();
+            frame = PHYSMEM_buddyAlloc(0);
+        }
+
+        if(frame == PHYSMEM_NO_FRAME)
+        {
+            // give back what we took so far
+            while(i-- > 0)
             {
-                PHYSMEM_setBlockToUsed(block_addr + i);
-                PHYSMEM_totalUsedBlock++;
-                PHYSMEM_totalFreeBlock--;
+                uint32_t block = (uint32_t)blocks[i] / (BLOCK_SIZEKB * 0x400);
+
+                PHYSMEM_setBlockToFree(block);
+                PHYSMEM_freeRange(block, 1);
             }
 
-            if(is_schedulerEnabled())
-                release_mutex(&PHYSMEM_mutex);
-            
-            return (void*)(block_addr * BLOCK_SIZEKB * 0x400);
+            PHYSMEM_failedAllocs++;
+
+            spin_unlock(&PHYSMEM_lock);
+
+            return false;
         }
 
-        index++;
-        if(PHYSMEM_checkIfBlockUsed(index))
+        PHYSMEM_setBlockToUsed(frame);
+        blocks[i] = (void*)(frame * BLOCK_SIZEKB * 0x400);
+    }
+
+    PHYSMEM_totalUsedBlock += count;
+    PHYSMEM_totalFreeBlock -= count;
+
+    PHYSMEM_allocCalls[user]++;
+    PHYSMEM_blocksInUse[user] += count;
+
+    spin_unlock(&PHYSMEM_lock);
+
+    return true;
+}
+
+bool PHYSMEM_AllocBlockList(void** blocks, uint32_t count, physmem_user_t user)
+{
+    if(PHYSMEM_tryAllocBlockList(blocks, count, user))
+        return true;
+
+    return PHYSMEM_reclaim(count) && PHYSMEM_tryAllocBlockList(blocks, count, user);
+}
+
+void PHYSMEM_freeBlock(void* ptr)
+{
+    PHYSMEM_freeBlocksFor(ptr, 1, PHYSMEM_USER_KERNEL);
+}
+
+void PHYSMEM_freeBlocks(void* ptr, uint32_t size)
+{
+    PHYSMEM_freeBlocksFor(ptr, size, PHYSMEM_USER_KERNEL);
+}
+
+void PHYSMEM_freeBlocksFor(void* ptr, uint32_t size, physmem_user_t user)
+{
+    if(!ptr || size == 0)
+        return;
+
+    uint32_t block = (uint32_t)ptr / (BLOCK_SIZEKB * 0x400);
+
+    if(block + size > PHYSMEM_totalBlockNumber)
+        return;
+
+    spin_lock(&PHYSMEM_lock);
+
+    // a block that is already free would corrupt the free lists
+    for(uint32_t i = 0; i < size; i++)
+    {
+        if(!PHYSMEM_checkIfBlockUsed(block + i))
         {
-            count = 1;
-            index = PHYSMEM_firstFreeBlockFrom(index);
-            block_addr = index;
+            log_err("physmem", "double free of block 0x%x", (block + i) * BLOCK_SIZEKB * 0x400);
+
+            spin_unlock(&PHYSMEM_lock);
+
+            return;
         }
+    }
+
+    // a shared block only loses one owner
+    if(size == 1 && PHYSMEM_frames[block].shareCount > 0)
+    {
+        PHYSMEM_frames[block].shareCount--;
 
-        count++;
+        spin_unlock(&PHYSMEM_lock);
+
+        return;
     }
 
-    if(is_schedulerEnabled())
-        release_mutex(&PHYSMEM_mutex);
-    
-    return NULL;
+    for(uint32_t i = 0; i < size; i++)
+        PHYSMEM_setBlockToFree(block + i);
+
+    PHYSMEM_freeRange(block, size);
+
+    PHYSMEM_totalUsedBlock -= size;
+    PHYSMEM_totalFreeBlock += size;
+
+    PHYSMEM_freeCalls[user]++;
+    PHYSMEM_blocksInUse[user] -= size;
+
+    spin_unlock(&PHYSMEM_lock);
 }
 
-void PHYSMEM_freeBlock(void* ptr)
+/*
+ * free many single blocks at once (an address space being torn down), the allocator
+ * is locked only once. shared blocks just lose one owner like in PHYSMEM_freeBlocksFor()
+*/
+void PHYSMEM_freeBlockList(void** blocks, uint32_t count, physmem_user_t user)
 {
-    if(!ptr)
+    uint32_t freed = 0;
+
+    if(count == 0)
         return;
 
-    if(is_schedulerEnabled())
-        acquire_mutex(&PHYSMEM_mutex);
+    spin_lock(&PHYSMEM_lock);
+
+    for(uint32_t i = 0; i < count; i++)
+    {
+        uint32_t block = (uint32_t)blocks[i] / (BLOCK_SIZEKB * 0x400);
+
+        if(blocks[i] == NULL || block >= PHYSMEM_totalBlockNumber)
+            continue;
 
+        if(!PHYSMEM_checkIfBlockUsed(block))
+        {
+            log_err("physmem", "double free of block 0x%x", blocks[i]);
+            continue;
+        }
+
+        if(PHYSMEM_frames[block].shareCount > 0)
+        {
+            PHYSMEM_frames[block].shareCount--;
+            continue;
+        }
+
+        PHYSMEM_setBlockToFree(block);
+        PHYSMEM_freeRange(block, 1);
+        freed++;
+    }
+
+    PHYSMEM_totalUsedBlock -= freed;
+    PHYSMEM_totalFreeBlock += freed;
+
+    PHYSMEM_freeCalls[user]++;
+    PHYSMEM_blocksInUse[user] -= freed;
+
+    spin_unlock(&PHYSMEM_lock);
+}
+
+/*
+ * add an owner to a used block, it will take one more PHYSMEM_freeBlocksFor()
+ * to really free it. returns false if the block is not in use or has too many owners
+*/
+bool PHYSMEM_shareBlock(void* ptr)
+{
     uint32_t block = (uint32_t)ptr / (BLOCK_SIZEKB * 0x400);
+    bool ret = false;
+
+    if(block >= PHYSMEM_totalBlockNumber)
+        return false;
 
-    PHYSMEM_setBlockToFree(block);
-    PHYSMEM_totalUsedBlock--;
-    PHYSMEM_totalFreeBlock++;
+    spin_lock(&PHYSMEM_lock);
+
+    if(PHYSMEM_checkIfBlockUsed(block) && PHYSMEM_frames[block].shareCount < 0xFFFF)
+    {
+        PHYSMEM_frames[block].shareCount++;
+        ret = true;
+    }
 
-    if(is_schedulerEnabled())
-        release_mutex(&PHYSMEM_mutex);
+    spin_unlock(&PHYSMEM_lock);
+
+    return ret;
 }
 
-void PHYSMEM_freeBlocks(void* ptr, uint32_t size)
+// number of owners of a block, 0 if it is free
+uint32_t PHYSMEM_getRefCount(void* ptr)
+{
+    uint32_t block = (uint32_t)ptr / (BLOCK_SIZEKB * 0x400);
+    uint32_t owners = 0;
+
+    if(block >= PHYSMEM_totalBlockNumber)
+        return 0;
+
+    spin_lock(&PHYSMEM_lock);
+
+    if(PHYSMEM_checkIfBlockUsed(block))
+        owners = PHYSMEM_frames[block].shareCount + 1;
+
+    spin_unlock(&PHYSMEM_lock);
+
+    return owners;
+}
+
+void* PHYSMEM_AllocZeroedBlock()
+{
+    return PHYSMEM_AllocZeroedBlockFor(PHYSMEM_USER_KERNEL);
+}
+
+/*
+ * allocate a block that is guaranteed to be filled with zeros, the pool
+ * is tried first and we only pay for the clearing if it is empty
+*/
+void* PHYSMEM_AllocZeroedBlockFor(physmem_user_t user)
+{
+    uint32_t frame = PHYSMEM_NO_FRAME;
+
+    spin_lock(&PHYSMEM_lock);
+
+    if(PHYSMEM_zeroPoolCount > 0)
+    {
+        frame = PHYSMEM_zeroPool[--PHYSMEM_zeroPoolCount];
+
+        PHYSMEM_zeroPoolHits++;
+        PHYSMEM_allocCalls[user]++;
+        PHYSMEM_blocksInUse[user]++;
+        PHYSMEM_blocksInUse[PHYSMEM_USER_ZERO_POOL]--;
+    }
+    else
+        PHYSMEM_zeroPoolMisses++;
+
+    spin_unlock(&PHYSMEM_lock);
+
+    if(frame != PHYSMEM_NO_FRAME)
+        return (void*)(frame * BLOCK_SIZEKB * 0x400);
+
+    void* block = PHYSMEM_AllocBlocksFor(1, user);
+    if(block != NULL)
+        VIRTMEM_clearFrame(block);
+
+    return block;
+}
+
+uint32_t PHYSMEM_getFreeBlocks()
+{
+    return PHYSMEM_totalFreeBlock + PHYSMEM_zeroPoolCount;  // the zero pool is given back on demand
+}
+
+// a cache that can give memory back, the handlers are asked in the order they were added
+void PHYSMEM_addReclaimHandler(physmem_reclaim_t handler)
 {
-    if(!ptr)
+    if(PHYSMEM_reclaimHandlerCount >= PHYSMEM_MAX_RECLAIM_HANDLERS)
+    {
+        log_err("physmem", "too many reclaim handlers");
         return;
+    }
 
-    if(is_schedulerEnabled())
-        acquire_mutex(&PHYSMEM_mutex);
+    PHYSMEM_reclaimHandlers[PHYSMEM_reclaimHandlerCount++] = handler;
+}
 
-    uint32_t block = (uint32_t)ptr / (BLOCK_SIZEKB * 0x400);
+/*
+ * ask the reclaim handlers for blocks until enough were given back, for a failed allocation
+ * or the reclaim task. They may sleep: the caller holds no spinlock.
+ * returns how many blocks were given back
+*/
+uint32_t PHYSMEM_shrinkCaches(uint32_t blocks)
+{
+    uint32_t freed = 0;
 
-    for(uint32_t i = 0; i < size; i++)
+    for(uint32_t i = 0; i < PHYSMEM_reclaimHandlerCount && freed < blocks; i++)
+        freed += PHYSMEM_reclaimHandlers[i](blocks - freed);
+
+    return freed;
+}
+
+/*
+ * called by the idle task: add one zeroed block to the pool.
+ * The idle task must never sleep, so we give up if someone holds the allocator
+ * returns true if a block was added
+*/
+bool PHYSMEM_refillZeroPool()
+{
+    // don't keep memory aside when there is not much left
+    if(PHYSMEM_zeroPoolCount >= PHYSMEM_ZERO_POOL_SIZE || PHYSMEM_totalFreeBlock < PHYSMEM_ZERO_POOL_SIZE * 4)
+        return false;
+
+    if(!spin_trylock(&PHYSMEM_lock))
+        return false;
+
+    uint32_t frame = PHYSMEM_buddyAlloc(0);
+
+    if(frame != PHYSMEM_NO_FRAME)
     {
-        PHYSMEM_setBlockToFree(block + i);
+        PHYSMEM_setBlockToUsed(frame);
+        PHYSMEM_totalUsedBlock++;
+        PHYSMEM_totalFreeBlock--;
+        PHYSMEM_blocksInUse[PHYSMEM_USER_ZERO_POOL]++;
+    }
+
+    spin_unlock(&PHYSMEM_lock);
+
+    if(frame == PHYSMEM_NO_FRAME)
+        return false;
+
+    // cleared without the lock, it's ours until it's in the pool
+    VIRTMEM_clearFrame((void*)(frame * BLOCK_SIZEKB * 0x400));
+
+    spin_lock(&PHYSMEM_lock);
+
+    if(PHYSMEM_zeroPoolCount < PHYSMEM_ZERO_POOL_SIZE)
+        PHYSMEM_zeroPool[PHYSMEM_zeroPoolCount++] = frame;
+    else
+    {
+        // someone else filled the pool meanwhile
+        PHYSMEM_setBlockToFree(frame);
+        PHYSMEM_freeRange(frame, 1);
         PHYSMEM_totalUsedBlock--;
         PHYSMEM_totalFreeBlock++;
+        PHYSMEM_blocksInUse[PHYSMEM_USER_ZERO_POOL]--;
     }
 
-    if(is_schedulerEnabled())
-        release_mutex(&PHYSMEM_mutex);
-}
\ No newline at end of file
+    spin_unlock(&PHYSMEM_lock);
+
+    return true;
+}
+
+/*
+ * boot time sanity check of the buddy allocator followed by a small benchmark,
+ * the timings come from the pit so the scheduler must be initialized
+*/
+bool PHYSMEM_selfTest()
+{
+    uint32_t freeBefore = PHYSMEM_totalFreeBlock;
+    uint32_t freeCountBefore[PHYSMEM_MAX_ORDER + 1];
+
+    for(int i = 0; i <= PHYSMEM_MAX_ORDER; i++)
+        freeCountBefore[i] = PHYSMEM_freeCount[i];
+
+    // a non power of two request must be aligned, contiguous and fully marked as used
+    uint8_t* multi = PHYSMEM_AllocBlocks(5);
+    uint8_t* single = PHYSMEM_AllocBlock();
+
+    if(multi == NULL || single == NULL || ((uint32_t)multi & 0xFFF) != 0)
+    {
+        log_err("physmem", "self-test: allocation failed");
+        return false;
+    }
+
+    for(uint32_t i = 0; i < 5; i++)
+    {
+        if(!PHYSMEM_checkIfBlockUsed((uint32_t)multi / 0x1000 + i) || (single >= multi && single < multi + 5 * 0x1000))
+        {
+            log_err("physmem", "self-test: overlapping or unmarked blocks");
+            return false;
+        }
+    }
+
+    PHYSMEM_freeBlock(single);
+    PHYSMEM_freeBlocks(multi, 5);
+
+    // every block must have been merged back with its buddy
+    for(int i = 0; i <= PHYSMEM_MAX_ORDER; i++)
+    {
+        if(freeCountBefore[i] != PHYSMEM_freeCount[i] || freeBefore != PHYSMEM_totalFreeBlock)
+        {
+            log_err("physmem", "self-test: coalescing failed at order %d", i);
+            return false;
+        }
+    }
+
+    // benchmark: 4kb requests
+    uint32_t allocations = 0;
+    uint64_t start = get_tikCount();
+
+    for(int round = 0; round < SELFTEST_ROUNDS; round++)
+    {
+        int count;
+        for(count = 0; count < SELFTEST_BLOCKS; count++)
+        {
+            PHYSMEM_selfTestBuffer[count] = PHYSMEM_AllocBlock();
+            if(PHYSMEM_selfTestBuffer[count] == NULL)
+                break;
+        }
+
+        allocations += count;
+
+        for(int i = 0; i < count; i++)
+            PHYSMEM_freeBlock(PHYSMEM_selfTestBuffer[i]);
+    }
+
+    uint32_t elapsed = get_tikCount() - start;
+    log_info("physmem", "self-test: %d 4KB allocs in %d ms (%d allocs/sec)", allocations, elapsed, allocations * 1000 / (elapsed ? elapsed : 1));
+
+    // benchmark: multi-page requests
+    allocations = 0;
+    start = get_tikCount();
+
+    for(int round = 0; round < SELFTEST_ROUNDS; round++)
+    {
+        int count;
+        for(count = 0; count < SELFTEST_BLOCKS / SELFTEST_MULTI_SIZE; count++)
+        {
+            PHYSMEM_selfTestBuffer[count] = PHYSMEM_AllocBlocks(SELFTEST_MULTI_SIZE);
+            if(PHYSMEM_selfTestBuffer[count] == NULL)
+                break;
+        }
+
+        allocations += count;
+
+        for(int i = 0; i < count; i++)
+            PHYSMEM_freeBlocks(PHYSMEM_selfTestBuffer[i], SELFTEST_MULTI_SIZE);
+    }
+
+    elapsed = get_tikCount() - start;
+    log_info("physmem", "self-test: %d %dKB allocs in %d ms (%d allocs/sec)", allocations, SELFTEST_MULTI_SIZE * BLOCK_SIZEKB, elapsed, allocations * 1000 / (elapsed ? elapsed : 1));
+
+    if(freeBefore != PHYSMEM_totalFreeBlock)
+    {
+        log_err("physmem", "self-test: leaked %d blocks", freeBefore - PHYSMEM_totalFreeBlock);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * take a snapshot of the allocator state. Looking for the free runs means
+ * walking the whole bitmap, so this is meant for reports, not hot paths
+*/
+void PHYSMEM_getStats(physmem_stats_t* stats)
+{
+    memset(stats, 0, sizeof(physmem_stats_t));
+
+    spin_lock(&PHYSMEM_lock);
+
+    stats->totalBlocks = PHYSMEM_totalBlockNumber;
+    stats->freeBlocks = PHYSMEM_totalFreeBlock;
+    stats->usedBlocks = PHYSMEM_totalUsedBlock;
+    stats->failedAllocs = PHYSMEM_failedAllocs;
+    stats->zeroPoolCount = PHYSMEM_zeroPoolCount;
+    stats->zeroPoolHits = PHYSMEM_zeroPoolHits;
+    stats->zeroPoolMisses = PHYSMEM_zeroPoolMisses;
+
+    for(int i = 0; i <= PHYSMEM_MAX_ORDER; i++)
+        stats->freeBuddyBlocks[i] = PHYSMEM_freeCount[i];
+
+    for(int i = 0; i < PHYSMEM_USER_COUNT; i++)
+    {
+        stats->allocCalls[i] = PHYSMEM_allocCalls[i];
+        stats->freeCalls[i] = PHYSMEM_freeCalls[i];
+        stats->blocksInUse[i] = PHYSMEM_blocksInUse[i];
+    }
+
+    uint32_t run = 0;
+    for(uint32_t i = 0; i <= PHYSMEM_totalBlockNumber; i++)
+    {
+        if(i < PHYSMEM_totalBlockNumber && !PHYSMEM_checkIfBlockUsed(i))
+        {
+            run++;
+            continue;
+        }
+
+        if(run == 0)
+            continue;
+
+        if(run > stats->largestFreeRun)
+            stats->largestFreeRun = run;
+
+        // bucket index is floor(log2(run))
+        uint8_t bucket = PHYSMEM_sizeToOrder(run + 1) - 1;
+        if(bucket > PHYSMEM_MAX_ORDER)
+            bucket = PHYSMEM_MAX_ORDER;
+
+        stats->freeRuns[bucket]++;
+        run = 0;
+    }
+
+    spin_unlock(&PHYSMEM_lock);
+}
+
+void PHYSMEM_dumpStats()
+{
+    physmem_stats_t stats;
+    PHYSMEM_getStats(&stats);
+
+    log_info("physmem", "%d/%d blocks free, largest free run: %d blocks, failed allocations: %d", stats.freeBlocks, stats.totalBlocks, stats.largestFreeRun, stats.failedAllocs);
+
+    for(int i = 0; i <= PHYSMEM_MAX_ORDER; i++)
+    {
+        if(stats.freeBuddyBlocks[i] == 0 && stats.freeRuns[i] == 0)
+            continue;
+
+        log_info("physmem", "  %d KB: %d free buddy blocks, %d free runs", (1 << i) * BLOCK_SIZEKB, stats.freeBuddyBlocks[i], stats.freeRuns[i]);
+    }
+
+    log_info("physmem", "zero pool: %d blocks, %d hits, %d misses", stats.zeroPoolCount, stats.zeroPoolHits, stats.zeroPoolMisses);
+
+    for(int i = 0; i < PHYSMEM_USER_COUNT; i++)
+        log_info("physmem", "  %s: %d blocks in use, %d allocs, %d frees", g_PhysmemUserNames[i], stats.blocksInUse[i], stats.allocCalls[i], stats.freeCalls[i]);
+}
+
+static bool PHYSMEM_statsRecord(uint32_t index, void* record)
+{
+    if(index > 0)
+        return false;
+
+    PHYSMEM_getStats((physmem_stats_t*)record);
+    return true;
+}
+
+/*
+ * read only device exposing a physmem_stats_t snapshot (/dev/physmem once devfs is mounted)
+*/
+void PHYSMEM_createDevice()
+{
+    add_record_device("physmem", PHYSMEM_statsRecord, sizeof(physmem_stats_t));
+}
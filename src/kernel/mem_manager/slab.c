@@ -0,0 +1,514 @@
+/*
+ * Copyright (C) 2025,  Novice
+ *
+ * This file is part of the Novix software.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <debug.h>
+#include <memory.h>
+#include <string.h>
+#include <utility.h>
+#include <mem_manager/slab.h>
+#include <mem_manager/heap.h>
+#include <mem_manager/vmalloc.h>
+#include <mem_manager/physmem_manager.h>
+#include <multitasking/scheduler.h>
+#include <multitasking/lock.h>
+#include <drivers/device.h>
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
+//============================================================================
+
+#define PAGE_SIZE 0x1000
+
+#define SLAB_ALIGN          8
+#define SLAB_MIN_OBJECTS    8   // a slab is made big enough to hold at least this many objects
+#define SLAB_MAX_PAGES      16
+#define SLAB_MAX_EMPTY      1   // empty slabs kept by a cache, the others go back to vmalloc
+
+#define SLAB_PAGE_COUNT     ((VMALLOC_END - VMALLOC_START + 1) / PAGE_SIZE)
+
+// stored in the link word of an object while it is allocated (catches double frees)
+#define SLAB_OBJ_ALLOCATED  ((void*)0xA110CA7E)
+
+#define SLAB_ALIGN_UP(x)    (((x) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1))
+#define SLAB_HEADER_SIZE    SLAB_ALIGN_UP(sizeof(slab_t))
+
+/*
+ * a slab is a few contiguous pages from vmalloc:
+ * [slab_t][obj 0][link 0][obj 1][link 1]...
+ * the link word right after each object chains the free objects,
+ * so a free object keeps its constructed state
+*/
+typedef struct slab
+{
+    struct kmem_cache* cache;
+    struct slab* next;
+    struct slab* prev;
+    void* free_list;    // first free object of this slab
+    uint32_t in_use;
+}slab_t;
+
+struct kmem_cache
+{
+    char name[KMEM_CACHE_NAME_LENGTH];
+    size_t size;                // size asked by the user
+    size_t stride;              // object + link word, aligned
+    uint32_t slab_pages;
+    uint32_t objects_per_slab;
+    kmem_ctor_t ctor;
+
+    slab_t* full;
+    slab_t* partial;
+    slab_t* empty;
+    uint32_t empty_count;
+    uint32_t total_slabs;
+
+    // statistics
+    uint32_t active_objects;
+    uint32_t alloc_calls;
+    uint32_t free_calls;
+    uint32_t slabs_created;
+    uint32_t slabs_reclaimed;
+
+    mutex_t mutex;
+    struct kmem_cache* next;
+};
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE DATA
+//============================================================================
+
+// which slab owns a page of the vmalloc range, this is how kmem_cache_free finds the slab of an object
+slab_t** SLAB_pageOwner = NULL;
+
+kmem_cache_t* SLAB_caches = NULL;
+mutex_t SLAB_mutex;  // protect the cache list
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE FUNCTIONS
+//============================================================================
+
+static inline void** SLAB_link(kmem_cache_t* cache, void* obj)
+{
+    return (void**)((uint8_t*)obj + cache->stride - sizeof(void*));
+}
+
+void SLAB_listPush(slab_t** list, slab_t* slab)
+{
+    slab->prev = NULL;
+    slab->next = *list;
+
+    if(*list != NULL)
+        (*list)->prev = slab;
+
+    *list = slab;
+}
+
+void SLAB_listRemove(slab_t** list, slab_t* slab)
+{
+    if(slab->prev != NULL)
+        slab->prev->next = slab->next;
+    else
+        *list = slab->next;
+
+    if(slab->next != NULL)
+        slab->next->prev = slab->prev;
+
+    slab->next = NULL;
+    slab->prev = NULL;
+}
+
+slab_t* SLAB_findSlab(void* obj)
+{
+    uint32_t addr = (uint32_t)obj;
+
+    if(addr < VMALLOC_START || addr > VMALLOC_END)
+        return NULL;
+
+    return SLAB_pageOwner[(addr - VMALLOC_START) / PAGE_SIZE];
+}
+
+void SLAB_setOwner(void* mem, uint32_t pages, slab_t* owner)
+{
+    uint32_t page = ((uint32_t)mem - VMALLOC_START) / PAGE_SIZE;
+
+    for(uint32_t i = 0; i < pages; i++)
+        SLAB_pageOwner[page + i] = owner;
+}
+
+// the caller must hold the cache mutex
+slab_t* SLAB_grow(kmem_cache_t* cache)
+{
+    void* mem = vmalloc(cache->slab_pages * PAGE_SIZE);
+    if(mem == NULL)
+        return NULL;
+
+    slab_t* slab = mem;
+    slab->cache = cache;
+    slab->in_use = 0;
+    slab->free_list = NULL;
+
+    // chain the objects backward so they are handed out in address order
+    uint8_t* first = (uint8_t*)mem + SLAB_HEADER_SIZE;
+    for(int i = cache->objects_per_slab - 1; i >= 0; i--)
+    {
+        void* obj = first + (i * cache->stride);
+
+        if(cache->ctor != NULL)
+            cache->ctor(obj);
+
+        *SLAB_link(cache, obj) = slab->free_list;
+        slab->free_list = obj;
+    }
+
+    SLAB_setOwner(mem, cache->slab_pages, slab);
+
+    cache->total_slabs++;
+    cache->slabs_created++;
+
+    return slab;
+}
+
+// the caller must hold the cache mutex, the slab must not be in any list
+void SLAB_release(kmem_cache_t* cache, slab_t* slab)
+{
+    SLAB_setOwner(slab, cache->slab_pages, NULL);
+    vfree(slab);
+
+    cache->total_slabs--;
+    cache->slabs_reclaimed++;
+}
+
+// give every empty slab of the cache back to vmalloc, the caller holds the cache mutex
+static uint32_t SLAB_releaseEmpty(kmem_cache_t* cache)
+{
+    uint32_t pages = 0;
+
+    while(cache->empty != NULL)
+    {
+        slab_t* slab = cache->empty;
+        SLAB_listRemove(&cache->empty, slab);
+        cache->empty_count--;
+
+        SLAB_release(cache, slab);
+        pages += cache->slab_pages;
+    }
+
+    return pages;
+}
+
+// the physical memory manager ran out, the empty slabs go first
+static uint32_t SLAB_reclaimHandler(uint32_t blocks)
+{
+    (void)blocks;   // all of them, they're of no use
+    return SLAB_reclaim();
+}
+
+//============================================================================
+//    INTERFACE FUNCTIONS
+//============================================================================
+
+bool SLAB_initialize()
+{
+    uint32_t size = SLAB_PAGE_COUNT * sizeof(slab_t*);
+
+    SLAB_pageOwner = vmalloc(size);
+    if(SLAB_pageOwner == NULL)
+        return false;
+
+    // memset can't clear more than 64kb at once
+    for(uint32_t i = 0; i < size; i += PAGE_SIZE)
+        memset((uint8_t*)SLAB_pageOwner + i, 0, PAGE_SIZE);
+
+    PHYSMEM_addReclaimHandler(SLAB_reclaimHandler);
+
+    return true;
+}
+
+kmem_cache_t* kmem_cache_create(const char* name, size_t size, kmem_ctor_t ctor)
+{
+    if(size == 0)
+        return NULL;
+
+    size_t stride = SLAB_ALIGN_UP(size + sizeof(void*));
+    uint32_t pages = roundUp_div(SLAB_HEADER_SIZE + (SLAB_MIN_OBJECTS * stride), PAGE_SIZE);
+
+    if(pages > SLAB_MAX_PAGES)
+    {
+        log_err("slab", "%s: objects of %d bytes are too big for a slab", name, size);
+        return NULL;
+    }
+
+    kmem_cache_t* cache = kmalloc(sizeof(kmem_cache_t));
+    if(cache == NULL)
+        return NULL;
+
+    memset(cache, 0, sizeof(kmem_cache_t));
+
+    strncpy(cache->name, name, KMEM_CACHE_NAME_LENGTH - 1);
+    cache->name[KMEM_CACHE_NAME_LENGTH - 1] = '\0';
+
+    cache->size = size;
+    cache->stride = stride;
+    cache->slab_pages = pages;
+    cache->objects_per_slab = ((pages * PAGE_SIZE) - SLAB_HEADER_SIZE) / stride;
+    cache->ctor = ctor;
+
+    if(is_schedulerEnabled())
+        acquire_mutex(&SLAB_mutex);
+
+    cache->next = SLAB_caches;
+    SLAB_caches = cache;
+
+    if(is_schedulerEnabled())
+        release_mutex(&SLAB_mutex);
+
+    return cache;
+}
+
+void kmem_cache_destroy(kmem_cache_t* cache)
+{
+    if(cache == NULL)
+        return;
+
+    if(cache->active_objects != 0)
+    {
+        log_err("slab", "%s: destroyed with %d objects still allocated", cache->name, cache->active_objects);
+        return;
+    }
+
+    if(is_schedulerEnabled())
+        acquire_mutex(&SLAB_mutex);
+
+    kmem_cache_t** current = &SLAB_caches;
+    while(*current != NULL && *current != cache)
+        current = &(*current)->next;
+
+    if(*current != NULL)
+        *current = cache->next;
+
+    if(is_schedulerEnabled())
+        release_mutex(&SLAB_mutex);
+
+    kmem_cache_shrink(cache);   // no active object: every slab is empty
+    kfree(cache);
+}
+
+void* kmem_cache_alloc(kmem_cache_t* cache)
+{
+    if(cache == NULL)
+        return NULL;
+
+    if(is_schedulerEnabled())
+        acquire_mutex(&cache->mutex);
+
+    slab_t* slab = cache->partial;
+
+    if(slab == NULL)
+    {
+        slab = cache->empty;
+
+        if(slab != NULL)
+        {
+            SLAB_listRemove(&cache->empty, slab);
+            cache->empty_count--;
+        }
+        else
+            slab = SLAB_grow(cache);
+
+        if(slab == NULL)
+        {
+            if(is_schedulerEnabled())
+                release_mutex(&cache->mutex);
+
+            return NULL;
+        }
+
+        SLAB_listPush(&cache->partial, slab);
+    }
+
+    void* obj = slab->free_list;
+    slab->free_list = *SLAB_link(cache, obj);
+    *SLAB_link(cache, obj) = SLAB_OBJ_ALLOCATED;
+    slab->in_use++;
+
+    if(slab->in_use == cache->objects_per_slab)
+    {
+        SLAB_listRemove(&cache->partial, slab);
+        SLAB_listPush(&cache->full, slab);
+    }
+
+    cache->active_objects++;
+    cache->alloc_calls++;
+
+    if(is_schedulerEnabled())
+        release_mutex(&cache->mutex);
+
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t* cache, void* obj)
+{
+    if(cache == NULL || obj == NULL)
+        return;
+
+    slab_t* slab = SLAB_findSlab(obj);
+    uint32_t offset = (uint32_t)obj - (uint32_t)slab - SLAB_HEADER_SIZE;
+
+    if(slab == NULL || slab->cache != cache || (offset % cache->stride) != 0)
+    {
+        log_err("slab", "%s: 0x%x doesn't belong to this cache", cache->name, obj);
+        return;
+    }
+
+    if(is_schedulerEnabled())
+        acquire_mutex(&cache->mutex);
+
+    if(*SLAB_link(cache, obj) != SLAB_OBJ_ALLOCATED)
+    {
+        log_err("slab", "%s: double free of 0x%x", cache->name, obj);
+
+        if(is_schedulerEnabled())
+            release_mutex(&cache->mutex);
+
+        return;
+    }
+
+    if(slab->in_use == cache->objects_per_slab)
+    {
+        SLAB_listRemove(&cache->full, slab);
+        SLAB_listPush(&cache->partial, slab);
+    }
+
+    *SLAB_link(cache, obj) = slab->free_list;
+    slab->free_list = obj;
+    slab->in_use--;
+
+    cache->active_objects--;
+    cache->free_calls++;
+
+    if(slab->in_use == 0)
+    {
+        SLAB_listRemove(&cache->partial, slab);
+
+        if(cache->empty_count < SLAB_MAX_EMPTY)
+        {
+            SLAB_listPush(&cache->empty, slab);
+            cache->empty_count++;
+        }
+        else
+            SLAB_release(cache, slab);
+    }
+
+    if(is_schedulerEnabled())
+        release_mutex(&cache->mutex);
+}
+
+/*
+ * give every empty slab of the cache back to vmalloc
+ * returns the number of pages released
+*/
+uint32_t kmem_cache_shrink(kmem_cache_t* cache)
+{
+    if(is_schedulerEnabled())
+        acquire_mutex(&cache->mutex);
+
+    uint32_t pages = SLAB_releaseEmpty(cache);
+
+    if(is_schedulerEnabled())
+        release_mutex(&cache->mutex);
+
+    return pages;
+}
+
+/*
+ * shrink every cache, returns the number of pages released. It is a reclaim handler of the physical
+ * memory manager, so it may run from an allocation of a cache (or of the list of caches): the ones
+ * in use are skipped instead of waited for
+*/
+uint32_t SLAB_reclaim()
+{
+    uint32_t pages = 0;
+
+    if(is_schedulerEnabled() && !try_acquire_mutex(&SLAB_mutex))
+        return 0;
+
+    for(kmem_cache_t* cache = SLAB_caches; cache != NULL; cache = cache->next)
+    {
+        if(is_schedulerEnabled() && !try_acquire_mutex(&cache->mutex))
+            continue;
+
+        pages += SLAB_releaseEmpty(cache);
+
+        if(is_schedulerEnabled())
+            release_mutex(&cache->mutex);
+    }
+
+    if(is_schedulerEnabled())
+        release_mutex(&SLAB_mutex);
+
+    return pages;
+}
+
+bool SLAB_getCacheStats(uint32_t index, kmem_cache_stats_t* stats)
+{
+    if(is_schedulerEnabled())
+        acquire_mutex(&SLAB_mutex);
+
+    kmem_cache_t* cache = SLAB_caches;
+    for(uint32_t i = 0; i < index && cache != NULL; i++)
+        cache = cache->next;
+
+    if(cache != NULL)
+    {
+        memset(stats, 0, sizeof(kmem_cache_stats_t));
+        strcpy(stats->name, cache->name);
+
+        stats->objectSize = cache->stride;
+        stats->objectsPerSlab = cache->objects_per_slab;
+        stats->slabPages = cache->slab_pages;
+        stats->activeObjects = cache->active_objects;
+        stats->totalObjects = cache->total_slabs * cache->objects_per_slab;
+        stats->totalSlabs = cache->total_slabs;
+        stats->emptySlabs = cache->empty_count;
+        stats->allocCalls = cache->alloc_calls;
+        stats->freeCalls = cache->free_calls;
+        stats->slabsCreated = cache->slabs_created;
+        stats->slabsReclaimed = cache->slabs_reclaimed;
+    }
+
+    if(is_schedulerEnabled())
+        release_mutex(&SLAB_mutex);
+
+    return cache != NULL;
+}
+
+static bool SLAB_statsRecord(uint32_t index, void* record)
+{
+    return SLAB_getCacheStats(index, (kmem_cache_stats_t*)record);
+}
+
+/*
+ * read only device exposing one kmem_cache_stats_t per cache (/dev/slabinfo once devfs is mounted)
+*/
+void SLAB_createDevice()
+{
+    add_record_device("slabinfo", SLAB_statsRecord, sizeof(kmem_cache_stats_t));
+}
@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2025,  Novice
+ *
+ * This file is part of the Novix software.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <debug.h>
+#include <memory.h>
+#include <string.h>
+#include <vfs/vfs.h>
+#include <drivers/device.h>
+#include <mem_manager/heap.h>
+#include <mem_manager/swap.h>
+#include <mem_manager/physmem_manager.h>
+#include <mem_manager/virtmem_manager.h>
+#include <multitasking/scheduler.h>
+#include <multitasking/process.h>
+#include <multitasking/lock.h>
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
+//============================================================================
+
+#define PAGE_SIZE 0x1000
+
+#define SWAP_NO_SLOT 0xFFFFFFFF
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE DATA
+//============================================================================
+
+/*
+ * the swap file is read and written straight on the disk, without the file system:
+ * its pages are located once by SWAP_initialize()
+*/
+device_t* SWAP_device = NULL;
+uint32_t* SWAP_sectors;         // first sector of each slot
+uint32_t SWAP_sectorsPerPage;
+
+uint16_t* SWAP_owners;          // page table entries pointing to each slot (fork shares them)
+uint32_t SWAP_slotCount = 0;
+uint32_t SWAP_usedSlots = 0;
+uint32_t SWAP_nextSlot = 0;     // where the search for a free slot starts
+
+uint32_t SWAP_pagesOut = 0;
+uint32_t SWAP_pagesIn = 0;
+
+// held during every transfer: a page being written out can't be read back before it's complete
+mutex_t SWAP_mutex;
+static uint8_t SWAP_buffer[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE FUNCTIONS
+//============================================================================
+
+// returns SWAP_NO_SLOT if the swap file is full
+uint32_t SWAP_allocSlot()
+{
+    uint32_t slot = SWAP_NO_SLOT;
+
+    lock_scheduler();
+
+    for(uint32_t i = 0; i < SWAP_slotCount; i++)
+    {
+        uint32_t candidate = (SWAP_nextSlot + i) % SWAP_slotCount;
+
+        if(SWAP_owners[candidate] == 0)
+        {
+            slot = candidate;
+            SWAP_owners[slot] = 1;
+            SWAP_usedSlots++;
+            SWAP_nextSlot = slot + 1;
+            break;
+        }
+    }
+
+    unlock_scheduler();
+
+    return slot;
+}
+
+bool SWAP_readSlot(uint32_t slot, void* buffer)
+{
+    return SWAP_device->read(buffer, SWAP_sectors[slot], SWAP_sectorsPerPage, SWAP_device->priv, 0) == SWAP_sectorsPerPage;
+}
+
+bool SWAP_writeSlot(uint32_t slot, const void* buffer)
+{
+    return SWAP_device->write(buffer, SWAP_sectors[slot], SWAP_sectorsPerPage, SWAP_device->priv, 0) == SWAP_sectorsPerPage;
+}
+
+//============================================================================
+//    INTERFACE FUNCTIONS
+//============================================================================
+
+/*
+ * use a preallocated file as swap space. its pages must each be contiguous on the disk,
+ * the swap space stops at the first one that isn't. returns false if there is no usable swap file:
+ * only the page cache can be reclaimed then
+*/
+bool SWAP_initialize(const char* path)
+{
+    int fd = VFS_open(path, VFS_O_RDWR);
+    if(fd < 0)
+    {
+        log_warn("swap", "no swap file %s, only the page cache can be reclaimed", path);
+        return false;
+    }
+
+    vnode_t* node = PROCESS_getCurrent()->resources[fd].vnode;
+    vfs_stat_t stat;
+
+    if(node->vnode_op->bmap == NULL || node->vnode_op->stat(node, &stat) != VFS_OK)
+    {
+        log_err("swap", "%s can't be used as a swap file", path);
+        VFS_close(fd);
+        return false;
+    }
+
+    uint32_t slots = stat.size / PAGE_SIZE < SWAP_MAX_SLOTS ? stat.size / PAGE_SIZE : SWAP_MAX_SLOTS;
+
+    SWAP_sectors = kmalloc(slots * sizeof(uint32_t));
+    SWAP_owners = kmalloc(slots * sizeof(uint16_t));
+
+    int64_t mapped = (SWAP_sectors != NULL && SWAP_owners != NULL) ? node->vnode_op->bmap(node, &SWAP_device, SWAP_sectors, slots) : 0;
+    if(mapped <= 0 || SWAP_device->blockSize == 0)
+    {
+        log_err("swap", "can't locate the pages of %s on the disk", path);
+
+        kfree(SWAP_sectors);
+        kfree(SWAP_owners);
+        SWAP_device = NULL;
+        VFS_close(fd);
+        return false;
+    }
+
+    if(mapped < slots)
+        log_warn("swap", "%s is fragmented, only its first %d KB are used", path, (uint32_t)mapped * 4);
+
+    for(uint32_t i = 0; i < mapped; i++)
+        SWAP_owners[i] = 0;
+
+    SWAP_slotCount = mapped;
+    SWAP_sectorsPerPage = PAGE_SIZE / SWAP_device->blockSize;
+
+    node->ref_count++;  // the file stays in use after the descriptor is closed
+    VFS_close(fd);
+
+    log_info("swap", "%d KB of swap in %s", SWAP_slotCount * 4, path);
+    return true;
+}
+
+// there is a swap file with room left
+bool SWAP_canPageOut()
+{
+    return SWAP_device != NULL && SWAP_usedSlots < SWAP_slotCount;
+}
+
+/*
+ * write one page of process id to the swap file, the clock scan of its address space goes on from *hand.
+ * returns false when the end of the address space is reached without finding a page (or the swap file is full)
+*/
+bool SWAP_pageOut(uint32_t id, uint32_t* hand)
+{
+    if(SWAP_device == NULL)
+        return false;
+
+    uint32_t slot = SWAP_allocSlot();
+    if(slot == SWAP_NO_SLOT)
+        return false;
+
+    if(is_schedulerEnabled())
+        acquire_mutex(&SWAP_mutex);
+
+    // the process can't be destroyed while the address spaces are locked, but it may be dead already
+    VIRTMEM_lockAddressSpaces();
+
+    lock_scheduler();
+
+    process_t* proc = PROCESS_get(id);
+    PDE* page_directory = (proc != NULL && proc->usermode && proc->state != DEAD) ? proc->virt_cr3 : NULL;
+
+    unlock_scheduler();
+
+    void* frame = page_directory != NULL ? VIRTMEM_pageOut(page_directory, hand, slot) : NULL;
+
+    if(frame != NULL)
+    {
+        lock_scheduler();
+
+        proc->memory.residentPages--;
+        proc->memory.swappedPages++;
+
+        unlock_scheduler();
+    }
+
+    VIRTMEM_unlockAddressSpaces();
+
+    if(frame == NULL)
+    {
+        if(is_schedulerEnabled())
+            release_mutex(&SWAP_mutex);
+
+        SWAP_freeSlot(slot);
+        return false;
+    }
+
+    // the entry already points to the slot, a fault on the page waits for SWAP_mutex
+    VIRTMEM_copyFromFrame(SWAP_buffer, frame);
+
+    if(!SWAP_writeSlot(slot, SWAP_buffer))
+        log_crit("swap", "can't write slot %d, page of process %d lost", slot, id);
+
+    PHYSMEM_freeBlocksFor(frame, 1, PHYSMEM_USER_PROCESS);
+    SWAP_pagesOut++;
+
+    if(is_schedulerEnabled())
+        release_mutex(&SWAP_mutex);
+
+    return true;
+}
+
+/*
+ * read a page of the loaded address space back from its slot, called by the page fault handler.
+ * returns false if there is no memory for it (or the disk failed), the page stays in the swap file
+*/
+bool SWAP_pageIn(void* virt, uint32_t slot)
+{
+    void* page = (void*)((uint32_t)virt & ~(PAGE_SIZE - 1));
+
+    void* frame = PHYSMEM_AllocBlocksFor(1, PHYSMEM_USER_PROCESS);
+    if(frame == NULL)
+        return false;
+
+    if(is_schedulerEnabled())
+        acquire_mutex(&SWAP_mutex);
+
+    bool done = SWAP_readSlot(slot, SWAP_buffer);
+    if(done)
+    {
+        VIRTMEM_copyToFrame(frame, SWAP_buffer);
+        done = VIRTMEM_pageIn(page, frame);
+    }
+
+    if(done)
+        SWAP_pagesIn++;
+
+    if(is_schedulerEnabled())
+        release_mutex(&SWAP_mutex);
+
+    if(!done)
+    {
+        PHYSMEM_freeBlocksFor(frame, 1, PHYSMEM_USER_PROCESS);
+        return false;
+    }
+
+    SWAP_freeSlot(slot);
+    return true;
+}
+
+// a fork copied an entry pointing to the slot
+void SWAP_duplicateSlot(uint32_t slot)
+{
+    if(slot >= SWAP_slotCount)
+        return;
+
+    lock_scheduler();
+    SWAP_owners[slot]++;
+    unlock_scheduler();
+}
+
+// an entry pointing to the slot went away (read back, unmapped, or its address space destroyed)
+void SWAP_freeSlot(uint32_t slot)
+{
+    if(slot >= SWAP_slotCount)
+        return;
+
+    lock_scheduler();
+
+    if(SWAP_owners[slot] > 0 && --SWAP_owners[slot] == 0)
+        SWAP_usedSlots--;
+
+    unlock_scheduler();
+}
+
+void SWAP_getStats(swap_stats_t* stats)
+{
+    stats->totalSlots = SWAP_slotCount;
+    stats->usedSlots = SWAP_usedSlots;
+    stats->pagesOut = SWAP_pagesOut;
+    stats->pagesIn = SWAP_pagesIn;
+}
+
+static bool SWAP_statsRecord(uint32_t index, void* record)
+{
+    if(index > 0)
+        return false;
+
+    SWAP_getStats((swap_stats_t*)record);
+    return true;
+}
+
+/*
+ * read only device exposing a swap_stats_t (/dev/swapinfo once devfs is mounted)
+*/
+void SWAP_createDevice()
+{
+    add_record_device("swapinfo", SWAP_statsRecord, sizeof(swap_stats_t));
+}
@@ -21,10 +21,50 @@
 global enablePaging
 enablePaging:
     mov		eax, cr0
-	or		eax, 0x80000000
+	or		eax, 0x80010000    ; PG, and WP so the kernel also faults on copy on write pages
 	mov		cr0, eax
     ret
 
+; returns 1 if the cpu supports global pages (cpuid.1:edx bit 13) and they are now enabled
+global enableGlobalPages
+enableGlobalPages:
+    push ebx            ; cpuid overwrites ebx
+
+    mov eax, 1
+    cpuid
+    xor eax, eax
+    test edx, (1 << 13)
+    jz .noPGE
+
+    mov ecx, cr4
+    or ecx, (1 << 7)    ; CR4.PGE
+    mov cr4, ecx
+    mov eax, 1
+
+.noPGE:
+    pop ebx
+    ret
+
+; returns 1 if the cpu supports 4mb pages (cpuid.1:edx bit 3) and they are now enabled
+global enableLargePages
+enableLargePages:
+    push ebx            ; cpuid overwrites ebx
+
+    mov eax, 1
+    cpuid
+    xor eax, eax
+    test edx, (1 << 3)
+    jz .noPSE
+
+    mov ecx, cr4
+    or ecx, (1 << 4)    ; CR4.PSE
+    mov cr4, ecx
+    mov eax, 1
+
+.noPSE:
+    pop ebx
+    ret
+
 global flushTLB
 flushTLB:
     ; make new call frame
@@ -42,6 +82,36 @@ flushTLB:
     pop ebp
     ret
 
+; invlpg on a range of pages: flushTLBRange(virt, pages)
+global flushTLBRange
+flushTLBRange:
+    mov eax, [esp+4]    ; first page
+    mov ecx, [esp+8]    ; number of pages
+    test ecx, ecx
+    jz .done
+
+.next:
+    invlpg [eax]
+    add eax, 0x1000
+    dec ecx
+    jnz .next
+
+.done:
+    ret
+
+; flush the whole tlb, global pages included (toggling CR4.PGE drops them)
+global flushTLBAll
+flushTLBAll:
+    mov eax, cr4
+    mov ecx, eax
+    and ecx, ~(1 << 7)
+    mov cr4, ecx
+    mov cr4, eax
+
+    mov eax, cr3        ; in case global pages are not enabled
+    mov cr3, eax
+    ret
+
 global getPDBR
 getPDBR:
     mov eax, cr3
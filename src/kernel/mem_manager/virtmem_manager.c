@@ -19,32 +19,114 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <debug.h>
 #include <hal/io.h>
 #include <mem_manager/physmem_manager.h>
 #include <mem_manager/virtmem_manager.h>
 #include <mem_manager/vmalloc.h>
+#include <mem_manager/heap.h>
+#include <mem_manager/swap.h>
 #include <memory.h>
 #include <utility.h>
 #include <multitasking/scheduler.h>
+#include <multitasking/process.h>
 #include <multitasking/lock.h>
+#include <multitasking/smp.h>
 
 //============================================================================
 //    IMPLEMENTATION PRIVATE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
 //============================================================================
 
-#define PAGE_ADD_ATTRIBUTE(page_entry, flags)     page_entry | flags
-#define PAGE_SET_FRAME(page_entry, frame)         page_entry | frame
+#define PAGE_ADD_ATTRIBUTE(page_entry, flags)     ((page_entry) | (flags))
+#define PAGE_SET_FRAME(page_entry, frame)         ((page_entry) | (frame))
 
-#define PTE_INDEX(virt_addr) (virt_addr >> 12) & 0x3ff
-#define PDE_INDEX(virt_addr) (virt_addr >> 22) & 0x3ff
+#define PTE_INDEX(virt_addr) (((virt_addr) >> 12) & 0x3ff)
+#define PDE_INDEX(virt_addr) (((virt_addr) >> 22) & 0x3ff)
+
+// one page per cpu in the table just below the recursive mapping, used to reach frames that are not mapped anywhere.
+// the acpi and apic windows are at the top of the same table
+#define TEMP_MAP_ADDR 0xFFBE0000
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE DATA
+//============================================================================
+
+bool VIRTMEM_largePages = false;    // CR4.PSE is enabled, 4mb pages can be used
+
+// page tables of a dying address space are copied here one at a time
+static PTE VIRTMEM_teardownTable[1024] __attribute__((aligned(0x1000)));
+
+// held to walk an address space that isn't necessarily the loaded one: teardown, fork, page out
+mutex_t VIRTMEM_spaceMutex;
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE FUNCTIONS
+//============================================================================
+
+// used to tell the physical memory manager who owns a frame (statistics only)
+physmem_user_t VIRTMEM_frameUser(void* virt)
+{
+    uint32_t addr = (uint32_t)virt;
+
+    if(addr < 0xc0000000)
+        return PHYSMEM_USER_PROCESS;
+
+    if(addr >= HEAP_START_ADDR && addr <= HEAP_END_ADDR)
+        return PHYSMEM_USER_HEAP;
+
+    if(addr >= VMALLOC_START && addr <= VMALLOC_END)
+        return PHYSMEM_USER_VMALLOC;
+
+    return PHYSMEM_USER_KERNEL;
+}
+
+/*
+ * the kernel image, the heap and vmalloc are the same in every address space (their page tables
+ * are created at boot and shared), so they don't need to leave the tlb when cr3 changes.
+ * 0xe0000000 and above may differ between processes, the temporary page is flushed by hand
+*/
+uint32_t VIRTMEM_globalFlag(void* virt)
+{
+    uint32_t addr = (uint32_t)virt;
+
+    if(addr >= 0xc0000000 && addr <= VMALLOC_END)
+        return PTE_PAGE_GLOBAL;
+
+    return 0;
+}
+
+/*
+ * the kernel half is the same in every address space, so the other cpus may have it in their tlb
+ * whatever they run. the user half is only loaded on the cpu running the process, and leaving
+ * it (a cr3 load) drops its entries
+*/
+static void VIRTMEM_flushOthers(void* virt, uint32_t pages)
+{
+    if((uint32_t)virt >= 0xc0000000)
+        SMP_shootdown(virt, pages);
+}
 
 //============================================================================
 //    INTERFACE FUNCTIONS
 //============================================================================
 
-bool VIRTMEM_allocPage(PTE* entry, uint32_t flags)
+// pages mapped or unmapped in the user half are counted for the process owning the address space
+void VIRTMEM_account(void* virt, process_mem_t type, int32_t pages)
 {
-    PTE page = (PTE)PHYSMEM_AllocBlock(); // allocate a free physical frame
+    if((uint32_t)virt < 0xc0000000 && pages != 0)
+        PROCESS_accountMemory(type, pages);
+}
+
+bool VIRTMEM_allocPage(PTE* entry, uint32_t flags, physmem_user_t user)
+{
+    PTE page;
+
+    // user pages must not leak what the previous owner left in the frame
+    if(user == PHYSMEM_USER_PROCESS)
+        page = (PTE)PHYSMEM_AllocZeroedBlockFor(user);
+    else
+        page = (PTE)PHYSMEM_AllocBlocksFor(1, user); // allocate a free physical frame
+
     if(!page)
         return false;
 
@@ -53,10 +135,10 @@ bool VIRTMEM_allocPage(PTE* entry, uint32_t flags)
     return true;
 }
 
-void VIRTMEM_freePage(PTE* entry)
+void VIRTMEM_freePage(PTE* entry, physmem_user_t user)
 {
     void* ptr = (void*)(*entry & 0xFFFFF000);
-    PHYSMEM_freeBlock(ptr);
+    PHYSMEM_freeBlocksFor(ptr, 1, user);
 
     *entry = 0x0; // page not present
 }
@@ -69,11 +151,13 @@ bool VIRTMEM_mapTable(void* virt, bool kernel_mode)
     PDE* page_directory = (PDE*)0xFFFFF000; // virtual addresse of the page directory
     
     uint32_t pageTableIndex = PDE_INDEX((uint32_t)virt);
-    PTE* page_table = (PTE*)(0xFFC00000 + (pageTableIndex << 12));   // virtuall addresse of the page table
+
+    if((page_directory[pageTableIndex] & PDE_4MBPAGE) == PDE_4MBPAGE)
+        return false;   // a 4mb page is there, no table to put the page in
 
     if((page_directory[pageTableIndex] & PDE_PRESENT) != PDE_PRESENT)
     {
-        void* frame = PHYSMEM_AllocBlock(); // physical address of the page table
+        void* frame = PHYSMEM_AllocZeroedBlockFor(PHYSMEM_USER_PAGE_TABLE); // physical address of the page table (already cleared)
         if(!frame)
             return false;
         
@@ -81,9 +165,8 @@ bool VIRTMEM_mapTable(void* virt, bool kernel_mode)
             page_directory[pageTableIndex] = PAGE_ADD_ATTRIBUTE((uint32_t)frame, PDE_PRESENT | PDE_WRITE | PDE_KERNEL_MODE);
         else
             page_directory[pageTableIndex] = PAGE_ADD_ATTRIBUTE((uint32_t)frame, PDE_PRESENT | PDE_WRITE | PDE_USER_MODE);
-            
-        
-        memset(page_table, 0, 0x1000);
+
+        VIRTMEM_account(virt, PROCESS_MEM_PAGE_TABLE, 1);
     }
 
     return true;
@@ -101,11 +184,15 @@ bool VIRTMEM_unMapTable(void* virt)
     if((page_directory[pageTableIndex] & PDE_PRESENT) != PDE_PRESENT)
         return true;    // alredy unmapped
 
+    if((page_directory[pageTableIndex] & PDE_4MBPAGE) == PDE_4MBPAGE)
+        return false;   // not a table, there is no frame to free
 
     void* frame = (void*)(page_directory[pageTableIndex] & 0xFFFFF000);
-    PHYSMEM_freeBlock(frame);
+    PHYSMEM_freeBlocksFor(frame, 1, PHYSMEM_USER_PAGE_TABLE);
     page_directory[pageTableIndex] = 0;
 
+    VIRTMEM_account(virt, PROCESS_MEM_PAGE_TABLE, -1);
+
     return true;
 }
 
@@ -115,8 +202,6 @@ bool VIRTMEM_mapPage (void* virt, bool kernel_mode)
     if(!VIRTMEM_mapTable(virt, kernel_mode))
         return false;
 
-    PDE* page_directory = (PDE*)0xFFFFF000; // virtual addresse of the page directory
-
     uint32_t pageTableIndex = PDE_INDEX((uint32_t)virt);
     PTE* page_table = (PTE*)(0xFFC00000 + (pageTableIndex << 12));   // virtuall addresse of the page table
 
@@ -126,15 +211,16 @@ bool VIRTMEM_mapPage (void* virt, bool kernel_mode)
 
     if(kernel_mode)
     {
-        if(!VIRTMEM_allocPage(&page_table[pageEntryIndex], PTE_PAGE_PRESENT | PTE_PAGE_WRITE | PTE_PAGE_KERNEL_MODE)) // PTE_PAGE_PRESENT | PTE_PAGE_WRITE | PTE_PAGE_KERNEL_MODE
+        if(!VIRTMEM_allocPage(&page_table[pageEntryIndex], PTE_PAGE_PRESENT | PTE_PAGE_WRITE | PTE_PAGE_KERNEL_MODE | VIRTMEM_globalFlag(virt), VIRTMEM_frameUser(virt))) // PTE_PAGE_PRESENT | PTE_PAGE_WRITE | PTE_PAGE_KERNEL_MODE
             return false;
     }
     else
     {
-        if(!VIRTMEM_allocPage(&page_table[pageEntryIndex], PTE_PAGE_PRESENT | PTE_PAGE_WRITE | PTE_PAGE_USER_MODE))
+        if(!VIRTMEM_allocPage(&page_table[pageEntryIndex], PTE_PAGE_PRESENT | PTE_PAGE_WRITE | PTE_PAGE_USER_MODE, VIRTMEM_frameUser(virt)))
             return false;
     }
         
+    VIRTMEM_account(virt, PROCESS_MEM_RESIDENT, 1);
     
     flushTLB(virt);
     return true;
@@ -153,24 +239,54 @@ bool VIRTMEM_unMapPage (void* virt)
     if((page_directory[pageTableIndex] & PDE_PRESENT) != PDE_PRESENT)
         return true;    // already unmapped
 
+    if((page_directory[pageTableIndex] & PDE_4MBPAGE) == PDE_4MBPAGE)
+        return false;   // part of a 4mb page
+
     uint32_t pageEntryIndex = PTE_INDEX((uint32_t)virt);
-    if((page_table[pageEntryIndex] & PTE_PAGE_PRESENT) != PTE_PAGE_PRESENT)
+
+    // the reclaim task can page the entry out at any time, it's read and cleared in one go
+    lock_scheduler();
+
+    PTE page = page_table[pageEntryIndex];
+    if(page & (PTE_PAGE_PRESENT | PTE_PAGE_SWAPPED))
+        page_table[pageEntryIndex] = 0x0;
+
+    unlock_scheduler();
+
+    if((page & PTE_PAGE_PRESENT) != PTE_PAGE_PRESENT)
+    {
+        // in the swap file, only the slot has to be given back
+        if((page & PTE_PAGE_SWAPPED) == PTE_PAGE_SWAPPED)
+        {
+            SWAP_freeSlot(PTE_SWAP_SLOT(page));
+            VIRTMEM_account(virt, PROCESS_MEM_SWAPPED, -1);
+        }
+
         return true; // page already unmapped nothing to do
+    }
 
-    VIRTMEM_freePage(&page_table[pageEntryIndex]);
-    
     flushTLB(virt);
+    VIRTMEM_flushOthers(virt, 1);
+
+    // a shared frame (shm) is released by its owner, not by the mappings
+    if((page & PTE_PAGE_SHARED) == PTE_PAGE_SHARED)
+        VIRTMEM_account(virt, PROCESS_MEM_SHARED, -1);
+    else
+    {
+        PHYSMEM_freeBlocksFor((void*)(page & 0xFFFFF000), 1, VIRTMEM_frameUser(virt));
+        VIRTMEM_account(virt, PROCESS_MEM_RESIDENT, -1);
+    }
+
     return true;
 }
 
-bool VIRTMEM_mapPageCustom (void* phys, void* virt, bool kernel_mode)
+// map a frame that belongs to someone else (shm, device memory) with the given memory type
+bool VIRTMEM_mapPageCustom (void* phys, void* virt, bool kernel_mode, pat_type_t cache)
 {
     // in case this page table doesn't exist
     if(!VIRTMEM_mapTable(virt, kernel_mode))
         return false;
 
-    PDE* page_directory = (PDE*)0xFFFFF000; // virtual addresse of the page directory
-
     uint32_t pageTableIndex = PDE_INDEX((uint32_t)virt);
     PTE* page_table = (PTE*)(0xFFC00000 + (pageTableIndex << 12));   // virtuall addresse of the page table
 
@@ -180,13 +296,14 @@ bool VIRTMEM_mapPageCustom (void* phys, void* virt, bool kernel_mode)
 
     if(kernel_mode)
     {
-        page_table[pageEntryIndex] = PAGE_ADD_ATTRIBUTE((PTE)phys, PTE_PAGE_PRESENT | PTE_PAGE_WRITE | PTE_PAGE_KERNEL_MODE);
+        page_table[pageEntryIndex] = PAGE_ADD_ATTRIBUTE((PTE)phys, PTE_PAGE_PRESENT | PTE_PAGE_WRITE | PTE_PAGE_KERNEL_MODE | PAT_getPteFlags(cache));
     }
     else
     {
-        page_table[pageEntryIndex] = PAGE_ADD_ATTRIBUTE((PTE)phys, PTE_PAGE_PRESENT | PTE_PAGE_WRITE | PTE_PAGE_USER_MODE);
+        page_table[pageEntryIndex] = PAGE_ADD_ATTRIBUTE((PTE)phys, PTE_PAGE_PRESENT | PTE_PAGE_WRITE | PTE_PAGE_USER_MODE | PAT_getPteFlags(cache));
     }
         
+    VIRTMEM_account(virt, PROCESS_MEM_SHARED, 1);
     
     flushTLB(virt);
     return true;
@@ -205,57 +322,539 @@ void* VIRTMEM_unMapPageCustom (void* virt)
     if((page_directory[pageTableIndex] & PDE_PRESENT) != PDE_PRESENT)
         return NULL;    // already unmapped
 
+    if((page_directory[pageTableIndex] & PDE_4MBPAGE) == PDE_4MBPAGE)
+        return NULL;    // part of a 4mb page
+
     uint32_t pageEntryIndex = PTE_INDEX((uint32_t)virt);
     if((page_table[pageEntryIndex] & PTE_PAGE_PRESENT) != PTE_PAGE_PRESENT)
         return NULL; // page already unmapped nothing to do
 
     void* ret = VIRTMEM_getPhysAddr(virt);
     page_table[pageEntryIndex] = 0x0;   // page not present
+
+    VIRTMEM_account(virt, PROCESS_MEM_SHARED, -1);
     
     flushTLB(virt);
+    VIRTMEM_flushOthers(virt, 1);
     return ret;
 }
 
+// make a mapped page writable or read only
+bool VIRTMEM_protectPage (void* virt, bool writable)
+{
+    if((uint32_t)virt >= 0xFFC00000) // arealdy used by recursive mapping
+        return false;
+
+    PDE* page_directory = (PDE*)0xFFFFF000; // virtual addresse of the page directory
+
+    uint32_t pageTableIndex = PDE_INDEX((uint32_t)virt);
+    PTE* page_table = (PTE*)(0xFFC00000 + (pageTableIndex << 12));   // virtuall addresse of the page table
+
+    if((page_directory[pageTableIndex] & PDE_PRESENT) != PDE_PRESENT || (page_directory[pageTableIndex] & PDE_4MBPAGE) == PDE_4MBPAGE)
+        return false;
+
+    uint32_t pageEntryIndex = PTE_INDEX((uint32_t)virt);
+
+    lock_scheduler();   // the entry must not be paged out in the middle
+
+    bool present = (page_table[pageEntryIndex] & PTE_PAGE_PRESENT) == PTE_PAGE_PRESENT;
+    if(present && writable)
+        page_table[pageEntryIndex] |= PTE_PAGE_WRITE;
+    else if(present)
+        page_table[pageEntryIndex] &= ~PTE_PAGE_WRITE;
+
+    unlock_scheduler();
+
+    if(present)
+    {
+        flushTLB(virt);
+        VIRTMEM_flushOthers(virt, 1);
+    }
+
+    return present;
+}
+
+/*
+ * map a frame someone gave us a reference to (a page of the page cache). it is mapped read only,
+ * copy_on_write lets the first write make a private copy. the mapping owns the reference: unmapping frees it
+ * returns false if the page was already mapped, the caller still owns its reference then
+*/
+bool VIRTMEM_mapFrame (void* phys, void* virt, bool kernel_mode, bool copy_on_write)
+{
+    // in case this page table doesn't exist
+    if(!VIRTMEM_mapTable(virt, kernel_mode))
+        return false;
+
+    uint32_t pageTableIndex = PDE_INDEX((uint32_t)virt);
+    PTE* page_table = (PTE*)(0xFFC00000 + (pageTableIndex << 12));   // virtuall addresse of the page table
+
+    uint32_t pageEntryIndex = PTE_INDEX((uint32_t)virt);
+    if((page_table[pageEntryIndex] & PTE_PAGE_PRESENT) == PTE_PAGE_PRESENT)
+        return false;
+
+    uint32_t flags = PTE_PAGE_PRESENT | (kernel_mode ? PTE_PAGE_KERNEL_MODE : PTE_PAGE_USER_MODE);
+    if(copy_on_write)
+        flags |= PTE_PAGE_COW;
+
+    page_table[pageEntryIndex] = PAGE_ADD_ATTRIBUTE((PTE)phys, flags);
+
+    VIRTMEM_account(virt, PROCESS_MEM_RESIDENT, 1);
+
+    flushTLB(virt);
+    return true;
+}
+
+/*
+ * map 4mb of contiguous physical memory with a single directory entry (one tlb entry instead of 1024).
+ * both addresses must be 4mb aligned and nothing may be mapped there yet
+*/
+bool VIRTMEM_mapLargePage (void* phys, void* virt, bool kernel_mode, pat_type_t cache)
+{
+    if(!VIRTMEM_largePages || (((uint32_t)phys | (uint32_t)virt) & (LARGE_PAGE_SIZE - 1)))
+        return false;
+
+    if((uint32_t)virt >= 0xFFC00000) // arealdy used by recursive mapping
+        return false;
+
+    PDE* page_directory = (PDE*)0xFFFFF000; // virtual addresse of the page directory
+    uint32_t pageTableIndex = PDE_INDEX((uint32_t)virt);
+
+    if((page_directory[pageTableIndex] & PDE_PRESENT) == PDE_PRESENT)
+        return false;   // a table or another 4mb page is already there
+
+    if(kernel_mode)
+        page_directory[pageTableIndex] = PAGE_ADD_ATTRIBUTE((PDE)phys, PDE_PRESENT | PDE_WRITE | PDE_KERNEL_MODE | PDE_4MBPAGE | PAT_getLargePageFlags(cache));
+    else
+        page_directory[pageTableIndex] = PAGE_ADD_ATTRIBUTE((PDE)phys, PDE_PRESENT | PDE_WRITE | PDE_USER_MODE | PDE_4MBPAGE | PAT_getLargePageFlags(cache));
+
+    flushTLB(virt);
+    return true;
+}
+
+// the entry of a page whose table exists
+static PTE* VIRTMEM_rangeEntry(void* page)
+{
+    PTE* page_table = (PTE*)(0xFFC00000 + ((PDE_INDEX((uint32_t)page)) << 12));
+    return &page_table[PTE_INDEX((uint32_t)page)];
+}
+
+// an entry written by a range mapping that isn't complete yet: it holds a frame but isn't present (nor swapped)
+static bool VIRTMEM_isPending(PTE entry)
+{
+    return entry != 0x0 && (entry & (PTE_PAGE_PRESENT | PTE_PAGE_SWAPPED)) == 0;
+}
+
+/*
+ * undo a range mapping that failed: clear the entries it wrote, the other ones were there before.
+ * they were never present so no tlb holds them. owned frames go back to the physical memory manager
+*/
+static void VIRTMEM_dropPending(void* virt, uint32_t pages, bool owned)
+{
+    void* frames[VIRTMEM_RANGE_BATCH];
+    physmem_user_t user = VIRTMEM_frameUser(virt);
+    uint32_t count = 0;
+
+    for(uint32_t i = 0; i < pages; i++)
+    {
+        PTE* entry = VIRTMEM_rangeEntry(virt + i * 0x1000);
+
+        if(!VIRTMEM_isPending(*entry))
+            continue;
+
+        if(owned)
+            frames[count++] = (void*)(*entry & 0xFFFFF000);
+
+        *entry = 0x0;
+
+        if(count == VIRTMEM_RANGE_BATCH)
+        {
+            PHYSMEM_freeBlockList(frames, count, user);
+            count = 0;
+        }
+    }
+
+    PHYSMEM_freeBlockList(frames, count, user);
+}
+
+/*
+ * map pages fresh frames from virt on, the frames come from the physical memory manager
+ * VIRTMEM_RANGE_BATCH at a time. pages already mapped (or swapped out) are left alone.
+ * the entries are written not present and only made present once every frame is there,
+ * so a failure gives back exactly what this call mapped.
+ * there is nothing to flush: the tlb never keeps entries that were not present.
+*/
+bool VIRTMEM_mapRange (void* virt, uint32_t pages, bool kernel_mode)
+{
+    void* frames[VIRTMEM_RANGE_BATCH];
+    physmem_user_t user = VIRTMEM_frameUser(virt);
+    uint32_t mapped = 0;
+    uint32_t done = 0;
+
+    while(done < pages)
+    {
+        uint32_t batch = pages - done < VIRTMEM_RANGE_BATCH ? pages - done : VIRTMEM_RANGE_BATCH;
+        uint32_t missing = 0;
+
+        // make sure the tables exist and count what needs a frame
+        for(uint32_t i = 0; i < batch; i++)
+        {
+            void* page = virt + (done + i) * 0x1000;
+
+            if(!VIRTMEM_mapTable(page, kernel_mode))
+                goto Failed;
+
+            if(*VIRTMEM_rangeEntry(page) == 0x0)
+                missing++;
+        }
+
+        if(!PHYSMEM_AllocBlockList(frames, missing, user))
+            goto Failed;
+
+        for(uint32_t i = 0, next = 0; i < batch; i++)
+        {
+            void* page = virt + (done + i) * 0x1000;
+            PTE* entry = VIRTMEM_rangeEntry(page);
+
+            if(*entry != 0x0)
+                continue;
+
+            if(kernel_mode)
+                *entry = PAGE_ADD_ATTRIBUTE((PTE)frames[next++], PTE_PAGE_WRITE | PTE_PAGE_KERNEL_MODE | VIRTMEM_globalFlag(page));
+            else
+                *entry = PAGE_ADD_ATTRIBUTE((PTE)frames[next++], PTE_PAGE_WRITE | PTE_PAGE_USER_MODE);
+        }
+
+        mapped += missing;
+        done += batch;
+    }
+
+    for(uint32_t i = 0; i < pages && mapped > 0; i++)
+    {
+        void* page = virt + i * 0x1000;
+        PTE* entry = VIRTMEM_rangeEntry(page);
+
+        if(!VIRTMEM_isPending(*entry))
+            continue;
+
+        *entry |= PTE_PAGE_PRESENT;
+
+        // user pages must not leak what the previous owner left in the frame
+        if(user == PHYSMEM_USER_PROCESS)
+            memset(page, 0, 0x1000);
+    }
+
+    VIRTMEM_account(virt, PROCESS_MEM_RESIDENT, mapped);
+    return true;
+
+Failed:
+    VIRTMEM_dropPending(virt, done, true);
+    return false;
+}
+
+/*
+ * map pages contiguous frames starting at phys, they are not owned by the mapping. This is the shared
+ * memory path: the pages are tagged PTE_PAGE_SHARED, a fork maps the same frames and an unmap never frees them.
+ * like VIRTMEM_mapRange, nothing is present before every table is there
+*/
+bool VIRTMEM_mapRangeCustom (void* phys, void* virt, uint32_t pages, bool kernel_mode, pat_type_t cache)
+{
+    uint32_t flags = PTE_PAGE_WRITE | PTE_PAGE_SHARED | PAT_getPteFlags(cache);
+    uint32_t mapped = 0;
+    flags |= kernel_mode ? PTE_PAGE_KERNEL_MODE : PTE_PAGE_USER_MODE;
+
+    for(uint32_t i = 0; i < pages; i++)
+    {
+        void* page = virt + i * 0x1000;
+
+        if(!VIRTMEM_mapTable(page, kernel_mode))
+        {
+            VIRTMEM_dropPending(virt, i, false);
+            return false;
+        }
+
+        PTE* entry = VIRTMEM_rangeEntry(page);
+
+        if(*entry == 0x0)
+        {
+            *entry = PAGE_ADD_ATTRIBUTE((PTE)(phys + i * 0x1000), flags);
+            mapped++;
+        }
+    }
+
+    for(uint32_t i = 0; i < pages && mapped > 0; i++)
+    {
+        PTE* entry = VIRTMEM_rangeEntry(virt + i * 0x1000);
+
+        if(VIRTMEM_isPending(*entry))
+            *entry |= PTE_PAGE_PRESENT;
+    }
+
+    VIRTMEM_account(virt, PROCESS_MEM_SHARED, mapped);
+    return true;
+}
+
+/*
+ * unmap pages from virt on and free the frames they own. The entries are first made not present
+ * (keeping the frame address), then the tlb is flushed once: invlpg for small ranges, the whole tlb otherwise.
+ * only then the frames are given back, VIRTMEM_RANGE_BATCH at a time
+*/
+void VIRTMEM_unmapRange (void* virt, uint32_t pages)
+{
+    PDE* page_directory = (PDE*)0xFFFFF000; // virtual addresse of the page directory
+    void* frames[VIRTMEM_RANGE_BATCH];
+    uint32_t count = 0;
+    uint32_t shared = 0;
+    uint32_t swapped = 0;
+    uint32_t freed = 0;
+    bool changed = false;
+
+    if((uint32_t)virt >= 0xFFC00000 || pages == 0) // arealdy used by recursive mapping
+        return;
+
+    lock_scheduler();   // the reclaim task only pages out present entries, none of them may change under us
+
+    for(uint32_t i = 0; i < pages; i++)
+    {
+        uint32_t page = (uint32_t)virt + i * 0x1000;
+        uint32_t pageTableIndex = PDE_INDEX(page);
+
+        if((page_directory[pageTableIndex] & PDE_PRESENT) != PDE_PRESENT || (page_directory[pageTableIndex] & PDE_4MBPAGE) == PDE_4MBPAGE)
+            continue;
+
+        PTE* page_table = (PTE*)(0xFFC00000 + (pageTableIndex << 12));
+        uint32_t pageEntryIndex = PTE_INDEX(page);
+
+        if((page_table[pageEntryIndex] & PTE_PAGE_SWAPPED) == PTE_PAGE_SWAPPED)
+        {
+            SWAP_freeSlot(PTE_SWAP_SLOT(page_table[pageEntryIndex]));
+            page_table[pageEntryIndex] = 0x0;
+            swapped++;
+            continue;
+        }
+
+        if((page_table[pageEntryIndex] & PTE_PAGE_PRESENT) != PTE_PAGE_PRESENT)
+            continue;
+
+        if((page_table[pageEntryIndex] & PTE_PAGE_SHARED) == PTE_PAGE_SHARED)
+        {
+            page_table[pageEntryIndex] = 0x0;   // released by its owner
+            shared++;
+        }
+        else
+            page_table[pageEntryIndex] &= ~PTE_PAGE_PRESENT;
+
+        changed = true;
+    }
+
+    unlock_scheduler();
+
+    VIRTMEM_account(virt, PROCESS_MEM_SWAPPED, -(int32_t)swapped);
+
+    if(!changed)
+        return;
+
+    if(pages <= VIRTMEM_FLUSH_THRESHOLD)
+        flushTLBRange(virt, pages);
+    else if(VIRTMEM_globalFlag(virt) || VIRTMEM_globalFlag(virt + (pages - 1) * 0x1000))
+        flushTLBAll();
+    else
+        switchPDBR(getPDBR());  // a cr3 reload keeps the global kernel pages
+
+    VIRTMEM_flushOthers(virt, pages);
+
+    physmem_user_t user = VIRTMEM_frameUser(virt);
+
+    for(uint32_t i = 0; i < pages; i++)
+    {
+        uint32_t page = (uint32_t)virt + i * 0x1000;
+        uint32_t pageTableIndex = PDE_INDEX(page);
+
+        if((page_directory[pageTableIndex] & PDE_PRESENT) != PDE_PRESENT || (page_directory[pageTableIndex] & PDE_4MBPAGE) == PDE_4MBPAGE)
+            continue;
+
+        PTE* page_table = (PTE*)(0xFFC00000 + (pageTableIndex << 12));
+        uint32_t pageEntryIndex = PTE_INDEX(page);
+
+        if(page_table[pageEntryIndex] == 0x0)
+            continue;
+
+        frames[count++] = (void*)(page_table[pageEntryIndex] & 0xFFFFF000);
+        page_table[pageEntryIndex] = 0x0;
+        freed++;
+
+        if(count == VIRTMEM_RANGE_BATCH)
+        {
+            PHYSMEM_freeBlockList(frames, count, user);
+            count = 0;
+        }
+    }
+
+    PHYSMEM_freeBlockList(frames, count, user);
+
+    VIRTMEM_account(virt, PROCESS_MEM_SHARED, -(int32_t)shared);
+    VIRTMEM_account(virt, PROCESS_MEM_RESIDENT, -(int32_t)freed);
+}
+
+/*
+ * map a frame at the temporary page of this cpu until VIRTMEM_tempUnmap(). the task can't be preempted
+ * meanwhile, so no other task uses the page, and no other cpu ever does: a local invlpg is enough.
+ * nothing in between may fault or sleep
+*/
+static void* VIRTMEM_tempMap(void* phys, uint32_t flags)
+{
+    void* virt = (void*)(TEMP_MAP_ADDR + get_cpu() * 0x1000);
+
+    *VIRTMEM_rangeEntry(virt) = PAGE_ADD_ATTRIBUTE((PTE)phys, PTE_PAGE_PRESENT | PTE_PAGE_KERNEL_MODE | flags);
+    flushTLB(virt);
+
+    return virt;
+}
+
+// the next user of the page flushes it
+static void VIRTMEM_tempUnmap(void* virt)
+{
+    *VIRTMEM_rangeEntry(virt) = 0x0;
+    put_cpu();
+}
+
+/*
+ * fill a physical frame with zeros through the temporary mapping,
+ * the frame doesn't need to be mapped anywhere
+*/
+void VIRTMEM_clearFrame(void* phys)
+{
+    void* temp = VIRTMEM_tempMap(phys, PTE_PAGE_WRITE);
+    memset(temp, 0, 0x1000);
+    VIRTMEM_tempUnmap(temp);
+}
+
+// copy one page to a physical frame through the temporary mapping, src must not fault
+void VIRTMEM_copyToFrame(void* phys, const void* src)
+{
+    void* temp = VIRTMEM_tempMap(phys, PTE_PAGE_WRITE);
+    memcpy(temp, src, 0x1000);
+    VIRTMEM_tempUnmap(temp);
+}
+
+// copy a physical frame to a buffer through the temporary mapping, dst must not fault
+void VIRTMEM_copyFromFrame(void* dst, void* phys)
+{
+    void* temp = VIRTMEM_tempMap(phys, 0);
+    memcpy(dst, temp, 0x1000);
+    VIRTMEM_tempUnmap(temp);
+}
+
+/*
+ * true if [virt, virt + size) of the loaded address space can be written without a fault. A user page
+ * must also be accessed: the reclaim task clears the bit and shoots it down (which waits for this cpu)
+ * before it can take the page, so it stays until the temporary mapping is gone
+*/
+static bool VIRTMEM_isWritable(void* virt, uint32_t size)
+{
+    PDE* page_directory = (PDE*)0xFFFFF000; // virtual addresse of the page directory
+
+    for(uint32_t page = (uint32_t)virt & 0xFFFFF000; page < (uint32_t)virt + size; page += 0x1000)
+    {
+        PDE table = page_directory[PDE_INDEX(page)];
+
+        if((table & (PDE_PRESENT | PDE_WRITE)) != (PDE_PRESENT | PDE_WRITE))
+            return false;
+
+        if(table & PDE_4MBPAGE)
+            continue;
+
+        PTE entry = *VIRTMEM_rangeEntry((void*)page);
+        if((entry & (PTE_PAGE_PRESENT | PTE_PAGE_WRITE | PTE_PAGE_ACCESSED)) != (PTE_PAGE_PRESENT | PTE_PAGE_WRITE | PTE_PAGE_ACCESSED))
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * copy size bytes from offset in a physical frame straight to dst, which may be a user page that isn't
+ * there yet (or is copy on write): it is faulted in first, nothing may fault under the temporary mapping.
+ * tried again if the page went away in between
+*/
+void VIRTMEM_copyFromFramePart(void* dst, void* phys, uint32_t offset, uint32_t size)
+{
+    for(;;)
+    {
+        for(uint32_t page = (uint32_t)dst & 0xFFFFF000; page < (uint32_t)dst + size; page += 0x1000)
+        {
+            volatile uint8_t* byte = (uint8_t*)(page < (uint32_t)dst ? (uint32_t)dst : page);
+            *byte = *byte;  // a write fault, and the accessed bit
+        }
+
+        void* temp = VIRTMEM_tempMap(phys, 0);
+
+        bool writable = VIRTMEM_isWritable(dst, size);
+        if(writable)
+            memcpy(dst, (uint8_t*)temp + offset, size);
+
+        VIRTMEM_tempUnmap(temp);
+
+        if(writable)
+            return;
+    }
+}
+
 uint32_t* VIRTMEM_getPhysAddr(void* virt)
 {   
     uint32_t pageTableIndex = PDE_INDEX((uint32_t)virt);
     uint32_t pageEntryIndex = PTE_INDEX((uint32_t)virt);
 
+    PDE* page_directory = (PDE*)0xFFFFF000; // virtual addresse of the page directory
     PTE* page_table = (PTE*)(0xFFC00000 + (pageTableIndex << 12));   // virtuall addresse of the page table
 
+    if((page_directory[pageTableIndex] & (PDE_PRESENT | PDE_4MBPAGE)) == (PDE_PRESENT | PDE_4MBPAGE))
+        return (uint32_t*)((page_directory[pageTableIndex] & ~(LARGE_PAGE_SIZE - 1)) | ((uint32_t)virt & (LARGE_PAGE_SIZE - 1) & 0xFFFFF000));
+
     return (uint32_t*)(page_table[pageEntryIndex] & 0xFFFFF000);
 }
 
 bool VIRTMEM_initialize(uint32_t kernel_size)
 {
     // allocate default page directory table
-    PDE* page_directory = PHYSMEM_AllocBlock();
-
-    // allocate first page table
-    PTE* table_0 = PHYSMEM_AllocBlock();
+    PDE* page_directory = PHYSMEM_AllocBlocksFor(1, PHYSMEM_USER_PAGE_TABLE);
 
     // allocates 3gb page table
     PTE* table_from_768;
 
-    if(page_directory == NULL || table_0 == NULL)
+    if(page_directory == NULL)
         return false;
 
-    // 1st 4mb are idenitity mapped
-   for (int i=0, frame=0x0, virt=0x00000000; i<1024; i++, frame+=4096, virt+=4096)
-   {
+   // clear and initialize directory table
+    memset(page_directory, 0, 0x1000);
 
-      // create a new page
-      PTE page = 0;
-      page = PAGE_ADD_ATTRIBUTE(page, PTE_PAGE_PRESENT | PTE_PAGE_WRITE | PTE_PAGE_KERNEL_MODE);
-      page = PAGE_SET_FRAME(page, frame);
+    // 1st 4mb are idenitity mapped, with a single 4mb page if the cpu can do it
+    VIRTMEM_largePages = enableLargePages();
 
-      // ...and add it to the page table
-      table_0[PTE_INDEX(virt)] = page;
-   }
+    if(VIRTMEM_largePages)
+    {
+        page_directory[PDE_INDEX(0x0)] = PAGE_ADD_ATTRIBUTE(0x0, PDE_PRESENT | PDE_WRITE | PDE_KERNEL_MODE | PDE_4MBPAGE);
+    }
+    else
+    {
+        // allocate first page table
+        PTE* table_0 = PHYSMEM_AllocBlocksFor(1, PHYSMEM_USER_PAGE_TABLE);
+        if(table_0 == NULL)
+            return false;
 
-   // clear and initialize directory table
-    memset(page_directory, 0, 0x1000);
-    page_directory[PDE_INDEX(0x0)] = PAGE_ADD_ATTRIBUTE((uint32_t)table_0, PDE_PRESENT | PDE_WRITE | PDE_KERNEL_MODE);
+       for (int i=0, frame=0x0, virt=0x00000000; i<1024; i++, frame+=4096, virt+=4096)
+       {
+
+          // create a new page
+          PTE page = 0;
+          page = PAGE_ADD_ATTRIBUTE(page, PTE_PAGE_PRESENT | PTE_PAGE_WRITE | PTE_PAGE_KERNEL_MODE);
+          page = PAGE_SET_FRAME(page, frame);
+
+          // ...and add it to the page table
+          table_0[PTE_INDEX(virt)] = page;
+       }
+
+        page_directory[PDE_INDEX(0x0)] = PAGE_ADD_ATTRIBUTE((uint32_t)table_0, PDE_PRESENT | PDE_WRITE | PDE_KERNEL_MODE);
+    }
 
    // map 1mb to 3gb (where we are at)
    uint32_t totalPageTable = roundUp_div(kernel_size, 0x400000); // based on the kernel size
@@ -265,12 +864,12 @@ bool VIRTMEM_initialize(uint32_t kernel_size)
 
       // create a new page
       PTE page = 0;
-      page = PAGE_ADD_ATTRIBUTE(page, PTE_PAGE_PRESENT | PTE_PAGE_WRITE | PTE_PAGE_KERNEL_MODE);
+      page = PAGE_ADD_ATTRIBUTE(page, PTE_PAGE_PRESENT | PTE_PAGE_WRITE | PTE_PAGE_KERNEL_MODE | PTE_PAGE_GLOBAL);
       page = PAGE_SET_FRAME(page, frame);
 
       if((virt % 0x400000) == 0)
       {
-        table_from_768 = PHYSMEM_AllocBlock();
+        table_from_768 = PHYSMEM_AllocBlocksFor(1, PHYSMEM_USER_PAGE_TABLE);
         page_directory[PDE_INDEX(virt)] = PAGE_ADD_ATTRIBUTE((uint32_t)table_from_768, PDE_PRESENT | PDE_WRITE | PDE_KERNEL_MODE);
       }
 
@@ -278,12 +877,27 @@ bool VIRTMEM_initialize(uint32_t kernel_size)
       table_from_768[PTE_INDEX(virt)] = page;
    }
 
+    // the table holding the temporary page must exist before the first address space is copied
+    PTE* temp_table = PHYSMEM_AllocBlocksFor(1, PHYSMEM_USER_PAGE_TABLE);
+    if(temp_table == NULL)
+        return false;
+
+    memset(temp_table, 0, 0x1000);
+    page_directory[PDE_INDEX(TEMP_MAP_ADDR)] = PAGE_ADD_ATTRIBUTE((uint32_t)temp_table, PDE_PRESENT | PDE_WRITE | PDE_KERNEL_MODE);
+
+    // the buddy frame array of the physical memory manager
+    PHYSMEM_mapFrames(page_directory);
+
     // recursive mapping here !
     page_directory[1023] = PAGE_ADD_ATTRIBUTE((uint32_t)page_directory, PDE_PRESENT | PDE_WRITE | PDE_KERNEL_MODE);
 
     switchPDBR(page_directory);
     enablePaging();    // just in case ...
 
+    // the kernel pages are marked global, they stay in the tlb when a task switch reloads cr3
+    if(!enableGlobalPages())
+        log_warn("virtmem", "global pages not supported, the kernel mappings are flushed on every task switch");
+
     return true;
 }
 
@@ -303,31 +917,315 @@ uint32_t* VIRTMEM_createAddressSpace()
     return new_pagedirectory;
 }
 
-// this function suppose that you provide a virtual address of the page directory
+/*
+ * free everything below 3gb in a page directory that is not in use anymore (the caller provides its virtual address).
+ * only the present tables are visited, each one is read through the temporary page so cr3 never changes,
+ * and its pages are given back to the physical memory manager in one call
+*/
 void VIRTMEM_destroyAddressSpace(PDE* page_directory)
 {
-    lock_scheduler();
+    if(is_schedulerEnabled())
+        acquire_mutex(&VIRTMEM_spaceMutex);
 
-    PROCESS_getCurrent()->cr3 = VIRTMEM_getPhysAddr(page_directory); // in case a context switch occurs
-    uint32_t* current_page_directory = getPDBR();   // save this direcotry
-    switchPDBR(VIRTMEM_getPhysAddr(page_directory));
+    for(int i = PDE_INDEX(0x400000); i < PDE_INDEX(0xc0000000); i++)
+    {
+        if((page_directory[i] & PDE_PRESENT) != PDE_PRESENT || (page_directory[i] & PDE_4MBPAGE) == PDE_4MBPAGE)
+            continue;
+
+        void* table = (void*)(page_directory[i] & 0xFFFFF000);
+        VIRTMEM_copyFromFrame(VIRTMEM_teardownTable, table);
+
+        // the frames to free are packed at the start of the copy
+        void** frames = (void**)VIRTMEM_teardownTable;
+        uint32_t count = 0;
+
+        for(int j = 0; j < 1024; j++)
+        {
+            PTE page = VIRTMEM_teardownTable[j];
+
+            // a shared frame (shm) is released by its owner, not by the mappings
+            if((page & PTE_PAGE_PRESENT) == PTE_PAGE_PRESENT && (page & PTE_PAGE_SHARED) != PTE_PAGE_SHARED)
+                frames[count++] = (void*)(page & 0xFFFFF000);
+            else if((page & PTE_PAGE_SWAPPED) == PTE_PAGE_SWAPPED)
+                SWAP_freeSlot(PTE_SWAP_SLOT(page));
+        }
+
+        PHYSMEM_freeBlockList(frames, count, PHYSMEM_USER_PROCESS);
+        PHYSMEM_freeBlocksFor(table, 1, PHYSMEM_USER_PAGE_TABLE);
+        page_directory[i] = 0;
+    }
 
-    unlock_scheduler();
+    if(is_schedulerEnabled())
+        release_mutex(&VIRTMEM_spaceMutex);
 
-    // unmap pages from 4mb to 3gb
-    for(int i = 0x400000; i < 0xc0000000; i += 0x1000)
-        VIRTMEM_unMapPage((void*)i);
+    vfree(page_directory);
+}
 
-    // unmap page tables from 4mb to 3gb
-    for(int i = 0x400000; i < 0xc0000000; i += 0x400000)
-        VIRTMEM_unMapTable((void*)i);
+/*
+ * copy the current address space for a fork: the page tables from 4mb to 3gb are duplicated
+ * but not the pages. Writable pages become read-only copy on write pages in both address spaces
+ * and each frame gets one more owner, only shared mappings (shm) stay writable.
+ * returns the virtual address of the new page directory
+*/
+uint32_t* VIRTMEM_cloneAddressSpace()
+{
+    PDE* page_directory = (PDE*)0xFFFFF000; // virtual addresse of the current page directory
+    PDE* new_pagedirectory = VIRTMEM_createAddressSpace();
+    PTE* new_table = vmalloc(0x1000);   // the new tables are built here then copied to their frame
+
+    if(new_pagedirectory == NULL || new_table == NULL)
+    {
+        vfree(new_pagedirectory);
+        vfree(new_table);
+        return NULL;
+    }
+
+    // the reclaim task must not page anything out between reading an entry and sharing its frame
+    if(is_schedulerEnabled())
+        acquire_mutex(&VIRTMEM_spaceMutex);
+
+    for(int i = PDE_INDEX(0x400000); i < PDE_INDEX(0xc0000000); i++)
+    {
+        if((page_directory[i] & PDE_PRESENT) != PDE_PRESENT)
+            continue;
+
+        PTE* page_table = (PTE*)(0xFFC00000 + (i << 12));   // virtuall addresse of the page table
+
+        for(int j = 0; j < 1024; j++)
+        {
+            PTE page = page_table[j];
+
+            if((page & PTE_PAGE_PRESENT) == PTE_PAGE_PRESENT && (page & PTE_PAGE_SHARED) != PTE_PAGE_SHARED)
+            {
+                if(page & PTE_PAGE_WRITE)
+                {
+                    page = (page & ~PTE_PAGE_WRITE) | PTE_PAGE_COW;
+                    page_table[j] = page;
+                }
+
+                PHYSMEM_shareBlock((void*)(page & 0xFFFFF000));
+            }
+            else if((page & PTE_PAGE_SWAPPED) == PTE_PAGE_SWAPPED)
+                SWAP_duplicateSlot(PTE_SWAP_SLOT(page));    // both read it back when they touch it
+
+            new_table[j] = page;
+        }
+
+        void* frame = PHYSMEM_AllocBlocksFor(1, PHYSMEM_USER_PAGE_TABLE);
+        if(frame == NULL)
+        {
+            // this table never made it to the new address space, the others are released with it
+            for(int j = 0; j < 1024; j++)
+            {
+                if((new_table[j] & PTE_PAGE_PRESENT) == PTE_PAGE_PRESENT && (new_table[j] & PTE_PAGE_SHARED) != PTE_PAGE_SHARED)
+                    PHYSMEM_freeBlocksFor((void*)(new_table[j] & 0xFFFFF000), 1, PHYSMEM_USER_PROCESS);
+                else if((new_table[j] & PTE_PAGE_SWAPPED) == PTE_PAGE_SWAPPED)
+                    SWAP_freeSlot(PTE_SWAP_SLOT(new_table[j]));
+            }
+
+            if(is_schedulerEnabled())
+                release_mutex(&VIRTMEM_spaceMutex);
+
+            vfree(new_table);
+            switchPDBR(getPDBR());
+            VIRTMEM_destroyAddressSpace(new_pagedirectory);
+            return NULL;
+        }
+
+        VIRTMEM_copyToFrame(frame, new_table);
+        new_pagedirectory[i] = PAGE_ADD_ATTRIBUTE((uint32_t)frame, page_directory[i] & 0xFFF);
+    }
+
+    if(is_schedulerEnabled())
+        release_mutex(&VIRTMEM_spaceMutex);
+
+    vfree(new_table);
+
+    switchPDBR(getPDBR());  // the parent's writable pages just became read-only
+    return new_pagedirectory;
+}
+
+/*
+ * a write hit a copy on write page: the last owner simply gets its write access back,
+ * the others get their own copy of the frame. returns false if it's not a copy on write page
+*/
+bool VIRTMEM_handleCowFault(void* virt)
+{
+    PDE* page_directory = (PDE*)0xFFFFF000; // virtual addresse of the page directory
+
+    uint32_t pageTableIndex = PDE_INDEX((uint32_t)virt);
+    PTE* page_table = (PTE*)(0xFFC00000 + (pageTableIndex << 12));   // virtuall addresse of the page table
+    uint32_t pageEntryIndex = PTE_INDEX((uint32_t)virt);
+
+    if((page_directory[pageTableIndex] & PDE_PRESENT) != PDE_PRESENT)
+        return false;
+
+    PTE page = page_table[pageEntryIndex];
+    if((page & PTE_PAGE_PRESENT) != PTE_PAGE_PRESENT || (page & PTE_PAGE_COW) != PTE_PAGE_COW)
+        return false;
+
+    void* frame = (void*)(page & 0xFFFFF000);
+    uint32_t flags = (page & 0xFFF & ~PTE_PAGE_COW) | PTE_PAGE_WRITE;
+
+    if(PHYSMEM_getRefCount(frame) == 1)
+    {
+        page_table[pageEntryIndex] = PAGE_ADD_ATTRIBUTE((PTE)frame, flags);
+        flushTLB(virt);
+        return true;
+    }
+
+    void* copy = PHYSMEM_AllocBlocksFor(1, PHYSMEM_USER_PROCESS);
+    if(copy == NULL)
+        return false;
+
+    VIRTMEM_copyToFrame(copy, (void*)((uint32_t)virt & 0xFFFFF000));
+
+    page_table[pageEntryIndex] = PAGE_ADD_ATTRIBUTE((PTE)copy, flags);
+    flushTLB(virt);
+
+    PHYSMEM_freeBlocksFor(frame, 1, PHYSMEM_USER_PROCESS);  // one owner less
+    return true;
+}
+
+// keep the reclaim task (and forks, and teardowns) out of every address space
+void VIRTMEM_lockAddressSpaces()
+{
+    if(is_schedulerEnabled())
+        acquire_mutex(&VIRTMEM_spaceMutex);
+}
+
+void VIRTMEM_unlockAddressSpaces()
+{
+    if(is_schedulerEnabled())
+        release_mutex(&VIRTMEM_spaceMutex);
+}
+
+/*
+ * clock (second chance) scan of the user pages of an address space that isn't loaded on this cpu, from *hand up to 3gb.
+ * a page accessed since the last pass only loses its accessed bit. the first one that wasn't becomes the victim
+ * if it's private with a single owner: its entry now points to the swap slot and its frame is returned, still
+ * allocated, for the caller to write out and free. *hand is left right after the last page scanned.
+ * the caller holds VIRTMEM_lockAddressSpaces(). returns NULL if the scan reached 3gb without a victim.
+ * the process may be running on another cpu: the entries are changed atomically (the cpu sets the accessed
+ * and dirty bits behind our back) and the other cpus drop what they cached of them
+*/
+void* VIRTMEM_pageOut(PDE* page_directory, uint32_t* hand, uint32_t slot)
+{
+    void* frame = NULL;
+
+    while(frame == NULL && *hand < 0xc0000000)
+    {
+        uint32_t pageTableIndex = PDE_INDEX(*hand);
+        uint32_t pageEntryIndex = PTE_INDEX(*hand);
+
+        if((page_directory[pageTableIndex] & PDE_PRESENT) != PDE_PRESENT || (page_directory[pageTableIndex] & PDE_4MBPAGE) == PDE_4MBPAGE)
+        {
+            *hand = (pageTableIndex + 1) << 22;
+            continue;
+        }
+
+        // entries changed in this table, to shoot down once it's scanned
+        uint32_t first = 1024;
+        uint32_t last = 0;
+
+        PTE* page_table = VIRTMEM_tempMap((void*)(page_directory[pageTableIndex] & 0xFFFFF000), PTE_PAGE_WRITE);
+
+        for(; pageEntryIndex < 1024; pageEntryIndex++)
+        {
+            PTE page = page_table[pageEntryIndex];
+
+            // shared and copy on write frames have other owners, they stay
+            if((page & (PTE_PAGE_PRESENT | PTE_PAGE_USER_MODE)) != (PTE_PAGE_PRESENT | PTE_PAGE_USER_MODE) || (page & (PTE_PAGE_SHARED | PTE_PAGE_COW)))
+                continue;
+
+            // second chance. a cpu with the entry in its tlb wouldn't set the bit again, hence the shootdown
+            if(page & PTE_PAGE_ACCESSED)
+            {
+                __sync_fetch_and_and(&page_table[pageEntryIndex], ~PTE_PAGE_ACCESSED);
+                first = first < pageEntryIndex ? first : pageEntryIndex;
+                last = pageEntryIndex;
+                continue;
+            }
+
+            // not under the scheduler lock, the physical memory manager's lock comes before it
+            if(PHYSMEM_getRefCount((void*)(page & 0xFFFFF000)) != 1)
+                continue;   // still held by the page cache
+
+            PTE swapped = (slot << 12) | (page & (PTE_PAGE_WRITE | PTE_PAGE_USER_MODE)) | PTE_PAGE_SWAPPED;
+
+            lock_scheduler();   // the owner changes its entries with the scheduler locked
+
+            // lost if the page was touched (or changed by its owner) since it was read
+            bool taken = __sync_bool_compare_and_swap(&page_table[pageEntryIndex], page, swapped);
+
+            unlock_scheduler();
+
+            if(!taken)
+                continue;
+
+            frame = (void*)(page & 0xFFFFF000);
+            first = first < pageEntryIndex ? first : pageEntryIndex;
+            last = pageEntryIndex;
+            break;
+        }
+
+        VIRTMEM_tempUnmap(page_table);
+
+        // before the frame is written out: a cpu running the process may still write through its tlb
+        if(first <= last)
+            SMP_shootdown((void*)((pageTableIndex << 22) + (first << 12)), last - first + 1);
+
+        *hand = (pageTableIndex << 22) + ((frame != NULL ? pageEntryIndex + 1 : 1024) << 12);
+    }
+
+    return frame;
+}
+
+// if virt (in the loaded address space) is in the swap file, get its slot
+bool VIRTMEM_getSwapSlot(void* virt, uint32_t* slot)
+{
+    PDE* page_directory = (PDE*)0xFFFFF000; // virtual addresse of the page directory
+
+    uint32_t pageTableIndex = PDE_INDEX((uint32_t)virt);
+    PTE* page_table = (PTE*)(0xFFC00000 + (pageTableIndex << 12));   // virtuall addresse of the page table
+
+    if((page_directory[pageTableIndex] & PDE_PRESENT) != PDE_PRESENT || (page_directory[pageTableIndex] & PDE_4MBPAGE) == PDE_4MBPAGE)
+        return false;
+
+    PTE page = page_table[PTE_INDEX((uint32_t)virt)];
+    if((page & (PTE_PAGE_PRESENT | PTE_PAGE_SWAPPED)) != PTE_PAGE_SWAPPED)
+        return false;
+
+    *slot = PTE_SWAP_SLOT(page);
+    return true;
+}
+
+/*
+ * map frame (holding the data read back from the swap file) where a swapped out page was,
+ * with the access it had. returns false if the page isn't swapped out anymore
+*/
+bool VIRTMEM_pageIn(void* virt, void* frame)
+{
+    uint32_t pageTableIndex = PDE_INDEX((uint32_t)virt);
+    PTE* page_table = (PTE*)(0xFFC00000 + (pageTableIndex << 12));   // virtuall addresse of the page table
+    uint32_t pageEntryIndex = PTE_INDEX((uint32_t)virt);
 
     lock_scheduler();
 
-    PROCESS_getCurrent()->cr3 = current_page_directory; // restoring ...
-    switchPDBR(current_page_directory);
-    
+    PTE page = page_table[pageEntryIndex];
+    bool swapped = (page & (PTE_PAGE_PRESENT | PTE_PAGE_SWAPPED)) == PTE_PAGE_SWAPPED;
+
+    if(swapped)
+        page_table[pageEntryIndex] = PAGE_ADD_ATTRIBUTE((PTE)frame, (page & (PTE_PAGE_WRITE | PTE_PAGE_USER_MODE)) | PTE_PAGE_PRESENT);
+
     unlock_scheduler();
 
-    vfree(page_directory);
-}
\ No newline at end of file
+    if(!swapped)
+        return false;
+
+    VIRTMEM_account(virt, PROCESS_MEM_SWAPPED, -1);
+    VIRTMEM_account(virt, PROCESS_MEM_RESIDENT, 1);
+
+    flushTLB(virt);
+    return true;
+}
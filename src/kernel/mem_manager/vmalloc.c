@@ -19,261 +19,565 @@
 
 #include <mem_manager/heap.h>
 #include <stdint.h>
+#include <debug.h>
+#include <string.h>
 #include <mem_manager/virtmem_manager.h>
 #include <memory.h>
 #include <utility.h>
 #include <mem_manager/vmalloc.h>
 #include <multitasking/scheduler.h>
 #include <multitasking/lock.h>
+#include <drivers/device.h>
 
 //============================================================================
 //    IMPLEMENTATION PRIVATE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
 //============================================================================
 
-#define VMALLOC_START  0xD8000000
-#define VMALLOC_END    0xDFFFFFFF
-
-#define VMALLOC_SIZE (VMALLOC_END - VMALLOC_START)
+#define VMALLOC_SIZE (VMALLOC_END - VMALLOC_START + 1)
 
 #define BLOCK_SIZE 4096
-#define BLOCK_PER_BYTE 8
 
-typedef enum{
-	FREE_BLOCK, // 0
-    USED_BLOCK, // 1
-}BITMAP_VALUE;
+#define VMALLOC_NODES_PER_CHUNK 128 // range nodes are taken from the heap this many at a time
 
-typedef struct tracking_list
+/*
+ * a range of virtual pages, it lives either in the free tree or in the used tree.
+ * both trees are AVL trees ordered by address, the free tree also keeps in every node
+ * the size of the biggest free range of its subtree so a fitting range is found in O(log n)
+*/
+typedef struct vmalloc_range
 {
-    uint32_t addr;
-    uint32_t block_size;
-    struct tracking_list* next;
-}tracking_list_t;
+    uint32_t start;     // first page of the range, guard pages included
+    uint32_t pages;     // size of the range, guard pages included
+    uint32_t addr;      // key: address given to the caller (same as start in the free tree)
+    uint16_t guards;    // guard pages in the range (used ranges only)
+    uint16_t height;
+    uint32_t largest;   // biggest range in this subtree (free tree only)
+
+    struct vmalloc_range* left;
+    struct vmalloc_range* right;
+    struct vmalloc_range* parent;
+}vmalloc_range_t;
 
 //============================================================================
 //    IMPLEMENTATION PRIVATE DATA
 //============================================================================
 
-uint8_t* VMALLOC_bitmap;
+vmalloc_range_t* VMALLOC_freeTree = NULL;
+vmalloc_range_t* VMALLOC_usedTree = NULL;
+vmalloc_range_t* VMALLOC_nodePool = NULL;   // unused nodes, chained by their right pointer
+
 uint32_t VMALLOC_totalBlockNumber   = 0;
 uint32_t VMALLOC_totalFreeBlock     = 0;
-uint32_t VMALLOC_totalUsedBlock     = 0;
-uint32_t VMALLOC_bitmapSize;
-
-tracking_list_t* tracking_head = NULL;
+uint32_t VMALLOC_totalUsedBlock     = 0;    // mapped blocks
+uint32_t VMALLOC_totalGuardBlock    = 0;
+uint32_t VMALLOC_usedRanges         = 0;
+uint32_t VMALLOC_freeRanges         = 0;
+uint32_t VMALLOC_allocCalls         = 0;
+uint32_t VMALLOC_freeCalls          = 0;
+uint32_t VMALLOC_failedAllocs       = 0;
 
-mutex_t VMALLOC_mutex;
+spinlock_t VMALLOC_lock = SPINLOCK_INIT("vmalloc");   // the ranges only, pages are mapped and unmapped without it
 
 //============================================================================
 //    IMPLEMENTATION PRIVATE FUNCTIONS
 //============================================================================
 
-void VMALLOC_setBlockToFree(uint32_t block)
+vmalloc_range_t* VMALLOC_newNode()
 {
-    if(block > VMALLOC_totalBlockNumber)
-        return;
-    
-    VMALLOC_bitmap[block / 8] ^= (1 << block % 8);
+    if(VMALLOC_nodePool == NULL)
+    {
+        // the nodes are never given back to the heap, they are recycled here
+        vmalloc_range_t* chunk = kmalloc(sizeof(vmalloc_range_t) * VMALLOC_NODES_PER_CHUNK);
+        if(chunk == NULL)
+            return NULL;
+
+        for(int i = 0; i < VMALLOC_NODES_PER_CHUNK; i++)
+        {
+            chunk[i].right = VMALLOC_nodePool;
+            VMALLOC_nodePool = &chunk[i];
+        }
+    }
+
+    vmalloc_range_t* node = VMALLOC_nodePool;
+    VMALLOC_nodePool = node->right;
+
+    memset(node, 0, sizeof(vmalloc_range_t));
+    node->height = 1;
+
+    return node;
 }
 
-void VMALLOC_setBlockToUsed(int block)
+void VMALLOC_deleteNode(vmalloc_range_t* node)
 {
-    if(block > VMALLOC_totalBlockNumber)
-        return;
-    
-    VMALLOC_bitmap[block / 8] |= (1 << block % 8);
+    node->right = VMALLOC_nodePool;
+    VMALLOC_nodePool = node;
+}
+
+static inline uint32_t VMALLOC_height(vmalloc_range_t* node)
+{
+    return node ? node->height : 0;
 }
 
-uint8_t VMALLOC_checkIfBlockUsed(int block)
+static inline uint32_t VMALLOC_largest(vmalloc_range_t* node)
 {
-    if(block > VMALLOC_totalBlockNumber)
-        return 1;
-    
-    return VMALLOC_bitmap[block / 8] & (1 << block % 8);
+    return node ? node->largest : 0;
 }
 
-uint32_t VMALLOC_firstFreeBlock()
+// recompute the height and the biggest range of a node from its children
+void VMALLOC_update(vmalloc_range_t* node)
 {
-    for(int i = 0; i < VMALLOC_totalBlockNumber; i++)
-        if(VMALLOC_checkIfBlockUsed(i) == 0)
-            return i;
+    uint32_t left = VMALLOC_height(node->left);
+    uint32_t right = VMALLOC_height(node->right);
+
+    node->height = 1 + (left > right ? left : right);
 
-    return -1;
+    node->largest = node->pages;
+    if(VMALLOC_largest(node->left) > node->largest)
+        node->largest = VMALLOC_largest(node->left);
+    if(VMALLOC_largest(node->right) > node->largest)
+        node->largest = VMALLOC_largest(node->right);
 }
 
-uint32_t VMALLOC_firstFreeBlockFrom(uint32_t position)
+void VMALLOC_replaceChild(vmalloc_range_t** root, vmalloc_range_t* parent, vmalloc_range_t* old, vmalloc_range_t* new)
 {
-    for(int i = position; i < VMALLOC_totalBlockNumber; i++)
-        if(VMALLOC_checkIfBlockUsed(i) == 0)
-            return i;
+    if(parent == NULL)
+        *root = new;
+    else if(parent->left == old)
+        parent->left = new;
+    else
+        parent->right = new;
 
-    return -1;
+    if(new != NULL)
+        new->parent = parent;
 }
 
-void* VMALLOC_findFreeRange(uint32_t block_size)
+vmalloc_range_t* VMALLOC_rotateLeft(vmalloc_range_t** root, vmalloc_range_t* node)
 {
-    uint32_t index;
-    uint32_t block_addr;
-    uint32_t count;
+    vmalloc_range_t* pivot = node->right;
 
-    if(block_size > VMALLOC_totalFreeBlock)
-        return NULL;
-    
-    index = VMALLOC_firstFreeBlock();
-    block_addr = index;
-    count = 1; // we already have one block
+    VMALLOC_replaceChild(root, node->parent, node, pivot);
 
-    while (index < VMALLOC_totalBlockNumber)
+    node->right = pivot->left;
+    if(pivot->left != NULL)
+        pivot->left->parent = node;
+
+    pivot->left = node;
+    node->parent = pivot;
+
+    VMALLOC_update(node);
+    VMALLOC_update(pivot);
+
+    return pivot;
+}
+
+vmalloc_range_t* VMALLOC_rotateRight(vmalloc_range_t** root, vmalloc_range_t* node)
+{
+    vmalloc_range_t* pivot = node->left;
+
+    VMALLOC_replaceChild(root, node->parent, node, pivot);
+
+    node->left = pivot->right;
+    if(pivot->right != NULL)
+        pivot->right->parent = node;
+
+    pivot->right = node;
+    node->parent = pivot;
+
+    VMALLOC_update(node);
+    VMALLOC_update(pivot);
+
+    return pivot;
+}
+
+// walk up from node to the root, fixing the heights, the biggest ranges and the balance
+void VMALLOC_rebalance(vmalloc_range_t** root, vmalloc_range_t* node)
+{
+    while(node != NULL)
     {
-        if(count >= block_size)
+        VMALLOC_update(node);
+
+        int balance = (int)VMALLOC_height(node->left) - (int)VMALLOC_height(node->right);
+
+        if(balance > 1)
         {
-            for(int i = 0; i < count; i++)
-            {
-                VMALLOC_setBlockToUsed(block_addr + i);
-                VMALLOC_totalUsedBlock++;
-                VMALLOC_totalFreeBlock--;
-            }
-            
-            return (void*)((block_addr * BLOCK_SIZE) + VMALLOC_START);
+            if(VMALLOC_height(node->left->left) < VMALLOC_height(node->left->right))
+                VMALLOC_rotateLeft(root, node->left);
+
+            node = VMALLOC_rotateRight(root, node);
+        }
+        else if(balance < -1)
+        {
+            if(VMALLOC_height(node->right->right) < VMALLOC_height(node->right->left))
+                VMALLOC_rotateRight(root, node->right);
+
+            node = VMALLOC_rotateLeft(root, node);
         }
 
-        index++;
-        if(VMALLOC_checkIfBlockUsed(index))
+        node = node->parent;
+    }
+}
+
+void VMALLOC_insert(vmalloc_range_t** root, vmalloc_range_t* node)
+{
+    vmalloc_range_t* parent = NULL;
+    vmalloc_range_t** link = root;
+
+    while(*link != NULL)
+    {
+        parent = *link;
+        link = (node->addr < parent->addr) ? &parent->left : &parent->right;
+    }
+
+    node->left = NULL;
+    node->right = NULL;
+    node->parent = parent;
+    *link = node;
+
+    VMALLOC_rebalance(root, node);
+}
+
+void VMALLOC_remove(vmalloc_range_t** root, vmalloc_range_t* node)
+{
+    vmalloc_range_t* fix;
+
+    if(node->left != NULL && node->right != NULL)
+    {
+        // replace the node by the smallest node of its right subtree
+        vmalloc_range_t* next = node->right;
+        while(next->left != NULL)
+            next = next->left;
+
+        fix = (next->parent == node) ? next : next->parent;
+
+        if(next->parent != node)
         {
-            count = 1;
-            index = VMALLOC_firstFreeBlockFrom(index);
-            block_addr = index;
+            VMALLOC_replaceChild(root, next->parent, next, next->right);
+
+            next->right = node->right;
+            next->right->parent = next;
         }
 
-        count++;
+        VMALLOC_replaceChild(root, node->parent, node, next);
+        next->left = node->left;
+        next->left->parent = next;
+    }
+    else
+    {
+        fix = node->parent;
+        VMALLOC_replaceChild(root, node->parent, node, node->left ? node->left : node->right);
+    }
+
+    VMALLOC_rebalance(root, fix);
+}
+
+vmalloc_range_t* VMALLOC_find(vmalloc_range_t* root, uint32_t addr)
+{
+    while(root != NULL && root->addr != addr)
+        root = (addr < root->addr) ? root->left : root->right;
+
+    return root;
+}
+
+// lowest free range holding at least `pages` pages
+vmalloc_range_t* VMALLOC_findFreeRange(uint32_t pages)
+{
+    vmalloc_range_t* node = VMALLOC_freeTree;
+
+    if(VMALLOC_largest(node) < pages)
+        return NULL;
+
+    while(node != NULL)
+    {
+        if(VMALLOC_largest(node->left) >= pages)
+            node = node->left;
+        else if(node->pages >= pages)
+            return node;
+        else
+            node = node->right;
     }
-    
+
     return NULL;
 }
 
-void VMALLOC_freeThisRange(void* ptr, uint8_t size)
+// free ranges just below and just above [start, end)
+void VMALLOC_findNeighbours(uint32_t start, uint32_t end, vmalloc_range_t** below, vmalloc_range_t** above)
 {
-    if(!ptr)
-        return;
+    vmalloc_range_t* node = VMALLOC_freeTree;
 
-    uint32_t block = (uint32_t)ptr / (BLOCK_SIZE);
+    *below = NULL;
+    *above = NULL;
 
-    for(int i = 0; i < size; i++)
+    while(node != NULL)
     {
-        VMALLOC_setBlockToFree(block + i);
-        VMALLOC_totalUsedBlock--;
-        VMALLOC_totalFreeBlock++;
+        if(node->addr < start)
+        {
+            *below = node;
+            node = node->right;
+        }
+        else
+        {
+            if(node->addr >= end)
+                *above = node;
+            node = node->left;
+        }
     }
 }
 
+// carve `pages` pages from the start of a free range, returns the first page
+uint32_t VMALLOC_takeRange(vmalloc_range_t* range, uint32_t pages)
+{
+    uint32_t start = range->start;
+
+    if(range->pages == pages)
+    {
+        VMALLOC_remove(&VMALLOC_freeTree, range);
+        VMALLOC_deleteNode(range);
+        VMALLOC_freeRanges--;
+    }
+    else
+    {
+        // the order of the free ranges doesn't change, only the sizes up to the root need fixing
+        range->start += pages * BLOCK_SIZE;
+        range->addr = range->start;
+        range->pages -= pages;
+        VMALLOC_rebalance(&VMALLOC_freeTree, range);
+    }
+
+    VMALLOC_totalFreeBlock -= pages;
+
+    return start;
+}
+
+// give back a range to the free tree, merging it with its neighbours
+void VMALLOC_releaseRange(uint32_t start, uint32_t pages, vmalloc_range_t* node)
+{
+    uint32_t end = start + pages * BLOCK_SIZE;
+    vmalloc_range_t *below, *above;
+
+    VMALLOC_findNeighbours(start, end, &below, &above);
+
+    if(below != NULL && below->start + below->pages * BLOCK_SIZE != start)
+        below = NULL;
+    if(above != NULL && above->start != end)
+        above = NULL;
+
+    if(below != NULL && above != NULL)
+    {
+        below->pages += pages + above->pages;
+        VMALLOC_remove(&VMALLOC_freeTree, above);
+        VMALLOC_deleteNode(above);
+        VMALLOC_rebalance(&VMALLOC_freeTree, below);
+        VMALLOC_freeRanges--;
+    }
+    else if(below != NULL)
+    {
+        below->pages += pages;
+        VMALLOC_rebalance(&VMALLOC_freeTree, below);
+    }
+    else if(above != NULL)
+    {
+        above->start = start;
+        above->addr = start;
+        above->pages += pages;
+        VMALLOC_rebalance(&VMALLOC_freeTree, above);
+    }
+    else
+    {
+        // reuse the node of the used range
+        node->start = start;
+        node->addr = start;
+        node->pages = pages;
+        node->guards = 0;
+        node->height = 1;
+        VMALLOC_insert(&VMALLOC_freeTree, node);
+        VMALLOC_freeRanges++;
+        node = NULL;
+    }
+
+    if(node != NULL)
+        VMALLOC_deleteNode(node);
+
+    VMALLOC_totalFreeBlock += pages;
+}
+
 //============================================================================
 //    INTERFACE FUNCTIONS
 //============================================================================
 
 bool VMALLOC_initialize()
 {
-    VMALLOC_totalBlockNumber = roundUp_div(VMALLOC_SIZE, BLOCK_SIZE);
-    VMALLOC_bitmapSize = roundUp_div(VMALLOC_totalBlockNumber, BLOCK_PER_BYTE);
-
-    VMALLOC_bitmap = kmalloc(sizeof(uint8_t) * VMALLOC_bitmapSize);
-    if(VMALLOC_bitmap == NULL)
-        return false; // error
+    VMALLOC_totalBlockNumber = VMALLOC_SIZE / BLOCK_SIZE;
 
     // first we need to allocate all the page table for vmalloc address range
     // because we want it to be consistent in all address space
     for(uint32_t i =  VMALLOC_START; i <= VMALLOC_END; i += (400 * 0x1000))
         VIRTMEM_mapTable((void*)i, true);
 
-    // initialy we mark the whole memory as used
-    memset(VMALLOC_bitmap, 0b11111111, VMALLOC_bitmapSize);
+    // the whole range starts as one free range
+    vmalloc_range_t* all = VMALLOC_newNode();
+    if(all == NULL)
+        return false; // error
+
+    all->start = VMALLOC_START;
+    all->addr = VMALLOC_START;
+    all->pages = VMALLOC_totalBlockNumber;
+    VMALLOC_insert(&VMALLOC_freeTree, all);
 
-    // then we mark the availabe blocks
-    for(int i = 0; i < VMALLOC_totalBlockNumber; i++)
-    {
-        VMALLOC_setBlockToFree(i);
-        VMALLOC_totalFreeBlock++;
-    }
+    VMALLOC_freeRanges = 1;
+    VMALLOC_totalFreeBlock = VMALLOC_totalBlockNumber;
 
     return true;
 }
 
-void* vmalloc(size_t size)
+/*
+ * allocate and map `size` bytes rounded up to whole pages.
+ * the flags add unmapped guard pages around the allocation so running
+ * past either end page faults instead of corrupting the next allocation
+*/
+void* VMALLOC_allocate(size_t size, uint32_t flags)
 {
     if(size <= 0)
         return NULL;
 
-    if(is_schedulerEnabled())
-        acquire_mutex(&VMALLOC_mutex);
-
     uint32_t block_size = roundUp_div(size, BLOCK_SIZE);
+    uint32_t guard_low = (flags & VMALLOC_GUARD_LOW) ? 1 : 0;
+    uint32_t guard_high = (flags & VMALLOC_GUARD_HIGH) ? 1 : 0;
+    uint32_t total = block_size + guard_low + guard_high;
 
-    void* block_addr = VMALLOC_findFreeRange(block_size);
+    spin_lock(&VMALLOC_lock);
 
-    for(int i = 0; i < block_size; i++)
-        VIRTMEM_mapPage (block_addr + (BLOCK_SIZE * i), true);
+    VMALLOC_allocCalls++;
 
-    tracking_list_t* new = kmalloc(sizeof(tracking_list_t));
+    vmalloc_range_t* range = VMALLOC_findFreeRange(total);
+    vmalloc_range_t* node = VMALLOC_newNode();
+    if(range == NULL || node == NULL)
+    {
+        if(node != NULL)
+            VMALLOC_deleteNode(node);
 
-    new->addr = (uint32_t)block_addr;
-    new->block_size = block_size;
-    new->next = NULL;
+        VMALLOC_failedAllocs++;
 
-    if(tracking_head == NULL)
-        tracking_head = new;
-    else
+        spin_unlock(&VMALLOC_lock);
+
+        return NULL;
+    }
+
+    node->start = VMALLOC_takeRange(range, total);
+    node->pages = total;
+    node->guards = guard_low + guard_high;
+    node->addr = node->start + guard_low * BLOCK_SIZE;
+
+    void* block_addr = (void*)node->addr;
+
+    // the range is ours, mapping it may reclaim memory (and sleep): not with the lock
+    spin_unlock(&VMALLOC_lock);
+
+    // on failure the range unmaps what it managed to map
+    bool mapped = VIRTMEM_mapRange(block_addr, block_size, true);
+
+    spin_lock(&VMALLOC_lock);
+
+    if(!mapped)
     {
-        new->next = tracking_head->next;
-        tracking_head->next = new;
+        VMALLOC_releaseRange(node->start, node->pages, node);
+        VMALLOC_failedAllocs++;
+
+        spin_unlock(&VMALLOC_lock);
+
+        log_err("vmalloc", "out of memory while mapping %d pages", block_size);
+        return NULL;
     }
 
-    if(is_schedulerEnabled())
-        release_mutex(&VMALLOC_mutex);
+    VMALLOC_insert(&VMALLOC_usedTree, node);
+    VMALLOC_usedRanges++;
+    VMALLOC_totalUsedBlock += block_size;
+    VMALLOC_totalGuardBlock += node->guards;
+
+    spin_unlock(&VMALLOC_lock);
 
     return block_addr;
 }
 
+void* vmalloc(size_t size)
+{
+    return VMALLOC_allocate(size, VMALLOC_GUARD_HIGH);
+}
+
 void vfree(void* ptr)
 {
-    if(ptr == NULL || tracking_head == NULL)
+    if(ptr == NULL)
         return;
 
-    if(is_schedulerEnabled())
-        acquire_mutex(&VMALLOC_mutex);
+    spin_lock(&VMALLOC_lock);
 
-    tracking_list_t *this = tracking_head;
-    tracking_list_t *before_this = NULL;
-    while (this != NULL)
+    vmalloc_range_t* node = VMALLOC_find(VMALLOC_usedTree, (uint32_t)ptr);
+    if(node == NULL)
     {
-        if(this->addr == (uint32_t)ptr)
-        {
-            VMALLOC_freeThisRange(ptr, this->block_size);
-            for(int i = 0; i < this->block_size; i++)
-                VIRTMEM_unMapPage(ptr + (BLOCK_SIZE * i));
-            
-            if(before_this != NULL)
-            {
-                before_this->next = this->next;
-                kfree(this);
-                this = NULL;
-            }
-            else
-            {
-                tracking_head = this->next;
-                kfree(this);
-            }
-
-            if(is_schedulerEnabled())
-                release_mutex(&VMALLOC_mutex);
-
-            return;
-        }
+        spin_unlock(&VMALLOC_lock);
 
-        before_this = this;
-        this = this->next;
+        log_err("vmalloc", "vfree: 0x%x was never allocated", ptr);
+        return;
     }
 
-    if(is_schedulerEnabled())
-        release_mutex(&VMALLOC_mutex);
+    uint32_t block_size = node->pages - node->guards;
+
+    VMALLOC_remove(&VMALLOC_usedTree, node);
+    VMALLOC_usedRanges--;
+    VMALLOC_totalUsedBlock -= block_size;
+    VMALLOC_totalGuardBlock -= node->guards;
+    VMALLOC_freeCalls++;
 
-    // if it reaches here that's means we never allocated this pointer before !
-}
\ No newline at end of file
+    spin_unlock(&VMALLOC_lock);
+
+    // the range can't be handed out again before it's back in the free tree
+    VIRTMEM_unmapRange(ptr, block_size);
+
+    spin_lock(&VMALLOC_lock);
+    VMALLOC_releaseRange(node->start, node->pages, node);
+    spin_unlock(&VMALLOC_lock);
+}
+
+void VMALLOC_getStats(vmalloc_stats_t* stats)
+{
+    spin_lock(&VMALLOC_lock);
+
+    stats->totalPages = VMALLOC_totalBlockNumber;
+    stats->usedPages = VMALLOC_totalUsedBlock;
+    stats->guardPages = VMALLOC_totalGuardBlock;
+    stats->freePages = VMALLOC_totalFreeBlock;
+    stats->largestFree = VMALLOC_largest(VMALLOC_freeTree);
+    stats->usedRanges = VMALLOC_usedRanges;
+    stats->freeRanges = VMALLOC_freeRanges;
+    stats->allocCalls = VMALLOC_allocCalls;
+    stats->freeCalls = VMALLOC_freeCalls;
+    stats->failedAllocs = VMALLOC_failedAllocs;
+
+    spin_unlock(&VMALLOC_lock);
+}
+
+void VMALLOC_dumpStats()
+{
+    vmalloc_stats_t stats;
+    VMALLOC_getStats(&stats);
+
+    log_info("vmalloc", "%d/%d pages free in %d ranges, largest free range: %d pages", stats.freePages, stats.totalPages, stats.freeRanges, stats.largestFree);
+    log_info("vmalloc", "%d pages mapped in %d ranges, %d guard pages", stats.usedPages, stats.usedRanges, stats.guardPages);
+    log_info("vmalloc", "%d allocs, %d frees, %d failed allocations", stats.allocCalls, stats.freeCalls, stats.failedAllocs);
+}
+
+static bool VMALLOC_statsRecord(uint32_t index, void* record)
+{
+    if(index > 0)
+        return false;
+
+    VMALLOC_getStats((vmalloc_stats_t*)record);
+    return true;
+}
+
+/*
+ * read only device exposing a vmalloc_stats_t snapshot (/dev/vmallocinfo once devfs is mounted)
+*/
+void VMALLOC_createDevice()
+{
+    add_record_device("vmallocinfo", VMALLOC_statsRecord, sizeof(vmalloc_stats_t));
+}
@@ -21,6 +21,7 @@
 #include <hal/io.h>
 #include <debug.h>
 #include <mem_manager/heap.h>
+#include <mem_manager/slab.h>
 #include <multitasking/scheduler.h>
 #include <multitasking/process.h>
 #include <multitasking/lock.h>
@@ -49,14 +50,21 @@ struct endpoint
 
 struct endpoint* endpoints[MAX_PROCESS];
 
+kmem_cache_t* message_cache;
+
+void message_init()
+{
+    message_cache = kmem_cache_create("message_t", sizeof(message_t), NULL);
+}
+
 int send_msg(uint32_t receiver_id, void* data, size_t size)
 {
-    message_t* new = kmalloc(sizeof(message_t));
+    message_t* new = kmem_cache_alloc(message_cache);
     do
     {
         if(endpoints[receiver_id] == NULL || !endpoints[receiver_id]->is_open)
         {
-            kfree(new);
+            kmem_cache_free(message_cache, new);
             return -1;
         }
 
@@ -151,7 +159,7 @@ bool receive_async_msg(void* dataOut, size_t *size)
         memcpy(dataOut, received_msg->data, received_msg->size);
     }
 
-    kfree(received_msg);
+    kmem_cache_free(message_cache, received_msg);
     return true;
 }
 
@@ -159,7 +167,18 @@ void receive_msg(void* dataOut, size_t *size)
 {
     while (!receive_async_msg(dataOut, size))
     {
+        // a message sent between the check and the state change would never wake us up
+        lock_scheduler();
+
+        if(endpoints[PROCESS_getCurrent()->id]->count > 0)
+        {
+            unlock_scheduler();
+            continue;
+        }
+
         PROCESS_getCurrent()->state = BLOCKED;
+        unlock_scheduler();
+
         block_task();
     }
 }
@@ -58,7 +58,7 @@ uint64_t shared_memory_create(uint32_t length)
 
     new->length = roundUp_div(length, 0x1000);
     new->ref_count = 0;
-    new->phys_base = PHYSMEM_AllocBlocks(new->length);
+    new->phys_base = PHYSMEM_AllocBlocksFor(new->length, PHYSMEM_USER_SHM);
     new->id = feistel64(shm_counter++, shm_key);
 
     acquire_mutex(mutex_list);
@@ -96,8 +96,11 @@ void* shared_memory_attach(uint64_t id)
     if(NULL == mem_base)    // there is no free region
         return NULL;
         
-    for(uint32_t i = 0; i < mem->length; i++)
-        VIRTMEM_mapPageCustom(mem->phys_base + (i * 0x1000), mem_base + (i * 0x1000), !PROCESS_getCurrent()->usermode);
+    if(!VIRTMEM_mapRangeCustom(mem->phys_base, mem_base, mem->length, !PROCESS_getCurrent()->usermode, PAT_WRITE_BACK))
+    {
+        PROCESS_removeRegion(PROCESS_getCurrent(), PROCESS_findRegion(PROCESS_getCurrent(), (uint32_t)mem_base));
+        return NULL;
+    }
 
     mem->ref_count++;
     return mem_base;
@@ -124,31 +127,19 @@ void shared_memory_detach(uint64_t id)
         return; // that shared memory doesn't exist
 
     vm_region_t* region = PROCESS_getCurrent()->regions;
-    vm_region_t* before = NULL;
     while(region != NULL)
     {
         if(region->type == REGION_SHM && region->shm_id == id)
             break;
 
-        before = region;
         region = region->next;
     }
     
     if(NULL != region)
     {
-        for(uint32_t i = 0; i < mem->length; i++)
-            VIRTMEM_unMapPageCustom((void*)(region->start + (i * 0x1000)));
-
-        if(NULL == before)  // its the first in the list
-        {
-            PROCESS_getCurrent()->regions = region->next;
-        }
-        else
-        {
-            before->next = region->next;
-        }
+        VIRTMEM_unmapRange((void*)region->start, mem->length);
 
-        kfree(region);
+        PROCESS_removeRegion(PROCESS_getCurrent(), region);
         mem->ref_count--;
 
         if(0 == mem->ref_count)
@@ -166,7 +157,7 @@ void shared_memory_detach(uint64_t id)
             }
             release_mutex(mutex_list);
 
-            PHYSMEM_freeBlocks(mem->phys_base, mem->length);
+            PHYSMEM_freeBlocksFor(mem->phys_base, mem->length, PHYSMEM_USER_SHM);
             kfree(mem);
         }
     }
@@ -188,4 +179,21 @@ void shared_memory_detachAll()
 
         region = region->next;
     }
+}
+
+// a forked child inherits the attached region (already mapped by VIRTMEM_cloneAddressSpace)
+void shared_memory_fork(uint64_t id)
+{
+    acquire_mutex(mutex_list);
+    for(uint32_t index = 0; index < memories_shared->count; index++)
+    {
+        shared_memory_t* mem = list_getAt(memories_shared, index);
+
+        if(mem->id == id)
+        {
+            mem->ref_count++;
+            break;
+        }
+    }
+    release_mutex(mutex_list);
 }
\ No newline at end of file
@@ -22,35 +22,210 @@
 #include <hal/io.h>
 #include <multitasking/scheduler.h>
 #include <multitasking/lock.h>
+#include <multitasking/smp.h>
 #include <mem_manager/heap.h>
 
-int scheduler_lock_depth = 0;
-bool scheduler_locked = false;
+static inline void SPIN_acquire(spinlock_t* lock)
+{
+    uint16_t ticket = __sync_fetch_and_add(&lock->next, 1);
+
+    // a cpu spinning with its interrupts disabled still has to answer tlb shootdowns
+    while(lock->owner != ticket)
+    {
+        SMP_handleShootdown();
+        __asm__ volatile("pause");
+    }
+}
+
+static inline bool SPIN_tryAcquire(spinlock_t* lock)
+{
+    uint16_t ticket = lock->owner;
+
+    // free if no ticket was handed out past the one being served
+    return __sync_bool_compare_and_swap(&lock->next, ticket, (uint16_t)(ticket + 1));
+}
+
+static inline void SPIN_release(spinlock_t* lock)
+{
+    __sync_synchronize();
+    lock->owner++;  // only the holder writes it
+}
+
+// no preemption while the cpu holds a spinlock, so the task can't move to another cpu either
+static cpu_t* SPIN_enter(spinlock_t* lock)
+{
+    uint32_t eflags = get_eflags();
+    disableInterrupts();
+
+    cpu_t* cpu = SMP_getCpu();
+
+    if(lock->cpu == (int32_t)cpu->id)
+    {
+        log_crit("lock", "cpu %d takes spinlock %s it already holds", cpu->id, lock->name);
+        panic();
+    }
+
+    cpu->spinDepth++;
+
+    if(eflags & (1 << 9))
+        enableInterrupts();
+
+    return cpu;
+}
+
+static void SPIN_leave(cpu_t* cpu)
+{
+    uint32_t eflags = get_eflags();
+    disableInterrupts();
+
+    cpu->spinDepth--;
 
+    if(eflags & (1 << 9))
+        enableInterrupts();
+}
+
+void spin_lock(spinlock_t* lock)
+{
+    cpu_t* cpu = SPIN_enter(lock);
+
+    SPIN_acquire(lock);
+    lock->cpu = cpu->id;
+}
+
+// returns false if someone else holds the lock
+bool spin_trylock(spinlock_t* lock)
+{
+    cpu_t* cpu = SPIN_enter(lock);
+
+    if(!SPIN_tryAcquire(lock))
+    {
+        SPIN_leave(cpu);
+        return false;
+    }
+
+    lock->cpu = cpu->id;
+    return true;
+}
+
+void spin_unlock(spinlock_t* lock)
+{
+    cpu_t* cpu = SMP_getCpu();
+
+    if(lock->cpu != (int32_t)cpu->id)
+        log_err("lock", "cpu %d releases spinlock %s held by cpu %d", cpu->id, lock->name, lock->cpu);
+
+    lock->cpu = -1;
+    SPIN_release(lock);
+    SPIN_leave(cpu);
+}
+
+// returns the flags to give back to spin_unlock_irqrestore()
+uint32_t spin_lock_irqsave(spinlock_t* lock)
+{
+    uint32_t eflags = get_eflags();
+    disableInterrupts();
+
+    spin_lock(lock);
+
+    return eflags;
+}
+
+void spin_unlock_irqrestore(spinlock_t* lock, uint32_t eflags)
+{
+    spin_unlock(lock);
+
+    if(eflags & (1 << 9))
+        enableInterrupts();
+}
+
+/*
+ * no preemption until put_cpu(), like holding a spinlock: the task stays on this cpu and nothing
+ * else runs on it. returns the cpu number, for per cpu data
+*/
+uint32_t get_cpu()
+{
+    uint32_t eflags = get_eflags();
+    disableInterrupts();
+
+    cpu_t* cpu = SMP_getCpu();
+    cpu->spinDepth++;
+
+    if(eflags & (1 << 9))
+        enableInterrupts();
+
+    return cpu->id;
+}
+
+void put_cpu()
+{
+    SPIN_leave(SMP_getCpu());   // still the same cpu
+}
+
+// does this cpu hold a spinlock, it must not sleep or be preempted then
+bool is_spinlock_held()
+{
+    uint32_t eflags = get_eflags();
+    disableInterrupts();
+
+    bool held = SMP_getCpu()->spinDepth > 0;
+
+    if(eflags & (1 << 9))
+        enableInterrupts();
+
+    return held;
+}
+
+/*
+ * one lock for every scheduler structure (the run queues of all the cpus, the sleepers, the
+ * mutexes), held by a cpu: it nests on the cpu holding it, and a task switch hands it over
+ * to the next task (see yield()). Interrupt handlers take it too, so a cpu waits for its
+ * turn with its interrupts disabled
+*/
+spinlock_t scheduler_lock = SPINLOCK_INIT("scheduler");
+
+// does this cpu hold the scheduler lock
 bool is_scheduler_locked()
 {
-    return scheduler_locked;
+    uint32_t eflags = get_eflags();
+    disableInterrupts();
+
+    bool locked = SMP_getCpu()->lockDepth > 0;
+
+    if(eflags & (1 << 9))
+        enableInterrupts();
+
+    return locked;
 }
 
 void lock_scheduler()
 {
-    // disable interrupt here
     uint32_t eflags = get_eflags();
-    disableInterrupts();    // because this action must not be interrupted   
+    disableInterrupts();    // the cpu can't change between reading it and taking the lock
+
+    cpu_t* cpu = SMP_getCpu();
 
-    scheduler_lock_depth++;
-    scheduler_locked = true;
+    if(cpu->lockDepth == 0)
+        SPIN_acquire(&scheduler_lock);
+
+    cpu->lockDepth++;
 
-    // enable them here
     if(eflags & (1 << 9)) // if before disabling interrupt we were is a state where interrupt were enabled
         enableInterrupts();
 }
 
 void unlock_scheduler()
 {
-    scheduler_lock_depth--;
-    if(scheduler_lock_depth == 0)
-        scheduler_locked = false;
+    uint32_t eflags = get_eflags();
+    disableInterrupts();
+
+    cpu_t* cpu = SMP_getCpu();
+
+    cpu->lockDepth--;
+    if(cpu->lockDepth == 0)
+        SPIN_release(&scheduler_lock);
+
+    if(eflags & (1 << 9))
+        enableInterrupts();
 }
 
 mutex_t* create_mutex()
@@ -122,6 +297,34 @@ void acquire_mutex(mutex_t* mut)
     unlock_scheduler();
 }
 
+// same as acquire_mutex but never blocks, returns false if someone else owns the mutex
+bool try_acquire_mutex(mutex_t* mut)
+{
+    process_t* current_process = PROCESS_getCurrent();
+
+    lock_scheduler();
+
+    if(mut->locked)
+    {
+        if(mut->owner == current_process && mut->owner->id == current_process->id)
+        {
+            mut->locked_count++;
+
+            unlock_scheduler();
+            return true;
+        }
+
+        unlock_scheduler();
+        return false;
+    }
+
+    mut->locked = true;
+    mut->owner = current_process;
+    unlock_scheduler();
+
+    return true;
+}
+
 void release_mutex(mutex_t* mut)
 {
     process_t* current_process = PROCESS_getCurrent();
@@ -20,6 +20,8 @@
 CR3_OFFSET  equ 0
 ESP_OFFSET  equ 4
 
+extern SCHEDULER_finishSwitch
+
 global task_switch
 task_switch:
 
@@ -85,4 +87,20 @@ switch_to_usermode:
     ; restore old call frame (never goes there)
     mov esp, ebp
     pop ebp
-    ret
\ No newline at end of file
+    ret
+
+; first thing a forked process runs after task_switch: its kernel stack holds
+; a copy of the parent's interrupt frame, leave the interrupt like isr_common does
+global fork_return
+fork_return:
+    call SCHEDULER_finishSwitch
+
+    pop eax             ; restore user segment
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+
+    popa
+    add esp, 8          ; remove error code and interrupt number
+    iret
\ No newline at end of file
@@ -20,23 +20,34 @@
 #include <stddef.h>
 #include <debug.h>
 #include <hal/io.h>
+#include <hal/isr.h>
 #include <utility.h>
 #include <memory.h>
+#include <mem_manager/physmem_manager.h>
 #include <mem_manager/virtmem_manager.h>
 #include <mem_manager/heap.h>
 #include <mem_manager/vmalloc.h>
+#include <mem_manager/kstack.h>
+#include <mem_manager/slab.h>
+#include <mem_manager/swap.h>
 #include <multitasking/scheduler.h>
 #include <multitasking/process.h>
 #include <multitasking/lock.h>
+#include <multitasking/time.h>
 #include <multitasking/ipc/message.h>
 #include <multitasking/ipc/shared_memory.h>
+#include <vfs/page_cache.h>
 
 process_t* PROCESS_list[MAX_PROCESS];
 uint32_t PROCESS_count;
+uint32_t PROCESS_maxId = 0;     // highest id handed out so far, ids are reused from 0
 
 process_t PROCESS_cleaner;
 process_t* terminated_tasks; // dead process list
 
+kmem_cache_t* PROCESS_cache;
+kmem_cache_t* PROCESS_regionCache;
+
 int id_dispatcher(process_t* proc)
 {
     lock_scheduler();
@@ -48,6 +59,9 @@ int id_dispatcher(process_t* proc)
             PROCESS_list[i] = proc;
             PROCESS_count++;
 
+            if(i > PROCESS_maxId)
+                PROCESS_maxId = i;
+
             unlock_scheduler();
             return i;
         }
@@ -62,6 +76,74 @@ process_t* PROCESS_get(uint32_t id)
     return PROCESS_list[id];
 }
 
+// a process with its own address space starts with its page directory and kernel stack
+void PROCESS_initMemory(process_t* proc, bool address_space)
+{
+    memset(&proc->memory, 0, sizeof(process_memstat_t));
+
+    proc->memory.pageTablePages = address_space ? 1 : 0;
+    proc->memory.kstackPages = proc->esp0 != NULL ? KSTACK_PAGES : 0;
+    proc->account = proc;
+}
+
+/*
+ * called by the virtual memory manager when user pages are mapped or unmapped in the loaded address space.
+ * the counters are only touched by the process owning them (or by its creator before it runs),
+ * and by the swap code with the scheduler locked when it pages them out
+*/
+void PROCESS_accountMemory(process_mem_t type, int32_t pages)
+{
+    process_t* proc = PROCESS_getCurrent();
+
+    if(proc == NULL || proc->account == NULL)
+        return;
+
+    process_t* owner = proc->account;
+
+    switch (type)
+    {
+    case PROCESS_MEM_RESIDENT:
+        owner->memory.residentPages += pages;
+        break;
+    case PROCESS_MEM_SHARED:
+        owner->memory.sharedPages += pages;
+        break;
+    case PROCESS_MEM_PAGE_TABLE:
+        owner->memory.pageTablePages += pages;
+        break;
+    case PROCESS_MEM_SWAPPED:
+        owner->memory.swappedPages += pages;
+        break;
+    }
+
+    if(owner->memory.residentPages + owner->memory.sharedPages > owner->memory.peakResidentPages)
+        owner->memory.peakResidentPages = owner->memory.residentPages + owner->memory.sharedPages;
+}
+
+// returns false if there is no such process
+bool PROCESS_getMemoryStats(uint32_t id, process_memstat_t* stats)
+{
+    process_memstat_t copy;
+    bool found = false;
+
+    lock_scheduler();   // the process can't go away while we copy
+
+    process_t* proc = id < MAX_PROCESS ? PROCESS_list[id] : NULL;
+    if(proc != NULL && proc->state != DEAD)
+    {
+        copy = proc->memory;
+        found = true;
+    }
+
+    unlock_scheduler();
+
+    // stats may be a user page that isn't mapped yet, don't fault with the scheduler locked
+    if(found)
+        *stats = copy;
+
+    return found;
+}
+
 void block_task()
 {
     // blocking a task just means removing it from the ready list
@@ -78,6 +160,7 @@ void block_task()
 
 void unblock_task(process_t* proc, bool priority)
 {
+    SCHEDULER_wakeUp(proc);
     add_READY_process(proc, priority);
 }
 
@@ -86,6 +169,8 @@ void spawnProcess()
 {
     void (*entryPoint)();
 
+    SCHEDULER_finishSwitch();   // the first thing after task_switch, like any task resuming in yield()
+
     entryPoint = PROCESS_getCurrent()->entryPoint;
     
     if(PROCESS_getCurrent()->usermode)
@@ -94,6 +179,147 @@ void spawnProcess()
         entryPoint();
 }
 
+vm_region_t* PROCESS_findRegion(process_t* proc, uint32_t address)
+{
+    for(vm_region_t* region = proc->regions; region != NULL; region = region->next)
+        if(address >= region->start && address < region->start + region->length * 0x1000)
+            return region;
+
+    return NULL;
+}
+
+// take a region out of the list of proc and free it
+void PROCESS_removeRegion(process_t* proc, vm_region_t* region)
+{
+    vm_region_t* before = NULL;
+
+    for(vm_region_t* current = proc->regions; current != region; current = current->next)
+    {
+        if(current == NULL)
+            return;
+
+        before = current;
+    }
+
+    if(NULL == before)  // its the first in the list
+        proc->regions = region->next;
+    else
+        before->next = region->next;
+
+    PROCESS_freeRegion(region);
+}
+
+/*
+ * fill the page of a file mapping containing address. The page is mapped writable
+ * while the file is read into it, then made read only unless the mapping is writable
+ * (the frame is private anyway). Past the end of the file it stays zeroed
+*/
+bool PROCESS_loadFilePage(process_t* proc, vm_region_t* region, uint32_t address)
+{
+    void* page = (void*)(address & ~(0x1000 - 1));
+    uint32_t offset = region->file_offset + ((uint32_t)page - region->start);
+
+    // map the page cache frame itself, a writable mapping gets its own copy on the first write
+    if(region->file->vnode_op->readpages != NULL && (offset % 0x1000) == 0)
+    {
+        void* frame = PCACHE_getPage(region->file, offset / 0x1000);
+
+        if(frame != NULL)
+        {
+            if(VIRTMEM_mapFrame(frame, page, !proc->usermode, region->file_writable))
+                return true;
+
+            PHYSMEM_freeBlocksFor(frame, 1, PHYSMEM_USER_PAGE_CACHE);
+            return false;
+        }
+
+        // past the end of the file (or out of memory), the page is read below
+    }
+
+    if(!VIRTMEM_mapPage(page, !proc->usermode))
+        return false;
+
+    if(region->file->vnode_op->read(region->file, page, 0x1000, offset, VFS_O_RDONLY) < 0)
+    {
+        VIRTMEM_unMapPage(page);
+        return false;
+    }
+
+    return region->file_writable || VIRTMEM_protectPage(page, false);
+}
+
+/*
+ * heap and stack pages are only mapped when they are first touched:
+ * a fault on a missing page inside one of those regions gets a fresh zeroed page,
+ * a missing page of a file mapping or of the code of an executable is read from the file.
+ * a write to a page shared by fork gets its own copy.
+ * any other fault of user code terminates the process, only a fault of the kernel panics
+*/
+void PROCESS_pageFaultHandler(Registers* regs)
+{
+    uint32_t address = ISR_getFaultAddress();
+    process_t* proc = PROCESS_getCurrent();
+
+    if((regs->error & PAGE_FAULT_PRESENT) && (regs->error & PAGE_FAULT_WRITE) && address < 0xC0000000)
+    {
+        if(VIRTMEM_handleCowFault((void*)address))
+            return;
+    }
+
+    if((regs->error & PAGE_FAULT_PRESENT) == 0 && address < 0xC0000000)
+    {
+        void* page = (void*)(address & ~(0x1000 - 1));
+        vm_region_t* region = PROCESS_findRegion(proc, address);
+        uint32_t slot;
+        bool swapped = VIRTMEM_getSwapSlot(page, &slot);
+        bool valid = false;
+
+        if(swapped)
+            valid = true;   // it was mapped before the reclaim task wrote it out
+        else if(region != NULL && region->type == REGION_STACK)
+            valid = true;
+        else if(region != NULL && region->type == REGION_HEAP)
+            valid = address < roundUp_div((uint32_t)proc->brk, 0x1000) * 0x1000;   // only what sbrk gave out
+        else if(region != NULL && region->file != NULL)
+            valid = region->file_writable || (regs->error & PAGE_FAULT_WRITE) == 0;
+
+        // out of memory: the reclaim task gets a few periods to free some
+        for(int attempt = 0; valid && attempt < SWAP_FAULT_ATTEMPTS; attempt++)
+        {
+            if(attempt > 0)
+                sleep(SWAP_PERIOD);
+
+            if(swapped)
+            {
+                if(SWAP_pageIn(page, slot))
+                    return;
+            }
+            else if(region->file != NULL)
+            {
+                if(PROCESS_loadFilePage(proc, region, address))
+                    return;
+            }
+            else if(VIRTMEM_mapPage(page, !proc->usermode))
+                return;
+        }
+
+        if(valid)
+            log_err("process", "out of memory while faulting in 0x%x for process %d", address, proc->id);
+    }
+
+    // a fault of user code only takes its own process down, like running out of memory for it
+    if((regs->error & PAGE_FAULT_USER) && proc->usermode)
+    {
+        log_err("process", "invalid %s access to 0x%x by process %d (eip 0x%x), terminated", (regs->error & PAGE_FAULT_WRITE) ? "write" : "read", address, proc->id, regs->eip);
+        PROCESS_terminate();    // doesn't return
+    }
+
+    if(!KSTACK_reportGuardFault(address))
+        log_crit("process", "invalid %s access to 0x%x by process %d (eip 0x%x)", (regs->error & PAGE_FAULT_WRITE) ? "write" : "read", address, proc->id, regs->eip);
+
+    ISR_panic(regs);
+}
+
 void cleaner_task()
 {
     while (true)
@@ -109,7 +335,11 @@ void cleaner_task()
 
             log_warn("cleaner", "cleaning 0x%x, id: %d", trash, trash->id);
 
-            vfree(trash->esp0); // deallocate the kernel stack for the process
+            // it may still be switching away on another cpu, on its kernel stack
+            while(trash->onCpu)
+                yield();
+
+            KSTACK_free(trash->esp0); // give the kernel stack back to the cache
             VIRTMEM_destroyAddressSpace(trash->virt_cr3);
 
             PROCESS_list[trash->id] = NULL;
@@ -118,11 +348,16 @@ void cleaner_task()
             vm_region_t* region = trash->regions;
             while (region != NULL)
             {
-                kfree(region);
-                region = region->next;
+                vm_region_t* next = region->next;
+
+                if(region->file != NULL)
+                    region->file->ref_count--;
+
+                PROCESS_freeRegion(region);
+                region = next;
             }
             
-            kfree(trash);
+            kmem_cache_free(PROCESS_cache, trash);
 
             continue;
         }
@@ -133,14 +368,49 @@ void cleaner_task()
     
 }
 
-void PROCESS_initialize(process_t* idle)
+/*
+ * keeps some memory free for the allocations that can't wait. below SWAP_LOW_WATERMARK free blocks,
+ * the empty slabs and the clean page cache pages go first (there is nothing to write), then user pages are written to
+ * the swap file until SWAP_HIGH_WATERMARK blocks are free. the clock hand goes around every process
+*/
+void reclaim_task()
 {
-    // create the first process which is the idle process
-    // the idle process represent the current stream of execution
-    // and it's idle because it will be the one executing when no
-    // other process is available to use the CPU
+    uint32_t id = 0;                // clock hand: the process being scanned
+    uint32_t address = 0x400000;    // and where in its address space
 
-    idle->esp0 = NULL;  // doesn't have esp0 because this process is never meant to be terminated (which involves freeing the stack)
+    while (true)
+    {
+        uint32_t freeBlocks = PHYSMEM_getFreeBlocks();
+
+        if(freeBlocks < SWAP_LOW_WATERMARK)
+        {
+            PHYSMEM_shrinkCaches(SWAP_HIGH_WATERMARK - freeBlocks);    // the empty slabs and the page cache
+
+            // two turns at most without finding anything: the first one may only clear the accessed bits
+            uint32_t scanned = 0;
+
+            while(PHYSMEM_getFreeBlocks() < SWAP_HIGH_WATERMARK && SWAP_canPageOut() && scanned <= 2 * (PROCESS_maxId + 1))
+            {
+                if(SWAP_pageOut(id, &address))
+                {
+                    scanned = 0;
+                    continue;
+                }
+
+                // end of this address space, on to the next process
+                id = id < PROCESS_maxId ? id + 1 : 0;
+                address = 0x400000;
+                scanned++;
+            }
+        }
+
+        sleep(SWAP_PERIOD);
+    }
+}
+
+// an idle process runs in the kernel address space and is never terminated
+static void PROCESS_initIdle(process_t* idle)
+{
     idle->esp = NULL;   // this will be filled automatically when a context switch occurs
 
     idle->cr3 = getPDBR();
@@ -148,11 +418,25 @@ void PROCESS_initialize(process_t* idle)
     idle->usermode = false;
     idle->entryPoint = NULL;
     idle->id = id_dispatcher(idle);
+    idle->parent = idle->id;
 
     memset(idle->resources, 0, sizeof(file_descriptor_t) * MAX_OPEN_FILES);
     idle->regions = NULL;
+    PROCESS_initMemory(idle, false);
+    SCHEDULER_initTask(idle, 0);
 
     idle->next = NULL;
+}
+
+void PROCESS_initialize(process_t* idle)
+{
+    // create the first process which is the idle process
+    // the idle process represent the current stream of execution
+    // and it's idle because it will be the one executing when no
+    // other process is available to use the CPU
+
+    idle->esp0 = NULL;  // doesn't have esp0 because this process is never meant to be terminated (which involves freeing the stack)
+    PROCESS_initIdle(idle);
 
     // the cleaner process is also not meant to be terminated
     // but we can't just create it the same way we created the idle process
@@ -160,8 +444,8 @@ void PROCESS_initialize(process_t* idle)
     // context switch however this process will share the same address space with
     // the idle process just to save up some memory
 
-    PROCESS_cleaner.esp0 = vmalloc(1);
-    PROCESS_cleaner.esp = PROCESS_cleaner.esp0 + 0x1000 - 4;
+    PROCESS_cleaner.esp0 = KSTACK_alloc();
+    PROCESS_cleaner.esp = PROCESS_cleaner.esp0 + KSTACK_SIZE - 4;
 
     *(uint32_t*)PROCESS_cleaner.esp = (uint32_t)spawnProcess; // return address after task_switch
 
@@ -176,17 +460,88 @@ void PROCESS_initialize(process_t* idle)
     PROCESS_cleaner.id = id_dispatcher(&PROCESS_cleaner);
     memset(PROCESS_cleaner.resources, 0, sizeof(file_descriptor_t) * MAX_OPEN_FILES);
     PROCESS_cleaner.regions = NULL;
+    PROCESS_initMemory(&PROCESS_cleaner, false);
+    SCHEDULER_initTask(&PROCESS_cleaner, 0);
     PROCESS_cleaner.state = BLOCKED;    // initially this process is blocked and will be unblocked when there is a task termination
 
+    ISR_registerNewHandler(14, PROCESS_pageFaultHandler);
+
+    PROCESS_cache = kmem_cache_create("process_t", sizeof(process_t), NULL);
+    PROCESS_regionCache = kmem_cache_create("vm_region_t", sizeof(vm_region_t), NULL);
+
     shared_memory_init();   // intialize the shared_memory system
+    message_init();
+}
+
+// the idle process of an application processor, stack is the kernel stack it starts on
+process_t* PROCESS_createIdle(void* stack)
+{
+    process_t* idle = kmem_cache_alloc(PROCESS_cache);
+    if(idle == NULL)
+        return NULL;
+
+    idle->esp0 = stack;
+    PROCESS_initIdle(idle);
+
+    return idle;
+}
+
+// the reclaim task is a kernel process like any other, it just never ends
+void PROCESS_startReclaimTask()
+{
+    PROCESS_createFrom(reclaim_task);
+}
+
+vm_region_t* PROCESS_allocRegion()
+{
+    vm_region_t* region = kmem_cache_alloc(PROCESS_regionCache);
+
+    if(region != NULL)
+        region->file = NULL;
+
+    return region;
+}
+
+void PROCESS_freeRegion(vm_region_t* region)
+{
+    kmem_cache_free(PROCESS_regionCache, region);
+}
+
+/*
+ * undo a process that failed to load before it was ever scheduled,
+ * the caller is back on its own address space
+*/
+static void PROCESS_discard(process_t* proc)
+{
+    while(proc->regions != NULL)
+    {
+        vm_region_t* next = proc->regions->next;
+
+        if(proc->regions->file != NULL)
+            proc->regions->file->ref_count--;
+
+        PROCESS_freeRegion(proc->regions);
+        proc->regions = next;
+    }
+
+    lock_scheduler();
+
+    PROCESS_list[proc->id] = NULL;
+    PROCESS_count--;
+
+    unlock_scheduler();
+
+    KSTACK_free(proc->esp0);
+    VIRTMEM_destroyAddressSpace(proc->virt_cr3);
+    kmem_cache_free(PROCESS_cache, proc);
 }
 
 void PROCESS_createFrom(void* entryPoint)
 {
-    process_t* proc = kmalloc(sizeof(process_t));
+    process_t* proc = kmem_cache_alloc(PROCESS_cache);
 
-    proc->esp0 = vmalloc(1);
-    proc->esp = proc->esp0 + 0x1000 - 4;
+    proc->esp0 = KSTACK_alloc();
+    proc->esp = proc->esp0 + KSTACK_SIZE - 4;
 
     *(uint32_t*)proc->esp = (uint32_t)spawnProcess; // return address after task_switch
 
@@ -202,20 +557,26 @@ void PROCESS_createFrom(void* entryPoint)
     proc->entryPoint = entryPoint;
 
     proc->id = id_dispatcher(proc); // WARNING: should check if there is more room for this process
+    proc->parent = PROCESS_getCurrent()->id;
     memset(proc->resources, 0, sizeof(file_descriptor_t) * MAX_OPEN_FILES);
     proc->regions = NULL;
+    PROCESS_initMemory(proc, true);
+    SCHEDULER_initTask(proc, 0);
 
     proc->next = NULL;
 
     add_READY_process(proc, false);
 }
 
-void PROCESS_createFromByteArray(void* array, int length, bool is_usermode)
+/*
+ * start a new process running the flat binary in array. returns the id of the process or -1
+*/
+int PROCESS_createFromByteArray(void* array, int length, bool is_usermode)
 {
-    process_t* proc = kmalloc(sizeof(process_t));
+    process_t* proc = kmem_cache_alloc(PROCESS_cache);
 
-    proc->esp0 = vmalloc(1);
-    proc->esp = proc->esp0 + 0x1000 - 4;
+    proc->esp0 = KSTACK_alloc();
+    proc->esp = proc->esp0 + KSTACK_SIZE - 4;
 
     *(uint32_t*)proc->esp = (uint32_t)spawnProcess; // return address after task_switch
 
@@ -230,8 +591,11 @@ void PROCESS_createFromByteArray(void* array, int length, bool is_usermode)
     proc->entryPoint = is_usermode ? (void*)0x400000 : (void*)0xe0000000;
 
     proc->id = id_dispatcher(proc); // WARNING: should check if there is more room for this process
+    proc->parent = PROCESS_getCurrent()->id;
     memset(proc->resources, 0, sizeof(file_descriptor_t) * MAX_OPEN_FILES);
     proc->regions = NULL;
+    PROCESS_initMemory(proc, true);
+    SCHEDULER_initTask(proc, 0);
 
     proc->next = NULL;
 
@@ -241,25 +605,24 @@ void PROCESS_createFromByteArray(void* array, int length, bool is_usermode)
     void* currentpdbr = PROCESS_getCurrent()->cr3;
     PROCESS_getCurrent()->cr3 = proc->cr3;   // we're updating the current process in case a context switch occurs while reading the file
     switchPDBR(proc->cr3);
+    PROCESS_getCurrent()->account = proc->account;  // what we map there belongs to the new process
 
     unlock_scheduler();
 
     if(is_usermode)
     {
-        VIRTMEM_mapPage((void*)(0xc0000000 - 4), false); // we need to map the stack for this process (4kb before 0xc0000000)
-
-        vm_region_t* code = kmalloc(sizeof(vm_region_t));
+        vm_region_t* code = PROCESS_allocRegion();
         code->start = 0x400000;
         code->length = roundUp_div(length, 0x1000); // page size
         code->type = REGION_CODE;
 
-        vm_region_t* heap = kmalloc(sizeof(vm_region_t));
+        vm_region_t* heap = PROCESS_allocRegion();
         heap->start = code->start + (code->length * 0x1000);
         heap->length = roundUp_div(0x20000000, 0x1000);   // 512 Mo for the heap
         heap->type = REGION_HEAP;
         proc->brk = (void*)heap->start;
 
-        vm_region_t* stack = kmalloc(sizeof(vm_region_t));
+        vm_region_t* stack = PROCESS_allocRegion();
         stack->start = 0xBFF00000;
         stack->length = roundUp_div(0x100000, 0x1000);   // 1 Mo for the stack
         stack->type = REGION_STACK;
@@ -284,22 +647,38 @@ void PROCESS_createFromByteArray(void* array, int length, bool is_usermode)
 
     void* buffer = is_usermode ? (void*)0x400000 : (void*)0xe0000000;
 
-    for(int i = 0; i < roundUp_div(length, 0x1000); i++)
-        VIRTMEM_mapPage(buffer + (i * 0x1000), false);
+    bool loaded = VIRTMEM_mapRange(buffer, roundUp_div(length, 0x1000), false);
 
-    memcpy(buffer, array, length);
+    if(loaded)
+        memcpy(buffer, array, length);
 
     // restoring pdbr
     lock_scheduler();
 
     PROCESS_getCurrent()->cr3 = currentpdbr;
     switchPDBR(PROCESS_getCurrent()->cr3);
+    PROCESS_getCurrent()->account = PROCESS_getCurrent();
 
     unlock_scheduler();
 
+    if(!loaded)
+    {
+        log_warn("process", "not enough memory to load a program of %d bytes", length);
+        PROCESS_discard(proc);
+        return -1;
+    }
+
     add_READY_process(proc, false);
+    return proc->id;
 }
 
+/*
+ * start a new process running the flat binary at path. If its file system has a readpages op,
+ * nothing is read here: the code region maps the file and its pages are faulted in from the
+ * page cache, so every instance of the same executable shares the same read only frames
+ * (a write to one of them, in .data or .bss, gives the process its own copy).
+ * Otherwise the binary is copied into private pages. returns the id of the process or -1
+*/
 int PROCESS_execve(const char *path, char* argv)
 {
     int file = VFS_open(path, VFS_O_RDONLY);
@@ -308,10 +687,14 @@ int PROCESS_execve(const char *path, char* argv)
     vfs_stat_t stat;
     VFS_stat(path, &stat);
 
-    process_t* proc = kmalloc(sizeof(process_t));
+    vnode_t* node = PROCESS_getCurrent()->resources[file].vnode;
+    bool shared = node->vnode_op->readpages != NULL;
+    bool loaded = true;
 
-    proc->esp0 = vmalloc(1);
-    proc->esp = proc->esp0 + 0x1000 - 4;
+    process_t* proc = kmem_cache_alloc(PROCESS_cache);
+
+    proc->esp0 = KSTACK_alloc();
+    proc->esp = proc->esp0 + KSTACK_SIZE - 4;
 
     *(uint32_t*)proc->esp = (uint32_t)spawnProcess; // return address after task_switch
 
@@ -326,8 +709,11 @@ int PROCESS_execve(const char *path, char* argv)
     proc->entryPoint = (void*)0x400000;
 
     proc->id = id_dispatcher(proc); // WARNING: should check if there is more room for this process
+    proc->parent = PROCESS_getCurrent()->id;
     memset(proc->resources, 0, sizeof(file_descriptor_t) * MAX_OPEN_FILES);
     proc->regions = NULL;
+    PROCESS_initMemory(proc, true);
+    SCHEDULER_initTask(proc, 0);
 
     proc->next = NULL;
 
@@ -343,25 +729,24 @@ int PROCESS_execve(const char *path, char* argv)
     void* currentpdbr = PROCESS_getCurrent()->cr3;
     PROCESS_getCurrent()->cr3 = proc->cr3;   // we're updating the current process in case a context switch occurs while reading the file
     switchPDBR(proc->cr3);
+    PROCESS_getCurrent()->account = proc->account;  // what we map there belongs to the new process
 
     unlock_scheduler();
 
-    
-    for (int i = 0; i < 32; i++) // alloc 128 KB for the stack!
-        VIRTMEM_mapPage((void*)(0xc0000000 - (i+1)*0x1000), false);
+    // the stack and the heap are mapped on demand by PROCESS_pageFaultHandler
 
-    vm_region_t* code = kmalloc(sizeof(vm_region_t));
+    vm_region_t* code = PROCESS_allocRegion();
     code->start = 0x400000;
     code->length = roundUp_div(stat.size, 0x1000); // page size
     code->type = REGION_CODE;
 
-    vm_region_t* heap = kmalloc(sizeof(vm_region_t));
+    vm_region_t* heap = PROCESS_allocRegion();
     heap->start = code->start + (code->length * 0x1000);
     heap->length = roundUp_div(0x20000000, 0x1000);   // 512 Mo for the heap
     heap->type = REGION_HEAP;
     proc->brk = (void*)heap->start;
 
-    vm_region_t* stack = kmalloc(sizeof(vm_region_t));
+    vm_region_t* stack = PROCESS_allocRegion();
     stack->start = 0xBFF00000;
     stack->length = roundUp_div(0x100000, 0x1000);   // 1 Mo for the stack
     stack->type = REGION_STACK;
@@ -373,23 +758,154 @@ int PROCESS_execve(const char *path, char* argv)
 
     proc->regions = code;
 
-
-    void* buffer = proc->entryPoint;
-    for(int i = 0; i < roundUp_div(stat.size, 0x1000); i++)
-        VIRTMEM_mapPage(buffer + (i * 0x1000), false);
-
-    VFS_read(file, buffer, stat.size);
+    if(shared)
+    {
+        code->file = node;
+        code->file_offset = 0;
+        code->file_writable = true;
+        node->ref_count++;  // released with the region
+    }
+    else if(VIRTMEM_mapRange(proc->entryPoint, roundUp_div(stat.size, 0x1000), false))
+        VFS_read(file, proc->entryPoint, stat.size);
+    else
+        loaded = false;
 
     // restoring pdbr
     lock_scheduler();
 
     PROCESS_getCurrent()->cr3 = currentpdbr;
     switchPDBR(PROCESS_getCurrent()->cr3);
+    PROCESS_getCurrent()->account = PROCESS_getCurrent();
 
     unlock_scheduler();
 
+    VFS_close(file);
+
+    if(!loaded)
+    {
+        log_warn("process", "not enough memory to load %s", path);
+        PROCESS_discard(proc);
+        return -1;
+    }
+
+    add_READY_process(proc, false);
+    return proc->id;
+}
+
+/*
+ * duplicate the current user process. The child gets a copy on write view of the address space,
+ * the same regions and open files, and starts by returning from the same system call with 0.
+ * returns the id of the child or -1
+*/
+int PROCESS_fork(Registers* regs)
+{
+    process_t* parent = PROCESS_getCurrent();
+
+    if(!parent->usermode)
+        return -1;
+
+    process_t* proc = kmem_cache_alloc(PROCESS_cache);
+    if(proc == NULL)
+        return -1;
+
+    proc->esp0 = KSTACK_alloc();
+    proc->virt_cr3 = VIRTMEM_cloneAddressSpace();
+
+    if(proc->esp0 == NULL || proc->virt_cr3 == NULL)
+    {
+        KSTACK_free(proc->esp0);
+        if(proc->virt_cr3 != NULL)
+            VIRTMEM_destroyAddressSpace(proc->virt_cr3);
+
+        kmem_cache_free(PROCESS_cache, proc);
+        return -1;
+    }
+
+    proc->cr3 = VIRTMEM_getPhysAddr(proc->virt_cr3);    // store the physical address of the new pdbr
+
+    // the interrupt frame of the parent goes on top of the new kernel stack, fork_return pops it
+    Registers* frame = (Registers*)(proc->esp0 + KSTACK_SIZE - sizeof(Registers));
+    *frame = *regs;
+    frame->edx = 0; // fork returns 0 in the child
+
+    proc->esp = (void*)frame - 4;
+    *(uint32_t*)proc->esp = (uint32_t)fork_return; // return address after task_switch
+
+    proc->esp -= (4 * 5);   // pushed register
+    *(uint32_t*)proc->esp = 0x202;       // default eflags for the new process
+
+    proc->usermode = true;
+    proc->entryPoint = parent->entryPoint;
+    proc->brk = parent->brk;
+
+    // the child maps the same pages (copy on write) and has a copy of every page table
+    proc->memory = parent->memory;
+    proc->memory.peakResidentPages = proc->memory.residentPages + proc->memory.sharedPages;
+    proc->account = proc;
+
+    SCHEDULER_initTask(proc, parent->sched.basePriority);   // same base priority, fresh counters
+
+    // same regions, in the same order (sbrk expects the heap right after the code).
+    // they are copied before anything is shared with the child, so a failure has little to undo
+    vm_region_t* tail = NULL;
+    proc->regions = NULL;
+    for(vm_region_t* region = parent->regions; region != NULL; region = region->next)
+    {
+        vm_region_t* copy = PROCESS_allocRegion();
+        if(copy == NULL)
+            goto Failed;
+
+        *copy = *region;
+        copy->next = NULL;
+
+        if(tail == NULL)
+            proc->regions = copy;
+        else
+            tail->next = copy;
+
+        tail = copy;
+    }
+
+    int id = id_dispatcher(proc);
+    if(id < 0)
+        goto Failed;
+
+    proc->id = id;
+    proc->parent = parent->id;
+    proc->next = NULL;
+
+    // nothing can fail anymore, the child takes its share of what it inherits
+    memcpy(proc->resources, parent->resources, sizeof(file_descriptor_t) * MAX_OPEN_FILES);
+    for(int i = 0; i < MAX_OPEN_FILES; i++)
+        if(proc->resources[i].vnode != NULL)
+            proc->resources[i].vnode->ref_count++;
+
+    for(vm_region_t* region = proc->regions; region != NULL; region = region->next)
+    {
+        if(region->type == REGION_SHM)
+            shared_memory_fork(region->shm_id);
+
+        if(region->file != NULL)
+            region->file->ref_count++;
+    }
+
     add_READY_process(proc, false);
     return proc->id;
+
+Failed:
+    log_warn("fork", "process %d can't fork, out of memory or process ids", parent->id);
+
+    while(proc->regions != NULL)
+    {
+        vm_region_t* next = proc->regions->next;
+        PROCESS_freeRegion(proc->regions);
+        proc->regions = next;
+    }
+
+    KSTACK_free(proc->esp0);
+    VIRTMEM_destroyAddressSpace(proc->virt_cr3);
+    kmem_cache_free(PROCESS_cache, proc);
+    return -1;
 }
 
 void* PROCESS_sbrk(intptr_t size)
@@ -402,37 +918,68 @@ void* PROCESS_sbrk(intptr_t size)
         return PROCESS_getCurrent()->brk;   // failed
     }
 
-    // log_debug("sbrk", "requested 0x%x, current sbrk: 0x%x, will end at: 0x%x", size, PROCESS_getCurrent()->brk, PROCESS_getCurrent()->brk + size);
-    // // uint32_t current_page = (uint32_t)PROCESS_getCurrent()->brk & 0xFFFFFFF8;
-    // // uint32_t end_page = ((uint32_t)PROCESS_getCurrent()->brk + size) & 0xFFFFFFF8;
-    // uint32_t current_page = (uint32_t)PROCESS_getCurrent()->brk & ~(0x1000 - 1);
-    // uint32_t end_page = ((uint32_t)PROCESS_getCurrent()->brk + size) & ~(0x1000 - 1);
-    // log_debug("sbrk", "current page 0x%x, endpage 0x%x", current_page, end_page);
-    // for(; current_page <= end_page; current_page+=0x1000)
-    //     VIRTMEM_mapPage((void*)current_page, !PROCESS_getCurrent()->usermode);
-
-    // PROCESS_getCurrent()->brk += size;
-    // return PROCESS_getCurrent()->brk;
-
     uint32_t old_brk = PROCESS_getCurrent()->brk;
     uint32_t new_brk = old_brk + size;
 
-    // 1. Calculer la page de départ (arrondi à la page inférieure)
-    uint32_t start_page = old_brk & ~(0x1000 - 1);
-    // 2. Calculer la page de fin (on veut couvrir jusqu'au dernier octet de new_brk)
-    uint32_t end_page = (new_brk - 1) & ~(0x1000 - 1);
+    // growing the heap doesn't map anything, pages are faulted in when they are touched.
+    // when it shrinks, the pages that are now completely above the break are given back
+    if (new_brk < old_brk) {
+        uint32_t start_page = roundUp_div(new_brk, 0x1000) * 0x1000;
 
-    // 3. On ne mappe que si on a changé de page ou si on progresse
-    if (new_brk > old_brk) {
-        for (uint32_t curr = start_page; curr <= end_page; curr += 0x1000) {
-            VIRTMEM_mapPage((void*)curr, !PROCESS_getCurrent()->usermode);
-        }
+        if (start_page < old_brk)
+            VIRTMEM_unmapRange((void*)start_page, roundUp_div(old_brk - start_page, 0x1000));
     }
 
     PROCESS_getCurrent()->brk = (void*)new_brk;
     return (void*)old_brk; // sbrk retourne l'ANCIENNE valeur
 }
 
+/*
+ * map length bytes of an open file, from offset (page aligned) on. The mapping is private: writes,
+ * if allowed, are never written back. Nothing is read here, the page fault handler reads each page
+ * when it's first touched. returns NULL on failure
+*/
+void* PROCESS_mmap(uint32_t length, int fd, uint32_t offset, bool writable)
+{
+    process_t* proc = PROCESS_getCurrent();
+
+    if(length == 0 || (offset & (0x1000 - 1)) || fd < 0 || fd >= MAX_OPEN_FILES)
+        return NULL;
+
+    file_descriptor_t file = proc->resources[fd];  // a copy, process_t is packed
+    if(file.vnode == NULL || !(file.mode & (VFS_O_RDONLY | VFS_O_RDWR)))
+        return NULL;
+
+    void* start = PROCESS_createNewRegion(REGION_FILE, roundUp_div(length, 0x1000), 0);
+    if(start == NULL)
+        return NULL;
+
+    vm_region_t* region = PROCESS_findRegion(proc, (uint32_t)start);
+    region->file = file.vnode;
+    region->file_offset = offset;
+    region->file_writable = writable;
+
+    file.vnode->ref_count++;   // the mapping stays valid after the file is closed
+    return start;
+}
+
+// only a whole mapping made by PROCESS_mmap can be unmapped. returns 0 or -1
+int PROCESS_munmap(void* addr, uint32_t length)
+{
+    process_t* proc = PROCESS_getCurrent();
+    vm_region_t* region = PROCESS_findRegion(proc, (uint32_t)addr);
+
+    if(region == NULL || region->start != (uint32_t)addr || region->type != REGION_FILE || region->length != roundUp_div(length, 0x1000))
+        return -1;
+
+    VIRTMEM_unmapRange(addr, region->length);
+
+    region->file->ref_count--;
+    PROCESS_removeRegion(proc, region);
+
+    return 0;
+}
+
 void* PROCESS_createNewRegion(region_type_t type, uint32_t length, uint64_t shm_id)
 {
     vm_region_t* regions = PROCESS_getCurrent()->regions;
@@ -442,7 +989,7 @@ void* PROCESS_createNewRegion(region_type_t type, uint32_t length, uint64_t shm_
         if(length > limit)
             return NULL;
 
-        vm_region_t* new = kmalloc(sizeof(vm_region_t));
+        vm_region_t* new = PROCESS_allocRegion();
         new->start = 0x400000;
         new->length = length;
         new->type = type;
@@ -465,7 +1012,7 @@ void* PROCESS_createNewRegion(region_type_t type, uint32_t length, uint64_t shm_
                 if(length > limit)
                     return NULL;
 
-                vm_region_t* new = kmalloc(sizeof(vm_region_t));
+                vm_region_t* new = PROCESS_allocRegion();
                 new->start = regions->start + regions->length * 0x1000;
                 new->length = length;
                 new->type = type;
@@ -486,7 +1033,7 @@ void* PROCESS_createNewRegion(region_type_t type, uint32_t length, uint64_t shm_
                 continue;
             }
 
-            vm_region_t* new = kmalloc(sizeof(vm_region_t));
+            vm_region_t* new = PROCESS_allocRegion();
             new->start = regions->start + regions->length * 0x1000;
             new->length = length;
             new->type = type;
@@ -508,11 +1055,12 @@ void PROCESS_terminate()
     destroy_endpoint();
     shared_memory_detachAll();
 
-    lock_scheduler();
-
+    // closing may free memory, the allocators' spinlocks can't be taken under the scheduler lock
     for(int i = 0; i < MAX_OPEN_FILES; i++)
         VFS_close(i);
 
+    lock_scheduler();
+
     PROCESS_getCurrent()->state = DEAD;
     PROCESS_getCurrent()->next = terminated_tasks;
     terminated_tasks = PROCESS_getCurrent();
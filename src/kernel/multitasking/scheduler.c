@@ -19,97 +19,359 @@
 
 #include <stddef.h>
 #include <debug.h>
+#include <memory.h>
 #include <hal/gdt.h>
+#include <mem_manager/kstack.h>
+#include <mem_manager/physmem_manager.h>
 #include <hal/io.h>
 #include <multitasking/process.h>
+#include <multitasking/scheduler.h>
 #include <multitasking/lock.h>
 #include <multitasking/time.h>
+#include <multitasking/smp.h>
 
-process_t PROCESS_idle;
-process_t* PROCESS_current;
+process_t PROCESS_idle;     // the boot processor's, the flow of execution that started the kernel
 
-// ready list
-process_t* first_ready;
-process_t* last_ready;
+/*
+ * multilevel feedback queue: one ready list per level, the first non empty level runs.
+ * A task that uses its whole time slice goes down one level (where slices are longer),
+ * a task woken up after blocking goes up one, and every SCHED_BOOST_PERIOD the ready
+ * tasks go back to their base level so nothing starves.
+ * Each cpu has its own queue (see cpu_t), a task made ready goes to an idle cpu if there is one
+ * and a cpu with nothing to run takes a task from the busiest queue. Everything is protected by
+ * the scheduler lock
+*/
 
 bool SCHEDULER_enabled;
 
 process_t* PROCESS_getCurrent()
 {
-    return PROCESS_current;
+    uint32_t eflags = get_eflags();
+    disableInterrupts();    // the task can't move to another cpu while we read
+
+    process_t* current = SMP_getCpu()->current;
+
+    if(eflags & (1 << 9))
+        enableInterrupts();
+
+    return current;
 }
 
-void add_READY_process(process_t* proc, bool high_priority)
+static inline uint32_t SCHEDULER_slice(uint32_t level)
 {
-    lock_scheduler();
+    return SCHED_BASE_SLICE << level;
+}
+
+// the caller locks the scheduler
+void SCHEDULER_enqueue(cpu_t* cpu, process_t* proc, bool front)
+{
+    uint32_t level = proc->sched.priority;
 
-    proc->state = READY;
     proc->next = NULL;
 
-    if(first_ready == NULL)
+    if(cpu->firstReady[level] == NULL)
     {
-        first_ready = proc;
-        last_ready = proc;
+        cpu->firstReady[level] = proc;
+        cpu->lastReady[level] = proc;
+    }
+    else if(front)
+    {
+        proc->next = cpu->firstReady[level];
+        cpu->firstReady[level] = proc;
+    }
+    else
+    {
+        cpu->lastReady[level]->next = proc;
+        cpu->lastReady[level] = proc;
+    }
 
-        unlock_scheduler();
+    cpu->readyCount++;
+}
+
+// the caller locks the scheduler
+void SCHEDULER_dequeue(cpu_t* cpu, process_t* proc)
+{
+    uint32_t level = proc->sched.priority;
+    process_t* before = NULL;
+
+    for(process_t* current = cpu->firstReady[level]; current != NULL; before = current, current = current->next)
+    {
+        if(current != proc)
+            continue;
+
+        if(before == NULL)
+            cpu->firstReady[level] = proc->next;
+        else
+            before->next = proc->next;
+
+        if(cpu->lastReady[level] == proc)
+            cpu->lastReady[level] = before;
+
+        proc->next = NULL;
+        cpu->readyCount--;
         return;
     }
+}
 
-    if(high_priority)
+// is a task of a level above `level` ready on this cpu
+bool SCHEDULER_hasReady(cpu_t* cpu, uint32_t level)
+{
+    for(uint32_t i = 0; i < level && i < SCHED_LEVELS; i++)
+        if(cpu->firstReady[i] != NULL)
+            return true;
+
+    return false;
+}
+
+// every ready task of the cpu goes back to its base level, the caller locks the scheduler
+void SCHEDULER_boost(cpu_t* cpu)
+{
+    for(uint32_t level = 1; level < SCHED_LEVELS; level++)
     {
-        proc->next = first_ready;
-        first_ready = proc;
+        process_t* proc = cpu->firstReady[level];
 
-        unlock_scheduler();
-        return;
+        cpu->firstReady[level] = NULL;
+        cpu->lastReady[level] = NULL;
+
+        while(proc != NULL)
+        {
+            process_t* next = proc->next;
+
+            cpu->readyCount--;
+            proc->sched.priority = proc->sched.basePriority;
+            proc->sliceLeft = SCHEDULER_slice(proc->sched.priority);
+            SCHEDULER_enqueue(cpu, proc, false);
+
+            proc = next;
+        }
     }
 
-    last_ready->next = proc;
-    last_ready = proc;
+    if(cpu->current != cpu->idle)
+        cpu->current->sched.priority = cpu->current->sched.basePriority;
+
+    cpu->lastBoost = get_tikCount();
+}
+
+static inline bool SCHEDULER_isIdle(cpu_t* cpu)
+{
+    return cpu->online && cpu->current == cpu->idle && cpu->readyCount == 0;
+}
+
+// the cpu it ran on last if it's idle (its cache may still be warm), else any idle cpu, else the last one
+static cpu_t* SCHEDULER_place(process_t* proc)
+{
+    cpu_t* last = SMP_getCpuById(proc->cpu);
+
+    if(SCHEDULER_isIdle(last))
+        return last;
+
+    for(uint32_t i = 0; i < SMP_getCpuCount(); i++)
+        if(SCHEDULER_isIdle(SMP_getCpuById(i)))
+            return SMP_getCpuById(i);
+
+    return last->online ? last : SMP_getCpu();
+}
+
+void add_READY_process(process_t* proc, bool high_priority)
+{
+    lock_scheduler();   // we stay on this cpu until it's unlocked
+
+    proc->state = READY;
+    proc->readySince = get_tikCount();
+
+    cpu_t* cpu = SCHEDULER_place(proc);
+    proc->cpu = cpu->id;
+
+    SCHEDULER_enqueue(cpu, proc, high_priority);
+
+    // it must preempt the running task: the clock was programmed for the end of its slice
+    process_t* running = cpu->current;
+    bool preempt = running != proc && (running == cpu->idle || proc->sched.priority < running->sched.priority);
+
+    if(cpu == SMP_getCpu())
+    {
+        if(preempt && running != cpu->idle)
+            TIME_requestEvent();
+    }
+    else if(preempt)
+        SMP_sendReschedule(cpu);
 
     unlock_scheduler();
 }
 
-process_t* schedule_next_process()
+// the time since the last charge comes out of the slice of the running task
+void SCHEDULER_charge(cpu_t* cpu)
+{
+    uint64_t now = get_tikCount();
+    uint32_t used = now - cpu->lastCharge;
+
+    cpu->lastCharge = now;
+
+    if(cpu->current == cpu->idle)
+    {
+        cpu->stats.idleTime += used;
+        return;
+    }
+
+    cpu->current->sliceLeft = used < cpu->current->sliceLeft ? cpu->current->sliceLeft - used : 0;
+}
+
+/*
+ * removes the first task of the highest level from the queue of cpu. A task still switching
+ * away on another cpu (see SCHEDULER_finishSwitch()) is skipped, unless it's the running one
+*/
+static process_t* SCHEDULER_take(cpu_t* cpu, cpu_t* self)
+{
+    for(uint32_t level = 0; level < SCHED_LEVELS; level++)
+    {
+        for(process_t* proc = cpu->firstReady[level]; proc != NULL; proc = proc->next)
+        {
+            if(proc->onCpu && proc != self->current)
+                continue;
+
+            SCHEDULER_dequeue(cpu, proc);
+            return proc;
+        }
+    }
+
+    return NULL;
+}
+
+process_t* schedule_next_process(cpu_t* cpu)
 {
     // the caller is responsible for making sure the scheduler is locked before using this fucntion
 
-    if(first_ready == NULL)
+    process_t* ret = SCHEDULER_take(cpu, cpu);
+
+    if(ret == NULL)
     {
-        if(PROCESS_current->state != RUNNING)
-            return &PROCESS_idle;
-        else
-            return PROCESS_current;
+        if(cpu->current->state == RUNNING && cpu->current != cpu->idle)
+            return cpu->current;
+
+        // nothing left here: help the cpu with the most waiting tasks
+        cpu_t* busiest = NULL;
+        for(uint32_t i = 0; i < SMP_getCpuCount(); i++)
+        {
+            cpu_t* other = SMP_getCpuById(i);
+            if(other != cpu && other->online && other->readyCount > 0 && (busiest == NULL || other->readyCount > busiest->readyCount))
+                busiest = other;
+        }
+
+        if(busiest != NULL)
+            ret = SCHEDULER_take(busiest, cpu);
+
+        if(ret == NULL)
+            return cpu->current->state == RUNNING ? cpu->current : cpu->idle;
+
+        ret->cpu = cpu->id;
+        cpu->stats.steals++;
     }
 
-    process_t* ret = first_ready;
+    // how long it waited for the cpu
+    uint32_t waited = get_tikCount() - ret->readySince;
 
-    first_ready = first_ready->next;
+    ret->sched.runs++;
+    ret->sched.totalWait += waited;
+    if(waited > ret->sched.maxWait)
+        ret->sched.maxWait = waited;
 
     return ret;
 }
 
+/*
+ * the scheduler lock is held across task_switch(): the task we switched to releases it here,
+ * once the previous task's stack isn't used anymore and another cpu may run it
+*/
+void SCHEDULER_finishSwitch()
+{
+    cpu_t* cpu = SMP_getCpu();  // the lock keeps us on this cpu
+    process_t* prev = cpu->previous;
+
+    cpu->lockDepth = cpu->current->lockDepth;
+    cpu->previous = NULL;
+
+    if(prev != NULL)
+    {
+        // read before it's released, the cleaner may free a dead task right after
+        bool elsewhere = prev->state == READY && prev->cpu != cpu->id;
+        uint32_t target = prev->cpu;
+
+        __sync_synchronize();
+        prev->onCpu = false;
+
+        // its new cpu skipped it until now
+        if(elsewhere)
+            SMP_sendReschedule(SMP_getCpuById(target));
+    }
+
+    unlock_scheduler();
+}
+
 void yield()
 {
     // disable interrupt here
     uint32_t eflags = get_eflags();
     disableInterrupts();
 
-    process_t* prev = PROCESS_current;
-    process_t* next = schedule_next_process();
+    lock_scheduler();
+
+    cpu_t* cpu = SMP_getCpu();
+    process_t* prev = cpu->current;
+
+    // whoever waits for the spinlock would spin until this task runs again
+    if(cpu->spinDepth > 0)
+    {
+        log_crit("scheduler", "process %d sleeps or yields with %d spinlock(s) held", prev->id, cpu->spinDepth);
+        panic();
+    }
+
+    TIME_update();
+    SCHEDULER_charge(cpu);
+
+    // it used its whole time slice: one level down, with a longer slice
+    if(prev != cpu->idle && prev->state == RUNNING && prev->sliceLeft == 0)
+    {
+        if(prev->sched.priority < SCHED_LEVELS - 1)
+            prev->sched.priority++;
+
+        prev->sliceLeft = SCHEDULER_slice(prev->sched.priority);
+    }
+
+    process_t* next = schedule_next_process(cpu);
 
     if(next != prev)
     {
-        if(prev->state == RUNNING && prev != &PROCESS_idle)
-            add_READY_process(prev, false);
+        // back in the queue of this cpu, its context is here until the switch is over
+        if(prev->state == RUNNING && prev != cpu->idle)
+        {
+            prev->state = READY;
+            prev->readySince = get_tikCount();
+            SCHEDULER_enqueue(cpu, prev, false);
+        }
 
         if(next->usermode)
-            TSS_setKernelStack((uint32_t)next->esp0 + 0x1000);
+            TSS_setKernelStack(cpu->id, (uint32_t)next->esp0 + KSTACK_SIZE);
 
-        PROCESS_current = next;
-        PROCESS_current->state = RUNNING;
+        next->state = RUNNING;
+        next->onCpu = true;
+        next->cpu = cpu->id;
 
+        cpu->current = next;
+        cpu->previous = prev;
+        cpu->stats.switches++;
+
+        prev->lockDepth = cpu->lockDepth;
+
+        TIME_reprogram();   // for the end of its slice
         task_switch(prev, next);
+
+        // prev is running again, maybe on another cpu
+        SCHEDULER_finishSwitch();
+    }
+    else
+    {
+        TIME_reprogram();
+        unlock_scheduler();
     }
 
     // enable them here
@@ -117,6 +379,193 @@ void yield()
         enableInterrupts();
 }
 
+/*
+ * the loop of the idle task of a cpu. A task made ready by an interrupt after the check and before
+ * the halt would wait for the next unrelated interrupt (the clock of an idle cpu isn't programmed):
+ * the check runs with the interrupts disabled and they only come in once the cpu is halted
+*/
+void SCHEDULER_idle()
+{
+    for(;;)
+    {
+        // nothing else to run: prepare zeroed pages for later, and sleep once the pool is full
+        if(PHYSMEM_refillZeroPool())
+        {
+            yield();
+            continue;
+        }
+
+        disableInterrupts();
+
+        if(SCHEDULER_hasReady(SMP_getCpu(), SCHED_LEVELS))
+            enableInterrupts();
+        else
+            enableInterruptsAndHalt();
+
+        yield();    // no periodic tick anymore: the interrupt that woke us up may have made a task ready
+    }
+}
+
+// a new task starts at its base level with a full time slice
+void SCHEDULER_initTask(process_t* proc, uint32_t basePriority)
+{
+    memset(&proc->sched, 0, sizeof(process_schedstat_t));
+
+    proc->sched.basePriority = basePriority;
+    proc->sched.priority = basePriority;
+    proc->sliceLeft = SCHEDULER_slice(basePriority);
+    proc->readySince = 0;
+
+    proc->cpu = GDT_getCpu();   // only a hint for SCHEDULER_place()
+    proc->onCpu = false;
+    proc->lockDepth = 1;        // it starts where yield() switched to it, with the lock held
+}
+
+/*
+ * a blocked task (i/o, message, sleep, mutex) goes up one level when it's woken up,
+ * it didn't use its slice while waiting so interactive tasks stay ahead of cpu bound ones
+*/
+void SCHEDULER_wakeUp(process_t* proc)
+{
+    lock_scheduler();
+
+    if(proc->sched.priority > proc->sched.basePriority)
+        proc->sched.priority--;
+
+    proc->sliceLeft = SCHEDULER_slice(proc->sched.priority);
+
+    unlock_scheduler();
+}
+
+/*
+ * called by the timer interrupt of a cpu, charges the time since the last charge to its running task.
+ * returns true if it should be preempted: its slice is over or a task of a higher level is ready
+*/
+bool SCHEDULER_tick()
+{
+    cpu_t* cpu = SMP_getCpu();
+    process_t* proc = cpu->current;
+
+    if(!is_scheduler_locked() && get_tikCount() - cpu->lastBoost >= SCHED_BOOST_PERIOD)
+    {
+        lock_scheduler();
+        SCHEDULER_boost(cpu);
+        unlock_scheduler();
+    }
+
+    SCHEDULER_charge(cpu);
+
+    if(proc == cpu->idle)
+        return SCHEDULER_hasReady(cpu, SCHED_LEVELS);
+
+    return proc->sliceLeft == 0 || SCHEDULER_hasReady(cpu, proc->sched.priority);
+}
+
+/*
+ * when the timer of this cpu has to interrupt its running task (in ms since boot): now if a task of
+ * a higher level is ready, else at the end of its slice or at the next boost.
+ * the idle process needs nothing, it's woken up by the interrupt that makes a task ready.
+ * the caller locks the scheduler
+*/
+uint64_t SCHEDULER_nextEvent()
+{
+    uint64_t now = get_tikCount();
+    cpu_t* cpu = SMP_getCpu();
+    process_t* proc = cpu->current;
+
+    if(proc == cpu->idle || proc == NULL)
+        return SCHEDULER_hasReady(cpu, SCHED_LEVELS) ? now : UINT64_MAX;
+
+    if(SCHEDULER_hasReady(cpu, proc->sched.priority))
+        return now;
+
+    uint64_t next = cpu->lastCharge + proc->sliceLeft;
+    if(cpu->lastBoost + SCHED_BOOST_PERIOD < next)
+        next = cpu->lastBoost + SCHED_BOOST_PERIOD;
+
+    return next;
+}
+
+// the process restarts from its new base level. only a user process can be changed, by itself
+// or by the process that started it. returns false if there is no such process or level, or if
+// the caller isn't allowed to change it
+bool SCHEDULER_setPriority(uint32_t id, uint32_t priority)
+{
+    bool found = false;
+
+    if(priority >= SCHED_LEVELS || id >= MAX_PROCESS)
+        return false;
+
+    lock_scheduler();
+
+    process_t* caller = PROCESS_getCurrent();
+    process_t* proc = PROCESS_get(id);
+    if(proc != NULL && proc->state != DEAD && proc->usermode && (proc == caller || proc->parent == caller->id))
+    {
+        bool ready = proc->state == READY;
+        cpu_t* cpu = SMP_getCpuById(proc->cpu);
+
+        if(ready)
+            SCHEDULER_dequeue(cpu, proc);
+
+        proc->sched.basePriority = priority;
+        proc->sched.priority = priority;
+        proc->sliceLeft = SCHEDULER_slice(priority);
+
+        if(ready)
+            SCHEDULER_enqueue(cpu, proc, false);
+
+        found = true;
+    }
+
+    unlock_scheduler();
+
+    return found;
+}
+
+// returns false if there is no such process
+bool SCHEDULER_getStats(uint32_t id, process_schedstat_t* stats)
+{
+    process_schedstat_t copy;
+    bool found = false;
+
+    lock_scheduler();   // the process can't go away while we copy
+
+    process_t* proc = id < MAX_PROCESS ? PROCESS_get(id) : NULL;
+    if(proc != NULL && proc->state != DEAD)
+    {
+        copy = proc->sched;
+        found = true;
+    }
+
+    unlock_scheduler();
+
+    // stats may be a user page that isn't mapped yet, don't fault with the scheduler locked
+    if(found)
+        *stats = copy;
+
+    return found;
+}
+
+// idle is the flow of execution already running on cpu, from now on it's scheduled there
+void SCHEDULER_startCpu(cpu_t* cpu, process_t* idle)
+{
+    lock_scheduler();
+
+    idle->state = RUNNING;
+    idle->onCpu = true;
+    idle->cpu = cpu->id;
+    idle->lockDepth = 0;
+
+    cpu->idle = idle;
+    cpu->current = idle;
+    cpu->lastCharge = get_tikCount();
+    cpu->lastBoost = cpu->lastCharge;
+    cpu->online = true;
+
+    unlock_scheduler();
+}
+
 bool is_schedulerEnabled()
 {
     return SCHEDULER_enabled;
@@ -125,10 +574,10 @@ bool is_schedulerEnabled()
 void SCHEDULER_initialize()
 {
     PROCESS_initialize(&PROCESS_idle);
+    time_init();
 
-    PROCESS_current = &PROCESS_idle;
-    PROCESS_current->state = RUNNING;
+    SCHEDULER_startCpu(SMP_getCpuById(0), &PROCESS_idle);
 
     SCHEDULER_enabled = true;
-    IRQ_registerNewHandler(0, timer);   // pit interrupt
+    IRQ_registerNewHandler(0, timer);   // clock interrupt, the local apic timer of every cpu
 }
\ No newline at end of file
@@ -0,0 +1,97 @@
+; Copyright (C) 2025,  Novice
+;
+; This file is part of the Novix software.
+;
+; This program is free software: you can redistribute it and/or modify
+; it under the terms of the GNU General Public License as published by
+; the Free Software Foundation, either version 3 of the License, or
+; (at your option) any later version.
+;
+; This program is distributed in the hope that it will be useful,
+; but WITHOUT ANY WARRANTY; without even the implied warranty of
+; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+; GNU General Public License for more details.
+;
+; You should have received a copy of the GNU General Public License
+; along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+; entry point of the application processors. SMP_initialize() copies the code from
+; SMP_trampolineStart to SMP_trampolineEnd at SMP_TRAMPOLINE_ADDR and fills the data at the end,
+; so every address is taken relative to the start of the copy
+
+TRAMPOLINE_ADDR equ 0x8000      ; SMP_TRAMPOLINE_ADDR in smp.h
+
+%define REL(label) (TRAMPOLINE_ADDR + (label - SMP_trampolineStart))
+
+section .text
+
+global SMP_trampolineStart
+global SMP_trampolineData
+global SMP_trampolineEnd
+
+[bits 16]
+SMP_trampolineStart:
+    cli
+    cld
+
+    xor ax, ax
+    mov ds, ax
+
+    lgdt [REL(trampoline_gdt_descriptor)]
+
+    mov eax, cr0
+    or eax, 1           ; protected mode
+    mov cr0, eax
+
+    jmp dword 0x08:REL(trampoline_pmode)
+
+[bits 32]
+trampoline_pmode:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ; same paging as the boot processor: its cr4 (large and global pages), the kernel page directory
+    mov eax, [REL(SMP_trampolineData.cr4)]
+    mov cr4, eax
+    mov eax, [REL(SMP_trampolineData.cr3)]
+    mov cr3, eax
+    mov eax, [REL(SMP_trampolineData.cr0)]
+    mov cr0, eax
+
+    ; the first 4mb are identity mapped, we're still here. on to the kernel stack and the higher half
+    mov esp, [REL(SMP_trampolineData.stack)]
+    push dword [REL(SMP_trampolineData.cpu)]
+    call [REL(SMP_trampolineData.entry)]
+
+.halt:
+    cli
+    hlt
+    jmp .halt
+
+align 8
+trampoline_gdt:
+    dq 0                        ; null descriptor
+    dq 0x00CF9A000000FFFF       ; 32-bit kernel code segment, flat
+    dq 0x00CF92000000FFFF       ; 32-bit kernel data segment, flat
+trampoline_gdt_end:
+
+trampoline_gdt_descriptor:
+    dw trampoline_gdt_end - trampoline_gdt - 1
+    dd REL(trampoline_gdt)
+
+; smp_trampoline_data_t in smp.c
+align 4
+SMP_trampolineData:
+.cr0:   dd 0
+.cr3:   dd 0
+.cr4:   dd 0
+.stack: dd 0
+.entry: dd 0
+.cpu:   dd 0
+
+SMP_trampolineEnd:
@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2025,  Novice
+ *
+ * This file is part of the Novix software.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stddef.h>
+#include <debug.h>
+#include <memory.h>
+#include <string.h>
+#include <hal/io.h>
+#include <hal/gdt.h>
+#include <hal/idt.h>
+#include <hal/irq.h>
+#include <hal/fpu.h>
+#include <hal/pat.h>
+#include <hal/apic.h>
+#include <mem_manager/kstack.h>
+#include <mem_manager/heap.h>
+#include <mem_manager/virtmem_manager.h>
+#include <multitasking/smp.h>
+#include <multitasking/scheduler.h>
+#include <multitasking/lock.h>
+#include <multitasking/time.h>
+#include <drivers/device.h>
+
+#define SMP_SHOOTDOWN_MAX_PAGES 32  // above this a shootdown flushes the whole tlb
+
+// filled before each startup ipi, read by the trampoline (see smp.asm)
+typedef struct smp_trampoline_data
+{
+    uint32_t cr0;
+    uint32_t cr3;
+    uint32_t cr4;
+    uint32_t stack;
+    uint32_t entry;
+    uint32_t cpu;
+}__attribute__((packed)) smp_trampoline_data_t;
+
+extern uint8_t SMP_trampolineStart[];
+extern uint8_t SMP_trampolineData[];
+extern uint8_t SMP_trampolineEnd[];
+
+cpu_t SMP_cpus[SMP_MAX_CPUS];
+uint32_t SMP_cpuCount = 1;      // cpus online, the boot processor is there from the start
+
+// one tlb shootdown at a time: the request, and its number that every cpu acknowledges
+spinlock_t SMP_shootdownLock = SPINLOCK_INIT("shootdown");
+volatile uint32_t SMP_shootdownGeneration = 0;
+void* volatile SMP_shootdownAddr;
+volatile uint32_t SMP_shootdownPages;
+
+// the cpu running this code, the caller disables interrupts (or the answer may be stale already)
+cpu_t* SMP_getCpu()
+{
+    return &SMP_cpus[GDT_getCpu()];
+}
+
+cpu_t* SMP_getCpuById(uint32_t id)
+{
+    return &SMP_cpus[id < SMP_MAX_CPUS ? id : 0];
+}
+
+uint32_t SMP_getCpuCount()
+{
+    return SMP_cpuCount;
+}
+
+// busy wait, the time keeps going since the boot processor's interrupts are enabled
+static void SMP_delay(uint32_t ms)
+{
+    uint64_t end = get_tikCount() + ms;
+    while(get_tikCount() < end);
+}
+
+// a task was made ready for this cpu, or it has to make room for a task of a higher level
+static void SMP_rescheduleHandler(Registers* regs)
+{
+    APIC_sendEndOfInterrupt();
+
+    SMP_getCpu()->stats.ipis++;
+
+    if(!is_scheduler_locked() && !is_spinlock_held())
+        yield();
+}
+
+static void SMP_shootdownHandler(Registers* regs)
+{
+    SMP_handleShootdown();
+    APIC_sendEndOfInterrupt();
+}
+
+/*
+ * first c code of an application processor, on the kernel stack of its idle task: the same
+ * cpu setup as the boot processor, then it joins the scheduler and becomes its idle loop
+*/
+static void SMP_apEntry(uint32_t id)
+{
+    cpu_t* cpu = &SMP_cpus[id];
+
+    GDT_initializeCpu(id);  // SMP_getCpu() works from here
+    IDT_initialize();
+    FPU_enable();
+    PAT_initialize();
+    APIC_initializeCpu();
+
+    cpu->shootdownAck = SMP_shootdownGeneration;
+    SCHEDULER_startCpu(cpu, cpu->idle);
+
+    TIME_requestEvent();
+    enableInterrupts();
+
+    SCHEDULER_idle();
+}
+
+// INIT, then up to two startup ipis as the MP specification asks
+static bool SMP_startCpu(cpu_t* cpu)
+{
+    void* stack = KSTACK_alloc();
+    if(stack == NULL)
+        return false;
+
+    cpu->idle = PROCESS_createIdle(stack);
+    if(cpu->idle == NULL)
+    {
+        KSTACK_free(stack);
+        return false;
+    }
+
+    smp_trampoline_data_t* data = (smp_trampoline_data_t*)(SMP_TRAMPOLINE_ADDR + (SMP_trampolineData - SMP_trampolineStart));
+
+    __asm__ volatile("mov %%cr0, %0" : "=r"(data->cr0));
+    __asm__ volatile("mov %%cr4, %0" : "=r"(data->cr4));
+    data->cr3 = (uint32_t)getPDBR();
+    data->stack = (uint32_t)stack + KSTACK_SIZE;
+    data->entry = (uint32_t)SMP_apEntry;
+    data->cpu = cpu->id;
+
+    APIC_sendInit(cpu->apicId);
+    SMP_delay(10);
+
+    for(int attempt = 0; attempt < 2 && !cpu->online; attempt++)
+    {
+        APIC_sendStartup(cpu->apicId, SMP_TRAMPOLINE_ADDR >> 12);
+
+        uint64_t end = get_tikCount() + (attempt == 0 ? 1 : SMP_START_TIMEOUT);
+        while(!cpu->online && get_tikCount() < end);
+    }
+
+    // a cpu that didn't answer keeps its stack and idle task: it may still wake up and use them
+    return cpu->online;
+}
+
+/*
+ * start the application processors listed by the ACPI or MP tables, one at a time since they
+ * share the trampoline. Needs the local apic (IRQ_enableApic()) and the scheduler, and the time
+ * stamp counter: every cpu has its own timer, the time has to come from a clock they all can read
+*/
+void SMP_initialize()
+{
+    cpu_t* bsp = &SMP_cpus[0];
+    bsp->apicId = IRQ_isApicEnabled() ? APIC_getId() : 0;
+    bsp->stats.apicId = bsp->apicId;
+    bsp->stats.online = true;
+
+    const apic_topology_t* topology = APIC_getTopology();
+
+    if(!IRQ_isApicEnabled() || topology->cpuCount < 2)
+    {
+        log_info("smp", "one cpu");
+        return;
+    }
+
+    if(APIC_getTscKhz() == 0)
+    {
+        log_warn("smp", "no time stamp counter, the application processors are not started");
+        return;
+    }
+
+    // the cpus share deadlines and charge time slices with it: it can't drift or differ between them
+    if(!APIC_hasInvariantTsc())
+    {
+        log_warn("smp", "the time stamp counter isn't invariant, the application processors are not started");
+        return;
+    }
+
+    TIME_useTsc(APIC_getTscKhz());
+
+    ISR_registerNewHandler(APIC_RESCHEDULE_VECTOR, SMP_rescheduleHandler);
+    ISR_registerNewHandler(APIC_SHOOTDOWN_VECTOR, SMP_shootdownHandler);
+
+    memcpy((void*)SMP_TRAMPOLINE_ADDR, SMP_trampolineStart, SMP_trampolineEnd - SMP_trampolineStart);
+
+    for(uint32_t i = 0; i < topology->cpuCount && SMP_cpuCount < SMP_MAX_CPUS; i++)
+    {
+        if(topology->cpuApicIds[i] == bsp->apicId)
+            continue;
+
+        cpu_t* cpu = &SMP_cpus[SMP_cpuCount];
+        cpu->id = SMP_cpuCount;
+        cpu->apicId = topology->cpuApicIds[i];
+        cpu->stats.apicId = cpu->apicId;
+
+        if(!SMP_startCpu(cpu))
+        {
+            log_warn("smp", "cpu with apic id %d didn't start", cpu->apicId);
+            continue;
+        }
+
+        cpu->stats.online = true;
+        SMP_cpuCount++;
+    }
+
+    log_info("smp", "%d cpu(s) online, tsc at %d khz", SMP_cpuCount, APIC_getTscKhz());
+}
+
+void SMP_sendReschedule(cpu_t* cpu)
+{
+    if(cpu->online)
+        APIC_sendIpi(cpu->apicId, APIC_RESCHEDULE_VECTOR);
+}
+
+// do the pending tlb shootdown if this cpu didn't already
+void SMP_handleShootdown()
+{
+    uint32_t eflags = get_eflags();
+    disableInterrupts();
+
+    cpu_t* cpu = SMP_getCpu();
+    uint32_t generation = SMP_shootdownGeneration;
+
+    if(cpu->shootdownAck != generation)
+    {
+        if(SMP_shootdownPages == 0 || SMP_shootdownPages > SMP_SHOOTDOWN_MAX_PAGES)
+            flushTLBAll();
+        else
+            flushTLBRange(SMP_shootdownAddr, SMP_shootdownPages);
+
+        cpu->stats.shootdowns++;
+        cpu->shootdownAck = generation;
+    }
+
+    if(eflags & (1 << 9))
+        enableInterrupts();
+}
+
+/*
+ * the other cpus drop their tlb entries for [virt, virt + pages * 4kb), or everything with pages = 0.
+ * the caller already flushed its own. It waits until every cpu is done: a cpu spinning for a lock
+ * with its interrupts disabled answers from the spin loop (see SPIN_acquire())
+*/
+void SMP_shootdown(void* virt, uint32_t pages)
+{
+    if(SMP_cpuCount < 2)
+        return;
+
+    uint32_t eflags = spin_lock_irqsave(&SMP_shootdownLock);    // waiting, we answer the others' shootdowns
+
+    cpu_t* self = SMP_getCpu();
+
+    SMP_shootdownAddr = virt;
+    SMP_shootdownPages = pages;
+    __sync_synchronize();
+    uint32_t generation = ++SMP_shootdownGeneration;
+    self->shootdownAck = generation;
+
+    for(uint32_t i = 0; i < SMP_cpuCount; i++)
+        if(&SMP_cpus[i] != self && SMP_cpus[i].online)
+            APIC_sendIpi(SMP_cpus[i].apicId, APIC_SHOOTDOWN_VECTOR);
+
+    for(uint32_t i = 0; i < SMP_cpuCount; i++)
+        while(SMP_cpus[i].online && SMP_cpus[i].shootdownAck != generation)
+            __asm__ volatile("pause");
+
+    spin_unlock_irqrestore(&SMP_shootdownLock, eflags);
+}
+
+static bool SMP_statsRecord(uint32_t index, void* record)
+{
+    if(index >= SMP_cpuCount)
+        return false;
+
+    *(cpu_stats_t*)record = SMP_cpus[index].stats;
+    return true;
+}
+
+/*
+ * read only device returning a cpu_stats_t per cpu (/dev/cpus once devfs is mounted)
+*/
+void SMP_createDevice()
+{
+    add_record_device("cpus", SMP_statsRecord, sizeof(cpu_stats_t));
+}
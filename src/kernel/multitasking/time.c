@@ -22,9 +22,13 @@
 #include <multitasking/process.h>
 #include <multitasking/scheduler.h>
 #include <multitasking/lock.h>
-#include <hal/pic.h>
+#include <hal/irq.h>
 #include <hal/io.h>
+#include <mem_manager/slab.h>
 #include <mem_manager/heap.h>
+#include <drivers/device.h>
+#include <memory.h>
+#include <string.h>
 
 typedef struct sleep_tasks
 {
@@ -35,8 +39,30 @@ typedef struct sleep_tasks
 }sleep_tasks_t;
 
 sleep_tasks_t* sleeping_tasks_list;
+kmem_cache_t* sleep_cache;
 
-uint64_t g_tickCount;
+uint64_t g_tickCount;   // ms since the scheduler started
+
+/*
+ * there is no periodic tick: the clock is programmed for one interrupt, at the next time
+ * something has to happen (a sleeper wakes up, the time slice of the running task ends).
+ * The time is kept by adding up the clock ticks elapsed between two programs
+*/
+clock_event_t* TIME_clock = NULL;
+uint32_t TIME_ticksPerMs;       // clock ticks in a millisecond
+uint32_t TIME_accounted;        // clock ticks of the current program already added to the time
+uint32_t TIME_remainder;        // clock ticks that don't make a whole millisecond yet
+
+/*
+ * with more than one cpu each one has its own clock, programmed for its own next event:
+ * adding up what elapsed doesn't work anymore, the time comes from the time stamp counter
+*/
+uint32_t TIME_tscKhz = 0;       // 0 while the clock keeps the time
+uint64_t TIME_tscBase;          // counter value when it took over
+uint64_t TIME_tscTickBase;      // g_tickCount at that moment
+
+uint32_t TIME_interrupts = 0;
+uint32_t TIME_programs = 0;
 
 void add_SLEEP_process(sleep_tasks_t* proc)
 {
@@ -93,13 +119,128 @@ void add_SLEEP_process(sleep_tasks_t* proc)
 }
 
 
+void time_init()
+{
+    sleep_cache = kmem_cache_create("sleep_tasks_t", sizeof(sleep_tasks_t), NULL);
+
+    TIME_clock = IRQ_getClockEvent();
+    TIME_ticksPerMs = TIME_clock->frequency / 1000;
+
+    // the first interrupt programs the real next event
+    TIME_clock->program(TIME_clock->maxDelta);
+    TIME_accounted = 0;
+    TIME_remainder = 0;
+
+    log_info("time", "one shot clock: %s, %d ticks per ms, %d ms at most between interrupts",
+        TIME_clock->name, TIME_ticksPerMs, TIME_clock->maxDelta / TIME_ticksPerMs);
+}
+
+static inline uint64_t TIME_readTsc()
+{
+    uint32_t low, high;
+    __asm__ volatile("rdtsc" : "=a"(low), "=d"(high));
+
+    return ((uint64_t)high << 32) | low;
+}
+
+// adds the time elapsed since the last call to g_tickCount, the caller disables interrupts
+void TIME_update()
+{
+    if(TIME_clock == NULL || TIME_tscKhz != 0)
+        return;
+
+    uint32_t elapsed = TIME_clock->elapsed();
+    if(elapsed < TIME_accounted)
+        elapsed = TIME_accounted;
+
+    TIME_remainder += elapsed - TIME_accounted;
+    TIME_accounted = elapsed;
+
+    g_tickCount += TIME_remainder / TIME_ticksPerMs;
+    TIME_remainder %= TIME_ticksPerMs;
+}
+
+// ms since boot, the caller disables interrupts
+static uint64_t TIME_now()
+{
+    if(TIME_tscKhz != 0)
+        return TIME_tscTickBase + (TIME_readTsc() - TIME_tscBase) / TIME_tscKhz;
+
+    TIME_update();
+    return g_tickCount;
+}
+
+// the time stamp counter (khz ticks per ms) keeps the time from now on, see SMP_initialize()
+void TIME_useTsc(uint32_t khz)
+{
+    uint32_t eflags = get_eflags();
+    disableInterrupts();
+
+    TIME_update();
+    TIME_tscBase = TIME_readTsc();
+    TIME_tscTickBase = g_tickCount;
+    TIME_tscKhz = khz;
+
+    if(eflags & (1 << 9))
+        enableInterrupts();
+}
+
+/*
+ * program the clock for the first of: the next sleeper to wake up, the next event of the scheduler.
+ * With nothing to wait for (idle), it's programmed as far as it goes, only to keep the time.
+ * It programs the clock of the calling cpu. the caller disables interrupts
+*/
+void TIME_reprogram()
+{
+    if(TIME_clock == NULL)
+        return;
+
+    lock_scheduler();
+
+    uint64_t now = TIME_now();
+
+    uint64_t next = SCHEDULER_nextEvent();
+    if(sleeping_tasks_list != NULL && sleeping_tasks_list->wakeTime < next)
+        next = sleeping_tasks_list->wakeTime;
+
+    unlock_scheduler();
+
+    uint32_t remainder = TIME_tscKhz != 0 ? 0 : TIME_remainder;
+
+    uint32_t delta = TIME_clock->maxDelta;
+    if(next <= now)
+        delta = TIME_ticksPerMs;    // already due, but no more often than the old periodic tick
+    else if(next - now <= TIME_clock->maxDelta / TIME_ticksPerMs)
+        delta = (uint32_t)(next - now) * TIME_ticksPerMs - remainder;
+
+    if(delta < TIME_clock->minDelta)
+        delta = TIME_clock->minDelta;
+
+    TIME_update();  // what elapsed since the first update is lost otherwise
+    TIME_clock->program(delta);
+    TIME_accounted = 0;
+    TIME_programs++;
+}
+
+// same as TIME_reprogram, from anywhere
+void TIME_requestEvent()
+{
+    uint32_t eflags = get_eflags();
+    disableInterrupts();
+
+    TIME_reprogram();
+
+    if(eflags & (1 << 9))
+        enableInterrupts();
+}
+
 void sleep(uint64_t ms)
 {
     process_t* this_proc = PROCESS_getCurrent();
 
-    sleep_tasks_t* new = kmalloc(sizeof(sleep_tasks_t));
+    sleep_tasks_t* new = kmem_cache_alloc(sleep_cache);
     new->proc = this_proc;
-    new->wakeTime = g_tickCount + ms;
+    new->wakeTime = get_tikCount() + ms;
 
     lock_scheduler();
 
@@ -110,14 +251,18 @@ void sleep(uint64_t ms)
     
     block_task();
 
-    kfree(new); // after sleeping we want to free this structure
+    kmem_cache_free(sleep_cache, new); // after sleeping we want to free this structure
 }
 
 void wakeUp_proc()
 {
+    lock_scheduler();   // another cpu may be adding a sleeper
+
+    uint64_t now = TIME_now();
+
     while (sleeping_tasks_list != NULL)
     {
-        if(sleeping_tasks_list->wakeTime > g_tickCount)
+        if(sleeping_tasks_list->wakeTime > now)
             break;
 
         unblock_task(sleeping_tasks_list->proc, false);
@@ -126,26 +271,61 @@ void wakeUp_proc()
         if(sleeping_tasks_list != NULL)
             sleeping_tasks_list->back = NULL;
     }
-    
+
+    unlock_scheduler();
 }
 
+// the clock doesn't interrupt every ms anymore, the time is brought up to date on each read
 uint64_t get_tikCount()
 {
-    return g_tickCount;
+    uint32_t eflags = get_eflags();
+    disableInterrupts();
+
+    uint64_t now = TIME_now();
+
+    if(eflags & (1 << 9))
+        enableInterrupts();
+
+    return now;
 }
 
 void timer(Registers* reg)
 {
-    PIC_sendEndOfInterrupt(0);
+    IRQ_sendEndOfInterrupt(0);
 
-    g_tickCount++;
+    TIME_interrupts++;
+    TIME_update();
 
     if(!is_scheduler_locked())  // if its not locked
             wakeUp_proc();      // To avoid race condition (for ex if were modifing the ready list structure)
 
-    if((g_tickCount % 10) == 0)
-    {
-        if(!is_scheduler_locked())  // if its not locked
-            yield();
-    }
+    // the slice of the running task is over, or a task of a higher level is ready
+    if(SCHEDULER_tick() && !is_scheduler_locked() && !is_spinlock_held())
+        yield();
+
+    TIME_reprogram();
+}
+
+void TIME_getStats(time_stats_t* stats)
+{
+    stats->uptime = get_tikCount();
+    stats->interrupts = TIME_interrupts;
+    stats->programs = TIME_programs;
+}
+
+static bool TIME_statsRecord(uint32_t index, void* record)
+{
+    if(index > 0)
+        return false;
+
+    TIME_getStats((time_stats_t*)record);
+    return true;
+}
+
+/*
+ * read only device exposing a time_stats_t (/dev/timer once devfs is mounted)
+*/
+void TIME_createDevice()
+{
+    add_record_device("timer", TIME_statsRecord, sizeof(time_stats_t));
 }
\ No newline at end of file
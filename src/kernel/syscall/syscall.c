@@ -187,6 +187,51 @@ void SYSCALL_sbrk(Registers* regs)
     regs->esi = (uint32_t)PROCESS_sbrk(regs->ebx);
 }
 
+void SYSCALL_fork(Registers* regs)
+{
+    regs->edx = PROCESS_fork(regs);
+}
+
+void SYSCALL_uptime(Registers* regs)
+{
+    uint64_t ms = get_tikCount();
+
+    // edx:ecx
+    regs->ecx = ms;
+    regs->edx = ms >> 32;
+}
+
+void SYSCALL_memstat(Registers* regs)
+{
+    uint32_t id = regs->ebx == (uint32_t)-1 ? PROCESS_getCurrent()->id : regs->ebx;
+
+    regs->edx = PROCESS_getMemoryStats(id, (process_memstat_t*)regs->edi) ? 0 : -1;
+}
+
+void SYSCALL_mmap(Registers* regs)
+{
+    regs->edx = (uint32_t)PROCESS_mmap(regs->ebx, regs->ecx, regs->edi, regs->esi != 0);
+}
+
+void SYSCALL_munmap(Registers* regs)
+{
+    regs->edx = PROCESS_munmap((void*)regs->esi, regs->ebx);
+}
+
+void SYSCALL_setpriority(Registers* regs)
+{
+    uint32_t id = regs->ebx == (uint32_t)-1 ? PROCESS_getCurrent()->id : regs->ebx;
+
+    regs->edx = SCHEDULER_setPriority(id, regs->ecx) ? 0 : -1;
+}
+
+void SYSCALL_schedstat(Registers* regs)
+{
+    uint32_t id = regs->ebx == (uint32_t)-1 ? PROCESS_getCurrent()->id : regs->ebx;
+
+    regs->edx = SCHEDULER_getStats(id, (process_schedstat_t*)regs->edi) ? 0 : -1;
+}
+
 void SYSCALL_keyeventToAscii(Registers* regs)
 {
     regs->ebx = KEYBOARD_scanToAscii((void*)regs->esi);
@@ -219,6 +264,13 @@ SyscallHandler Handlers[] = {
     [23]    = SYSCALL_getdents,
     [24]    = SYSCALL_execve,
     [25]    = SYSCALL_sbrk,
+    [26]    = SYSCALL_fork,
+    [27]    = SYSCALL_uptime,
+    [28]    = SYSCALL_memstat,
+    [29]    = SYSCALL_mmap,
+    [30]    = SYSCALL_munmap,
+    [31]    = SYSCALL_setpriority,
+    [32]    = SYSCALL_schedstat,
 };
 
 void SYSCALL_handler(Registers* regs)
@@ -75,7 +75,7 @@ void devfs_init()
 
 int devfs_mount(vfs_t* mountpoint, device_t* dev)
 {
-    vnode_t* root = kmalloc(sizeof(vnode_t));
+    vnode_t* root = VFS_allocVnode();
 
     if(!root)
         return VFS_ERROR;
@@ -94,7 +94,7 @@ int devfs_mount(vfs_t* mountpoint, device_t* dev)
 
 int devfs_unmount(vfs_t* mountpoint)
 {
-    kfree(mountpoint->vfs_data);
+    VFS_freeVnode(mountpoint->vfs_data);
 
     return VFS_OK;
 }
@@ -112,7 +112,7 @@ static vnode_t* create_vnode(vfs_t* mountpoint, device_t* dev)
         if(total_vnode[i] != NULL && total_vnode[i]->vnode_data == (void*)dev)
             return total_vnode[i];    // if the vnode already exist in the vnode table
 
-    vnode_t* newVnode = kmalloc(sizeof(vnode_t));
+    vnode_t* newVnode = VFS_allocVnode();
     newVnode->ref_count = 0;
     newVnode->flags = VNODE_NONE;
     newVnode->VFS_mountedhere = NULL;
@@ -133,13 +133,13 @@ static vnode_t* create_vnode(vfs_t* mountpoint, device_t* dev)
         // if the vnode is unused
         if(total_vnode[i]->ref_count <= 0)
         {
-            kfree(total_vnode[i]);
+            VFS_freeVnode(total_vnode[i]);
             total_vnode[i] = newVnode;
             return newVnode;
         }
     }
 
-    kfree(newVnode);
+    VFS_freeVnode(newVnode);
     return NULL;    // cannot create vnode
 }
 
@@ -147,6 +147,7 @@ int64_t read(struct vnode* node, void *buffer, size_t size, int64_t offset, uint
 {
     device_t* dev = (device_t*)node->vnode_data;
 
+    // not through the page cache: the file systems and the swap write the disks directly
     return dev->read(buffer, offset, size, dev->priv, flags);
 }
 
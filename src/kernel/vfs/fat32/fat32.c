@@ -19,9 +19,11 @@
 
 #include <drivers/device.h>
 #include <mem_manager/heap.h>
+#include <mem_manager/slab.h>
 #include <memory.h>
 #include <string.h>
 #include <vfs/vfs.h>
+#include <vfs/page_cache.h>
 #include <debug.h>
 
 #include "fat32_interface.h"
@@ -33,6 +35,8 @@ int fat32_get_root(vfs_t* mountpoint, vnode_t** result);
 
 static int64_t read(vnode_t* node, void *buffer, size_t size, int64_t offset, uint32_t flags);
 static int64_t write(vnode_t* node, const void *buffer, size_t size, int64_t offset, uint32_t flags);
+static int64_t readpages(struct vnode* node, void *buffer, uint32_t index, uint32_t count);
+static int64_t bmap(struct vnode* node, device_t** dev, uint32_t* sectors, uint32_t count);
 static int ioctl(struct vnode* node, const int command, void* arg);
 static int lookup(vnode_t* node, const char* name, struct vnode** result);
 static int trunc(struct vnode* node);
@@ -52,6 +56,8 @@ filesystem_t fat32_op = {
 vnodeops_t fat32_vnode_op = {
     .read = read,
     .write = write,
+    .readpages = readpages,
+    .bmap = bmap,
     .lookup = lookup,
     .ioctl = ioctl,
     .trunc = trunc,
@@ -61,8 +67,12 @@ vnodeops_t fat32_vnode_op = {
     .stat = stat,
 };
 
+kmem_cache_t* fat32_file_cache;   // file_t inodes
+
 void fat12_init()
 {
+    fat32_file_cache = kmem_cache_create("fat32 file_t", sizeof(file_t), NULL);
+
     strcpy(fat32_op.fs_name, "fat32");
     VFS_register_new_filesystem(&fat32_op);
 }
@@ -98,7 +108,7 @@ int fat32_mount(vfs_t* mountpoint, device_t* dev)
         return VFS_ERROR;
     }
 
-    fs_info->root_vnode = kmalloc(sizeof(vnode_t));
+    fs_info->root_vnode = VFS_allocVnode();
     if(fs_info->root_vnode == NULL)
     {
         kfree(fs_info->FAT);
@@ -107,7 +117,7 @@ int fat32_mount(vfs_t* mountpoint, device_t* dev)
         return VFS_ERROR;
     }
 
-    file_t* root = kmalloc(sizeof(file_t));
+    file_t* root = kmem_cache_alloc(fat32_file_cache);
     memset(root, 0, sizeof(file_t));
     root->entry.attributes = FAT_ATTR_DIRECTORY;
     root->entry.firstClusterLow = fs_info->bootSector.root_cluster;
@@ -136,12 +146,12 @@ int fat32_unmount(vfs_t* mountpoint)
     {
         if(fs_info->total_vnode[i] != NULL)
         {
-            kfree(fs_info->total_vnode[i]->vnode_data);
-            kfree(fs_info->total_vnode[i]);
+            kmem_cache_free(fat32_file_cache, fs_info->total_vnode[i]->vnode_data);
+            VFS_freeVnode(fs_info->total_vnode[i]);
         }
     }
     
-    kfree(fs_info->root_vnode);
+    VFS_freeVnode(fs_info->root_vnode);
     kfree(fs_info->FAT);
     kfree(fs_info->working_buffer);
     kfree(fs_info);
@@ -184,10 +194,10 @@ static vnode_t* create_vnode(vfs_t* mountpoint, file_t* inode_info)
 
     /* Otherwise, we create a new vnode and ensure that we also generate a new inode,
     since the one we received is temporary (as it came from the FAT buffer). */
-    file_t* file_inode = kmalloc(sizeof(file_t));
+    file_t* file_inode = kmem_cache_alloc(fat32_file_cache);
     memcpy(file_inode, inode_info, sizeof(file_t));
 
-    vnode_t* newVnode = kmalloc(sizeof(vnode_t));
+    vnode_t* newVnode = VFS_allocVnode();
     newVnode->flags = VNODE_NONE;
     newVnode->ref_count = 0;
     newVnode->VFS_mountedhere = NULL;
@@ -212,21 +222,24 @@ static vnode_t* create_vnode(vfs_t* mountpoint, file_t* inode_info)
         // if the vnode is unused
         if(fs_info->total_vnode[i]->ref_count <= 0)
         {
-            kfree(fs_info->total_vnode[i]->vnode_data);  // free the inode !
-            kfree(fs_info->total_vnode[i]);
+            kmem_cache_free(fat32_file_cache, fs_info->total_vnode[i]->vnode_data);  // free the inode !
+            VFS_freeVnode(fs_info->total_vnode[i]);
 
             fs_info->total_vnode[i] = newVnode;
             return newVnode;
         }
     }
 
-    kfree(newVnode->vnode_data); // free the inode !
-    kfree(newVnode);
+    kmem_cache_free(fat32_file_cache, newVnode->vnode_data); // free the inode !
+    VFS_freeVnode(newVnode);
     return NULL;    // cannot create vnode because too many vnodes are in used
 }
 
 int64_t read(vnode_t* node, void *buffer, size_t size, int64_t offset, uint32_t flags)
 {
+    if(node->vnode_type == VREG)
+        return PCACHE_read(node, buffer, size, offset);   // comes back to readpages for what isn't cached
+
     file_t* inode = node->vnode_data;
     fat32_info_t* fs_info = node->vnode_vfs->vfs_data;
 
@@ -234,12 +247,33 @@ int64_t read(vnode_t* node, void *buffer, size_t size, int64_t offset, uint32_t
     return read < 0 ? VFS_ERROR : read;
 }
 
+// fill count pages of the page cache with a single walk of the cluster chain
+int64_t readpages(struct vnode* node, void *buffer, uint32_t index, uint32_t count)
+{
+    file_t* inode = node->vnode_data;
+    fat32_info_t* fs_info = node->vnode_vfs->vfs_data;
+
+    int64_t read = fat32_read(fs_info, inode, buffer, count * 0x1000, (uint64_t)index * 0x1000);
+    return read < 0 ? VFS_ERROR : read;
+}
+
+// where the pages of the file are on the disk (swap file)
+int64_t bmap(struct vnode* node, device_t** dev, uint32_t* sectors, uint32_t count)
+{
+    file_t* inode = node->vnode_data;
+    fat32_info_t* fs_info = node->vnode_vfs->vfs_data;
+
+    *dev = fs_info->dev;
+    return fat32_bmap(fs_info, inode, sectors, count);
+}
+
 int64_t write(vnode_t* node, const void *buffer, size_t size, int64_t offset, uint32_t flags)
 {
     file_t* inode = node->vnode_data;
     fat32_info_t* fs_info = node->vnode_vfs->vfs_data;
 
     int64_t read = fat32_write(fs_info, inode, buffer, size, offset);
+    PCACHE_invalidate(node, offset, size);  // write through, the cached pages are stale
     return read < 0 ? VFS_ERROR : read;
 }
 
@@ -254,11 +288,11 @@ int lookup(vnode_t* node, const char* name, struct vnode** result)
     file_t* inode = node->vnode_data;
     fat32_info_t* fs_info = node->vnode_vfs->vfs_data;
 
-    file_t* new = kmalloc(sizeof(file_t));
+    file_t* new = kmem_cache_alloc(fat32_file_cache);
 
     if(!fat32_lookup_in_dir(fs_info, inode->entry.firstClusterLow | (inode->entry.firstClusterHigh << 16), name, &new->entry, &new->in_parent))
     {
-        kfree(new);
+        kmem_cache_free(fat32_file_cache, new);
         *result = NULL;
         return VFS_ENOENT;
     }
@@ -268,12 +302,12 @@ int lookup(vnode_t* node, const char* name, struct vnode** result)
     *result = create_vnode(node->vnode_vfs, new);
     if(*result == NULL)
     {
-        kfree(new);
+        kmem_cache_free(fat32_file_cache, new);
         return VFS_ENFILE;
     }
 
     // if we already had this file cached then the allocation was useless
-    if((*result)->vnode_data != new)    kfree(new); // we must free this inode otherwise its a memory leak
+    if((*result)->vnode_data != new)    kmem_cache_free(fat32_file_cache, new); // we must free this inode otherwise its a memory leak
     return VFS_OK;
 }
 
@@ -293,6 +327,7 @@ int trunc(struct vnode* node)
     fat32_info_t* fs_info = node->vnode_vfs->vfs_data;
 
     fat32_trunc(fs_info, file);
+    PCACHE_invalidateAll(node);
     return VFS_OK;
 }
 
@@ -302,6 +337,7 @@ int remove(struct vnode* node)
     fat32_info_t* fs_info = node->vnode_vfs->vfs_data;
 
     fat32_delete(fs_info, file);
+    PCACHE_invalidateAll(node);
     return VFS_OK;
 }
 
@@ -392,6 +392,43 @@ End:
     return to_write;
 }
 
+/*
+ * first sector of each 4kb page of the file, for the swap file which is accessed without the file system.
+ * the sectors of a page must follow each other on the disk: the result stops at the first page that isn't
+ * contiguous (or at the end of the file). The cluster chain is walked only once
+*/
+int64_t fat32_bmap(fat32_info_t* filesystem, file_t* this_file, uint32_t* sectors, uint32_t count)
+{
+    uint32_t sectors_per_page = 0x1000 / filesystem->bootSector.bytes_per_sector;
+    uint32_t current_cluster = this_file->entry.firstClusterLow | (this_file->entry.firstClusterHigh << 16);
+    uint32_t sector_in_cluster = 0;
+    uint32_t pages = 0;
+
+    if(count > this_file->entry.fileSize / 0x1000)
+        count = this_file->entry.fileSize / 0x1000;
+
+    while(pages < count && IS_VALID_CLUSTER(current_cluster))
+    {
+        uint32_t first = cluster_to_Lba(filesystem, current_cluster) + sector_in_cluster;
+
+        for(uint32_t i = 0; i < sectors_per_page; i++)
+        {
+            if(!IS_VALID_CLUSTER(current_cluster) || cluster_to_Lba(filesystem, current_cluster) + sector_in_cluster != first + i)
+                return pages;   // the page is split on the disk
+
+            if(++sector_in_cluster == filesystem->bootSector.sectors_per_cluster)
+            {
+                current_cluster = get_next_cluster(filesystem, current_cluster);
+                sector_in_cluster = 0;
+            }
+        }
+
+        sectors[pages++] = first;
+    }
+
+    return pages;
+}
+
 int fat32_get_next_entry(fat32_info_t* filesystem, dir_iterator_t* dir, fat_dir_entry_t* entryOut, location_t* out, char* nameOut)
 {
     enum {NORMAL_ENTRY, LFN_ENTRY};
@@ -125,6 +125,7 @@ typedef struct fat32_info
 
 int64_t fat32_read(fat32_info_t* filesystem, file_t* this_file, void* buffer, size_t size, uint64_t readPos);
 int64_t fat32_write(fat32_info_t* filesystem, file_t* this_file, const void* buffer, size_t size, uint64_t readPos);
+int64_t fat32_bmap(fat32_info_t* filesystem, file_t* this_file, uint32_t* sectors, uint32_t count);
 
 bool fat32_lookup_in_dir(fat32_info_t* filesystem, uint32_t first_cluster, const char* name, fat_dir_entry_t* entryOut, location_t* out);
 int fat32_readdir(fat32_info_t* filesystem, file_t* this_dir, dirEntry_t* out, uint64_t readPos);
@@ -0,0 +1,500 @@
+/*
+ * Copyright (C) 2025,  Novice
+ *
+ * This file is part of the Novix software.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <debug.h>
+#include <memory.h>
+#include <string.h>
+#include <utility.h>
+#include <vfs/vfs.h>
+#include <vfs/page_cache.h>
+#include <mem_manager/heap.h>
+#include <mem_manager/slab.h>
+#include <mem_manager/physmem_manager.h>
+#include <mem_manager/virtmem_manager.h>
+#include <multitasking/scheduler.h>
+#include <multitasking/lock.h>
+#include <drivers/device.h>
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE DEFINITIONS / ENUMERATIONS / SIMPLE TYPEDEFS
+//============================================================================
+
+#define PAGE_SIZE 0x1000
+
+/*
+ * one cached page of a file. It is linked in its hash bucket, in the pages
+ * of its vnode and in the lru list (most recently used first)
+*/
+typedef struct pcache_page
+{
+    vnode_t* vnode;
+    uint32_t index;     // page number in the file
+    void* frame;        // physical frame holding the data
+    uint32_t length;    // valid bytes, less than a page only at the end of the file
+
+    struct pcache_page* hashNext;
+    struct pcache_page* vnodeNext;
+    struct pcache_page* vnodePrev;
+    struct pcache_page* lruNext;
+    struct pcache_page* lruPrev;
+}pcache_page_t;
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE DATA
+//============================================================================
+
+pcache_page_t* PCACHE_hash[PCACHE_HASH_SIZE];
+pcache_page_t* PCACHE_lruHead = NULL;   // most recently used
+pcache_page_t* PCACHE_lruTail = NULL;   // next one to be evicted
+
+kmem_cache_t* PCACHE_pageCache;
+
+// PCACHE_FILL_PAGES pages, the data goes through it between the file systems and the frames
+uint8_t* PCACHE_buffer;
+
+uint32_t PCACHE_cachedPages     = 0;
+uint32_t PCACHE_hits            = 0;
+uint32_t PCACHE_misses          = 0;
+uint32_t PCACHE_evictions       = 0;
+uint32_t PCACHE_invalidations   = 0;
+
+mutex_t PCACHE_mutex;
+
+//============================================================================
+//    IMPLEMENTATION PRIVATE FUNCTIONS
+//============================================================================
+
+static inline uint32_t PCACHE_hashIndex(vnode_t* node, uint32_t index)
+{
+    return (((uint32_t)node >> 4) ^ (index * 2654435761u)) % PCACHE_HASH_SIZE;
+}
+
+pcache_page_t* PCACHE_lookup(vnode_t* node, uint32_t index)
+{
+    for(pcache_page_t* page = PCACHE_hash[PCACHE_hashIndex(node, index)]; page != NULL; page = page->hashNext)
+        if(page->vnode == node && page->index == index)
+            return page;
+
+    return NULL;
+}
+
+void PCACHE_lruRemove(pcache_page_t* page)
+{
+    if(page->lruPrev != NULL)
+        page->lruPrev->lruNext = page->lruNext;
+    else
+        PCACHE_lruHead = page->lruNext;
+
+    if(page->lruNext != NULL)
+        page->lruNext->lruPrev = page->lruPrev;
+    else
+        PCACHE_lruTail = page->lruPrev;
+}
+
+void PCACHE_lruPush(pcache_page_t* page)
+{
+    page->lruPrev = NULL;
+    page->lruNext = PCACHE_lruHead;
+
+    if(PCACHE_lruHead != NULL)
+        PCACHE_lruHead->lruPrev = page;
+    else
+        PCACHE_lruTail = page;
+
+    PCACHE_lruHead = page;
+}
+
+// the page was just used, it will be evicted last
+void PCACHE_touch(pcache_page_t* page)
+{
+    if(page == PCACHE_lruHead)
+        return;
+
+    PCACHE_lruRemove(page);
+    PCACHE_lruPush(page);
+}
+
+void PCACHE_insert(pcache_page_t* page)
+{
+    uint32_t bucket = PCACHE_hashIndex(page->vnode, page->index);
+
+    page->hashNext = PCACHE_hash[bucket];
+    PCACHE_hash[bucket] = page;
+
+    page->vnodePrev = NULL;
+    page->vnodeNext = page->vnode->pages;
+    if(page->vnode->pages != NULL)
+        page->vnode->pages->vnodePrev = page;
+    page->vnode->pages = page;
+
+    PCACHE_lruPush(page);
+    PCACHE_cachedPages++;
+}
+
+// the frame only goes back to the allocator if no process maps it anymore
+void PCACHE_drop(pcache_page_t* page)
+{
+    pcache_page_t** link = &PCACHE_hash[PCACHE_hashIndex(page->vnode, page->index)];
+    while(*link != page)
+        link = &(*link)->hashNext;
+    *link = page->hashNext;
+
+    if(page->vnodePrev != NULL)
+        page->vnodePrev->vnodeNext = page->vnodeNext;
+    else
+        page->vnode->pages = page->vnodeNext;
+
+    if(page->vnodeNext != NULL)
+        page->vnodeNext->vnodePrev = page->vnodePrev;
+
+    PCACHE_lruRemove(page);
+    PCACHE_cachedPages--;
+
+    PHYSMEM_freeBlocksFor(page->frame, 1, PHYSMEM_USER_PAGE_CACHE);
+    kmem_cache_free(PCACHE_pageCache, page);
+}
+
+/*
+ * drop up to count of the least recently used pages whose frame goes back to the allocator:
+ * a page mapped by a process (or being read) would only lose the cache's reference, it stays.
+ * returns how many frames were freed
+*/
+uint32_t PCACHE_evict(uint32_t count)
+{
+    uint32_t dropped = 0;
+    pcache_page_t* page = PCACHE_lruTail;
+
+    while(dropped < count && page != NULL)
+    {
+        pcache_page_t* prev = page->lruPrev;
+
+        // no new owner while we hold PCACHE_mutex, they get it through PCACHE_getPage() or PCACHE_read()
+        if(PHYSMEM_getRefCount(page->frame) == 1)
+        {
+            PCACHE_drop(page);
+            dropped++;
+        }
+
+        page = prev;
+    }
+
+    PCACHE_evictions += dropped;
+    return dropped;
+}
+
+/*
+ * read count pages of the file from index on (stopping before the first one already cached)
+ * with a single call to the file system, and cache them. the caller holds PCACHE_mutex
+ * returns the number of pages cached, 0 at the end of the file, < 0 on error
+*/
+int64_t PCACHE_fill(vnode_t* node, uint32_t index, uint32_t count)
+{
+    for(uint32_t i = 1; i < count; i++)
+    {
+        if(PCACHE_lookup(node, index + i) != NULL)
+        {
+            count = i;
+            break;
+        }
+    }
+
+    // make room first when memory is getting low
+    uint32_t freeBlocks = PHYSMEM_getFreeBlocks();
+    if(freeBlocks < PCACHE_MIN_FREE_BLOCKS + count)
+        PCACHE_evict(PCACHE_MIN_FREE_BLOCKS + count - freeBlocks);
+
+    for(uint32_t i = 0; i < count; i++)
+        memset(PCACHE_buffer + i * PAGE_SIZE, 0, PAGE_SIZE);   // the end of the last page stays zeroed
+
+    int64_t bytes = node->vnode_op->readpages(node, PCACHE_buffer, index, count);
+    if(bytes <= 0)
+        return bytes;
+
+    uint32_t pages = roundUp_div(bytes, PAGE_SIZE);
+    uint32_t cached = 0;
+
+    for(; cached < pages; cached++)
+    {
+        pcache_page_t* page = kmem_cache_alloc(PCACHE_pageCache);
+        void* frame = PHYSMEM_AllocBlocksFor(1, PHYSMEM_USER_PAGE_CACHE);
+
+        if(page == NULL || frame == NULL)
+        {
+            if(page != NULL)
+                kmem_cache_free(PCACHE_pageCache, page);
+            PHYSMEM_freeBlocksFor(frame, 1, PHYSMEM_USER_PAGE_CACHE);
+
+            log_warn("pcache", "out of memory, %d of %d pages cached", cached, pages);
+            break;
+        }
+
+        VIRTMEM_copyToFrame(frame, PCACHE_buffer + cached * PAGE_SIZE);
+
+        page->vnode = node;
+        page->index = index + cached;
+        page->frame = frame;
+        page->length = (bytes - cached * PAGE_SIZE) < PAGE_SIZE ? (bytes - cached * PAGE_SIZE) : PAGE_SIZE;
+
+        PCACHE_insert(page);
+    }
+
+    PCACHE_misses += cached;
+    return cached > 0 ? (int64_t)cached : VFS_ERROR;
+}
+
+//============================================================================
+//    INTERFACE FUNCTIONS
+//============================================================================
+
+void PCACHE_initialize()
+{
+    PCACHE_pageCache = kmem_cache_create("pcache_page_t", sizeof(pcache_page_t), NULL);
+    PCACHE_buffer = kmalloc(PCACHE_FILL_PAGES * PAGE_SIZE);
+
+    if(PCACHE_pageCache == NULL || PCACHE_buffer == NULL)
+    {
+        log_crit("pcache", "can't allocate the page cache");
+        return;
+    }
+
+    // the allocator asks us for memory when it runs out
+    PHYSMEM_addReclaimHandler(PCACHE_shrink);
+}
+
+/*
+ * read through the cache, for the file systems that implement readpages.
+ * the missing pages are read PCACHE_FILL_PAGES at most at a time.
+ * PCACHE_mutex is only held to find (or fill) each page: the copy to the buffer, which
+ * may fault, is done from the frame with a reference of our own so it can't be freed
+ * returns the number of bytes read or < 0 on error
+*/
+int64_t PCACHE_read(vnode_t* node, void* buffer, size_t size, uint64_t offset)
+{
+    size_t done = 0;
+    int64_t error = 0;
+
+    while(done < size)
+    {
+        uint32_t index = (offset + done) / PAGE_SIZE;
+        uint32_t start = (offset + done) % PAGE_SIZE;
+
+        if(is_schedulerEnabled())
+            acquire_mutex(&PCACHE_mutex);
+
+        pcache_page_t* page = PCACHE_lookup(node, index);
+        if(page != NULL)
+            PCACHE_hits++;
+        else
+        {
+            uint32_t wanted = roundUp_div(start + (size - done), PAGE_SIZE);
+            error = PCACHE_fill(node, index, wanted < PCACHE_FILL_PAGES ? wanted : PCACHE_FILL_PAGES);
+
+            page = error > 0 ? PCACHE_lookup(node, index) : NULL;
+        }
+
+        void* frame = NULL;
+        uint32_t length = 0;
+
+        if(page != NULL && PHYSMEM_shareBlock(page->frame))
+        {
+            PCACHE_touch(page);
+            frame = page->frame;
+            length = page->length;
+        }
+
+        if(is_schedulerEnabled())
+            release_mutex(&PCACHE_mutex);
+
+        if(frame == NULL)
+            break;  // end of the file or error
+
+        if(start >= length)
+        {
+            PHYSMEM_freeBlocksFor(frame, 1, PHYSMEM_USER_PAGE_CACHE);
+            break;  // end of the file
+        }
+
+        uint32_t count = (length - start) < (size - done) ? (length - start) : (size - done);
+
+        VIRTMEM_copyFromFramePart(buffer + done, frame, start, count);
+        PHYSMEM_freeBlocksFor(frame, 1, PHYSMEM_USER_PAGE_CACHE);
+        done += count;
+
+        if(length < PAGE_SIZE)
+            break;  // that was the last page of the file
+    }
+
+    return (done == 0 && error < 0) ? error : (int64_t)done;
+}
+
+/*
+ * physical frame of a page of the file (read with a few pages after it if it's missing), to be mapped in a process.
+ * the caller gets its own reference to the frame and must free it (or unmap it) with PHYSMEM_freeBlocksFor
+ * returns NULL past the end of the file or on error
+*/
+void* PCACHE_getPage(vnode_t* node, uint32_t index)
+{
+    void* frame = NULL;
+
+    if(is_schedulerEnabled())
+        acquire_mutex(&PCACHE_mutex);
+
+    pcache_page_t* page = PCACHE_lookup(node, index);
+    if(page != NULL)
+        PCACHE_hits++;
+    else if(PCACHE_fill(node, index, PCACHE_FILL_PAGES) > 0)
+        page = PCACHE_lookup(node, index);
+
+    if(page != NULL && PHYSMEM_shareBlock(page->frame))
+    {
+        PCACHE_touch(page);
+        frame = page->frame;
+    }
+
+    if(is_schedulerEnabled())
+        release_mutex(&PCACHE_mutex);
+
+    return frame;
+}
+
+/*
+ * the file was written from offset on: drop the pages covering the range, and the last page
+ * of the file since its length may have changed. writes go straight to the file system
+*/
+void PCACHE_invalidate(vnode_t* node, uint64_t offset, uint64_t size)
+{
+    uint32_t first = offset / PAGE_SIZE;
+    uint32_t last = size ? (offset + size - 1) / PAGE_SIZE : first;
+
+    if(is_schedulerEnabled())
+        acquire_mutex(&PCACHE_mutex);
+
+    pcache_page_t* page = node->pages;
+    while(page != NULL)
+    {
+        pcache_page_t* next = page->vnodeNext;
+
+        if((size && page->index >= first && page->index <= last) || page->length < PAGE_SIZE)
+        {
+            PCACHE_drop(page);
+            PCACHE_invalidations++;
+        }
+
+        page = next;
+    }
+
+    if(is_schedulerEnabled())
+        release_mutex(&PCACHE_mutex);
+}
+
+// drop every page of the file (truncated, removed, or its vnode is freed)
+void PCACHE_invalidateAll(vnode_t* node)
+{
+    if(node->pages == NULL)
+        return;
+
+    if(is_schedulerEnabled())
+        acquire_mutex(&PCACHE_mutex);
+
+    while(node->pages != NULL)
+    {
+        PCACHE_drop(node->pages);
+        PCACHE_invalidations++;
+    }
+
+    if(is_schedulerEnabled())
+        release_mutex(&PCACHE_mutex);
+}
+
+/*
+ * reclaim handler of the physical memory manager: drop the least recently used pages.
+ * gives up if someone else is using the cache, the allocation will just fail
+ * returns how many pages were dropped
+*/
+uint32_t PCACHE_shrink(uint32_t pages)
+{
+    if(is_schedulerEnabled() && !try_acquire_mutex(&PCACHE_mutex))
+        return 0;
+
+    uint32_t dropped = PCACHE_evict(pages);
+
+    if(is_schedulerEnabled())
+        release_mutex(&PCACHE_mutex);
+
+    return dropped;
+}
+
+void PCACHE_getStats(pcache_stats_t* stats)
+{
+    stats->cachedPages = PCACHE_cachedPages;
+    stats->hits = PCACHE_hits;
+    stats->misses = PCACHE_misses;
+    stats->evictions = PCACHE_evictions;
+    stats->invalidations = PCACHE_invalidations;
+    stats->mappedPages = 0;
+    stats->mappings = 0;
+
+    if(is_schedulerEnabled())
+        acquire_mutex(&PCACHE_mutex);
+
+    // every owner of a cached frame but the cache itself is a mapping
+    for(pcache_page_t* page = PCACHE_lruHead; page != NULL; page = page->lruNext)
+    {
+        uint32_t owners = PHYSMEM_getRefCount(page->frame);
+
+        if(owners > 1)
+        {
+            stats->mappedPages++;
+            stats->mappings += owners - 1;
+        }
+    }
+
+    if(is_schedulerEnabled())
+        release_mutex(&PCACHE_mutex);
+}
+
+void PCACHE_dumpStats()
+{
+    pcache_stats_t stats;
+    PCACHE_getStats(&stats);
+
+    log_info("pcache", "%d pages cached, %d hits, %d misses, %d evictions, %d invalidations",
+        stats.cachedPages, stats.hits, stats.misses, stats.evictions, stats.invalidations);
+    log_info("pcache", "%d pages mapped %d times (%d frames saved)",
+        stats.mappedPages, stats.mappings, stats.mappings - stats.mappedPages);
+}
+
+static bool PCACHE_statsRecord(uint32_t index, void* record)
+{
+    if(index > 0)
+        return false;
+
+    PCACHE_getStats((pcache_stats_t*)record);
+    return true;
+}
+
+/*
+ * read only device exposing a pcache_stats_t (/dev/pagecache once devfs is mounted)
+*/
+void PCACHE_createDevice()
+{
+    add_record_device("pagecache", PCACHE_statsRecord, sizeof(pcache_stats_t));
+}
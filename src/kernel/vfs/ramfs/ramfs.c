@@ -224,7 +224,7 @@ int ramfs_mount(vfs_t* mountpoint, device_t* dev)
 
     fs_info->root_node = ramfs_createRoot();
 
-    fs_info->root_vnode = kmalloc(sizeof(vnode_t));
+    fs_info->root_vnode = VFS_allocVnode();
     fs_info->root_vnode->ref_count = 0;
     fs_info->root_vnode->flags = VNODE_NONE;
     fs_info->root_vnode->vnode_type = VDIR;
@@ -245,9 +245,9 @@ int ramfs_unmount(vfs_t* mountpoint)
 
     for(int i = 0; i < MAX_VNODE_PER_VFS; i++)
         if(fs_info->total_vnode[i] != NULL)
-            kfree(fs_info->total_vnode[i]);
+            VFS_freeVnode(fs_info->total_vnode[i]);
 
-    kfree(fs_info->root_vnode);
+    VFS_freeVnode(fs_info->root_vnode);
 
     kfree(fs_info);
 
@@ -283,7 +283,7 @@ static vnode_t* create_vnode(vfs_t* mountpoint, treenode_t* node)
         if(fs_info->total_vnode[i] != NULL && fs_info->total_vnode[i]->vnode_data == (void*)node)
             return fs_info->total_vnode[i];    // if the vnode already exist in the vnode table
 
-    vnode_t* newVnode = kmalloc(sizeof(vnode_t));
+    vnode_t* newVnode = VFS_allocVnode();
     newVnode->ref_count = 0;
     newVnode->flags = VNODE_NONE;
     newVnode->VFS_mountedhere = NULL;
@@ -318,13 +318,13 @@ static vnode_t* create_vnode(vfs_t* mountpoint, treenode_t* node)
         // if the vnode is unused
         if(fs_info->total_vnode[i]->ref_count <= 0)
         {
-            kfree(fs_info->total_vnode[i]);
+            VFS_freeVnode(fs_info->total_vnode[i]);
             fs_info->total_vnode[i] = newVnode;
             return newVnode;
         }
     }
 
-    kfree(newVnode);
+    VFS_freeVnode(newVnode);
     return NULL;    // cannot create vnode
 }
 
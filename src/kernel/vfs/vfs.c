@@ -22,8 +22,10 @@
 #include <drivers/e9_port.h>
 #include <drivers/device.h>
 #include <mem_manager/heap.h>
+#include <mem_manager/slab.h>
 #include <string.h>
 #include <vfs/vfs.h>
+#include <vfs/page_cache.h>
 #include <multitasking/process.h>
 #include <multitasking/scheduler.h>
 
@@ -45,6 +47,8 @@ vfs_t *vfs_root;
 filesystem_t *registered_fs[VFS_MAX_FS];
 int num_registered_fs;
 
+kmem_cache_t* vnode_cache;
+
 //============================================================================
 //    IMPLEMENTATION PRIVATE FUNCTIONS
 //============================================================================
@@ -122,11 +126,31 @@ void VFS_init()
 	for(int i = 0; i < VFS_MAX_FS; i++)
 		registered_fs[i] = NULL;
 
+	vnode_cache = kmem_cache_create("vnode_t", sizeof(vnode_t), NULL);
+	PCACHE_initialize();
+
 	ramfs_init();
 	devfs_init();
 	fat12_init();
 }
 
+// every file system allocates its vnodes here
+vnode_t* VFS_allocVnode()
+{
+	vnode_t* node = kmem_cache_alloc(vnode_cache);
+
+	if(node != NULL)
+		node->pages = NULL;
+
+	return node;
+}
+
+void VFS_freeVnode(vnode_t* node)
+{
+	PCACHE_invalidateAll(node);
+	kmem_cache_free(vnode_cache, node);
+}
+
 vnode_t* lookup_path_name(const char* path)
 {
 	vnode_t* node_out = NULL;
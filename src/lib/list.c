@@ -27,15 +27,28 @@ typedef void (*memFree)(void* __ptr);
 memAlloc malloc;
 memFree free;
 
+// nodes are allocated all the time, they can come from a dedicated allocator
+memAlloc node_malloc;
+memFree node_free;
+
 void List_init(memAlloc mallocFunc, memFree freeFunc)
 {
     malloc = mallocFunc;
     free = freeFunc;
+
+    node_malloc = mallocFunc;
+    node_free = freeFunc;
+}
+
+void List_setNodeAllocator(memAlloc mallocFunc, memFree freeFunc)
+{
+    node_malloc = mallocFunc;
+    node_free = freeFunc;
 }
 
 struct listNode* create_newNode(void* payload)
 {
-    struct listNode* new = malloc(sizeof(struct listNode));
+    struct listNode* new = node_malloc(sizeof(struct listNode));
 
     if(!new)
         return new;
@@ -133,7 +146,7 @@ void* list_removeAt(list_t* list, uint32_t index)
         current->next->prev = current->prev;
     }
 
-    free(current);
+    node_free(current);
     list->count--;
     return payload;
 }
\ No newline at end of file
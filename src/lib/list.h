@@ -39,6 +39,7 @@ typedef struct list {
 }list_t;
 
 void List_init(memAlloc mallocFunc, memFree freeFunc);
+void List_setNodeAllocator(memAlloc mallocFunc, memFree freeFunc);
 
 list_t* create_newList();
 
@@ -122,7 +122,7 @@ void DG_SetWindowTitle(const char * title)
 
 int main()
 {
-    doomgeneric_Create(0, (char*[]){"/", NULL});
+    doomgeneric_Create(2, (char*[]){"/", "-mmap", NULL});   // map the WAD instead of reading it
 
     while (1)
     {
@@ -425,6 +425,294 @@ __sys_getdents:
     pop esi
     pop ebx
 
+    ; restore old call frame
+    mov esp, ebp
+    pop ebp
+    ret
+
+global __sys_yield
+__sys_yield:
+    ; make new call frame
+    push ebp             ; save old call frame
+    mov ebp, esp         ; initialize new call frame
+
+    ; calle-save
+    push ebx
+    push esi
+    push edi
+
+    mov eax, 1
+    int 0x80
+
+    pop edi
+    pop esi
+    pop ebx
+
+    ; restore old call frame
+    mov esp, ebp
+    pop ebp
+    ret
+
+global __sys_fork
+__sys_fork:
+    ; make new call frame
+    push ebp             ; save old call frame
+    mov ebp, esp         ; initialize new call frame
+
+    ; calle-save
+    push ebx
+    push esi
+    push edi
+
+    mov eax, 26
+    int 0x80
+
+    mov eax, edx
+
+    pop edi
+    pop esi
+    pop ebx
+
+    ; restore old call frame
+    mov esp, ebp
+    pop ebp
+    ret
+
+global __sys_uptime
+__sys_uptime:
+    ; make new call frame
+    push ebp             ; save old call frame
+    mov ebp, esp         ; initialize new call frame
+
+    ; calle-save
+    push ebx
+    push esi
+    push edi
+
+    mov eax, 27
+    int 0x80
+
+    ; the syscall already puts the higher part in edx
+    mov eax, ecx    ;return value edx:eax
+
+    pop edi
+    pop esi
+    pop ebx
+
+    ; restore old call frame
+    mov esp, ebp
+    pop ebp
+    ret
+
+global __sys_memstat
+__sys_memstat:
+    ; make new call frame
+    push ebp             ; save old call frame
+    mov ebp, esp         ; initialize new call frame
+
+    ; calle-save
+    push ebx
+    push esi
+    push edi
+
+    mov eax, 28
+    mov ebx, [ebp+8]        ; pid, -1 for the caller
+    mov edi, [ebp+12]       ; struct memstat*
+    int 0x80
+
+    mov eax, edx
+
+    pop edi
+    pop esi
+    pop ebx
+
+    ; restore old call frame
+    mov esp, ebp
+    pop ebp
+    ret
+
+global __sys_mmap
+__sys_mmap:
+    ; make new call frame
+    push ebp             ; save old call frame
+    mov ebp, esp         ; initialize new call frame
+
+    ; calle-save
+    push ebx
+    push esi
+    push edi
+
+    mov eax, 29
+    mov ebx, [ebp+8]        ; length
+    mov ecx, [ebp+12]       ; fd
+    mov edi, [ebp+16]       ; offset
+    mov esi, [ebp+20]       ; writable
+    int 0x80
+
+    mov eax, edx            ; address or NULL
+
+    pop edi
+    pop esi
+    pop ebx
+
+    ; restore old call frame
+    mov esp, ebp
+    pop ebp
+    ret
+
+global __sys_munmap
+__sys_munmap:
+    ; make new call frame
+    push ebp             ; save old call frame
+    mov ebp, esp         ; initialize new call frame
+
+    ; calle-save
+    push ebx
+    push esi
+    push edi
+
+    mov eax, 30
+    mov esi, [ebp+8]        ; address
+    mov ebx, [ebp+12]       ; length
+    int 0x80
+
+    mov eax, edx
+
+    pop edi
+    pop esi
+    pop ebx
+
+    ; restore old call frame
+    mov esp, ebp
+    pop ebp
+    ret
+
+global __sys_setpriority
+__sys_setpriority:
+    ; make new call frame
+    push ebp             ; save old call frame
+    mov ebp, esp         ; initialize new call frame
+
+    ; calle-save
+    push ebx
+    push esi
+    push edi
+
+    mov eax, 31
+    mov ebx, [ebp+8]        ; pid, -1 for the caller
+    mov ecx, [ebp+12]       ; level
+    int 0x80
+
+    mov eax, edx
+
+    pop edi
+    pop esi
+    pop ebx
+
+    ; restore old call frame
+    mov esp, ebp
+    pop ebp
+    ret
+
+global __sys_schedstat
+__sys_schedstat:
+    ; make new call frame
+    push ebp             ; save old call frame
+    mov ebp, esp         ; initialize new call frame
+
+    ; calle-save
+    push ebx
+    push esi
+    push edi
+
+    mov eax, 32
+    mov ebx, [ebp+8]        ; pid, -1 for the caller
+    mov edi, [ebp+12]       ; struct schedstat*
+    int 0x80
+
+    mov eax, edx
+
+    pop edi
+    pop esi
+    pop ebx
+
+    ; restore old call frame
+    mov esp, ebp
+    pop ebp
+    ret
+
+global __sys_open_inbox
+__sys_open_inbox:
+    ; make new call frame
+    push ebp             ; save old call frame
+    mov ebp, esp         ; initialize new call frame
+
+    ; calle-save
+    push ebx
+    push esi
+    push edi
+
+    mov eax, 3
+    int 0x80
+
+    pop edi
+    pop esi
+    pop ebx
+
+    ; restore old call frame
+    mov esp, ebp
+    pop ebp
+    ret
+
+global __sys_send_msg
+__sys_send_msg:
+    ; make new call frame
+    push ebp             ; save old call frame
+    mov ebp, esp         ; initialize new call frame
+
+    ; calle-save
+    push ebx
+    push esi
+    push edi
+
+    mov eax, 5
+    mov ebx, [ebp+8]        ; receiver
+    mov esi, [ebp+12]       ; data
+    mov ecx, [ebp+16]       ; size
+    int 0x80
+
+    mov eax, edx
+
+    pop edi
+    pop esi
+    pop ebx
+
+    ; restore old call frame
+    mov esp, ebp
+    pop ebp
+    ret
+
+global __sys_receive_msg
+__sys_receive_msg:
+    ; make new call frame
+    push ebp             ; save old call frame
+    mov ebp, esp         ; initialize new call frame
+
+    ; calle-save
+    push ebx
+    push esi
+    push edi
+
+    mov eax, 7
+    mov edi, [ebp+8]        ; buffer
+    int 0x80
+
+    mov eax, ebx            ; size of the message
+
+    pop edi
+    pop esi
+    pop ebx
+
     ; restore old call frame
     mov esp, ebp
     pop ebp
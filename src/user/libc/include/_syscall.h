@@ -19,4 +19,15 @@ int __attribute__((cdecl)) __sys_getdents(const char* path, void* entries, uint3
 int __attribute__((cdecl)) __sys_exit(int status);
 void* __attribute__((cdecl)) __sys_sbrk(intptr_t size);
 int __attribute__((cdecl)) __sys_getpid();
-int __attribute__((cdecl)) __sys_execve(const char *path, char *const argv[]);
\ No newline at end of file
+int __attribute__((cdecl)) __sys_execve(const char *path, char *const argv[]);
+void __attribute__((cdecl)) __sys_yield();
+int __attribute__((cdecl)) __sys_fork();
+uint64_t __attribute__((cdecl)) __sys_uptime();
+int __attribute__((cdecl)) __sys_memstat(int pid, void* stat);
+void* __attribute__((cdecl)) __sys_mmap(size_t length, int fd, uint32_t offset, int writable);
+int __attribute__((cdecl)) __sys_munmap(void* addr, size_t length);
+int __attribute__((cdecl)) __sys_setpriority(int pid, int level);
+int __attribute__((cdecl)) __sys_schedstat(int pid, void* stat);
+void __attribute__((cdecl)) __sys_open_inbox();
+int __attribute__((cdecl)) __sys_send_msg(int receiver, const void* data, size_t size);
+size_t __attribute__((cdecl)) __sys_receive_msg(void* data);
\ No newline at end of file
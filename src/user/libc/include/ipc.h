@@ -0,0 +1,9 @@
+#pragma once
+#include <stddef.h>
+
+#define MAX_MESSAGE_SIZE 1024
+
+// messages between processes, a process must open its inbox before anyone can send to it
+void open_inbox(void);
+int send_msg(int receiver, const void* data, size_t size);
+size_t receive_msg(void* data);
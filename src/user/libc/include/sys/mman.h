@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stddef.h>
+#include <unistd.h>
+
+#define PROT_NONE   0
+#define PROT_READ   (1 << 0)
+#define PROT_WRITE  (1 << 1)
+#define PROT_EXEC   (1 << 2)
+
+#define MAP_SHARED  (1 << 0)
+#define MAP_PRIVATE (1 << 1)
+#define MAP_FIXED   (1 << 4)
+
+#define MAP_FAILED  ((void*)-1)
+
+// only private mappings of a file are supported, the pages are read when first touched
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset);
+int munmap(void *addr, size_t length);
@@ -1 +1,36 @@
 #pragma once
+
+#include <stdint.h>
+#include <unistd.h>
+
+// memory held by a process, in 4KB pages (process_memstat_t in the kernel)
+struct memstat {
+    uint32_t resident;      // private pages
+    uint32_t shared;        // shared memory and device pages
+    uint32_t page_tables;   // page directory and page tables
+    uint32_t kstack;        // kernel stack
+    uint32_t peak_resident; // highest resident + shared so far
+    uint32_t swapped;       // private pages written to the swap file
+};
+
+// pid -1 is the caller, returns 0 or -1 if there is no such process
+int getmemstat(pid_t pid, struct memstat* stat);
+
+#define PRIO_PROCESS    0
+#define PRIO_LEVELS     4   // levels of the scheduler, 0 is the highest priority
+
+// how a process is scheduled, times in ms (process_schedstat_t in the kernel)
+struct schedstat {
+    uint32_t priority;      // current level
+    uint32_t base_priority; // highest level it can reach
+    uint32_t runs;          // times it got the cpu
+    uint32_t total_wait;    // time spent ready but not running
+    uint32_t max_wait;      // longest of those waits
+};
+
+// which must be PRIO_PROCESS, who 0 is the caller or one of the processes it started. prio is a level,
+// 0 to PRIO_LEVELS - 1. returns 0 or -1
+int setpriority(int which, pid_t who, int prio);
+
+// pid -1 is the caller, returns 0 or -1 if there is no such process
+int getschedstat(pid_t pid, struct schedstat* stat);
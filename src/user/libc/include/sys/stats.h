@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+
+// what /dev/timer returns (time_stats_t in the kernel)
+struct time_stats {
+    uint64_t uptime;        // ms
+    uint32_t interrupts;    // timer interrupts so far
+    uint32_t programs;      // times the clock was programmed for the next event
+};
+
+// what /dev/cpus returns for each cpu (cpu_stats_t in the kernel)
+struct cpu_stats {
+    uint32_t apic_id;
+    uint32_t online;
+    uint32_t switches;      // task switches
+    uint32_t steals;        // tasks taken from the queue of another cpu
+    uint32_t ipis;          // reschedule interrupts received
+    uint32_t shootdowns;    // tlb flushes asked by another cpu
+    uint64_t idle_time;     // ms spent in the idle task
+};
+
+// what /dev/pagecache returns, in 4KB pages (pcache_stats_t in the kernel)
+struct pcache_stats {
+    uint32_t cached;        // pages currently held
+    uint32_t hits;          // pages found in the cache
+    uint32_t misses;        // pages read from the file system
+    uint32_t evictions;     // pages dropped because memory was low
+    uint32_t invalidations; // pages dropped because the file changed or went away
+    uint32_t mapped;        // cached pages mapped in at least one process
+    uint32_t mappings;      // mappings of those pages
+};
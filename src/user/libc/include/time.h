@@ -1,5 +1,6 @@
 #pragma once
 #include <stddef.h>
+#include <stdint.h>
 
 typedef long time_t;
 
@@ -10,8 +11,12 @@ struct timespec {
 
 typedef enum {
     CLOCK_REALTIME,
+    CLOCK_MONOTONIC,
 } ClockID;
 
 int clock_gettime(ClockID clockid, struct timespec *tp);
 int nanosleep(struct timespec *duration);
 time_t time(time_t *tloc);
+
+// ms since boot, what both clocks count from
+uint64_t uptime_ms(void);
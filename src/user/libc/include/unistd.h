@@ -8,6 +8,7 @@ typedef int pid_t;
 void *sbrk(intptr_t increment);
 off_t lseek(int fd, off_t offset, int whence);
 pid_t fork(void);
+pid_t getpid(void);
 int execve(const char *path, char **argv, char **envp);
 int execvp(const char *path, char **argv);
 int chdir(const char *path);
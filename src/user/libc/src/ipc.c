@@ -0,0 +1,15 @@
+#include <ipc.h>
+#include <_syscall.h>
+
+void open_inbox(void) {
+    __sys_open_inbox();
+}
+
+int send_msg(int receiver, const void* data, size_t size) {
+    return __sys_send_msg(receiver, data, size);
+}
+
+// blocks until a message arrives, data must hold MAX_MESSAGE_SIZE bytes
+size_t receive_msg(void* data) {
+    return __sys_receive_msg(data);
+}
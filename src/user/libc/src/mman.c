@@ -0,0 +1,29 @@
+#include <sys/mman.h>
+#include <errno.h>
+#include <_syscall.h>
+
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset) {
+    // addr is only a hint, we ignore it
+    // writes to a shared mapping would have to reach the file
+    if (((prot & PROT_WRITE) && !(flags & MAP_PRIVATE)) || (flags & MAP_FIXED) || fd < 0 || offset < 0) {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+
+    void *ret = __sys_mmap(length, fd, (uint32_t)offset, (prot & PROT_WRITE) != 0);
+    if (ret == NULL) {
+        errno = ENOMEM;
+        return MAP_FAILED;
+    }
+
+    return ret;
+}
+
+int munmap(void *addr, size_t length) {
+    if (__sys_munmap(addr, length) < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
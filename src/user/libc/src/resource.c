@@ -0,0 +1,17 @@
+#include <sys/resource.h>
+#include <_syscall.h>
+
+int getmemstat(pid_t pid, struct memstat* stat) {
+    return __sys_memstat(pid, stat);
+}
+
+int setpriority(int which, pid_t who, int prio) {
+    if (which != PRIO_PROCESS)
+        return -1;
+
+    return __sys_setpriority(who == 0 ? -1 : who, prio);
+}
+
+int getschedstat(pid_t pid, struct schedstat* stat) {
+    return __sys_schedstat(pid, stat);
+}
@@ -1,7 +1,6 @@
 #include <_syscall.h>
 
 int sched_yield(void) {
-    #if 0
-    __syscall0(17);
-    #endif
+    __sys_yield();
+    return 0;
 }
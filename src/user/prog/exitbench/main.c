@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+#include <ipc.h>
+
+/*
+ * process exit latency for different resident sizes. The child touches its memory,
+ * sends the time to the parent and exits. The cleaner task is woken up with priority
+ * and tears the address space down before the parent runs again, so the parent
+ * sees exit + teardown
+ */
+
+#define ROUNDS 8
+
+static const uint32_t sizes_kb[] = {100, 1024, 16 * 1024, 64 * 1024};
+
+int main(int argc, char **argv) {
+    uint64_t msg[MAX_MESSAGE_SIZE / sizeof(uint64_t)];
+    pid_t parent = getpid();
+
+    printf("--- EXIT BENCHMARK ---\n");
+
+    open_inbox();
+
+    for (uint32_t s = 0; s < sizeof(sizes_kb) / sizeof(sizes_kb[0]); s++) {
+        uint32_t total = 0;
+        int done = 0;
+
+        for (int r = 0; r < ROUNDS; r++) {
+            pid_t child = fork();
+
+            if (child == 0) {
+                uint8_t* mem = malloc(sizes_kb[s] * 1024);
+                if (mem)
+                    memset(mem, r, sizes_kb[s] * 1024);
+
+                msg[0] = uptime_ms();
+                send_msg(parent, msg, sizeof(uint64_t));
+                exit(0);
+            }
+
+            if (child < 0) {
+                printf("[FAIL] fork()\n");
+                return 1;
+            }
+
+            receive_msg(msg);
+            total += (uint32_t)(uptime_ms() - msg[0]);
+            done++;
+        }
+
+        printf("%d KB resident: %d exits, %d ms total, %d us per exit\n", sizes_kb[s], done, total, (total * 1000) / done);
+    }
+
+    printf("--- EXIT BENCHMARK FINISHED ---\n");
+    return 0;
+}
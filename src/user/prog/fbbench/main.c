@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+#include <_syscall.h>
+
+/*
+ * framebuffer blit throughput: full screen FB_BLIT_RECT over and over,
+ * the way the doom port presents its frames
+ */
+
+#define FRAMES          300
+#define FB_GET_INFO     0
+#define FB_BLIT_RECT    1
+
+typedef struct video_info
+{
+    uint16_t pitch;
+    uint16_t width;
+    uint16_t height;
+    uint8_t bpp;
+    uint8_t bytes_per_pixel;
+
+    uint8_t memory_model;
+
+    uint8_t red_mask;
+    uint8_t red_position;
+    uint8_t green_mask;
+    uint8_t green_position;
+    uint8_t blue_mask;
+    uint8_t blue_position;
+
+    uint32_t framebuffer;
+    uint32_t off_screen_mem_off;
+    uint16_t off_screen_mem_size;
+}__attribute__((packed)) video_info_t;
+
+typedef struct surface
+{
+    int x, y;
+    uint16_t width;
+    uint16_t height;
+    void* pixels;
+}__attribute__((packed)) surface_t;
+
+int main(int argc, char **argv) {
+    video_info_t info;
+    surface_t surface;
+
+    printf("--- FRAMEBUFFER BENCHMARK ---\n");
+
+    int fb = open("/dev/fb", O_WRONLY, 0);
+    if (fb < 0) {
+        printf("[FAIL] open(/dev/fb)\n");
+        return 1;
+    }
+
+    __sys_ioctl(fb, FB_GET_INFO, &info);
+
+    uint32_t frame_size = info.width * info.height * info.bytes_per_pixel;
+    uint32_t* pixels = malloc(frame_size);
+    if (!pixels) {
+        printf("[FAIL] malloc(%d)\n", frame_size);
+        close(fb);
+        return 1;
+    }
+
+    printf("%dx%d, %d bytes per pixel, %d KB per frame\n", info.width, info.height, info.bytes_per_pixel, frame_size / 1024);
+
+    surface.x = 0;
+    surface.y = 0;
+    surface.width = info.width;
+    surface.height = info.height;
+    surface.pixels = pixels;
+
+    uint64_t start = uptime_ms();
+
+    for (int i = 0; i < FRAMES; i++) {
+        // a different color every frame so nothing can be skipped
+        uint32_t color = (i & 1) ? 0x00ff8040 + i : 0x004080ff - i;
+        for (uint32_t p = 0; p < frame_size / 4; p++)
+            pixels[p] = color;
+
+        __sys_ioctl(fb, FB_BLIT_RECT, &surface);
+    }
+
+    uint64_t blit_start = uptime_ms();
+
+    // blits only, the source stays the same
+    for (int i = 0; i < FRAMES; i++)
+        __sys_ioctl(fb, FB_BLIT_RECT, &surface);
+
+    uint64_t end = uptime_ms();
+
+    uint32_t fill_ms = (uint32_t)(blit_start - start);
+    uint32_t blit_ms = (uint32_t)(end - blit_start);
+    if (fill_ms == 0) fill_ms = 1;
+    if (blit_ms == 0) blit_ms = 1;
+
+    uint32_t kb = (uint32_t)(((uint64_t)frame_size * FRAMES) / 1024);
+
+    printf("fill+blit: %d frames in %d ms, %d fills/s\n", FRAMES, fill_ms, (FRAMES * 1000) / fill_ms);
+    printf("blit: %d frames in %d ms, %d fills/s, %d MB/s\n", FRAMES, blit_ms, (FRAMES * 1000) / blit_ms, (uint32_t)(((uint64_t)kb * 1000 / 1024) / blit_ms));
+
+    free(pixels);
+    close(fb);
+
+    printf("--- FRAMEBUFFER BENCHMARK FINISHED ---\n");
+    return 0;
+}
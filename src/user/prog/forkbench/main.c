@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <stdint.h>
+
+/*
+ * fork + exit latency. There is no wait() yet, so after each fork the parent
+ * yields: the child is the only other ready task, it runs and exits before
+ * the parent gets the cpu back
+ */
+
+#define ITERATIONS  200
+#define TOUCH_PAGES 16      // pages the child writes in the second test (copy on write faults)
+#define PAGE_SIZE   4096
+
+static void report(const char* name, uint64_t start, uint64_t end, int done) {
+    uint32_t total = (uint32_t)(end - start);
+    uint32_t per_fork = done ? (total * 1000) / done : 0;
+
+    printf("%s: %d forks in %d ms (%d us per fork+exit)\n", name, done, total, per_fork);
+}
+
+static int bench(const char* name, uint8_t* touch) {
+    int done = 0;
+    uint64_t start = uptime_ms();
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        pid_t pid = fork();
+
+        if (pid == 0) {
+            if (touch)
+                for (int p = 0; p < TOUCH_PAGES; p++)
+                    touch[p * PAGE_SIZE] = (uint8_t)i;
+            exit(0);
+        }
+
+        if (pid < 0) {
+            printf("[FAIL] fork() returned %d after %d iterations\n", pid, done);
+            break;
+        }
+
+        done++;
+        sched_yield();  // let the child run and exit
+    }
+
+    report(name, start, uptime_ms(), done);
+    return done;
+}
+
+int main(int argc, char **argv) {
+    printf("--- FORK BENCHMARK ---\n");
+
+    // the child must see the parent's memory as it was at fork time
+    uint8_t* buffer = malloc(TOUCH_PAGES * PAGE_SIZE);
+    if (!buffer) {
+        printf("[FAIL] malloc()\n");
+        return 1;
+    }
+    memset(buffer, 0x5a, TOUCH_PAGES * PAGE_SIZE);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        int ok = buffer[0] == 0x5a && buffer[(TOUCH_PAGES * PAGE_SIZE) - 1] == 0x5a;
+        buffer[0] = 0;  // copy on write, the parent must not see it
+        printf("[%s] child sees the parent's memory\n", ok ? "OK" : "FAIL");
+        exit(0);
+    }
+    sched_yield();
+    printf("[%s] parent memory untouched by the child\n", buffer[0] == 0x5a ? "OK" : "FAIL");
+
+    bench("fork+exit", NULL);
+    bench("fork+write+exit", buffer);
+
+    free(buffer);
+    printf("--- FORK BENCHMARK FINISHED ---\n");
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/stats.h>
+#include <_syscall.h>
+
+/*
+ * timer interrupts per second while the system is idle (this process sleeps)
+ * and while it's busy (this process spins). The clock is only programmed for
+ * the next event, so the idle rate should be far below the old 1000 per second
+ */
+
+#define PERIOD_MS 2000
+
+static int read_stats(struct time_stats* st) {
+    int fd = open("/dev/timer", O_RDONLY, 0);
+    if (fd < 0)
+        return -1;
+
+    int ok = read(fd, st, sizeof(*st)) == sizeof(*st);
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+static void measure(const char* name, int busy) {
+    struct time_stats before, after;
+
+    if (read_stats(&before) < 0) {
+        printf("[FAIL] /dev/timer\n");
+        return;
+    }
+
+    if (busy) {
+        uint64_t end = uptime_ms() + PERIOD_MS;
+        while (uptime_ms() < end)
+            ;
+    } else
+        __sys_sleep(PERIOD_MS);
+
+    read_stats(&after);
+
+    uint32_t elapsed = (uint32_t)(after.uptime - before.uptime);
+    uint32_t irqs = after.interrupts - before.interrupts;
+
+    printf("%s: %d timer interrupts in %d ms (%d per second), clock programmed %d times\n",
+        name, irqs, elapsed, elapsed ? (irqs * 1000) / elapsed : 0, after.programs - before.programs);
+}
+
+int main(int argc, char **argv) {
+    printf("--- TIMER INTERRUPTS ---\n");
+    measure("idle", 0);
+    measure("busy", 1);
+    printf("--- TIMER INTERRUPTS FINISHED ---\n");
+    return 0;
+}
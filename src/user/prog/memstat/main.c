@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/resource.h>
+
+/*
+ * prints the memory held by a process: its own counters while the heap grows,
+ * then the ones of a forked child. Run with a pid to look at another process
+ */
+
+#define STEP_KB 256
+#define STEPS   4
+
+static void print_stats(const char* name, pid_t pid) {
+    struct memstat st;
+
+    if (getmemstat(pid, &st) < 0) {
+        printf("%s: no process %d\n", name, pid);
+        return;
+    }
+
+    printf("%s: resident %d KB, shared %d KB, page tables %d KB, kernel stack %d KB, peak %d KB, swapped %d KB\n",
+        name, st.resident * 4, st.shared * 4, st.page_tables * 4, st.kstack * 4, st.peak_resident * 4, st.swapped * 4);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        print_stats(argv[1], atoi(argv[1]));
+        return 0;
+    }
+
+    printf("--- MEMSTAT ---\n");
+    print_stats("start", -1);
+
+    char* blocks[STEPS];
+    for (int i = 0; i < STEPS; i++) {
+        blocks[i] = malloc(STEP_KB * 1024);
+        if (!blocks[i]) {
+            printf("[FAIL] malloc()\n");
+            return 1;
+        }
+
+        memset(blocks[i], i, STEP_KB * 1024);   // heap pages are only counted once touched
+        print_stats("after touching", -1);
+    }
+
+    pid_t child = fork();
+    if (child == 0) {
+        print_stats("child", -1);
+        exit(0);
+    }
+
+    print_stats("parent after fork", -1);
+    sched_yield();  // let the child print
+
+    for (int i = 0; i < STEPS; i++)
+        free(blocks[i]);
+
+    print_stats("after free", -1);
+    printf("--- MEMSTAT FINISHED ---\n");
+    return 0;
+}
@@ -0,0 +1,34 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/stats.h>
+
+/*
+ * prints the page cache counters. Start the same program twice before running it:
+ * the code of an executable is mapped from the page cache, so its frames show up
+ * once in mapped pages and once per running instance in mappings
+ */
+
+int main(int argc, char **argv) {
+    struct pcache_stats st;
+
+    int fd = open("/dev/pagecache", O_RDONLY, 0);
+    if (fd < 0) {
+        printf("[FAIL] open(/dev/pagecache)\n");
+        return 1;
+    }
+
+    if (read(fd, &st, sizeof(st)) != sizeof(st)) {
+        printf("[FAIL] read(/dev/pagecache)\n");
+        close(fd);
+        return 1;
+    }
+    close(fd);
+
+    printf("cached %d KB, hits %d, misses %d, evictions %d, invalidations %d\n",
+        st.cached * 4, st.hits, st.misses, st.evictions, st.invalidations);
+    printf("shared: %d pages mapped %d times, %d KB saved\n",
+        st.mapped, st.mappings, (st.mappings - st.mapped) * 4);
+    return 0;
+}
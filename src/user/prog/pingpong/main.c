@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+#include <ipc.h>
+
+/*
+ * context switch cost: two processes bounce a message with send_msg/receive_msg.
+ * each round trip is two task switches between different address spaces,
+ * so it shows what a cr3 reload costs (kernel pages are global and survive it)
+ */
+
+#define ROUND_TRIPS 10000
+
+int main(int argc, char **argv) {
+    uint32_t msg[MAX_MESSAGE_SIZE / sizeof(uint32_t)];
+    pid_t parent = getpid();
+
+    printf("--- PING PONG BENCHMARK ---\n");
+
+    open_inbox();
+
+    pid_t child = fork();
+    if (child < 0) {
+        printf("[FAIL] fork()\n");
+        return 1;
+    }
+
+    if (child == 0) {
+        open_inbox();
+        send_msg(parent, msg, sizeof(uint32_t));   // tell the parent we're ready
+
+        for (int i = 0; i < ROUND_TRIPS; i++) {
+            receive_msg(msg);
+            send_msg(parent, msg, sizeof(uint32_t));
+        }
+        exit(0);
+    }
+
+    receive_msg(msg);   // wait for the child's inbox
+
+    uint64_t start = uptime_ms();
+
+    for (uint32_t i = 0; i < ROUND_TRIPS; i++) {
+        msg[0] = i;
+        send_msg(child, msg, sizeof(uint32_t));
+        receive_msg(msg);
+
+        if (msg[0] != i) {
+            printf("[FAIL] round trip %d came back as %d\n", i, msg[0]);
+            return 1;
+        }
+    }
+
+    uint32_t total = (uint32_t)(uptime_ms() - start);
+    uint32_t per_switch = (uint32_t)(((uint64_t)total * 1000000) / (ROUND_TRIPS * 2));
+    printf("%d round trips in %d ms (%d ns per task switch)\n", ROUND_TRIPS, total, per_switch);
+
+    printf("--- PING PONG BENCHMARK FINISHED ---\n");
+    return 0;
+}
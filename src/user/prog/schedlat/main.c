@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <_syscall.h>
+
+/*
+ * wake up latency of an interactive task next to cpu bound ones. The children spin
+ * and sink to the lowest level of the scheduler, the parent sleeps SLEEP_MS at a time
+ * and measures how late it gets the cpu back. The last child lowers its own priority
+ */
+
+#define HOGS        2
+#define SPIN_MS     3000
+#define SLEEP_MS    10
+#define ROUNDS      100
+
+static void print_stats(const char* name, pid_t pid) {
+    struct schedstat st;
+
+    if (getschedstat(pid, &st) < 0) {
+        printf("%s: no process %d\n", name, pid);
+        return;
+    }
+
+    printf("%s: level %d (base %d), %d runs, waited %d ms (longest %d ms)\n",
+        name, st.priority, st.base_priority, st.runs, st.total_wait, st.max_wait);
+}
+
+int main(int argc, char **argv) {
+    pid_t hogs[HOGS];
+
+    printf("--- SCHEDULER LATENCY ---\n");
+
+    for (int i = 0; i < HOGS; i++) {
+        hogs[i] = fork();
+
+        if (hogs[i] == 0) {
+            if (i == HOGS - 1 && setpriority(PRIO_PROCESS, 0, PRIO_LEVELS - 1) < 0)
+                printf("[FAIL] setpriority()\n");
+
+            uint64_t end = uptime_ms() + SPIN_MS;
+            while (uptime_ms() < end)
+                ;
+            exit(0);
+        }
+    }
+
+    uint32_t total = 0, worst = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+        uint64_t start = uptime_ms();
+        __sys_sleep(SLEEP_MS);
+
+        uint32_t late = (uint32_t)(uptime_ms() - start) - SLEEP_MS;
+        total += late;
+        if (late > worst)
+            worst = late;
+    }
+
+    printf("woken up %d ms late on average, %d ms at worst\n", total / ROUNDS, worst);
+    print_stats("sleeper", -1);
+    for (int i = 0; i < HOGS; i++)
+        print_stats("spinner", hogs[i]);
+
+    printf("--- SCHEDULER LATENCY FINISHED ---\n");
+    return 0;
+}
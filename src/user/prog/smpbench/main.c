@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/wait.h>
+#include <sys/stats.h>
+
+/*
+ * the same cpu bound work done by one process, then split between WORKERS processes.
+ * With one cpu both take as long, with several the second should be about
+ * WORKERS times faster (up to the number of cpus). /dev/cpus tells where the time went
+ */
+
+#define WORKERS     4
+#define WORK        (1u << 27)     // loop iterations in total
+#define MAX_CPUS    16
+
+static int read_stats(struct cpu_stats* st) {
+    int fd = open("/dev/cpus", O_RDONLY, 0);
+    if (fd < 0)
+        return -1;
+
+    int n = read(fd, st, sizeof(struct cpu_stats) * MAX_CPUS);
+    close(fd);
+    return n < 0 ? -1 : n / (int)sizeof(struct cpu_stats);
+}
+
+static void spin(uint32_t iterations) {
+    volatile uint32_t sink = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+        sink += i;
+}
+
+// ms to do WORK split between workers processes
+static uint32_t run(int workers) {
+    pid_t pids[WORKERS];
+    uint64_t start = uptime_ms();
+
+    for (int i = 0; i < workers; i++) {
+        pids[i] = fork();
+
+        if (pids[i] == 0) {
+            spin(WORK / workers);
+            exit(0);
+        }
+
+        if (pids[i] < 0)
+            printf("[FAIL] fork()\n");
+    }
+
+    for (int i = 0; i < workers; i++)
+        if (pids[i] > 0)
+            waitpid(pids[i], NULL, 0);
+
+    return (uint32_t)(uptime_ms() - start);
+}
+
+int main(int argc, char **argv) {
+    struct cpu_stats before[MAX_CPUS], after[MAX_CPUS];
+
+    printf("--- SMP SCALING ---\n");
+
+    int cpus = read_stats(before);
+    if (cpus <= 0) {
+        printf("[FAIL] /dev/cpus\n");
+        return 1;
+    }
+
+    uint32_t one = run(1);
+    uint32_t many = run(WORKERS);
+
+    printf("%d cpu(s): 1 worker %d ms, %d workers %d ms, speedup x%d.%02d\n", cpus, one, WORKERS, many,
+        many ? one / many : 0, many ? (one * 100 / many) % 100 : 0);
+
+    read_stats(after);
+    for (int i = 0; i < cpus; i++)
+        printf("cpu %d (apic %d): %d switches, %d steals, %d ipis, %d shootdowns, idle %d ms\n", i, after[i].apic_id,
+            after[i].switches - before[i].switches, after[i].steals - before[i].steals, after[i].ipis - before[i].ipis,
+            after[i].shootdowns - before[i].shootdowns, (uint32_t)(after[i].idle_time - before[i].idle_time));
+
+    printf("--- SMP SCALING FINISHED ---\n");
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/resource.h>
+
+/*
+ * touches more memory than the machine has (run with MEMORY=16M ./run.sh) so
+ * the reclaim task has to write pages to the swap file, then reads every page
+ * back to check that the data survived the round trip
+ */
+
+#define PAGE_SIZE   4096
+#define BUFFER_MB   24
+#define PAGES       ((BUFFER_MB * 1024 * 1024) / PAGE_SIZE)
+
+static void print_stats(const char* name) {
+    struct memstat st;
+
+    if (getmemstat(-1, &st) < 0)
+        return;
+
+    printf("%s: resident %d KB, swapped %d KB\n", name, st.resident * 4, st.swapped * 4);
+}
+
+int main(int argc, char **argv) {
+    printf("--- SWAP TEST ---\n");
+
+    uint8_t* buffer = malloc(PAGES * PAGE_SIZE);
+    if (!buffer) {
+        printf("[FAIL] malloc()\n");
+        return 1;
+    }
+
+    // one word per page is enough to tell the pages apart
+    for (uint32_t i = 0; i < PAGES; i++)
+        *(uint32_t*)&buffer[i * PAGE_SIZE] = i ^ 0xa5a5a5a5;
+    print_stats("after writing");
+
+    uint32_t bad = 0;
+    for (uint32_t i = 0; i < PAGES; i++)
+        if (*(uint32_t*)&buffer[i * PAGE_SIZE] != (i ^ 0xa5a5a5a5))
+            bad++;
+
+    printf("[%s] %d pages checked, %d wrong\n", bad ? "FAIL" : "OK", PAGES, bad);
+    print_stats("after reading");
+
+    free(buffer);
+    printf("--- SWAP TEST FINISHED ---\n");
+    return bad ? 1 : 0;
+}